@@ -235,7 +235,9 @@ static NSUInteger const kSFSyncTargetRefreshDefaultCountIdsPerSoql = 500;
     //     since not all records will have changed
     if (self.page == 0) {
         NSError* error = nil;
-        self.totalSize = [[syncManager.store countWithQuerySpec:querySpec error:&error] unsignedIntegerValue];
+        // Both query specs return all the rows of the soup: counting with an "all" query spec lets soups with materialized counts skip the scan
+        SFQuerySpec* countQuerySpec = [SFQuerySpec newAllQuerySpec:self.soupName withOrderPath:self.idFieldName withOrder:kSFSoupQuerySortOrderAscending withPageSize:self.countIdsPerSoql];
+        self.totalSize = [[syncManager.store countWithQuerySpec:countQuerySpec error:&error] unsignedIntegerValue];
         if (error != nil) {
             errorBlock(error);
             return;
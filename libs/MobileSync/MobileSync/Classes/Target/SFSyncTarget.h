@@ -25,6 +25,7 @@
 NS_ASSUME_NONNULL_BEGIN
 
 @class SFMobileSyncSyncManager;
+@class SFSoupCompositeIndex;
 NS_SWIFT_NAME(SyncTarget)
 @interface SFSyncTarget : NSObject
 
@@ -109,6 +110,15 @@ extern NSString * const kSyncTargetLastError;
  */
 - (NSOrderedSet*) getDirtyRecordIds:(SFMobileSyncSyncManager*)syncManager soupName:(NSString*)soupName idField:(NSString*)idField;
 
+/**
+ * Partial index covering the dirty records query of getDirtyRecordIds:soupName:idField:
+ * Add it to the soup spec of the soup (__local__ and idField must be indexed) so that only dirty records get scanned
+ * @param soupName The soup
+ * @param idField The field containing the ids
+ * @return composite index to register with the soup
+ */
++ (SFSoupCompositeIndex*) dirtyRecordIdsIndexForSoup:(NSString*)soupName idField:(NSString*)idField;
+
 /**
  * @param syncManager The sync manager
  * @param soupName The soup
@@ -27,6 +27,7 @@
 #import "SFMobileSyncSyncManager.h"
 #import <SmartStore/SFQuerySpec.h>
 #import <SmartStore/SFSmartStore.h>
+#import <SmartStore/SFSoupCompositeIndex.h>
 
 // Page size
 NSUInteger const kSyncTargetPageSize = 2000;
@@ -129,21 +130,30 @@ NSString * const kSyncTargetLastError = @"__last_error__";
 
 #pragma mark - Helper methods
 
++ (NSString*) dirtyRecordsPredicate:(NSString*)soupName {
+    return [NSString stringWithFormat:@"{%@:%@} = '1'", soupName, kSyncTargetLocal];
+}
+
++ (SFSoupCompositeIndex*) dirtyRecordIdsIndexForSoup:(NSString*)soupName idField:(NSString*)idField {
+    // Where clause must match the one of getDirtyRecordIdsSql for sqlite to use the index
+    return [[SFSoupCompositeIndex alloc] initWithPaths:@[idField]
+                                         includedPaths:@[kSyncTargetLocal]
+                                           whereClause:[SFSyncTarget dirtyRecordsPredicate:soupName]];
+}
+
 - (NSString*) getDirtyRecordIdsSql:(NSString*)soupName idField:(NSString*)idField {
-    return [NSString stringWithFormat:@"SELECT {%@:%@} FROM {%@} WHERE {%@:%@} = '1' ORDER BY {%@:%@} ASC",
-                                      soupName, idField, soupName, soupName, kSyncTargetLocal, soupName, idField];
+    return [NSString stringWithFormat:@"SELECT {%@:%@} FROM {%@} WHERE %@ ORDER BY {%@:%@} ASC",
+                                      soupName, idField, soupName, [SFSyncTarget dirtyRecordsPredicate:soupName], soupName, idField];
 }
 
 - (NSOrderedSet *)getIdsWithQuery:idsSql syncManager:(SFMobileSyncSyncManager *)syncManager {
     NSMutableOrderedSet* ids = [NSMutableOrderedSet new];
     SFQuerySpec* querySpec = [SFQuerySpec newSmartQuerySpec:idsSql withPageSize:kSyncTargetPageSize];
 
-    BOOL hasMore = YES;
-    for (NSUInteger pageIndex=0; hasMore; pageIndex++) {
-        NSArray* results = [syncManager.store queryWithQuerySpec:querySpec pageIndex:pageIndex error:nil];
-        hasMore = (results.count == kSyncTargetPageSize);
-        [ids addObjectsFromArray:[self flatten:results]];
-    }
+    // Single pass over the query results (instead of re-running the query for every page)
+    [syncManager.store enumerateQuerySpec:querySpec usingBlock:^(NSArray* row, BOOL *stop) {
+        [ids addObjectsFromArray:row];
+    } error:nil];
     return ids;
 }
 
@@ -198,12 +208,4 @@ NSString * const kSyncTargetLastError = @"__last_error__";
     record[kSyncTargetLastError] = nil;
 }
 
-- (NSArray*) flatten:(NSArray*)results {
-    NSMutableArray* flatArray = [NSMutableArray new];
-    for (NSArray* row in results) {
-        [flatArray addObjectsFromArray:row];
-    }
-    return flatArray;
-}
-
 @end
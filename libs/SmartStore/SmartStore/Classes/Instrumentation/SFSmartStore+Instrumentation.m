@@ -89,6 +89,14 @@
         swizzledSelector = @selector(instr_queryAsString:querySpec:pageIndex:error:);
         [SFSDKInstrumentationHelper swizzleMethod:originalSelector with:swizzledSelector forClass:class  isInstanceMethod:YES];
         
+        originalSelector = @selector(queryWithQuerySpec:continuationToken:nextContinuationToken:error:);
+        swizzledSelector = @selector(instr_queryWithQuerySpec:continuationToken:nextContinuationToken:error:);
+        [SFSDKInstrumentationHelper swizzleMethod:originalSelector with:swizzledSelector forClass:class  isInstanceMethod:YES];
+        
+        originalSelector = @selector(enumerateQuerySpec:usingBlock:error:);
+        swizzledSelector = @selector(instr_enumerateQuerySpec:usingBlock:error:);
+        [SFSDKInstrumentationHelper swizzleMethod:originalSelector with:swizzledSelector forClass:class  isInstanceMethod:YES];
+        
         originalSelector = @selector(retrieveEntries:fromSoup:);
         swizzledSelector = @selector(instr_retrieveEntries:fromSoup:);
         [SFSDKInstrumentationHelper swizzleMethod:originalSelector with:swizzledSelector forClass:class  isInstanceMethod:YES];
@@ -137,6 +145,10 @@
         swizzledSelector = @selector(instr_reIndexSoup:withIndexPaths:);
         [SFSDKInstrumentationHelper swizzleMethod:originalSelector with:swizzledSelector forClass:class  isInstanceMethod:YES];
         
+        originalSelector = @selector(optimizeFts:error:);
+        swizzledSelector = @selector(instr_optimizeFts:error:);
+        [SFSDKInstrumentationHelper swizzleMethod:originalSelector with:swizzledSelector forClass:class  isInstanceMethod:YES];
+        
         originalSelector = @selector(firstTimeStoreDatabaseSetup);
         swizzledSelector = @selector(instr_firstTimeStoreDatabaseSetup);
         [SFSDKInstrumentationHelper swizzleMethod:originalSelector with:swizzledSelector forClass:class  isInstanceMethod:YES];
@@ -213,6 +225,24 @@
     
 }
 
+- (NSArray *)instr_queryWithQuerySpec:(SFQuerySpec *)querySpec continuationToken:(NSDictionary *)continuationToken nextContinuationToken:(NSDictionary **)nextContinuationToken error:(NSError **)error {
+    os_log_t logger = self.class.oslog;
+    os_signpost_id_t sid = sf_os_signpost_id_generate(logger);
+    sf_os_signpost_interval_begin(logger, sid, "queryWithQuerySpec:continuationToken:nextContinuationToken:error:", "storeName:%{public}@ soupName:%{public}@", self.storeName, querySpec.soupName);
+    NSArray *result = [self instr_queryWithQuerySpec:querySpec continuationToken:continuationToken nextContinuationToken:nextContinuationToken error:error];
+    sf_os_signpost_interval_end(logger, sid, "queryWithQuerySpec:continuationToken:nextContinuationToken:error:", "storeName:%{public}@ soupName:%{public}@", self.storeName, querySpec.soupName);
+    return result;
+}
+
+- (BOOL)instr_enumerateQuerySpec:(SFQuerySpec *)querySpec usingBlock:(SFSmartStoreQueryEnumerationBlock)block error:(NSError **)error {
+    os_log_t logger = self.class.oslog;
+    os_signpost_id_t sid = sf_os_signpost_id_generate(logger);
+    sf_os_signpost_interval_begin(logger, sid, "enumerateQuerySpec:usingBlock:error:", "storeName:%{public}@ soupName:%{public}@", self.storeName, querySpec.soupName);
+    BOOL result = [self instr_enumerateQuerySpec:querySpec usingBlock:block error:error];
+    sf_os_signpost_interval_end(logger, sid, "enumerateQuerySpec:usingBlock:error:", "storeName:%{public}@ soupName:%{public}@", self.storeName, querySpec.soupName);
+    return result;
+}
+
 - (NSArray<NSDictionary*>*)instr_retrieveEntries:(NSArray<NSNumber*>*)soupEntryIds fromSoup:(NSString*)soupName {
     os_log_t logger = self.class.oslog;
     os_signpost_id_t sid = sf_os_signpost_id_generate(logger);
@@ -320,6 +350,15 @@
     return result;
 }
 
+- (BOOL)instr_optimizeFts:(NSString*)soupName error:(NSError**)error {
+    os_log_t logger = self.class.oslog;
+    os_signpost_id_t sid = sf_os_signpost_id_generate(logger);
+    sf_os_signpost_interval_begin(logger, sid, "optimizeFts:error:", "storeName:%{public}@ soupName:%{public}@", self.storeName, soupName);
+    BOOL result = [self instr_optimizeFts:soupName error:error];
+    sf_os_signpost_interval_end(logger, sid, "optimizeFts:error:", "storeName:%{public}@ soupName:%{public}@", self.storeName, soupName);
+    return result;
+}
+
 - (BOOL)instr_reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray<NSString*>*)indexPaths {
     os_log_t logger = self.class.oslog;
     os_signpost_id_t sid = sf_os_signpost_id_generate(logger);
@@ -51,6 +51,9 @@ static NSString * const OLD_SOUP_SPEC   = @"oldSoupSpec";
 static NSString * const OLD_INDEX_SPECS = @"oldIndexSpecs";
 static NSString * const NEW_INDEX_SPECS = @"newIndexSpecs";
 static NSString * const RE_INDEX_DATA   = @"reIndexData";
+static NSString * const BATCH_SIZE      = @"batchSize";
+static NSString * const LAST_COPIED_ID  = @"lastCopiedId";
+static NSString * const STEP_TIMINGS    = @"stepTimings";
 static NSInteger  const kLastStep = SFAlterSoupStepCleanup;
 
 /**
@@ -105,6 +108,20 @@ NS_SWIFT_NAME(AlterSoupLongOperation)
  */
 @property (nonatomic, readonly, assign) long long rowId;
 
+/** Number of rows copied per transaction by the copy table step.
+ Saved with the operation details so that a resumed operation keeps copying with the same batch size.
+ */
+@property (nonatomic, assign) NSUInteger batchSize;
+
+/** Highest id of the old soup table copied so far by the copy table step.
+ Saved with the operation details so that a resumed operation carries on with the next rows of the old table.
+ */
+@property (nonatomic, readonly, assign) long long lastCopiedId;
+
+/** Time spent in each completed step, in milliseconds, keyed by step name (also recorded in the operation details).
+ */
+@property (nonatomic, readonly, strong) NSDictionary<NSString*, NSNumber*> *stepTimings;
+
 
 /**
  Initializer for starting the alter soup operation.
@@ -43,9 +43,32 @@
 @property (nonatomic, readwrite, strong) SFSmartStore *store;
 @property (nonatomic, readwrite, strong) FMDatabaseQueue *queue;
 @property (nonatomic, readwrite, assign) long long rowId;
+@property (nonatomic, readwrite, assign) long long lastCopiedId;
+@property (nonatomic, strong) NSString *tableCopySql;
+@property (nonatomic, strong) NSString *ftsCopySql;
+@property (nonatomic, strong) NSMutableDictionary<NSString*, NSNumber*> *mutableStepTimings;
+@property (nonatomic, strong) NSDate *stepStartDate;
 
 @end
 
+// Number of rows copied per transaction by the copy table step
+static NSUInteger const kCopyTableBatchSize = 5000;
+
+static NSString * SFAlterSoupStepName(SFAlterSoupStep step)
+{
+    switch (step) {
+        case SFAlterSoupStepStarting:                   return @"starting";
+        case SFAlterSoupStepRenameOldSoupTable:         return @"renameOldSoupTable";
+        case SFAlterSoupStepDropOldIndexes:             return @"dropOldIndexes";
+        case SFAlterSoupStepRegisterSoupUsingTableName: return @"registerSoupUsingTableName";
+        case SFAlterSoupStepCopyTable:                  return @"copyTable";
+        case SFAlterSoupStepReIndexSoup:                return @"reIndexSoup";
+        case SFAlterSoupStepDropOldTable:               return @"dropOldTable";
+        case SFAlterSoupStepCleanup:                    return @"cleanup";
+    }
+    return [NSString stringWithFormat:@"%lu", (unsigned long)step];
+}
+
 @implementation SFAlterSoupLongOperation
 
 - (id) initWithStore:(SFSmartStore*)store soupName:(NSString*)soupName newIndexSpecs:(NSArray*)newIndexSpecs reIndexData:(BOOL)reIndexData
@@ -65,6 +88,9 @@
         _oldIndexSpecs = [store indicesForSoup:soupName];
         _reIndexData = reIndexData;
         _afterStep = SFAlterSoupStepStarting;
+        _batchSize = kCopyTableBatchSize;
+        _lastCopiedId = 0;
+        _mutableStepTimings = [NSMutableDictionary dictionary];
         [store.storeQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
             self->_soupTableName = [store tableNameForSoup:soupName withDb:db];
             self->_oldSoupSpec = [store attributesForSoup:soupName withDb:db];
@@ -90,6 +116,11 @@
         _reIndexData = [details[RE_INDEX_DATA] boolValue];
         _afterStep = status;
         
+        _batchSize = details[BATCH_SIZE] ? [details[BATCH_SIZE] unsignedIntegerValue] : kCopyTableBatchSize;
+        // No last copied id means the operation was started by a version that didn't record it (see prepareCopy)
+        _lastCopiedId = details[LAST_COPIED_ID] ? [details[LAST_COPIED_ID] longLongValue] : -1;
+        _mutableStepTimings = [NSMutableDictionary dictionaryWithDictionary:details[STEP_TIMINGS] ?: @{}];
+
         // No old soup spec? Means SmartStore was updated,
         // from a version that didn't support SFSoupSpec,
         // and there was an incomplete long operation.
@@ -123,6 +154,11 @@
             ];
 }
 
+- (NSDictionary<NSString*, NSNumber*>*) stepTimings
+{
+    return [self.mutableStepTimings copy];
+}
+
 - (void) run
 {
     // Since the soup will be altered, we should get rid of cached statements etc
@@ -134,6 +170,7 @@
 {
     // NB: if failure happens in a middle of a step before status row is updated (e.g. in steps that do ddl steps)
     //     it should be safe to re-play that step
+    self.stepStartDate = [NSDate date];
     switch(self.afterStep) {
 		case SFAlterSoupStepStarting:
 			[self renameOldSoupTable];
@@ -203,6 +240,13 @@
         for (int i=0; i<[self.oldIndexSpecs count]; i++) {
             [dropIndexStatements addObject:[NSString stringWithFormat:dropIndexFormat, self.soupTableName, [NSString stringWithFormat:@"%d", i]]];
         }
+        for (int i=0; i<[self.oldSoupSpec.compositeIndexes count]; i++) {
+            [dropIndexStatements addObject:[NSString stringWithFormat:dropIndexFormat, self.soupTableName, [NSString stringWithFormat:@"c%d", i]]];
+        }
+        // Counts triggers moved with the renamed table
+        for (NSString* event in @[@"insert", @"delete", @"update"]) {
+            [dropIndexStatements addObject:[NSString stringWithFormat:@"DROP TRIGGER IF EXISTS %@_counts_%@", self.soupTableName, event]];
+        }
         for (NSString* dropIndexStatement in dropIndexStatements) {
             [self executeUpdate:db sql:dropIndexStatement context:@"dropOldIndexes"];
         }
@@ -217,6 +261,7 @@
         
         // Remove soup from cache
         [self.store removeFromCache:self.soupName];
+        [db clearCachedStatements];
     }];
 }
 
@@ -231,6 +276,10 @@
         SFSoupSpec *specToRegister = self.soupSpec ?: self.oldSoupSpec;
         [self.store registerSoupWithSpec:specToRegister withIndexSpecs:self.indexSpecs withSoupTableName:self.soupTableName withDb:db];
         
+        // Entries inserted into the new table from now on should not take ids of rows still to be copied
+        [self reserveOldIdsWithDb:db];
+        self.lastCopiedId = 0;
+        
         // Update row in alter status table -auto commit
         [self updateLongOperationDbRow:SFAlterSoupStepRegisterSoupUsingTableName withDb:db];
     }];
@@ -239,91 +288,22 @@
 
 /**
  Step 4: copy data from old soup table to new soup table
+ Rows are copied in batches of batchSize rows, each batch in its own transaction.
+ The last id copied is saved with the operation details, so an interrupted copy carries on where it stopped.
  */
 - (void) copyTable
 {
-    [self.queue inTransaction:^(FMDatabase *db, BOOL *rollback) {
-        // We need column names in the index specs
-        self->_indexSpecs = [self.store indicesForSoup:self.soupName withDb:db];
-		
-        // Move data (core columns + indexed paths that we are still indexing)
-        NSDictionary* mapOldSpecs = [SFSoupIndex mapForSoupIndexes:self.oldIndexSpecs];
-        NSDictionary* mapNewSpecs = [SFSoupIndex mapForSoupIndexes:self.indexSpecs];
-        
-        // Figuring out paths we are keeping
-        NSSet* oldPaths = [NSSet setWithArray:[mapOldSpecs allKeys]];
-        NSMutableSet* keptPaths = [NSMutableSet setWithArray:[mapNewSpecs allKeys]];
-        [keptPaths intersectSet:oldPaths];
-        
-        // Compute list of columns to copy from / list of columns to copy into
-        NSMutableArray* oldColumns = [NSMutableArray arrayWithObjects:ID_COL, CREATED_COL, LAST_MODIFIED_COL, nil];
-        NSMutableArray* newColumns = [NSMutableArray arrayWithObjects:ID_COL, CREATED_COL, LAST_MODIFIED_COL, nil];
-        
-        BOOL oldSoupUsesExternalStorage = [self.oldSoupSpec.features containsObject:kSoupFeatureExternalStorage];
-        BOOL newSoupUsesExternalStorage = [self.soupSpec.features containsObject:kSoupFeatureExternalStorage];
-        // Old specs uses internal storage, and
-        // no new specs or new specs still uses internal storage
-        if (!oldSoupUsesExternalStorage && !newSoupUsesExternalStorage) {
-            [oldColumns addObject:SOUP_COL];
-            [newColumns addObject:SOUP_COL];
-        }
-        
-        // Adding indexed path columns that we are keeping
-        for (NSString* keptPath in keptPaths) {
-            SFSoupIndex* oldIndexSpec = mapOldSpecs[keptPath];
-            SFSoupIndex* newIndexSpec = mapNewSpecs[keptPath];
-            
-            if (newIndexSpec.columnType == nil) {
-                // we are now using json1, there is no column to populate
-                continue;
-            }
-            
-            if ([oldIndexSpec.columnType isEqualToString:newIndexSpec.columnType]) {
-                [oldColumns addObject:oldIndexSpec.columnName];
-                [newColumns addObject:newIndexSpec.columnName];
-            }
-        }
-        
-        // Compute copy statement
-        NSString* copySql = [NSString stringWithFormat:@"INSERT INTO %@ (%@) SELECT %@ FROM %@_old",
-                             self.soupTableName,
-                             [newColumns componentsJoinedByString:@","],
-                             [oldColumns componentsJoinedByString:@","],
-                             self.soupTableName
-                             ];
-        [self executeUpdate:db sql:copySql context:@"copyTable"];
-        
-        // Fts
-        if ([SFSoupIndex hasFts:self.indexSpecs]) {
-            NSMutableArray* oldColumnsFts = [NSMutableArray arrayWithObjects:ID_COL, nil];
-            NSMutableArray* newColumnsFts = [NSMutableArray arrayWithObjects:ROWID_COL, nil];
-
-            // Adding indexed path columns that we are keeping
-            for (NSString* keptPath in keptPaths) {
-                SFSoupIndex* oldIndexSpec = mapOldSpecs[keptPath];
-                SFSoupIndex* newIndexSpec = mapNewSpecs[keptPath];
-                if ([oldIndexSpec.columnType isEqualToString:newIndexSpec.columnType]
-                    && [newIndexSpec.indexType isEqualToString:kSoupIndexTypeFullText]) {
-                    [oldColumnsFts addObject:oldIndexSpec.columnName];
-                    [newColumnsFts addObject:newIndexSpec.columnName];
-                }
-            }
+    [self prepareCopy];
+    BOOL copied;
+    do {
+        copied = [self copyNextBatch];
+    } while (copied);
 
-            // Compute copy statement for fts table
-            NSString* copyFtsSql = [NSString stringWithFormat:@"INSERT INTO %@_fts (%@) SELECT %@ FROM %@_old",
-                                    self.soupTableName,
-                                    [newColumnsFts componentsJoinedByString:@","],
-                                    [oldColumnsFts componentsJoinedByString:@","],
-                                    self.soupTableName
-                                    ];
-            [self executeUpdate:db sql:copyFtsSql context:@"copyTable-fts"];
-        }
- 
- 		// Exchange internal<->external storage
+    BOOL oldSoupUsesExternalStorage = [self.oldSoupSpec.features containsObject:kSoupFeatureExternalStorage];
+    BOOL newSoupUsesExternalStorage = [self.soupSpec.features containsObject:kSoupFeatureExternalStorage];
+    [self.queue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        // Exchange internal<->external storage
         if (self.soupSpec) {
-            BOOL oldSoupUsesExternalStorage = [self.oldSoupSpec.features containsObject:kSoupFeatureExternalStorage];
-            BOOL newSoupUsesExternalStorage = [self.soupSpec.features containsObject:kSoupFeatureExternalStorage];
-            
             // Internal -> External
             if (!oldSoupUsesExternalStorage && newSoupUsesExternalStorage) {
                 NSString *selectIdSoupSql = [NSString stringWithFormat:@"SELECT %@, %@ FROM %@_old", ID_COL, SOUP_COL, self.soupTableName];
@@ -375,6 +355,165 @@
     }];
 }
 
+/**
+ Compute copy statements for the copy table step (and last copied id for operations that did not record it)
+ */
+- (void) prepareCopy
+{
+    [self.queue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        // We need column names in the index specs
+        self->_indexSpecs = [self.store indicesForSoup:self.soupName withDb:db];
+
+        // Operation started by a version that didn't record the last copied id:
+        // carry on after the rows already in the new table, like that version did
+        if (self.lastCopiedId < 0) {
+            [self reserveOldIdsWithDb:db];
+            NSString* maxIdSql = [NSString stringWithFormat:@"SELECT IFNULL(MAX(%@), 0) FROM %@", ID_COL, self.soupTableName];
+            FMResultSet* frs = [self.store executeQueryThrows:maxIdSql withDb:db];
+            self.lastCopiedId = [frs next] ? [frs longLongIntForColumnIndex:0] : 0;
+            [frs close];
+        }
+    }];
+
+    // Move data (core columns + indexed paths that we are still indexing)
+    NSDictionary* mapOldSpecs = [SFSoupIndex mapForSoupIndexes:self.oldIndexSpecs];
+    NSDictionary* mapNewSpecs = [SFSoupIndex mapForSoupIndexes:self.indexSpecs];
+    
+    // Figuring out paths we are keeping
+    NSSet* oldPaths = [NSSet setWithArray:[mapOldSpecs allKeys]];
+    NSMutableSet* keptPaths = [NSMutableSet setWithArray:[mapNewSpecs allKeys]];
+    [keptPaths intersectSet:oldPaths];
+    
+    // Compute list of columns to copy from / list of columns to copy into
+    NSMutableArray* oldColumns = [NSMutableArray arrayWithObjects:ID_COL, CREATED_COL, LAST_MODIFIED_COL, nil];
+    NSMutableArray* newColumns = [NSMutableArray arrayWithObjects:ID_COL, CREATED_COL, LAST_MODIFIED_COL, nil];
+    
+    BOOL oldSoupUsesExternalStorage = [self.oldSoupSpec.features containsObject:kSoupFeatureExternalStorage];
+    BOOL newSoupUsesExternalStorage = [self.soupSpec.features containsObject:kSoupFeatureExternalStorage];
+    // Old specs uses internal storage, and
+    // no new specs or new specs still uses internal storage
+    if (!oldSoupUsesExternalStorage && !newSoupUsesExternalStorage) {
+        [oldColumns addObject:SOUP_COL];
+        [newColumns addObject:SOUP_COL];
+    }
+    
+    // Adding indexed path columns that we are keeping
+    // Generated columns can't be written to: they get computed from the soup column
+    BOOL newSoupUsesGeneratedColumns = [(self.soupSpec ?: self.oldSoupSpec).features containsObject:kSoupFeatureGeneratedColumns];
+    for (NSString* keptPath in newSoupUsesGeneratedColumns ? @[] : keptPaths) {
+        SFSoupIndex* oldIndexSpec = mapOldSpecs[keptPath];
+        SFSoupIndex* newIndexSpec = mapNewSpecs[keptPath];
+        
+        if (newIndexSpec.columnType == nil) {
+            // we are now using json1, there is no column to populate
+            continue;
+        }
+        
+        if ([oldIndexSpec.columnType isEqualToString:newIndexSpec.columnType]) {
+            [oldColumns addObject:oldIndexSpec.columnName];
+            [newColumns addObject:newIndexSpec.columnName];
+        }
+    }
+    
+    // Compute copy statement (copies the rows of the old table with ids in the given range)
+    self.tableCopySql = [NSString stringWithFormat:@"INSERT INTO %@ (%@) SELECT %@ FROM %@_old WHERE %@ > ? AND %@ <= ? ORDER BY %@",
+                    self.soupTableName,
+                    [newColumns componentsJoinedByString:@","],
+                    [oldColumns componentsJoinedByString:@","],
+                    self.soupTableName,
+                    ID_COL, ID_COL,
+                    ID_COL
+                    ];
+    
+    // Fts
+    self.ftsCopySql = nil;
+    if ([SFSoupIndex hasFts:self.indexSpecs]) {
+        NSMutableArray* oldColumnsFts = [NSMutableArray arrayWithObjects:ID_COL, nil];
+        NSMutableArray* newColumnsFts = [NSMutableArray arrayWithObjects:ROWID_COL, nil];
+
+        // Adding indexed path columns that we are keeping
+        for (NSString* keptPath in keptPaths) {
+            SFSoupIndex* oldIndexSpec = mapOldSpecs[keptPath];
+            SFSoupIndex* newIndexSpec = mapNewSpecs[keptPath];
+            if ([oldIndexSpec.columnType isEqualToString:newIndexSpec.columnType]
+                && [newIndexSpec.indexType isEqualToString:kSoupIndexTypeFullText]) {
+                [oldColumnsFts addObject:oldIndexSpec.columnName];
+                [newColumnsFts addObject:newIndexSpec.columnName];
+            }
+        }
+
+        // Compute copy statement for fts table
+        self.ftsCopySql = [NSString stringWithFormat:@"INSERT INTO %@_fts (%@) SELECT %@ FROM %@_old WHERE %@ > ? AND %@ <= ? ORDER BY %@",
+                           self.soupTableName,
+                           [newColumnsFts componentsJoinedByString:@","],
+                           [oldColumnsFts componentsJoinedByString:@","],
+                           self.soupTableName,
+                           ID_COL, ID_COL,
+                           ID_COL
+                           ];
+    }
+}
+
+/**
+ Copy the next batchSize rows of the old table (and their fts rows) in one transaction
+ The last id copied is saved in the operation details in that same transaction
+ @return NO if there was no row left to copy
+ */
+- (BOOL) copyNextBatch
+{
+    if (!self.tableCopySql) {
+        [self prepareCopy];
+    }
+    
+    NSUInteger batchSize = self.batchSize > 0 ? self.batchSize : kCopyTableBatchSize;
+    NSString* batchEndSql = [NSString stringWithFormat:@"SELECT MAX(%@) FROM (SELECT %@ FROM %@_old WHERE %@ > ? ORDER BY %@ LIMIT %lu)",
+                             ID_COL, ID_COL, self.soupTableName, ID_COL, ID_COL, (unsigned long)batchSize];
+    __block BOOL copied = NO;
+    [self.queue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        NSNumber* lastCopiedId = @(self.lastCopiedId);
+        FMResultSet* frs = [self.store executeQueryThrows:batchEndSql withArgumentsInArray:@[lastCopiedId] withDb:db];
+        NSNumber* batchEndId = [frs next] && ![frs columnIndexIsNull:0] ? @([frs longLongIntForColumnIndex:0]) : nil;
+        [frs close];
+        if (!batchEndId) {
+            return;
+        }
+        
+        [self executeUpdate:db sql:self.tableCopySql args:@[lastCopiedId, batchEndId] context:@"copyTable"];
+        if (self.ftsCopySql) {
+            [self executeUpdate:db sql:self.ftsCopySql args:@[lastCopiedId, batchEndId] context:@"copyTable-fts"];
+        }
+        
+        self.lastCopiedId = [batchEndId longLongValue];
+        [self updateLongOperationDbRowDetailsWithDb:db];
+        copied = YES;
+    }];
+    return copied;
+}
+
+/**
+ Reserve the ids of the old soup table in the sqlite_sequence of the new soup table
+ @param db Database
+ */
+- (void) reserveOldIdsWithDb:(FMDatabase*)db
+{
+    NSString* oldTableName = [NSString stringWithFormat:@"%@_old", self.soupTableName];
+    NSString* maxOldIdSql = [NSString stringWithFormat:@"SELECT MAX(IFNULL((SELECT MAX(seq) FROM SQLITE_SEQUENCE WHERE name = ?), 0), IFNULL((SELECT MAX(%@) FROM %@), 0))",
+                             ID_COL, oldTableName];
+    FMResultSet* frs = [self.store executeQueryThrows:maxOldIdSql withArgumentsInArray:@[oldTableName] withDb:db];
+    NSNumber* maxOldId = @([frs next] ? [frs longLongIntForColumnIndex:0] : 0);
+    [frs close];
+    
+    // NB: name is not unique in SQLITE_SEQUENCE, only insert a row if the new table doesn't have one yet
+    [self executeUpdate:db
+                    sql:@"UPDATE SQLITE_SEQUENCE SET seq = ? WHERE name = ? AND seq < ?"
+                   args:@[maxOldId, self.soupTableName, maxOldId]
+                context:@"reserveOldIds"];
+    [self executeUpdate:db
+                    sql:@"INSERT INTO SQLITE_SEQUENCE (name, seq) SELECT ?, ? WHERE NOT EXISTS (SELECT 1 FROM SQLITE_SEQUENCE WHERE name = ?)"
+                   args:@[self.soupTableName, maxOldId, self.soupTableName]
+                context:@"reserveOldIds"];
+}
+
 
 /**
  Step 5: re-index soup for new indexes (optional step)
@@ -478,6 +617,9 @@
     details[OLD_INDEX_SPECS] = [SFSoupIndex asArrayOfDictionaries:self.oldIndexSpecs withColumnName:YES];
     details[NEW_INDEX_SPECS] = [SFSoupIndex asArrayOfDictionaries:self.indexSpecs withColumnName:YES];
     details[RE_INDEX_DATA] = @(self.reIndexData);
+    details[BATCH_SIZE] = @(self.batchSize);
+    details[LAST_COPIED_ID] = @(self.lastCopiedId);
+    details[STEP_TIMINGS] = self.mutableStepTimings;
     return details;
 }
 
@@ -489,24 +631,48 @@
  */
 - (void) updateLongOperationDbRow:(SFAlterSoupStep)newStatus withDb:(FMDatabase*)db
 {
+    // Time since previous step completed (or since run started)
+    NSDate *now = [NSDate date];
+    self.mutableStepTimings[SFAlterSoupStepName(newStatus)] = @((long long)([now timeIntervalSinceDate:self.stepStartDate] * 1000));
+    self.stepStartDate = now;
+
     if (newStatus == kLastStep) {
+        [SFSDKSmartStoreLogger i:[self class] format:@"Alter of soup %@ completed, step timings (ms): %@", self.soupName, [SFJsonUtils JSONRepresentation:self.mutableStepTimings]];
         NSString *sql = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = %lld",
                                LONG_OPERATIONS_STATUS_TABLE, ID_COL, self.rowId];
         [self.store executeUpdateThrows:sql withDb:db];
     }
     else {
-        NSNumber* now = [self.store currentTimeInMilliseconds];
         NSMutableDictionary* values = [NSMutableDictionary dictionary];
         values[STATUS_COL] = [NSNumber numberWithUnsignedInteger:newStatus];
-        values[LAST_MODIFIED_COL] = now;
+        values[DETAILS_COL] = [SFJsonUtils JSONRepresentation:[self getDetails]];
+        values[LAST_MODIFIED_COL] = [self.store currentTimeInMilliseconds];
         [self.store updateTable:LONG_OPERATIONS_STATUS_TABLE values:values entryId:@(self.rowId) idCol:ID_COL withDb:db];
     }
 }
 
+/**
+ Update details of row in long operations status table for on-going alter soup operation (status is unchanged)
+ @param db Database
+ */
+- (void) updateLongOperationDbRowDetailsWithDb:(FMDatabase*)db
+{
+    NSMutableDictionary* values = [NSMutableDictionary dictionary];
+    values[DETAILS_COL] = [SFJsonUtils JSONRepresentation:[self getDetails]];
+    values[LAST_MODIFIED_COL] = [self.store currentTimeInMilliseconds];
+    [self.store updateTable:LONG_OPERATIONS_STATUS_TABLE values:values entryId:@(self.rowId) idCol:ID_COL withDb:db];
+}
+
 -(void)executeUpdate:(FMDatabase*)db sql:(NSString*)sql context:(NSString*)context
 {
     [SFSDKSmartStoreLogger d:[self class] format:@"%@: %@", context, sql];
     [self.store executeUpdateThrows:sql withDb:db];
 }
 
+-(void)executeUpdate:(FMDatabase*)db sql:(NSString*)sql args:(NSArray*)args context:(NSString*)context
+{
+    [SFSDKSmartStoreLogger d:[self class] format:@"%@: %@ %@", context, sql, args];
+    [self.store executeUpdateThrows:sql withArgumentsInArray:args withDb:db];
+}
+
 @end
@@ -36,6 +36,7 @@ extern NSString * const kQuerySpecTypeRange;
 extern NSString * const kQuerySpecTypeLike;
 extern NSString * const kQuerySpecTypeSmart;
 extern NSString * const kQuerySpecTypeMatch;
+extern NSString * const kQuerySpecTypeRankedMatch;
 
 //kQuerySpecParamFoo constants are used when build SFQuerySpec from JS (dictionary) values
 extern NSString * const kQuerySpecParamQueryType;
@@ -49,15 +50,26 @@ extern NSString * const kQuerySpecParamBeginKey;
 extern NSString * const kQuerySpecParamEndKey;
 extern NSString * const kQuerySpecParamLikeKey;
 extern NSString * const kQuerySpecParamSmartSql;
+extern NSString * const kQuerySpecParamIncludesSnippet;
 
 extern NSUInteger const kQuerySpecDefaultPageSize;
 
+//kQuerySpecSnippetFoo constants are the markers used in the snippets returned by ranked match queries
+extern NSString * const kQuerySpecSnippetOpenMarker;
+extern NSString * const kQuerySpecSnippetCloseMarker;
+extern NSString * const kQuerySpecSnippetEllipsis;
+
+//kQuerySpecContinuationFoo constants are the keys of continuation tokens used for keyset pagination
+extern NSString * const kQuerySpecContinuationOrderValue;
+extern NSString * const kQuerySpecContinuationSoupEntryId;
+
 typedef NS_ENUM(NSInteger, SFSoupQueryType) {
     kSFSoupQueryTypeExact NS_SWIFT_NAME(exact) = 2,
     kSFSoupQueryTypeRange NS_SWIFT_NAME(range) = 4,
     kSFSoupQueryTypeLike  NS_SWIFT_NAME(like)  = 8,
     kSFSoupQueryTypeSmart NS_SWIFT_NAME(smart) = 16,
-    kSFSoupQueryTypeMatch NS_SWIFT_NAME(match) = 32
+    kSFSoupQueryTypeMatch NS_SWIFT_NAME(match) = 32,
+    kSFSoupQueryTypeRankedMatch NS_SWIFT_NAME(rankedMatch) = 64
 } NS_SWIFT_NAME(QuerySpec.QueryType);
 
 typedef NS_ENUM(NSUInteger, SFSoupQuerySortOrder) {
@@ -131,6 +143,17 @@ NS_SWIFT_NAME(QuerySpec)
  */
 @property (nonatomic, strong) NSString *matchKey;
 
+/**
+ includesSnippet is used for ranked match queries: when YES, a snippet of the matching text is selected after the requested paths.
+ */
+@property (nonatomic, assign) BOOL includesSnippet;
+
+/**
+ YES if results are rows (arrays of the selected values) rather than soup entries:
+ smart queries, queries with select paths and ranked match queries with a snippet.
+ */
+@property (nonatomic, readonly) BOOL returnsRows;
+
 /**
  The indexPath to use for sorting. Compound paths must be dot-delimited ie parent.child.grandchild.field .
  */
@@ -220,6 +243,22 @@ NS_SWIFT_NAME(QuerySpec)
 + (nullable SFQuerySpec*) newMatchQuerySpec:(NSString*)soupName withSelectPaths:(nullable NSArray*)selectPaths withPath:(NSString*)path withMatchKey:(NSString*)matchKey withOrderPath:(NSString*)orderPath withOrder:(SFSoupQuerySortOrder)order withPageSize:(NSUInteger)pageSize NS_SWIFT_NAME(buildMatchQuerySpec(soupName:selectPaths:path:matchKey:orderPath:order:pageSize:));
 + (SFQuerySpec*) newMatchQuerySpec:(NSString*)soupName withPath:(NSString*)path withMatchKey:(NSString*)matchKey withOrderPath:(NSString*)orderPath withOrder:(SFSoupQuerySortOrder)order withPageSize:(NSUInteger)pageSize NS_SWIFT_NAME(buildMatchQuerySpec(soupName:path:matchKey:orderPath:order:pageSize:));
 
+/**
+ * Factory method to build a ranked match query spec (full-text search, fts5 only)
+ * The fts table is joined directly and results are ordered by relevance (bm25), best matches first.
+ * The match key is bound to the statement (it is not inlined in the sql), so it can't contain {soup:path} references:
+ * use path to restrict the search to one full-text indexed path.
+ * @param soupName The target soup name.
+ * @param selectPaths The paths to return - if nil the entire soup element is returned.
+ * @param path The path to filter on - can be nil to match against any full-text indexed paths.
+ * @param matchKey The match query string (fts5 query syntax).
+ * @param includesSnippet YES to select a snippet of the best matching column after the requested paths (results are then rows),
+ *                        matched terms are surrounded by kQuerySpecSnippetOpenMarker and kQuerySpecSnippetCloseMarker.
+ * @param pageSize The page size.
+ * @return A query spec object.
+ */
++ (nullable SFQuerySpec*) newRankedMatchQuerySpec:(NSString*)soupName withSelectPaths:(nullable NSArray*)selectPaths withPath:(nullable NSString*)path withMatchKey:(NSString*)matchKey includesSnippet:(BOOL)includesSnippet withPageSize:(NSUInteger)pageSize NS_SWIFT_NAME(buildRankedMatchQuerySpec(soupName:selectPaths:path:matchKey:includesSnippet:pageSize:));
+
 /**
  * Factory method to build a smart query spec
  * Note: caller is responsible for releaseing the query spec
@@ -248,6 +287,28 @@ NS_SWIFT_NAME(QuerySpec)
  */
 - (nullable NSArray*) bindsForQuerySpec;
 
+/**
+ * YES if this query spec can be paged by seeking past the last row returned (keyset pagination)
+ * instead of skipping rows with an OFFSET. All query types but smart and ranked match queries support it.
+ */
+@property (nonatomic, readonly) BOOL supportsKeysetPagination;
+
+/**
+ * Smart sql for keyset pagination.
+ * Rows are ordered by orderPath then by soup entry id, and two trailing columns (order value and soup entry id) are
+ * selected after the requested ones so that a continuation token can be built from the last row of a page.
+ * @param continuationToken Token built from the last row of the previous page - nil for the first page.
+ * @return Smart sql returning the rows following the continuation token.
+ */
+- (NSString*) keysetSmartSqlAfterContinuationToken:(nullable NSDictionary*)continuationToken;
+
+/**
+ * Return bind arguments for keyset query.
+ * @param continuationToken Token built from the last row of the previous page - nil for the first page.
+ * @return bind arguments.
+ */
+- (NSArray*) keysetBindsAfterContinuationToken:(nullable NSDictionary*)continuationToken;
+
 
 /** Enum to/from string helper methods
  */
@@ -36,6 +36,7 @@ NSString * const kQuerySpecTypeRange = @"range";
 NSString * const kQuerySpecTypeLike = @"like";
 NSString * const kQuerySpecTypeSmart = @"smart";
 NSString * const kQuerySpecTypeMatch = @"match";
+NSString * const kQuerySpecTypeRankedMatch = @"rankedMatch";
 
 NSString * const kQuerySpecParamQueryType = @"queryType";
 NSString * const kQuerySpecParamSelectPaths = @"selectPaths";
@@ -49,6 +50,21 @@ NSString * const kQuerySpecParamBeginKey = @"beginKey";
 NSString * const kQuerySpecParamEndKey = @"endKey";
 NSString * const kQuerySpecParamLikeKey = @"likeKey";
 NSString * const kQuerySpecParamSmartSql = @"smartSql";
+NSString * const kQuerySpecParamIncludesSnippet = @"includesSnippet";
+
+NSString * const kQuerySpecSnippetOpenMarker = @"<b>";
+NSString * const kQuerySpecSnippetCloseMarker = @"</b>";
+NSString * const kQuerySpecSnippetEllipsis = @"...";
+
+// Maximum number of tokens in the snippets returned by ranked match queries
+static NSUInteger const kSnippetMaxTokens = 16;
+
+NSString * const kQuerySpecContinuationOrderValue = @"orderValue";
+NSString * const kQuerySpecContinuationSoupEntryId = @"soupEntryId";
+
+// Aliases of the trailing columns selected by keyset queries
+static NSString * const kKeysetOrderValueCol = @"_keysetOrderValue";
+static NSString * const kKeysetSoupEntryIdCol = @"_keysetSoupEntryId";
 
 
 @implementation SFQuerySpec
@@ -144,6 +160,21 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
     return querySpec;
 }
 
++ (SFQuerySpec*) newRankedMatchQuerySpec:(NSString*)soupName withSelectPaths:(NSArray*)selectPaths withPath:(NSString*)path withMatchKey:(NSString*)matchKey includesSnippet:(BOOL)includesSnippet withPageSize:(NSUInteger)pageSize {
+    SFQuerySpec* querySpec = [[super alloc] init];
+    if (nil != querySpec) {
+        querySpec.queryType = kSFSoupQueryTypeRankedMatch;
+        querySpec.soupName = soupName;
+        querySpec.selectPaths = selectPaths;
+        querySpec.path = path;
+        querySpec.matchKey = matchKey;
+        querySpec.includesSnippet = includesSnippet;
+        querySpec.pageSize = pageSize;
+        [querySpec computeSmartAndCountAndIdsSql];
+    }
+    return querySpec;
+}
+
 + (SFQuerySpec*) newSmartQuerySpec:(NSString*)smartSql withPageSize:(NSUInteger)pageSize {
     SFQuerySpec* querySpec = [[super alloc] init];
     if (nil != querySpec) {
@@ -169,6 +200,7 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
     NSString* orderPath = [querySpec nonNullObjectForKey:kQuerySpecParamOrderPath];
     NSString* rawOrder =  [querySpec nonNullObjectForKey:kQuerySpecParamOrder];
     NSNumber* rawPageSize = [querySpec nonNullObjectForKey:kQuerySpecParamPageSize];
+    NSNumber* rawIncludesSnippet = [querySpec nonNullObjectForKey:kQuerySpecParamIncludesSnippet];
 
     SFSoupQuerySortOrder order = [SFQuerySpec sortOrderFromString:rawOrder];
     NSUInteger pageSize = ([rawPageSize integerValue] > 0 ? [rawPageSize integerValue] : kQuerySpecDefaultPageSize);
@@ -197,6 +229,9 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
         case kSFSoupQueryTypeMatch:
             self = [SFQuerySpec newMatchQuerySpec:targetSoupName withSelectPaths:selectPaths withPath:path withMatchKey:matchKey withOrderPath:orderPath withOrder:order withPageSize:pageSize];
             break;
+        case kSFSoupQueryTypeRankedMatch:
+            self = [SFQuerySpec newRankedMatchQuerySpec:targetSoupName withSelectPaths:selectPaths withPath:path withMatchKey:matchKey includesSnippet:[rawIncludesSnippet boolValue] withPageSize:pageSize];
+            break;
     }
     
     return self;
@@ -229,6 +264,11 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
         case kSFSoupQueryTypeMatch:
             // baking matchKey into query
             break;
+
+        case kSFSoupQueryTypeRankedMatch:
+            if (nil != self.matchKey)
+                result = @[self.matchKey];
+            break;
             
         case kSFSoupQueryTypeSmart:
             break;
@@ -260,7 +300,12 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
      self.countSmartSql = countSmartSql;
 
     NSMutableString* idsSmartSql = [NSMutableString string];
-    [idsSmartSql appendString:[NSString stringWithFormat:@"SELECT %@ ", ID_COL]];
+    if (self.queryType == kSFSoupQueryTypeRankedMatch) {
+        // The fts table is part of the join
+        [idsSmartSql appendFormat:@"SELECT %@ ", [self computeFieldReference:SOUP_ENTRY_ID]];
+    } else {
+        [idsSmartSql appendString:[NSString stringWithFormat:@"SELECT %@ ", ID_COL]];
+    }
     [idsSmartSql appendString:fromClause];
     [idsSmartSql appendString:whereClause];
     [idsSmartSql appendString:orderClause];
@@ -277,23 +322,43 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
 }
 
 - (NSString*)computeSelectClause {
-    NSMutableArray* fieldReferences = [NSMutableArray new];
-    for (NSString* selectPath in (self.selectPaths ? self.selectPaths : @[@"_soup"])) {
-        [fieldReferences addObject:[self computeFieldReference:selectPath]];
-    }
-
     return [@[@"SELECT ",
-              [fieldReferences componentsJoinedByString:@", "],
+              [self computeSelectFields],
               @" "]
             componentsJoinedByString:@""];
 }
 
+- (NSString*)computeSelectFields {
+    NSMutableArray* fieldReferences = [NSMutableArray new];
+    BOOL ranked = self.queryType == kSFSoupQueryTypeRankedMatch;
+    for (NSString* selectPath in (self.selectPaths ? self.selectPaths : @[@"_soup"])) {
+        [fieldReferences addObject:ranked ? [self computeQualifiedFieldReference:selectPath] : [self computeFieldReference:selectPath]];
+    }
+    if (ranked && self.includesSnippet) {
+        // Negative column: fts5 picks the column that best matches
+        [fieldReferences addObject:[NSString stringWithFormat:@"snippet(%@, -1, %@, %@, %@, %lu)",
+                                    [self computeSoupFtsReference],
+                                    [SFQuerySpec sqlStringLiteral:kQuerySpecSnippetOpenMarker],
+                                    [SFQuerySpec sqlStringLiteral:kQuerySpecSnippetCloseMarker],
+                                    [SFQuerySpec sqlStringLiteral:kQuerySpecSnippetEllipsis],
+                                    (unsigned long)kSnippetMaxTokens]];
+    }
+    return [fieldReferences componentsJoinedByString:@", "];
+}
+
 - (NSString*)computeFromClause {
+    if (self.queryType == kSFSoupQueryTypeRankedMatch) {
+        // Fts table first: its MATCH constraint drives the join
+        return [@[@"FROM ", [self computeSoupFtsReference],
+                  @" JOIN ", [self computeSoupReference],
+                  @" ON ", [self computeFieldReference:SOUP_ENTRY_ID], @" = ", [self computeSoupFtsReference], @".", ROWID_COL, @" "]
+                componentsJoinedByString:@""];
+    }
     return [@[@"FROM ", [self computeSoupReference], @" "] componentsJoinedByString:@""];
 }
 
 - (NSString*)computeWhereClause {
-    if (self.path == nil && self.queryType != kSFSoupQueryTypeMatch /* null path allowed for fts match query */) {
+    if (self.path == nil && self.queryType != kSFSoupQueryTypeMatch && self.queryType != kSFSoupQueryTypeRankedMatch /* null path allowed for fts match queries */) {
         return @"";
     }
     
@@ -336,6 +401,13 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
                       ]
                     componentsJoinedByString:@""];
 
+        case kSFSoupQueryTypeRankedMatch:
+            if (field) {
+                // Column filter around the bound match key
+                return [@[@"WHERE ", [self computeSoupFtsReference], @" MATCH '", field, @" : (' || ? || ')' "] componentsJoinedByString:@""];
+            }
+            return [@[@"WHERE ", [self computeSoupFtsReference], @" MATCH ? "] componentsJoinedByString:@""];
+
         default: break;
     }
 
@@ -384,6 +456,10 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
 }
 
 - (NSString*)computeOrderClause {
+    if (self.queryType == kSFSoupQueryTypeRankedMatch) {
+        // bm25 scores are negative, the better the match the lower the score
+        return [@[@"ORDER BY bm25(", [self computeSoupFtsReference], @"), ", [self computeFieldReference:SOUP_ENTRY_ID], @" "] componentsJoinedByString:@""];
+    }
     if (self.orderPath == nil) {
         return @"";
     }
@@ -391,12 +467,113 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
     return [@[@"ORDER BY ", [self computeFieldReference:self.orderPath], @" ", [self sqlSortOrder], @" "] componentsJoinedByString:@""];
 }
 
+#pragma mark - Keyset pagination
+
+- (BOOL)supportsKeysetPagination {
+    return self.queryType != kSFSoupQueryTypeSmart && self.queryType != kSFSoupQueryTypeRankedMatch;
+}
+
+- (BOOL)returnsRows {
+    return self.queryType == kSFSoupQueryTypeSmart
+        || self.selectPaths != nil
+        || (self.queryType == kSFSoupQueryTypeRankedMatch && self.includesSnippet);
+}
+
+- (NSString*) keysetSmartSqlAfterContinuationToken:(NSDictionary*)continuationToken {
+    if (!self.supportsKeysetPagination) {
+        @throw [NSException exceptionWithName:@"keysetSmartSql failed" reason:@"Keyset pagination is not supported for smart queries" userInfo:nil];
+    }
+    NSString* idField = [self computeFieldReference:SOUP_ENTRY_ID];
+    NSString* orderField = self.orderPath ? [self computeFieldReference:self.orderPath] : idField;
+    NSString* sortOrder = [self sqlSortOrder];
+
+    NSMutableString* keysetSmartSql = [NSMutableString string];
+    [keysetSmartSql appendString:@"SELECT "];
+    [keysetSmartSql appendString:[self computeSelectFields]];
+    [keysetSmartSql appendFormat:@", %@ AS %@, %@ AS %@ ", orderField, kKeysetOrderValueCol, idField, kKeysetSoupEntryIdCol];
+    [keysetSmartSql appendString:[self computeFromClause]];
+
+    NSString* whereClause = [self computeWhereClause];
+    [keysetSmartSql appendString:whereClause];
+    if (continuationToken) {
+        [keysetSmartSql appendString:(whereClause.length > 0 ? @"AND " : @"WHERE ")];
+        [keysetSmartSql appendString:[self computeKeysetPredicate:continuationToken orderField:orderField idField:idField]];
+    }
+
+    if (self.orderPath) {
+        [keysetSmartSql appendFormat:@"ORDER BY %@ %@, %@ %@ ", orderField, sortOrder, idField, sortOrder];
+    } else {
+        [keysetSmartSql appendFormat:@"ORDER BY %@ %@ ", idField, sortOrder];
+    }
+    return keysetSmartSql;
+}
+
+/**
+ * Predicate selecting the rows that come after the continuation token given the (order value, soup entry id) ordering
+ * NB: sqlite sorts NULL before any other value, so NULL order values come first in ascending order and last in descending order
+ */
+- (NSString*) computeKeysetPredicate:(NSDictionary*)continuationToken orderField:(NSString*)orderField idField:(NSString*)idField {
+    BOOL ascending = self.order != kSFSoupQuerySortOrderDescending;
+    NSString* comparator = ascending ? @">" : @"<";
+    if (!self.orderPath) {
+        return [NSString stringWithFormat:@"%@ %@ ? ", idField, comparator];
+    }
+
+    BOOL orderValueIsNull = [self keysetOrderValue:continuationToken] == nil;
+    if (ascending) {
+        return orderValueIsNull
+        ? [NSString stringWithFormat:@"((%@ IS NULL AND %@ > ?) OR %@ IS NOT NULL) ", orderField, idField, orderField]
+        : [NSString stringWithFormat:@"(%@ > ? OR (%@ = ? AND %@ > ?)) ", orderField, orderField, idField];
+    } else {
+        return orderValueIsNull
+        ? [NSString stringWithFormat:@"(%@ IS NULL AND %@ < ?) ", orderField, idField]
+        : [NSString stringWithFormat:@"(%@ < ? OR (%@ = ? AND %@ < ?) OR %@ IS NULL) ", orderField, orderField, idField, orderField];
+    }
+}
+
+- (NSArray*) keysetBindsAfterContinuationToken:(NSDictionary*)continuationToken {
+    NSMutableArray* binds = [NSMutableArray arrayWithArray:[self bindsForQuerySpec] ?: @[]];
+    if (continuationToken) {
+        id soupEntryId = continuationToken[kQuerySpecContinuationSoupEntryId];
+        if (soupEntryId == nil || soupEntryId == [NSNull null]) {
+            @throw [NSException exceptionWithName:@"keysetBinds failed" reason:[NSString stringWithFormat:@"Invalid continuation token: %@", continuationToken] userInfo:nil];
+        }
+        id orderValue = [self keysetOrderValue:continuationToken];
+        if (self.orderPath && orderValue) {
+            [binds addObject:orderValue];
+            [binds addObject:orderValue];
+        }
+        [binds addObject:soupEntryId];
+    }
+    return binds;
+}
+
+- (id) keysetOrderValue:(NSDictionary*)continuationToken {
+    id orderValue = continuationToken[kQuerySpecContinuationOrderValue];
+    return orderValue == [NSNull null] ? nil : orderValue;
+}
+
 - (NSString*)computeFieldReference:(NSString*) field {
     NSString* fieldRef = [@[@"{", self.soupName, @":", field, @"}"] componentsJoinedByString:@""];
     [SFSDKSmartStoreLogger d:[self class] format:@"computeFieldReference: %@ --> %@", field, fieldRef];
     return fieldRef;
 }
 
+/**
+ * Field reference for queries joining the fts table: full-text indexed columns exist in both tables
+ * Special paths (_soup, _soupEntryId etc) are already qualified by the smart sql conversion
+ */
+- (NSString*)computeQualifiedFieldReference:(NSString*) field {
+    if ([field hasPrefix:@"_soup"]) {
+        return [self computeFieldReference:field];
+    }
+    return [@[[self computeSoupReference], @".", [self computeFieldReference:field]] componentsJoinedByString:@""];
+}
+
++ (NSString*)sqlStringLiteral:(NSString*)value {
+    return [NSString stringWithFormat:@"'%@'", [value stringByReplacingOccurrencesOfString:@"'" withString:@"''"]];
+}
+
 - (NSString*)computeSoupReference {
     return [@[@"{", self.soupName, @"}"] componentsJoinedByString:@""];
 }
@@ -458,6 +635,11 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
         case kSFSoupQueryTypeMatch:
             result[kQuerySpecParamMatchKey] = self.matchKey;
             break;
+
+        case kSFSoupQueryTypeRankedMatch:
+            result[kQuerySpecParamMatchKey] = self.matchKey;
+            result[kQuerySpecParamIncludesSnippet] = @(self.includesSnippet);
+            break;
         }
     
     return result;
@@ -484,6 +666,9 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
     else if ([queryType isEqualToString:kQuerySpecTypeMatch]) {
         return kSFSoupQueryTypeMatch;
     }
+    else if ([queryType isEqualToString:kQuerySpecTypeRankedMatch]) {
+        return kSFSoupQueryTypeRankedMatch;
+    }
     else {
         return kSFSoupQueryTypeSmart;
     }
@@ -501,6 +686,8 @@ NSString * const kQuerySpecParamSmartSql = @"smartSql";
             return kQuerySpecTypeSmart;
         case kSFSoupQueryTypeMatch:
             return kQuerySpecTypeMatch;
+        case kSFSoupQueryTypeRankedMatch:
+            return kQuerySpecTypeRankedMatch;
     }
 }
 
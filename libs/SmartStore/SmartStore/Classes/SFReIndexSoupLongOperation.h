@@ -0,0 +1,112 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+#import <SmartStore/SFSmartStore.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Value of the type column for re-index soup long operation rows in long_operations_status table
+static NSString * const kSFReIndexSoupLongOperationType = @"ReIndexSoup";
+
+// Fields of details for re-index soup long operation row in long_operations_status table
+static NSString * const INDEX_PATHS      = @"indexPaths";
+static NSString * const CHUNK_SIZE       = @"chunkSize";
+static NSString * const LAST_ENTRY_ID    = @"lastEntryId";
+static NSString * const RE_INDEXED_COUNT = @"reIndexedCount";
+
+/**
+ Use this class to re-index a soup a chunk of entries at a time. Each chunk is re-indexed in its own transaction,
+ and the id of the last entry re-indexed is recorded in the long operations status table along with it,
+ so that an interrupted re-index can be resumed without starting over.
+ */
+NS_SWIFT_NAME(ReIndexSoupLongOperation)
+@interface SFReIndexSoupLongOperation : NSObject
+
+/** Soup being re-indexed.
+ */
+@property (nonatomic, readonly, strong) NSString *soupName;
+
+/** Paths being re-indexed.
+ */
+@property (nonatomic, readonly, strong) NSArray<NSString*> *indexPaths;
+
+/** Number of entries re-indexed per transaction.
+ */
+@property (nonatomic, readonly, assign) NSUInteger chunkSize;
+
+/** Id of the last entry re-indexed.
+ */
+@property (nonatomic, readonly, assign) long long lastEntryId;
+
+/** Number of entries re-indexed so far.
+ */
+@property (nonatomic, readonly, assign) NSUInteger reIndexedCount;
+
+/** Instance of SmartStore.
+ */
+@property (nonatomic, readonly, strong) SFSmartStore *store;
+
+/** Row ID for long_operations_status table.
+ */
+@property (nonatomic, readonly, assign) long long rowId;
+
+/** Block called after each chunk has been committed (optional).
+ */
+@property (nonatomic, copy, nullable) SFReIndexSoupProgressBlock progressBlock;
+
+/**
+ Initializer for starting the re-index soup operation.
+ @param store SmartStore instance.
+ @param soupName Soup name.
+ @param indexPaths Paths to re-index.
+ @param chunkSize Number of entries re-indexed per transaction (0 to use kSFReIndexSoupDefaultChunkSize).
+ @return The initialized self.
+ */
+- (id) initWithStore:(SFSmartStore*)store soupName:(NSString*)soupName indexPaths:(NSArray<NSString*>*)indexPaths chunkSize:(NSUInteger)chunkSize;
+
+/**
+ Initializer for resuming a re-index soup operation from the data stored in the long operations status table.
+ @param store SmartStore instance.
+ @param rowId Row ID.
+ @param details Details.
+ @return The initialized self.
+ */
+- (id) initWithStore:(SFSmartStore*)store rowId:(long)rowId details:(NSDictionary*)details;
+
+/**
+ Run this operation to completion.
+ @return YES if the soup was entirely re-indexed.
+ */
+- (BOOL) run;
+
+/**
+ Re-index the next chunk of entries (used by tests).
+ @return The number of entries re-indexed, 0 once there is nothing left to do.
+ */
+- (NSUInteger) runNextChunk;
+
+@end
+
+NS_ASSUME_NONNULL_END
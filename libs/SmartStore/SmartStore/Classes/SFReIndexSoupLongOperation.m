@@ -0,0 +1,220 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SFReIndexSoupLongOperation.h"
+#import "FMDatabase.h"
+#import "FMDatabaseQueue.h"
+#import "SFSmartStore+Internal.h"
+#import "SFAlterSoupLongOperation.h"
+#import <SalesforceSDKCommon/SFJsonUtils.h>
+
+@interface SFReIndexSoupLongOperation ()
+
+@property (nonatomic, readwrite, strong) NSString *soupName;
+@property (nonatomic, readwrite, strong) NSArray<NSString*> *indexPaths;
+@property (nonatomic, readwrite, assign) NSUInteger chunkSize;
+@property (nonatomic, readwrite, assign) long long lastEntryId;
+@property (nonatomic, readwrite, assign) NSUInteger reIndexedCount;
+@property (nonatomic, readwrite, strong) SFSmartStore *store;
+@property (nonatomic, readwrite, assign) long long rowId;
+
+@end
+
+@implementation SFReIndexSoupLongOperation
+
+- (id) initWithStore:(SFSmartStore*)store soupName:(NSString*)soupName indexPaths:(NSArray<NSString*>*)indexPaths chunkSize:(NSUInteger)chunkSize
+{
+    self = [super init];
+    if (nil != self) {
+        _store = store;
+        _soupName = soupName;
+        _indexPaths = [indexPaths copy];
+        _chunkSize = chunkSize > 0 ? chunkSize : kSFReIndexSoupDefaultChunkSize;
+        _lastEntryId = 0;
+        _reIndexedCount = 0;
+        [store inTransaction:^(FMDatabase *db, BOOL *rollback) {
+            self->_rowId = [self createLongOperationDbRowWithDb:db];
+        } error:nil];
+    }
+    return self;
+}
+
+- (id) initWithStore:(SFSmartStore*)store rowId:(long)rowId details:(NSDictionary*)details
+{
+    self = [super init];
+    if (nil != self) {
+        _store = store;
+        _rowId = rowId;
+        _soupName = details[SOUP_NAME];
+        _indexPaths = details[INDEX_PATHS];
+        _chunkSize = [details[CHUNK_SIZE] unsignedIntegerValue] ?: kSFReIndexSoupDefaultChunkSize;
+        _lastEntryId = [details[LAST_ENTRY_ID] longLongValue];
+        _reIndexedCount = [details[RE_INDEXED_COUNT] unsignedIntegerValue];
+    }
+    return self;
+}
+
+- (NSString*) description
+{
+    return [NSString stringWithFormat:@"ReIndexSoupOperation = {rowId=%lld soupName=%@ indexPaths=%@ chunkSize=%lu lastEntryId=%lld reIndexedCount=%lu}\n",
+            self.rowId,
+            self.soupName,
+            [SFJsonUtils JSONRepresentation:self.indexPaths],
+            (unsigned long)self.chunkSize,
+            self.lastEntryId,
+            (unsigned long)self.reIndexedCount
+            ];
+}
+
+- (BOOL) run
+{
+    NSUInteger totalCount = self.reIndexedCount + [self remainingCount];
+    while (YES) {
+        NSError *error = nil;
+        NSUInteger count = [self runNextChunk:&error];
+        if (error) {
+            [SFSDKSmartStoreLogger e:[self class] format:@"Re-index of soup %@ stopped after entry %lld: %@", self.soupName, self.lastEntryId, error];
+            return NO;
+        }
+        if (count == 0) {
+            break;
+        }
+        if (self.progressBlock) {
+            // Entries added since we started are picked up too
+            totalCount = MAX(totalCount, self.reIndexedCount);
+            self.progressBlock(self.reIndexedCount, totalCount);
+        }
+    }
+    return YES;
+}
+
+- (NSUInteger) runNextChunk
+{
+    return [self runNextChunk:nil];
+}
+
+- (NSUInteger) runNextChunk:(NSError**)error
+{
+    // Each chunk gets its own transaction: the store queue is released in between,
+    // letting any reads or writes waiting on it go through before the next chunk
+    __block NSUInteger count = 0;
+    long long previousLastEntryId = self.lastEntryId;
+    NSUInteger previousReIndexedCount = self.reIndexedCount;
+    BOOL success = [self.store inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        long long lastEntryId = self.lastEntryId;
+        count = [self.store reIndexSoup:self.soupName
+                         withIndexPaths:self.indexPaths
+                           afterEntryId:self.lastEntryId
+                                  limit:self.chunkSize
+                            lastEntryId:&lastEntryId
+                                 withDb:db];
+        if (count > 0) {
+            self.lastEntryId = lastEntryId;
+            self.reIndexedCount += count;
+            [self updateLongOperationDbRowWithDb:db];
+        } else {
+            [self deleteLongOperationDbRowWithDb:db];
+        }
+    } error:error];
+    if (!success) {
+        // Chunk was rolled back
+        self.lastEntryId = previousLastEntryId;
+        self.reIndexedCount = previousReIndexedCount;
+        count = 0;
+    }
+    return count;
+}
+
+/**
+ @return Number of entries not yet re-indexed
+ */
+- (NSUInteger) remainingCount
+{
+    __block NSUInteger count = 0;
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        NSString *soupTableName = [self.store tableNameForSoup:self.soupName withDb:db];
+        if (soupTableName) {
+            NSString *sql = [NSString stringWithFormat:@"SELECT COUNT(*) FROM %@ WHERE %@ > ?", soupTableName, ID_COL];
+            FMResultSet *frs = [self.store executeQueryThrows:sql withArgumentsInArray:@[@(self.lastEntryId)] withDb:db];
+            if ([frs next]) {
+                count = (NSUInteger) [frs longForColumnIndex:0];
+            }
+            [frs close];
+        }
+    }];
+    return count;
+}
+
+/**
+ Create row in long operations status table for a new re-index soup operation
+ @return row id
+ */
+- (long long) createLongOperationDbRowWithDb:(FMDatabase*) db
+{
+    NSNumber* now = [self.store currentTimeInMilliseconds];
+    NSMutableDictionary* values = [NSMutableDictionary dictionary];
+    values[TYPE_COL] = kSFReIndexSoupLongOperationType;
+    values[DETAILS_COL] = [SFJsonUtils JSONRepresentation:[self getDetails]];
+    values[STATUS_COL] = @0;
+    values[CREATED_COL] = now;
+    values[LAST_MODIFIED_COL] = now;
+    [self.store insertIntoTable:LONG_OPERATIONS_STATUS_TABLE values:values withDb:db];
+    return [db lastInsertRowId];
+}
+
+- (NSDictionary*) getDetails
+{
+    NSMutableDictionary* details = [NSMutableDictionary dictionary];
+    details[SOUP_NAME] = self.soupName;
+    details[INDEX_PATHS] = self.indexPaths;
+    details[CHUNK_SIZE] = @(self.chunkSize);
+    details[LAST_ENTRY_ID] = @(self.lastEntryId);
+    details[RE_INDEXED_COUNT] = @(self.reIndexedCount);
+    return details;
+}
+
+/**
+ Record progress in long operations status table for on-going re-index soup operation
+ @param db Database
+ */
+- (void) updateLongOperationDbRowWithDb:(FMDatabase*)db
+{
+    NSMutableDictionary* values = [NSMutableDictionary dictionary];
+    values[DETAILS_COL] = [SFJsonUtils JSONRepresentation:[self getDetails]];
+    values[LAST_MODIFIED_COL] = [self.store currentTimeInMilliseconds];
+    [self.store updateTable:LONG_OPERATIONS_STATUS_TABLE values:values entryId:@(self.rowId) idCol:ID_COL withDb:db];
+}
+
+/**
+ Delete row in long operations status table once re-index soup operation is done
+ @param db Database
+ */
+- (void) deleteLongOperationDbRowWithDb:(FMDatabase*)db
+{
+    NSString *sql = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = %lld",
+                     LONG_OPERATIONS_STATUS_TABLE, ID_COL, self.rowId];
+    [self.store executeUpdateThrows:sql withDb:db];
+}
+
+@end
@@ -28,15 +28,47 @@
 NS_ASSUME_NONNULL_BEGIN
 
 /**
- Cache for smart sql to sql conversions
+ LRU cache for smart sql to sql conversions, bounded by a number of entries and by the (approximate) size in bytes of the strings cached.
+ Entries are indexed by the soups they reference so that removing the entries of a soup only touches those entries.
  */
-@interface SFSmartSqlCache : NSObject <NSCacheDelegate>
+@interface SFSmartSqlCache : NSObject
+
+/**
+ Number of lookups that found a conversion.
+ */
+@property (nonatomic, readonly, assign) NSUInteger hitCount;
+
+/**
+ Number of lookups that did not find a conversion.
+ */
+@property (nonatomic, readonly, assign) NSUInteger missCount;
+
+/**
+ Number of entries evicted to stay within the limits.
+ */
+@property (nonatomic, readonly, assign) NSUInteger evictionCount;
+
+/**
+ Number of entries cached.
+ */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+/**
+ Approximate size in bytes of the entries cached.
+ */
+@property (nonatomic, readonly, assign) NSUInteger totalCost;
 
 - (id)initWithCountLimit:(NSUInteger)countLimit;
 
+/**
+ @param countLimit Maximum number of entries.
+ @param totalCostLimit Maximum size in bytes of the entries (0 for no limit).
+ */
+- (id)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit;
+
 - (void) setSql:(NSString*)sql forSmartSql:(NSString*)smartSql;
 
-- (NSString*) sqlForSmartSql:(NSString*)smartSql;
+- (nullable NSString*) sqlForSmartSql:(NSString*)smartSql;
 
 - (void) removeEntriesForSoup:(NSString*)soupName;
 
@@ -27,52 +27,189 @@
 
 #import "SFSmartSqlCache.h"
 
+// Entry of the cache - entries form a doubly linked list from the most recently used to the least recently used
+@interface SFSmartSqlCacheEntry : NSObject
+
+@property (nonatomic, strong) NSString* smartSql;
+@property (nonatomic, strong) NSString* sql;
+@property (nonatomic, strong) NSSet<NSString*>* soupNames;
+@property (nonatomic, assign) NSUInteger cost;
+@property (nonatomic, strong) SFSmartSqlCacheEntry* next;
+@property (nonatomic, unsafe_unretained) SFSmartSqlCacheEntry* previous;
+
+@end
+
+@implementation SFSmartSqlCacheEntry
+
+@end
+
 @interface SFSmartSqlCache ()
 
-@property (nonatomic, strong) NSCache* cache;
-@property (nonatomic, strong) NSMutableSet* keys;
+@property (nonatomic, readwrite, assign) NSUInteger hitCount;
+@property (nonatomic, readwrite, assign) NSUInteger missCount;
+@property (nonatomic, readwrite, assign) NSUInteger evictionCount;
+@property (nonatomic, readwrite, assign) NSUInteger totalCost;
+@property (nonatomic, assign) NSUInteger countLimit;
+@property (nonatomic, assign) NSUInteger totalCostLimit;
+@property (nonatomic, strong) NSMutableDictionary<NSString*, SFSmartSqlCacheEntry*>* entries;
+@property (nonatomic, strong) NSMutableDictionary<NSString*, NSMutableSet<NSString*>*>* smartSqlsBySoup;
+@property (nonatomic, strong) SFSmartSqlCacheEntry* head;
+@property (nonatomic, unsafe_unretained) SFSmartSqlCacheEntry* tail;
 
 @end
 
 @implementation SFSmartSqlCache
 
 - (id)initWithCountLimit:(NSUInteger)countLimit {
+    return [self initWithCountLimit:countLimit totalCostLimit:0];
+}
+
+- (id)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit {
     self = [super init];
     if (self) {
-        _cache = [[NSCache alloc] init];
-        _cache.countLimit = countLimit;
-        _cache.delegate = self;
-        _keys = [NSMutableSet new];
+        _countLimit = countLimit;
+        _totalCostLimit = totalCostLimit;
+        _entries = [NSMutableDictionary new];
+        _smartSqlsBySoup = [NSMutableDictionary new];
     }
     return self;
 }
 
+// Queries can run concurrently on the read connections: all accesses are guarded by @synchronized
 - (void) setSql:(NSString*)sql forSmartSql:(NSString*)smartSql {
-    [self.cache setObject:sql forKey:smartSql];
-    [self.keys addObject:smartSql];
+    @synchronized (self) {
+        SFSmartSqlCacheEntry* entry = self.entries[smartSql];
+        if (entry) {
+            self.totalCost -= entry.cost;
+            entry.sql = sql;
+            entry.cost = [SFSmartSqlCache costForSmartSql:smartSql sql:sql];
+            self.totalCost += entry.cost;
+            if (entry != self.head) {
+                [self unlinkEntry:entry];
+                [self linkEntryAtHead:entry];
+            }
+        } else {
+            entry = [SFSmartSqlCacheEntry new];
+            entry.smartSql = smartSql;
+            entry.sql = sql;
+            entry.soupNames = [SFSmartSqlCache soupNamesInSmartSql:smartSql];
+            entry.cost = [SFSmartSqlCache costForSmartSql:smartSql sql:sql];
+            self.entries[smartSql] = entry;
+            for (NSString* soupName in entry.soupNames) {
+                NSMutableSet* smartSqls = self.smartSqlsBySoup[soupName];
+                if (smartSqls == nil) {
+                    smartSqls = [NSMutableSet new];
+                    self.smartSqlsBySoup[soupName] = smartSqls;
+                }
+                [smartSqls addObject:smartSql];
+            }
+            self.totalCost += entry.cost;
+            [self linkEntryAtHead:entry];
+        }
+        
+        // Evicting least recently used entries
+        while (self.tail && (self.entries.count > self.countLimit || (self.totalCostLimit > 0 && self.totalCost > self.totalCostLimit))) {
+            [self removeEntry:self.tail];
+            self.evictionCount++;
+        }
+    }
 }
 
 - (NSString*) sqlForSmartSql:(NSString*)smartSql {
-    return [self.cache objectForKey:smartSql];
+    @synchronized (self) {
+        SFSmartSqlCacheEntry* entry = self.entries[smartSql];
+        if (entry == nil) {
+            self.missCount++;
+            return nil;
+        }
+        self.hitCount++;
+        if (entry != self.head) {
+            [self unlinkEntry:entry];
+            [self linkEntryAtHead:entry];
+        }
+        return entry.sql;
+    }
 }
 
 - (void) removeEntriesForSoup:(NSString*)soupName {
-    NSString* soupRef = [@[@"{", soupName, @"}"] componentsJoinedByString:@""];
-    NSMutableArray* keysToRemove = [NSMutableArray array];
-    for (NSString* smartSql in [self.keys allObjects]) {
-        if ([smartSql rangeOfString:soupRef].location != NSNotFound) {
-            [keysToRemove addObject:smartSql];
+    @synchronized (self) {
+        NSSet* smartSqls = [self.smartSqlsBySoup[soupName] copy];
+        for (NSString* smartSql in smartSqls) {
+            [self removeEntry:self.entries[smartSql]];
         }
     }
-    for (NSString* keyToRemove in keysToRemove) {
-        [self.cache removeObjectForKey:keyToRemove];
-        [self.keys removeObject:keyToRemove];
+}
+
+- (NSUInteger) count {
+    @synchronized (self) {
+        return self.entries.count;
+    }
+}
+
+#pragma mark - Helper methods (to be called while holding the lock)
+
+- (void) linkEntryAtHead:(SFSmartSqlCacheEntry*)entry {
+    entry.previous = nil;
+    entry.next = self.head;
+    self.head.previous = entry;
+    self.head = entry;
+    if (self.tail == nil) {
+        self.tail = entry;
     }
 }
 
-# pragma Mark - NSCacheDelegate methods
-- (void)cache:(NSCache *)cache willEvictObject:(id)obj {
-    [self.keys removeObject:obj];
+// NB: entries are retained by the entries dictionary, the list does not keep them alive
+- (void) unlinkEntry:(SFSmartSqlCacheEntry*)entry {
+    if (entry.previous) {
+        entry.previous.next = entry.next;
+    } else {
+        self.head = entry.next;
+    }
+    if (entry.next) {
+        entry.next.previous = entry.previous;
+    } else {
+        self.tail = entry.previous;
+    }
+    entry.next = nil;
+    entry.previous = nil;
+}
+
+- (void) removeEntry:(SFSmartSqlCacheEntry*)entry {
+    if (entry == nil) {
+        return;
+    }
+    [self unlinkEntry:entry];
+    self.totalCost -= entry.cost;
+    for (NSString* soupName in entry.soupNames) {
+        NSMutableSet* smartSqls = self.smartSqlsBySoup[soupName];
+        [smartSqls removeObject:entry.smartSql];
+        if (smartSqls.count == 0) {
+            [self.smartSqlsBySoup removeObjectForKey:soupName];
+        }
+    }
+    [self.entries removeObjectForKey:entry.smartSql];
+}
+
+// Approximate size in bytes of the strings of an entry
++ (NSUInteger) costForSmartSql:(NSString*)smartSql sql:(NSString*)sql {
+    return (smartSql.length + sql.length) * sizeof(unichar);
+}
+
+// Names of the soups referenced as {soupName} or {soupName:path}
++ (NSSet<NSString*>*) soupNamesInSmartSql:(NSString*)smartSql {
+    NSMutableSet<NSString*>* soupNames = [NSMutableSet new];
+    NSUInteger length = smartSql.length;
+    NSUInteger start = NSNotFound;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar c = [smartSql characterAtIndex:i];
+        if (c == '{') {
+            start = i + 1;
+        } else if ((c == '}' || c == ':') && start != NSNotFound) {
+            [soupNames addObject:[smartSql substringWithRange:NSMakeRange(start, i - start)]];
+            start = NSNotFound;
+        }
+    }
+    return soupNames;
 }
 
 @end
@@ -28,6 +28,21 @@
 
 static SFSmartSqlHelper *sharedInstance = nil;
 
+// Start of the column name of json1 indexes
+static NSString * const kJsonExtractSoup = @"json_extract(soup";
+
+// Soup attributes used by the conversion - looked up once per soup referenced in a query
+@interface SFSmartSqlSoupRef : NSObject
+
+@property (nonatomic, strong) NSString *tableName;
+@property (nonatomic, assign) BOOL usesExternalStorage;
+
+@end
+
+@implementation SFSmartSqlSoupRef
+
+@end
+
 @implementation SFSmartSqlHelper
 
 + (SFSmartSqlHelper*) sharedInstance
@@ -42,98 +57,172 @@ static SFSmartSqlHelper *sharedInstance = nil;
 
 - (NSString*) convertSmartSql:(NSString*)smartSql withStore:(SFSmartStore*) store withDb:(FMDatabase *)db
 {
-    // Select's only
-    NSString* smartSqlLowerCase = [[smartSql lowercaseString] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    NSUInteger length = smartSql.length;
     
-    if ([smartSqlLowerCase hasPrefix:@"insert"]
-        || [smartSqlLowerCase hasPrefix:@"update"]
-        || [smartSqlLowerCase hasPrefix:@"delete"]) {
-
+    // Reading the characters once (without copying them when the string stores them as UTF-16)
+    const unichar* chars = CFStringGetCharactersPtr((__bridge CFStringRef)smartSql);
+    NSMutableData* charsData = nil;
+    if (chars == NULL) {
+        charsData = [NSMutableData dataWithLength:length * sizeof(unichar)];
+        [smartSql getCharacters:charsData.mutableBytes range:NSMakeRange(0, length)];
+        chars = charsData.bytes;
+    }
+    
+    // Select's only
+    if ([SFSmartSqlHelper isWriteStatement:chars length:length]) {
         @throw [NSException exceptionWithName:@"convertSmartSql failed" reason:@"Only SELECT are supported" userInfo:nil];
     }
     
-    // Replacing {soupName} and {soupName:path}
-    NSMutableString* sql = [NSMutableString string];
-    NSScanner* scanner = [NSScanner scannerWithString:smartSql];
-    [scanner setCharactersToBeSkipped:nil];
-    while(![scanner isAtEnd]) {
-        NSMutableString* foundString = [NSMutableString string];
-        if([scanner scanUpToString:@"{" intoString:&foundString]) {
-            [sql appendString:foundString];
+    // Replacing {soupName} and {soupName:path} in a single pass
+    // Characters between references are copied as is, soups are looked up once per query
+    NSMutableString* sql = [NSMutableString stringWithCapacity:length + length / 2];
+    NSMutableDictionary<NSString*, SFSmartSqlSoupRef*>* soupRefs = [NSMutableDictionary new];
+    NSUInteger runStart = 0;
+    NSUInteger i = 0;
+    while (i < length) {
+        if (chars[i] != '{') {
+            i++;
+            continue;
+        }
+        CFStringAppendCharacters((__bridge CFMutableStringRef)sql, chars + runStart, i - runStart);
+        
+        // Reference goes up to the closing brace (or the end of the query)
+        NSUInteger position = i;
+        NSUInteger referenceStart = i + 1;
+        NSUInteger referenceEnd = referenceStart;
+        NSUInteger firstColon = NSNotFound;
+        NSUInteger colonCount = 0;
+        while (referenceEnd < length && chars[referenceEnd] != '}') {
+            if (chars[referenceEnd] == ':') {
+                if (colonCount == 0) firstColon = referenceEnd;
+                colonCount++;
+            }
+            referenceEnd++;
         }
-        if(![scanner isAtEnd]) {
-            NSUInteger position = [scanner scanLocation];
-            [scanner scanString:@"{" intoString:nil];
-            [scanner scanUpToString:@"}" intoString:&foundString];
-            
-            NSArray* parts = [foundString componentsSeparatedByString:@":"];
-            NSString* soupName = parts[0];
-            SFSoupSpec *soupSpec = [store attributesForSoup:soupName withDb:db];
-            BOOL soupUsesExternalStorage = [soupSpec.features containsObject:kSoupFeatureExternalStorage];
+        
+        NSUInteger soupNameEnd = colonCount > 0 ? firstColon : referenceEnd;
+        NSString* soupName = [[NSString alloc] initWithCharacters:chars + referenceStart length:soupNameEnd - referenceStart];
+        SFSmartSqlSoupRef* soupRef = soupRefs[soupName];
+        if (nil == soupRef) {
             NSString* soupTableName = [store tableNameForSoup:soupName withDb:db];
             if (nil == soupTableName) {
                 @throw [NSException exceptionWithName:@"convertSmartSql failed" reason:[NSString stringWithFormat:@"Invalid soup name:%@", soupName] userInfo:nil];
             }
-            BOOL tableQualified = [smartSql characterAtIndex:position-1] == '.';
-            NSString* tableQualifier = tableQualified ? @"" : [soupTableName stringByAppendingString:@"."];
-            
-            // {soupName}
-            if ([parts count] == 1) {
-                [sql appendString:soupTableName];
-            }
-            else if ([parts count] == 2) {
-                NSString* path = parts[1];
-                // {soupName:_soup}
-                if ([path isEqualToString:@"_soup"]) {
-                    if (soupUsesExternalStorage) {
-                        [sql appendFormat:@"'%@' as '%@'", soupTableName, kSoupFeatureExternalStorage];
-                        [sql appendFormat:@", %@.%@ as '%@'", soupTableName, ID_COL, SOUP_ENTRY_ID];
-                    } else {
-                        [sql appendString:tableQualifier];
-                        [sql appendString:@"soup"];
-                    }
-                }
-                // {soupName:_soupEntryId}
-                else if ([path isEqualToString:@"_soupEntryId"]) {
-                    [sql appendString:tableQualifier];
-                    [sql appendString:@"id"];
-                }
-                // {soupName:_soupCreatedDate}
-                else if ([path isEqualToString:@"_soupCreatedDate"]) {
-                    [sql appendString:tableQualifier];
-                    [sql appendString:@"created"];
+            soupRef = [SFSmartSqlSoupRef new];
+            soupRef.tableName = soupTableName;
+            soupRef.usesExternalStorage = [[store attributesForSoup:soupName withDb:db].features containsObject:kSoupFeatureExternalStorage];
+            soupRefs[soupName] = soupRef;
+        }
+        NSString* soupTableName = soupRef.tableName;
+        BOOL tableQualified = position > 0 && chars[position - 1] == '.';
+        
+        // {soupName}
+        if (colonCount == 0) {
+            [sql appendString:soupTableName];
+        }
+        else if (colonCount == 1) {
+            NSString* path = [[NSString alloc] initWithCharacters:chars + firstColon + 1 length:referenceEnd - firstColon - 1];
+            // {soupName:_soup}
+            if ([path isEqualToString:@"_soup"]) {
+                if (soupRef.usesExternalStorage) {
+                    [sql appendFormat:@"'%@' as '%@'", soupTableName, kSoupFeatureExternalStorage];
+                    [sql appendFormat:@", %@.%@ as '%@'", soupTableName, ID_COL, SOUP_ENTRY_ID];
+                } else {
+                    [self appendColumn:SOUP_COL tableName:soupTableName tableQualified:tableQualified toSql:sql];
                 }
-                // {soupName:_soupLastModifiedDate}
-                else if ([path isEqualToString:@"_soupLastModifiedDate"]) {
-                    [sql appendString:tableQualifier];
-                    [sql appendString:@"lastModified"];
+            }
+            // {soupName:_soupEntryId}
+            else if ([path isEqualToString:@"_soupEntryId"]) {
+                [self appendColumn:ID_COL tableName:soupTableName tableQualified:tableQualified toSql:sql];
+            }
+            // {soupName:_soupCreatedDate}
+            else if ([path isEqualToString:@"_soupCreatedDate"]) {
+                [self appendColumn:CREATED_COL tableName:soupTableName tableQualified:tableQualified toSql:sql];
+            }
+            // {soupName:_soupLastModifiedDate}
+            else if ([path isEqualToString:@"_soupLastModifiedDate"]) {
+                [self appendColumn:LAST_MODIFIED_COL tableName:soupTableName tableQualified:tableQualified toSql:sql];
+            }
+            // {soupName:path}
+            else {
+                NSString* columnName = [store columnNameForPath:path inSoup:soupName withDb:db];
+                if (nil == columnName) {
+                    @throw [NSException exceptionWithName:@"convertSmartSql failed" reason:[NSString stringWithFormat:@"Invalid path:%@", path] userInfo:nil];
                 }
-                // {soupName:path}
-                else {
-                    NSString* columnName = [store columnNameForPath:path inSoup:soupName withDb:db];
-                    if (nil == columnName) {
-                        @throw [NSException exceptionWithName:@"convertSmartSql failed" reason:[NSString stringWithFormat:@"Invalid path:%@", path] userInfo:nil];
-                    }
+                // With json1 support, the column name could be an expression of the form json_extract(soup, '$.x.y.z')
+                // We can't have TABLE_x.json_extract(soup, ...) or table_alias.json_extract(soup, ...) in the sql query
+                // Instead we should have json_extract(TABLE_x.soup, ...)
+                if (tableQualified && [columnName hasPrefix:kJsonExtractSoup]) {
+                    [self moveQualifierIntoJsonExtract:columnName toSql:sql];
+                } else {
                     [sql appendString:columnName];
                 }
             }
-            else if ([parts count] > 2) {
-                @throw [NSException exceptionWithName:@"convertSmartSql failed" reason:[NSString stringWithFormat:@"Invalid soup/path reference: %@ at character: %lu", foundString, (unsigned long)position] userInfo:nil];
-            }
-            
-            
-            [scanner scanString:@"}" intoString:nil];
         }
+        else {
+            NSString* reference = [[NSString alloc] initWithCharacters:chars + referenceStart length:referenceEnd - referenceStart];
+            @throw [NSException exceptionWithName:@"convertSmartSql failed" reason:[NSString stringWithFormat:@"Invalid soup/path reference: %@ at character: %lu", reference, (unsigned long)position] userInfo:nil];
+        }
+        
+        i = referenceEnd < length ? referenceEnd + 1 : length;
+        runStart = i;
     }
-    
-    // With json1 support, the column name could be an expression of the form json_extract(soup, '$.x.y.z')
-    // We can't have TABLE_x.json_extract(soup, ...) or table_alias.json_extract(soup, ...) in the sql query
-    // Instead we should have json_extract(TABLE_x.soup, ...)
-    NSError *error = nil;
-    NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:@"([^ ]+)\\.json_extract\\(soup" options:0 error:&error];
-    [regex replaceMatchesInString:sql options:0 range:NSMakeRange(0, [sql length]) withTemplate:@"json_extract($1.soup"];
+    CFStringAppendCharacters((__bridge CFMutableStringRef)sql, chars + runStart, length - runStart);
     
     return sql;
 }
 
++ (BOOL) isWriteStatement:(const unichar*)chars length:(NSUInteger)length
+{
+    static NSCharacterSet* whitespaces;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        whitespaces = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    });
+    NSUInteger start = 0;
+    while (start < length && [whitespaces characterIsMember:chars[start]]) {
+        start++;
+    }
+    for (NSString* keyword in @[@"insert", @"update", @"delete"]) {
+        if (length - start < keyword.length) {
+            continue;
+        }
+        BOOL matches = YES;
+        for (NSUInteger k = 0; k < keyword.length && matches; k++) {
+            // Case insensitive match of ascii letters
+            matches = (chars[start + k] | 0x20) == [keyword characterAtIndex:k];
+        }
+        if (matches) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (void) appendColumn:(NSString*)column tableName:(NSString*)tableName tableQualified:(BOOL)tableQualified toSql:(NSMutableString*)sql
+{
+    if (!tableQualified) {
+        [sql appendString:tableName];
+        [sql appendString:@"."];
+    }
+    [sql appendString:column];
+}
+
+// Turns [qualifier].json_extract(soup, ...) into json_extract([qualifier].soup, ...) - sql ends with the qualifier and the dot
+- (void) moveQualifierIntoJsonExtract:(NSString*)columnName toSql:(NSMutableString*)sql
+{
+    NSUInteger dot = sql.length - 1;
+    NSUInteger qualifierStart = dot;
+    while (qualifierStart > 0) {
+        unichar c = [sql characterAtIndex:qualifierStart - 1];
+        if (c == ' ' || c == '(' || c == ',' || c == '\n' || c == '\t') {
+            break;
+        }
+        qualifierStart--;
+    }
+    NSString* qualifier = [sql substringWithRange:NSMakeRange(qualifierStart, dot - qualifierStart)];
+    [sql deleteCharactersInRange:NSMakeRange(qualifierStart, sql.length - qualifierStart)];
+    [sql appendFormat:@"json_extract(%@.%@%@", qualifier, SOUP_COL, [columnName substringFromIndex:kJsonExtractSoup.length]];
+}
+
 @end
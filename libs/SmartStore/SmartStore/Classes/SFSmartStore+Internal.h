@@ -28,6 +28,7 @@
 #import "SFSmartStoreDatabaseManager.h"
 @class FMDatabase;
 @class FMResultSet;
+@class FMDatabasePool;
 
 typedef NS_ENUM(NSUInteger, SFSmartStoreFtsExtension) {
     SFSmartStoreFTS4 = 4,
@@ -41,13 +42,22 @@ static NSUInteger kBufferSize = 4096;
 static NSString *const ROWID_COL = @"rowid";
 static NSString *const PATH_COL = @"path";
 
+// Columns of a soup counts table (kSoupFeatureMaterializedCounts), the total row count is under COUNTS_TOTAL_KEY
+static NSString *const COUNTS_VALUE_COL = @"value";
+static NSString *const COUNTS_COUNT_COL = @"count";
+static NSString *const COUNTS_TOTAL_KEY = @"*";
+
 // Columns of the soup index map table
 static NSString *const SOUP_NAME_COL = @"soupName";
 static NSString *const COLUMN_TYPE_COL = @"columnType";
+static NSString *const OPTIONS_COL = @"options";
 
 // Table to keep track of soup attributes
 static NSString *const SOUP_ATTRS_TABLE = @"soup_attrs";
 
+// Column of the soup attributes table with the soup's composite indexes (json), not a feature
+static NSString *const COMPOSITE_INDEXES_COL = @"compositeIndexes";
+
 // Table to keep track of soup's index specs
 static NSString *const SOUP_INDEX_MAP_TABLE = @"soup_index_map";
 
@@ -65,10 +75,31 @@ static NSString *const EXPLAIN_ROWS = @"rows";
 @interface SFSmartStore ()
 
 @property (nonatomic, strong) FMDatabaseQueue *storeQueue;
+@property (nonatomic, strong) FMDatabasePool *readPool;
+@property (nonatomic, strong) dispatch_semaphore_t readPoolSemaphore;
+@property (nonatomic, strong) NSString *journalModeBeforeReadPool;
 @property (nonatomic, strong) SFSmartStoreDatabaseManager *dbMgr;
 @property (nonatomic, assign) BOOL isGlobal;
 @property (nonatomic, assign) SFSmartStoreFtsExtension ftsExtension;
 
+/**
+ Runs the block on a connection from the read pool when readConnectionsCount > 0, on the store queue otherwise.
+ The block should only read from the database.
+ @param block The block to run.
+ @param error Set if the block throws.
+ @return YES if the block ran without throwing.
+ */
+- (BOOL)inReadDatabase:(void (^)(FMDatabase *db))block error:(NSError**)error;
+
+/**
+ Runs the block in a transaction on the store queue.
+ External storage files saved by the block are written before commit and only renamed to their final path once committed.
+ @param block The block to run.
+ @param error Set if the block throws or the files could not be written.
+ @return YES if the block ran without throwing.
+ */
+- (BOOL)inTransaction:(void (^)(FMDatabase *db, BOOL *rollback))block error:(NSError**)error;
+
 /**
  Simply open the db file.
  @return YES if we were able to open the DB file.
@@ -144,6 +175,34 @@ static NSString *const EXPLAIN_ROWS = @"rows";
 - (id)loadExternalSoupEntry:(NSNumber *)soupEntryId
               soupTableName:(NSString *)soupTableName;
 
+/**
+ @param soupEntryId   the soup entry id
+ @param soupTableName the soup table name
+ @param db            the connection the entry is read with: entries saved but not written yet by a transaction are only returned on its connection
+ @return a soup entry if file was loaded successfully.
+ */
+- (id)loadExternalSoupEntry:(NSNumber *)soupEntryId
+              soupTableName:(NSString *)soupTableName
+                     withDb:(FMDatabase *)db;
+
+/**
+ @param soupEntryId   the soup entry id
+ @param soupTableName the soup table name
+ @return the serialized soup entry (UTF-8 json) if file was loaded successfully.
+ */
+- (NSData *)loadExternalSoupEntryAsData:(NSNumber *)soupEntryId
+                          soupTableName:(NSString *)soupTableName;
+
+/**
+ @param soupEntryId   the soup entry id
+ @param soupTableName the soup table name
+ @param db            the connection the entry is read with: entries saved but not written yet by a transaction are only returned on its connection
+ @return the serialized soup entry (UTF-8 json) if file was loaded successfully.
+ */
+- (NSData *)loadExternalSoupEntryAsData:(NSNumber *)soupEntryId
+                          soupTableName:(NSString *)soupTableName
+                                 withDb:(FMDatabase *)db;
+
 /**
  @param soupTableName the soup table name
  @param deleteDir whether or not should delete directory as well
@@ -171,6 +230,34 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 - (NSArray*)indicesForSoup:(NSString*)soupName withDb:(FMDatabase *)db;
 
+/**
+ Upserts entries in a soup.
+ @param entries The entries to upsert.
+ @param soupName The name of the soup.
+ @param externalIdPath The path used to match entries to existing ones.
+ @param error Set if an error occurred.
+ @param db This method is expected to be called from [fmdbqueue inDatabase:^(){ ... }]
+ @return The upserted entries or an empty array if the upsert failed.
+ */
+- (NSArray*)upsertEntries:(NSArray*)entries toSoup:(NSString*)soupName withExternalIdPath:(NSString *)externalIdPath error:(NSError **)error withDb:(FMDatabase*)db;
+
+/**
+ Retrieves entries from a soup.
+ @param soupEntryIds The ids of the entries.
+ @param soupName The name of the soup.
+ @param db This method is expected to be called from [fmdbqueue inDatabase:^(){ ... }]
+ @return The entries found.
+ */
+- (NSArray *)retrieveEntries:(NSArray*)soupEntryIds fromSoup:(NSString*)soupName withDb:(FMDatabase*)db;
+
+/**
+ Removes entries from a soup.
+ @param soupEntryIds The ids of the entries.
+ @param soupName The name of the soup.
+ @param db This method is expected to be called from [fmdbqueue inDatabase:^(){ ... }]
+ */
+- (void)removeEntries:(NSArray*)soupEntryIds fromSoup:(NSString*)soupName withDb:(FMDatabase*)db;
+
 /**
  Helper method re-index a soup.
  @param soupName The soup to re-index
@@ -180,6 +267,18 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 - (BOOL) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray*)indexPaths withDb:(FMDatabase*)db;
 
+/**
+ Helper method to re-index a chunk of a soup.
+ @param soupName The soup to re-index
+ @param indexPaths Array of one ore more paths to re-index
+ @param afterEntryId Only entries with an id greater than this one are re-indexed
+ @param limit Maximum number of entries to re-index (0 for no limit)
+ @param lastEntryId Set to the id of the last entry re-indexed (or afterEntryId if there was none)
+ @param db This method is expected to be called from [fmdbqueue inDatabase:^(){ ... }]
+ @return The number of entries re-indexed (0 once the soup has been walked entirely or if it does not exist)
+ */
+- (NSUInteger) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray*)indexPaths afterEntryId:(long long)afterEntryId limit:(NSUInteger)limit lastEntryId:(long long*)lastEntryId withDb:(FMDatabase*)db;
+
 /**
  Helper method to insert values into an arbitrary table.
  @param tableName The table to insert the data into.
@@ -188,6 +287,14 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 - (void)insertIntoTable:(NSString *)tableName values:(NSDictionary *)map withDb:(FMDatabase*)db;
 
+/**
+ Helper method to insert several rows into an arbitrary table using multi-row INSERT statements.
+ @param tableName The table to insert the data into.
+ @param rows Dictionaries of key-value pairs to be inserted into table (all with the same keys).
+ @param db This method is expected to be called from [fmdbqueue inDatabase:^(){ ... }]
+ */
+- (void)insertIntoTable:(NSString *)tableName rows:(NSArray<NSDictionary*> *)rows withDb:(FMDatabase*)db;
+
 /**
  Helper method to update existing values in a table.
  @param tableName The name of the table to update.
@@ -225,6 +332,14 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 - (NSString *)columnNameForPath:(NSString *)path inSoup:(NSString *)soupName withDb:(FMDatabase*)db;
 
+/**
+ @param path The path.
+ @param soupName The soup name.
+ @param db This method is expected to be called from [fmdbqueue inDatabase:^(){ ... }]
+ @return The index spec for the given path in the given soup (looked up in a per soup map cached alongside the index specs), or nil.
+ */
+- (SFSoupIndex *)indexSpecForPath:(NSString *)path inSoup:(NSString *)soupName withDb:(FMDatabase*)db;
+
 /**
  Similar to System.currentTimeMillis: time in ms since Jan 1 1970
  Used for timestamping created and modified times.
@@ -253,6 +368,11 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 + (NSString*) stringFromInputStream:(NSInputStream*)inputStream;
 
+/**
+ @return The cache of smart sql conversions - its hit and miss counts help tuning CACHES_COUNT_LIMIT.
+ */
+- (SFSmartSqlCache*) smartSqlCache;
+
 /**
  Convert smart sql to sql.
  @param smartSql The smart sql to convert.
@@ -260,6 +380,20 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 - (NSString*) convertSmartSql:(NSString*)smartSql;
 
+/**
+ Run a query using keyset pagination.
+ When no continuation token is given, the page at pageIndex is fetched with an OFFSET, its last row still yielding a continuation token.
+ @param resultArray Array to which the entries are added (when not computing result as string).
+ @param resultString String to which the serialized entries are appended (when computing result as string).
+ @param querySpec The query spec - must support keyset pagination.
+ @param pageIndex The page index - ignored when a continuation token is provided.
+ @param continuationToken The token returned with the previous page.
+ @param nextContinuationToken Set to the token for the next page - nil when there are no more pages.
+ @param error Sets/returns any error generated as part of the process.
+ @return YES if successful
+ */
+- (BOOL) runKeysetQuery:(NSMutableArray*)resultArray resultString:(NSMutableString*)resultString querySpec:(SFQuerySpec*)querySpec pageIndex:(NSUInteger)pageIndex continuationToken:(NSDictionary*)continuationToken nextContinuationToken:(NSDictionary**)nextContinuationToken error:(NSError**)error;
+
 
 /**
  Remove soup from cache
@@ -285,6 +419,12 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 - (FMResultSet*) executeQueryThrows:(NSString*)sql withArgumentsInArray:(NSArray*)arguments withDb:(FMDatabase*)db;
 
+/**
+ Run EXPLAIN QUERY PLAN for the given query
+ @return Dictionary with the explain sql (EXPLAIN_SQL), its arguments (EXPLAIN_ARGS) and the plan rows (EXPLAIN_ROWS)
+ */
+- (NSDictionary*) explainQueryPlan:(NSString*)sql withArgumentsInArray:(NSArray*)arguments withDb:(FMDatabase*)db;
+
 /**
  Execute update
  Log errors and throw exception in case of error
@@ -309,4 +449,10 @@ static NSString *const EXPLAIN_ROWS = @"rows";
  */
 - (BOOL)checkRawJson:(NSString*)rawJson fromMethod:(NSString*)fromMethod;
 
+/**
+ Attributes of the SmartStoreSlowQueries event posted by reportSlowQueries
+ @return The attributes, nil if the query profiler has not kept any query
+ */
+- (NSDictionary*) slowQueriesEventAttributes;
+
 @end
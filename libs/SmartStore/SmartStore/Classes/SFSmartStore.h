@@ -73,6 +73,21 @@ typedef SFEncryptionKey*  _Nullable (^SFSmartStoreEncryptionKeyBlock)(void) NS_S
  */
 typedef NSString* _Nullable (^SFSmartStoreEncryptionSaltBlock)(void) NS_SWIFT_NAME(EncryptionSaltBlock);
 
+/**
+ Block typedef for enumerating query results. Set *stop to YES to end the enumeration.
+ */
+typedef void (^SFSmartStoreQueryEnumerationBlock)(id entry, BOOL *stop) NS_SWIFT_NAME(QueryEnumerationBlock);
+
+/**
+ Block typedef for reporting re-index progress. Called after each chunk of entries has been committed.
+ */
+typedef void (^SFReIndexSoupProgressBlock)(NSUInteger reIndexedCount, NSUInteger totalCount) NS_SWIFT_NAME(ReIndexSoupProgressBlock);
+
+/**
+ Number of entries re-indexed per transaction when no chunk size is given.
+ */
+extern NSUInteger const kSFReIndexSoupDefaultChunkSize NS_SWIFT_NAME(SmartStore.reIndexSoupDefaultChunkSize);
+
 /**
  The columns of a soup table
  */
@@ -87,10 +102,13 @@ extern NSString *const SOUP_COL NS_SWIFT_NAME(SmartStore.soupColumn);
 extern NSString *const SOUP_ENTRY_ID NS_SWIFT_NAME(SmartStore.soupEntryId);
 extern NSString *const SOUP_LAST_MODIFIED_DATE NS_SWIFT_NAME(SmartStore.lastModifiedDate);
 
+@class FMDatabase;
 @class FMDatabaseQueue;
 @class SFQuerySpec;
 @class SFSoupSpec;
 @class SFUserAccount;
+@class SFSmartStoreQueryProfiler;
+@class SFSmartStoreIndexAdvisor;
 
 NS_SWIFT_NAME(SmartStore)
 @interface SFSmartStore : NSObject {
@@ -106,7 +124,15 @@ NS_SWIFT_NAME(SmartStore)
     NSCache *_soupNameToTableName;
     NSCache *_attrSpecBySoup;
     NSCache *_indexSpecsBySoup;
+    NSCache *_indexSpecsByPathBySoup;
     SFSmartSqlCache *_smartSqlToSql;
+    NSCache *_statementSqlByTable;
+    NSMutableDictionary *_nextEntryIdBySoupTable;
+    NSMutableDictionary *_pendingExternalWrites;
+    NSMutableSet *_pendingExternalDeletes;
+    NSMapTable *_indexProjectors;
+    FMDatabase *_stagingExternalWritesDb;
+    BOOL _publishingExternalWrites;
 }
 
 /**
@@ -127,12 +153,39 @@ NS_SWIFT_NAME(SmartStore)
 /**
  Flag to cause explain plan to be captured for every query
  */
-@property (nonatomic, assign) BOOL captureExplainQueryPlan NS_SWIFT_NAME(capturesExplainQueryPlan);
+@property (atomic, assign) BOOL captureExplainQueryPlan NS_SWIFT_NAME(capturesExplainQueryPlan);
+
+/**
+ Number of read-only connections used to run queries (queryWithQuerySpec, countWithQuerySpec and retrieveEntries)
+ concurrently with writes. Setting a value greater than 0 switches the database to WAL journal mode, setting it back to 0
+ restores the journal mode in use before. WAL being persistent, a store closed while the pool is on reopens in WAL mode.
+ Defaults to 0: all operations go through the serial store queue.
+ */
+@property (nonatomic, assign) NSUInteger readConnectionsCount;
 
 /**
- Dictionary with results of last explain query plan
+ Flag to load, decrypt and parse the files of soups using external storage concurrently (retrieveEntries and queries
+ returning whole entries). Rows are read from the database first, then files are loaded by a pool of at most one worker per core.
+ Defaults to NO: files are loaded one after another on the store queue.
  */
-@property (nonatomic, strong) NSDictionary *lastExplainQueryPlan;
+@property (nonatomic, assign) BOOL loadsExternalEntriesConcurrently;
+
+/**
+ Dictionary with results of last explain query plan, captured by whichever connection ran the last query
+ */
+@property (atomic, strong) NSDictionary *lastExplainQueryPlan;
+
+/**
+ Profiler recording the queries run through queryWithQuerySpec and countWithQuerySpec (sql, bind count, rows returned and scanned,
+ wall and cpu time), capturing the query plan of the ones slower than its threshold. Defaults to nil: queries are not profiled.
+ */
+@property (nonatomic, strong, nullable) SFSmartStoreQueryProfiler *queryProfiler;
+
+/**
+ Index advisor recording the smart sql converted by the store, to recommend indexes for the paths queries filter or sort on.
+ Defaults to nil: smart sql is not recorded.
+ */
+@property (nonatomic, strong, nullable) SFSmartStoreIndexAdvisor *indexAdvisor;
 
 /**
  All of the store names for the current user from this app.
@@ -299,6 +352,49 @@ NS_SWIFT_NAME(SmartStore)
  @return YES if successful
  */
 - (BOOL) queryAsString:(NSMutableString*)resultString querySpec:(SFQuerySpec *)querySpec pageIndex:(NSUInteger)pageIndex error:(NSError **)error NS_SWIFT_UNAVAILABLE("Use query(querySpec:pageIndex:) in native applications");
+
+/**
+ Search for entries matching the given query spec, seeking past the last row of the previous page
+ instead of skipping rows with an OFFSET: the cost of fetching a page no longer grows with its index.
+ Rows are ordered by the query spec's order path and then by soup entry id.
+ Smart query specs are not supported.
+
+ @param querySpec A native query spec.
+ @param continuationToken The token returned with the previous page - nil to get the first page.
+ @param nextContinuationToken Set to the token to pass to get the next page - nil when there are no more pages.
+ @param error Sets/returns any error generated as part of the process.
+
+ @return A set of entries given the pageSize provided in the querySpec.
+ */
+- (NSArray * __nullable)queryWithQuerySpec:(SFQuerySpec *)querySpec continuationToken:(nullable NSDictionary *)continuationToken nextContinuationToken:(NSDictionary * __nullable * __nullable)nextContinuationToken error:(NSError **)error NS_SWIFT_NAME(query(using:continuationToken:nextContinuationToken:));
+
+/**
+ Search for entries matching the given query spec using keyset pagination without deserializing any JSON
+
+ @param resultString A mutable string to which the result (serialized) is appended
+ @param querySpec A native query spec.
+ @param continuationToken The token returned with the previous page - nil to get the first page.
+ @param nextContinuationToken Set to the token to pass to get the next page - nil when there are no more pages.
+ @param error Sets/returns any error generated as part of the process.
+
+ @return YES if successful
+ */
+- (BOOL) queryAsString:(NSMutableString*)resultString querySpec:(SFQuerySpec *)querySpec continuationToken:(nullable NSDictionary *)continuationToken nextContinuationToken:(NSDictionary * __nullable * __nullable)nextContinuationToken error:(NSError **)error NS_SWIFT_UNAVAILABLE("Use query(using:continuationToken:nextContinuationToken:) in native applications");
+
+/**
+ Enumerate all the entries matching the given query spec, without paging.
+ The query is run once and its rows are decoded one at a time as the statement is stepped through,
+ so memory use does not grow with the number of results. Each entry (an array of values for smart queries
+ and queries with select paths) is handed to the block within its own autorelease pool.
+ The block is called while a database connection is held: it should not call back into this store.
+ 
+ @param querySpec A native query spec (its page size is ignored).
+ @param block The block called for each entry.
+ @param error Sets/returns any error generated as part of the process.
+ 
+ @return YES if successful
+ */
+- (BOOL) enumerateQuerySpec:(SFQuerySpec *)querySpec usingBlock:(SFSmartStoreQueryEnumerationBlock)block error:(NSError **)error NS_SWIFT_NAME(enumerate(using:block:));
 /**
   Experimental flag to do additional checks when reading back soup entries that use external storage
   It could be dropped in a future release. Use only if you know what you are doing.
@@ -473,6 +569,32 @@ NS_SWIFT_NAME(SmartStore)
  */
 - (BOOL) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray<NSString*>*)indexPaths NS_SWIFT_NAME(reIndexSoup(named:indexPaths:));
 
+/**
+ Reindex a soup, a chunk of entries per transaction.
+ The database is released between chunks so that other reads and writes can go through,
+ and progress is recorded in the long operations status table so that an interrupted
+ re-index picks up where it left off when resumeLongOperations is called.
+ 
+ @param soupName The name of the soup to alter.
+ @param indexPaths Array of on ore more paths to be reindexed.
+ @param chunkSize Number of entries re-indexed per transaction.
+ @param progressBlock Optional block called after each chunk.
+ @return YES if soup reindexing succeeded.
+ */
+- (BOOL) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray<NSString*>*)indexPaths chunkSize:(NSUInteger)chunkSize progress:(nullable SFReIndexSoupProgressBlock)progressBlock NS_SWIFT_NAME(reIndexSoup(named:indexPaths:chunkSize:progress:));
+
+/**
+ Merge the segments of the full-text index of a soup into one, to speed up full-text searches.
+ Large upserts defer most of that merging work: this call is meant to be scheduled when the device is idle
+ (e.g. from a background processing task), it can take a while on large soups.
+ Does nothing if the soup does not exist or does not have any full_text index.
+
+ @param soupName The name of the soup.
+ @param error Sets/returns any error generated as part of the process.
+ @return YES if the full-text index was optimized successfully.
+ */
+- (BOOL) optimizeFts:(NSString*)soupName error:(NSError**)error NS_SWIFT_NAME(optimizeFullTextIndex(forSoupNamed:));
+
 /**
  * Return SQLCipher runtime settings
  * @return An array with all the compile options used to build SQL Cipher.
@@ -491,6 +613,13 @@ NS_SWIFT_NAME(SmartStore)
  */
 - (NSString *)getSQLCipherVersion NS_SWIFT_NAME(versionOfSQLCipher());
 
+/**
+ Post the slowest queries kept by the query profiler to the analytics event pipeline (SmartStoreSlowQueries event).
+ Does nothing if the store has no query profiler or if it has not kept any query.
+ Only timings, row and step counts and query plan details are posted: neither the sql (which can contain literal values) nor the bound arguments.
+ */
+- (void) reportSlowQueries NS_SWIFT_NAME(reportSlowQueries());
+
 #pragma mark - Long operations recovery methods
 
 /**
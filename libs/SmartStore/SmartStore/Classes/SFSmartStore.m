@@ -28,6 +28,7 @@
 #import "FMDatabase.h"
 #import "FMDatabaseAdditions.h"
 #import "FMDatabaseQueue.h"
+#import "FMDatabasePool.h"
 #import <SalesforceSDKCommon/SFJsonUtils.h>
 #import "SFSmartStore+Internal.h"
 #import "SFSmartStoreUpgrade.h"
@@ -35,9 +36,12 @@
 #import "SFSmartSqlHelper.h"
 #import "SFSmartSqlCache.h"
 #import "SFSoupIndex.h"
+#import "SFSoupIndexProjector.h"
+#import "SFSoupFtsBuffer.h"
 #import "SFQuerySpec.h"
 #import "SFSoupSpec.h"
 #import "SFSoupSpec+Internal.h"
+#import "SFSoupCompositeIndex.h"
 #import <SalesforceSDKCore/SFPasscodeManager.h>
 #import <SalesforceSDKCore/SFKeyStoreManager.h>
 #import <SalesforceSDKCore/SFEncryptionKey.h>
@@ -45,6 +49,9 @@
 #import <SalesforceSDKCore/SFEncryptStream.h>
 #import <SalesforceSDKCore/SFDecryptStream.h>
 #import "SFAlterSoupLongOperation.h"
+#import "SFReIndexSoupLongOperation.h"
+#import "SFSmartStoreQueryProfiler.h"
+#import "SFSmartStoreIndexAdvisor.h"
 #import <SalesforceSDKCore/SFUserAccountManager.h>
 #import <SalesforceSDKCore/SFDirectoryManager.h>
 #import <SalesforceSDKCore/SalesforceSDKManager.h>
@@ -111,9 +118,170 @@ NSString *const SOUP_LAST_MODIFIED_DATE = @"_soupLastModifiedDate";
 NSString *const EXPLAIN_SQL = @"sql";
 NSString *const EXPLAIN_ARGS = @"args";
 
+// Re-index chunk size
+NSUInteger const kSFReIndexSoupDefaultChunkSize = 1000;
+
+// Number of entries parsed and projected concurrently while re-indexing
+static NSUInteger const kReIndexBatchSize = 256;
+
 // Caches count limit
 NSUInteger CACHES_COUNT_LIMIT = 1024;
 
+// Smart sql cache size limit (in bytes)
+NSUInteger SMART_SQL_CACHE_COST_LIMIT = 1024 * 1024;
+
+// Prepared statements count limit (statements are cached by fmdb, keyed by sql)
+static NSUInteger const kMaxCachedStatements = 256;
+
+// Bind variables limit per statement (SQLITE_MAX_VARIABLE_NUMBER default for sqlite < 3.32)
+static NSUInteger const kMaxBindVariables = 999;
+
+// Upserts of at least that many entries defer the merging of fts5 index segments
+static NSUInteger const kFtsBulkLoadMinEntries = 1000;
+
+// Fts5 merge settings (defaults are 4 and 16) used during bulk loads: no incremental merges, crisis merges only past 64 segments
+static int const kFtsBulkLoadAutomerge = 0;
+static int const kFtsBulkLoadCrisismerge = 64;
+
+#pragma mark - JSON result writer
+
+// Escape character for each ascii character: 0 when no escaping is needed, 'u' for \u00XX
+static const char kJsonEscapes[128] = {
+    [0 ... 0x1f] = 'u',
+    ['\b'] = 'b',
+    ['\t'] = 't',
+    ['\n'] = 'n',
+    ['\f'] = 'f',
+    ['\r'] = 'r',
+    ['"'] = '"',
+    ['/'] = '/',
+    ['\\'] = '\\',
+};
+
+static inline void SFAppendJsonLiteral(NSMutableData *buffer, const char *literal) {
+    [buffer appendBytes:literal length:strlen(literal)];
+}
+
+// Separates values of a json array: the array is opened when the buffer is created
+static inline void SFAppendJsonSeparator(NSMutableData *buffer) {
+    if (buffer.length > 1) {
+        [buffer appendBytes:"," length:1];
+    }
+}
+
+static inline void SFAppendJsonString(NSMutableData *buffer, NSString *string) {
+    const char *utf8 = string.UTF8String;
+    [buffer appendBytes:utf8 length:strlen(utf8)];
+}
+
+// Appends the utf8 bytes quoted and escaped. Non-ascii bytes are copied as is.
+static void SFAppendJsonEscapedValue(NSMutableData *buffer, const unsigned char *bytes, int length) {
+    static const char hexDigits[] = "0123456789abcdef";
+    [buffer appendBytes:"\"" length:1];
+    int runStart = 0;
+    for (int i = 0; i < length; i++) {
+        unsigned char c = bytes[i];
+        char escape = c < 128 ? kJsonEscapes[c] : 0;
+        if (escape == 0) {
+            continue;
+        }
+        if (i > runStart) {
+            [buffer appendBytes:bytes + runStart length:i - runStart];
+        }
+        if (escape == 'u') {
+            char sequence[6] = { '\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xf] };
+            [buffer appendBytes:sequence length:sizeof(sequence)];
+        } else {
+            char sequence[2] = { '\\', escape };
+            [buffer appendBytes:sequence length:sizeof(sequence)];
+        }
+        runStart = i + 1;
+    }
+    if (length > runStart) {
+        [buffer appendBytes:bytes + runStart length:length - runStart];
+    }
+    [buffer appendBytes:"\"" length:1];
+}
+
+#pragma mark - Result rows
+
+// How the value of a result column is returned
+typedef NS_ENUM(uint8_t, SFResultColumnKind) {
+    SFResultColumnKindValue,        // atomic value
+    SFResultColumnKindSoup,         // serialized soup entry (soup column or soup:xxx alias)
+    SFResultColumnKindExternalSoup  // table name of an entry kept in external storage, followed by the entry id column
+};
+
+// Column kinds only depend on column names: they are computed once per statement rather than once per row
+static NSData *SFRowLayout(sqlite3_stmt *statement, int columnCount) {
+    const char *soupColName = SOUP_COL.UTF8String;
+    size_t soupColNameLength = strlen(soupColName);
+    const char *externalSoupColName = kSoupFeatureExternalStorage.UTF8String;
+    NSMutableData *layout = [NSMutableData dataWithLength:MAX(columnCount, 0) * sizeof(SFResultColumnKind)];
+    SFResultColumnKind *kinds = layout.mutableBytes;
+    for (int i = 0; i < columnCount; i++) {
+        const char *columnName = sqlite3_column_name(statement, i);
+        if (strncmp(columnName, soupColName, soupColNameLength) == 0
+            && (columnName[soupColNameLength] == '\0' || columnName[soupColNameLength] == ':')) {
+            kinds[i] = SFResultColumnKindSoup;
+        } else if (strcmp(columnName, externalSoupColName) == 0) {
+            kinds[i] = SFResultColumnKindExternalSoup;
+        } else {
+            kinds[i] = SFResultColumnKindValue;
+        }
+    }
+    return layout;
+}
+
+// Value of a column read straight from the statement (same types as -[FMResultSet objectForColumnIndex:])
+static id SFColumnValue(sqlite3_stmt *statement, int i) {
+    switch (sqlite3_column_type(statement, i)) {
+        case SQLITE_INTEGER:
+            return @(sqlite3_column_int64(statement, i));
+        case SQLITE_FLOAT:
+            return @(sqlite3_column_double(statement, i));
+        case SQLITE_TEXT: {
+            const unsigned char *text = sqlite3_column_text(statement, i);
+            NSString *value = [[NSString alloc] initWithBytes:text length:sqlite3_column_bytes(statement, i) encoding:NSUTF8StringEncoding];
+            return value ?: [NSNull null];
+        }
+        case SQLITE_BLOB: {
+            const void *blob = sqlite3_column_blob(statement, i);
+            return [NSData dataWithBytes:blob length:sqlite3_column_bytes(statement, i)];
+        }
+        default:
+            return [NSNull null];
+    }
+}
+
+#pragma mark - Query profiling
+
+// Measures taken while running a profiled query
+typedef struct {
+    uint64_t wallStart;  // ns
+    uint64_t cpuStart;   // ns of cpu time of the calling thread
+    int rowsScanned;
+    int vmSteps;
+} SFQueryProfileSample;
+
+static void SFQueryProfileStart(SFQueryProfileSample *sample) {
+    sample->wallStart = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    sample->cpuStart = clock_gettime_nsec_np(CLOCK_THREAD_CPUTIME_ID);
+    sample->rowsScanned = 0;
+    sample->vmSteps = 0;
+}
+
+// Statements are cached and reused: their counters are reset once the query is prepared and read before it is closed
+static void SFQueryProfileResetCounters(sqlite3_stmt *statement) {
+    sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_VM_STEP, 1);
+}
+
+static void SFQueryProfileReadCounters(SFQueryProfileSample *sample, sqlite3_stmt *statement) {
+    sample->rowsScanned = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+    sample->vmSteps = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_VM_STEP, 0);
+}
+
 @implementation SFSmartStore
 
 + (void)initialize
@@ -202,7 +370,18 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
         _indexSpecsBySoup = [[NSCache alloc] init];
         _indexSpecsBySoup.countLimit = CACHES_COUNT_LIMIT;
         
-        _smartSqlToSql = [[SFSmartSqlCache alloc] initWithCountLimit:CACHES_COUNT_LIMIT];
+        _indexSpecsByPathBySoup = [[NSCache alloc] init];
+        _indexSpecsByPathBySoup.countLimit = CACHES_COUNT_LIMIT;
+        
+        _smartSqlToSql = [[SFSmartSqlCache alloc] initWithCountLimit:CACHES_COUNT_LIMIT totalCostLimit:SMART_SQL_CACHE_COST_LIMIT];
+        
+        _statementSqlByTable = [[NSCache alloc] init];
+        _statementSqlByTable.countLimit = CACHES_COUNT_LIMIT;
+        
+        _nextEntryIdBySoupTable = [NSMutableDictionary new];
+        _pendingExternalWrites = [NSMutableDictionary new];
+        _pendingExternalDeletes = [NSMutableSet new];
+        _indexProjectors = [NSMapTable weakToStrongObjectsMapTable];
         
         // Using FTS5 by default
         _ftsExtension = SFSmartStoreFTS5;
@@ -223,17 +402,30 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
         
         // Register features in soup attributes table.
         [self registerNewSoupAttribute:kSoupFeatureExternalStorage];
+        [self registerNewSoupAttribute:kSoupFeatureGeneratedColumns];
+        [self registerNewSoupAttribute:kSoupFeatureMaterializedCounts];
+        
+        // Stores created before fts options / composite indexes were supported don't have these columns
+        [self addMetaTextColumn:OPTIONS_COL toTable:SOUP_INDEX_MAP_TABLE];
+        [self addMetaTextColumn:COMPOSITE_INDEXES_COL toTable:SOUP_ATTRS_TABLE];
     }
     return self;
 }
 
 - (void)dealloc {
     [SFSDKSmartStoreLogger d:[self class] format:@"dealloc store: '%@'", _storeName];
+    [self closeReadPool];
     [self.storeQueue close];
     SFRelease(_soupNameToTableName);
     SFRelease(_attrSpecBySoup);
     SFRelease(_indexSpecsBySoup);
+    SFRelease(_indexSpecsByPathBySoup);
     SFRelease(_smartSqlToSql);
+    SFRelease(_statementSqlByTable);
+    SFRelease(_nextEntryIdBySoupTable);
+    SFRelease(_pendingExternalWrites);
+    SFRelease(_pendingExternalDeletes);
+    SFRelease(_indexProjectors);
     
     //remove data protection observer
     [[NSNotificationCenter defaultCenter] removeObserver:_dataProtectAvailObserverToken];
@@ -308,10 +500,79 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     self.storeQueue = [self.dbMgr openStoreQueueWithName:self.storeName key:[[self class] encKey] salt:salt error:&openDbError];
     if (self.storeQueue == nil) {
         [SFSDKSmartStoreLogger e:[self class] format:@"Error opening store '%@': %@", self.storeName, [openDbError localizedDescription]];
+    } else {
+        // Insert/update sql is generated with a canonical column order (see insertIntoTable / updateTable)
+        // so that prepared statements can be reused across upserts
+        [self.storeQueue inDatabase:^(FMDatabase *db) {
+            [db setShouldCacheStatements:YES];
+        }];
+        if (self.readConnectionsCount > 0) {
+            [self openReadPool];
+        }
     }
     return (self.storeQueue != nil);
 }
 
+#pragma mark - Read pool
+
+// NB: the store queue is never entered while holding @synchronized(self) since readers take that lock from within store queue blocks
+- (void)setReadConnectionsCount:(NSUInteger)readConnectionsCount {
+    [self closeReadPool];
+    @synchronized (self) {
+        _readConnectionsCount = readConnectionsCount;
+    }
+    if (self.storeQueue == nil) {
+        return;
+    }
+    if (readConnectionsCount > 0) {
+        [self openReadPool];
+    } else {
+        [self restoreJournalMode];
+    }
+}
+
+- (void)openReadPool {
+    [self closeReadPool];
+    
+    // Readers don't block the writer (and vice versa) in WAL mode
+    // journalModeBeforeReadPool is only accessed on the store queue
+    [self.storeQueue inDatabase:^(FMDatabase *db) {
+        if (self.journalModeBeforeReadPool == nil) {
+            self.journalModeBeforeReadPool = [db stringForQuery:@"PRAGMA journal_mode"];
+        }
+        sqlite3_exec(db.sqliteHandle, "PRAGMA journal_mode = WAL;", 0, 0, 0);
+    }];
+    
+    NSString *salt = [[self class] encryptionSaltBlock] ? [[self class] encryptionSaltBlock]() : nil;
+    NSUInteger readConnectionsCount = self.readConnectionsCount;
+    FMDatabasePool *readPool = [self.dbMgr openStoreReadPoolWithName:self.storeName key:[[self class] encKey] salt:salt maximumNumberOfConnections:readConnectionsCount];
+    @synchronized (self) {
+        [self.readPool releaseAllDatabases];
+        self.readPool = readPool;
+        self.readPoolSemaphore = dispatch_semaphore_create(readConnectionsCount);
+    }
+}
+
+- (void)closeReadPool {
+    @synchronized (self) {
+        [self.readPool releaseAllDatabases];
+        self.readPool = nil;
+        self.readPoolSemaphore = nil;
+    }
+}
+
+- (void)restoreJournalMode {
+    [self.storeQueue inDatabase:^(FMDatabase *db) {
+        NSString *journalMode = self.journalModeBeforeReadPool;
+        if (journalMode == nil || [journalMode caseInsensitiveCompare:@"wal"] == NSOrderedSame) {
+            return;
+        }
+        NSString *sql = [NSString stringWithFormat:@"PRAGMA journal_mode = %@;", journalMode];
+        sqlite3_exec(db.sqliteHandle, [sql UTF8String], 0, 0, 0);
+        self.journalModeBeforeReadPool = nil;
+    }];
+}
+
 - (NSString *)storePath {
     if (self.storeName.length == 0)
         return nil;
@@ -394,6 +655,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
         NSString *userKey = [SFSmartStoreUtils userKeyForUser:user];
         SFSmartStore *existingStore = _allSharedStores[userKey][storeName];
         if (nil != existingStore) {
+            [existingStore closeReadPool];
             [existingStore.storeQueue close];
             [_allSharedStores[userKey] removeObjectForKey:storeName];
         }
@@ -407,6 +669,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
         [SFSDKSmartStoreLogger d:[self class] format:@"%@ %@", NSStringFromSelector(_cmd), storeName];
         SFSmartStore *existingStore = _allGlobalSharedStores[storeName];
         if (nil != existingStore) {
+            [existingStore closeReadPool];
             [existingStore.storeQueue close];
             [_allGlobalSharedStores removeObjectForKey:storeName];
         }
@@ -476,12 +739,13 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 - (void)createMetaTablesWithDb:(FMDatabase*) db {
     // Create SOUP_INDEX_MAP_TABLE
     NSString *createSoupIndexTableSql = [NSString stringWithFormat:
-                                         @"CREATE TABLE IF NOT EXISTS %@ (%@ TEXT, %@ TEXT, %@ TEXT, %@ TEXT )",
+                                         @"CREATE TABLE IF NOT EXISTS %@ (%@ TEXT, %@ TEXT, %@ TEXT, %@ TEXT, %@ TEXT )",
                                          SOUP_INDEX_MAP_TABLE,
                                          SOUP_NAME_COL,
                                          PATH_COL,
                                          COLUMN_NAME_COL,
-                                         COLUMN_TYPE_COL
+                                         COLUMN_TYPE_COL,
+                                         OPTIONS_COL
                                          ];
     [SFSDKSmartStoreLogger d:[self class] format:@"createSoupIndexTableSql: %@", createSoupIndexTableSql];
 
@@ -523,13 +787,28 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     } error:nil];
 }
 
+- (void)addMetaTextColumn:(NSString *)colName toTable:(NSString *)tableName
+{
+    [self inDatabase:^(FMDatabase *db) {
+        if (![db columnExists:colName inTableWithName:tableName]) {
+            NSString *addColSql = [NSString stringWithFormat:
+                                   @"ALTER TABLE %@ ADD COLUMN %@ TEXT",
+                                   tableName,
+                                   colName
+                                   ];
+            [SFSDKSmartStoreLogger d:[self class] format:@"addColSql: %@", addColSql];
+            [self executeUpdateThrows:addColSql withDb:db];
+        }
+    } error:nil];
+}
+
 - (NSArray *)registeredSoupFeaturesWithDb:(FMDatabase*)db
 {
     NSMutableArray *result = [[NSMutableArray alloc] init];
     FMResultSet *attrsSchema = [db getTableSchema:SOUP_ATTRS_TABLE];
     while ([attrsSchema next]) {
         NSString *col = [attrsSchema stringForColumn:@"name"];
-        if (![col isEqualToString:ID_COL] && ![col isEqualToString:SOUP_NAME_COL]) {
+        if (![col isEqualToString:ID_COL] && ![col isEqualToString:SOUP_NAME_COL] && ![col isEqualToString:COMPOSITE_INDEXES_COL]) {
             [result addObject:col];
         }
     }
@@ -571,7 +850,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 {
     // TODO call after opening db
     NSArray* longOperations = [self getLongOperations];
-    for(SFAlterSoupLongOperation* longOperation in longOperations) {
+    for(id longOperation in longOperations) {
         [longOperation run];
     }
 }
@@ -589,17 +868,21 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 {
     NSMutableArray* longOperations = [NSMutableArray array];
     
-    // TODO assuming all long operations are alter soup operations
-    //      revisit when we introduced another type of long operation
-    
-    FMResultSet* frs = [self queryTable:LONG_OPERATIONS_STATUS_TABLE forColumns:@[ID_COL, DETAILS_COL, STATUS_COL] orderBy:nil limit:nil whereClause:nil whereArgs:nil withDb:db];
+    FMResultSet* frs = [self queryTable:LONG_OPERATIONS_STATUS_TABLE forColumns:@[ID_COL, TYPE_COL, DETAILS_COL, STATUS_COL] orderBy:ID_COL limit:nil whereClause:nil whereArgs:nil withDb:db];
     
     while([frs next]) {
         long rowId = [frs longForColumn:ID_COL];
+        NSString *type = [frs stringForColumn:TYPE_COL];
         NSDictionary *details = [SFJsonUtils objectFromJSONString:[frs stringForColumn:DETAILS_COL]];
-        SFAlterSoupStep status = (SFAlterSoupStep)[frs intForColumn:STATUS_COL];
-        SFAlterSoupLongOperation *longOperation = [[SFAlterSoupLongOperation alloc] initWithStore:self rowId:rowId details:details status:status];
-        [longOperations addObject:longOperation];
+        if ([type isEqualToString:kSFReIndexSoupLongOperationType]) {
+            SFReIndexSoupLongOperation *longOperation = [[SFReIndexSoupLongOperation alloc] initWithStore:self rowId:rowId details:details];
+            [longOperations addObject:longOperation];
+        } else {
+            // Alter soup operation
+            SFAlterSoupStep status = (SFAlterSoupStep)[frs intForColumn:STATUS_COL];
+            SFAlterSoupLongOperation *longOperation = [[SFAlterSoupLongOperation alloc] initWithStore:self rowId:rowId details:details status:status];
+            [longOperations addObject:longOperation];
+        }
     }
     [frs close];
     
@@ -617,23 +900,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 
 - (FMResultSet*) executeQueryThrows:(NSString*)sql withArgumentsInArray:(NSArray*)arguments withDb:(FMDatabase*)db {
     if (self.captureExplainQueryPlan) {
-        NSString* explainSql = [NSString stringWithFormat:@"EXPLAIN QUERY PLAN %@", sql];
-        NSMutableDictionary* lastPlan = [NSMutableDictionary new];
-        lastPlan[EXPLAIN_SQL] = explainSql;
-        if (arguments.count > 0) lastPlan[EXPLAIN_ARGS] = arguments;
-        NSMutableArray* explainRows = [NSMutableArray new];
-        
-        FMResultSet* frs = [db executeQuery:explainSql withArgumentsInArray:arguments];
-        while ([frs next]) {
-            NSMutableDictionary* explainRow = [NSMutableDictionary new];
-            for (int i=0; i<frs.columnCount; i++) {
-                explainRow[[frs columnNameForIndex:i]] = [frs stringForColumnIndex:i];
-            }
-            [explainRows addObject:explainRow];
-        }
-        [frs close];
-        lastPlan[EXPLAIN_ROWS] = explainRows;
-        self.lastExplainQueryPlan = lastPlan;
+        self.lastExplainQueryPlan = [self explainQueryPlan:sql withArgumentsInArray:arguments withDb:db];
     }
     
     FMResultSet* result = [db executeQuery:sql withArgumentsInArray:arguments];
@@ -643,6 +910,45 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     return result;
 }
 
+- (NSDictionary*) explainQueryPlan:(NSString*)sql withArgumentsInArray:(NSArray*)arguments withDb:(FMDatabase*)db {
+    NSString* explainSql = [NSString stringWithFormat:@"EXPLAIN QUERY PLAN %@", sql];
+    NSMutableDictionary* plan = [NSMutableDictionary new];
+    plan[EXPLAIN_SQL] = explainSql;
+    if (arguments.count > 0) plan[EXPLAIN_ARGS] = arguments;
+    NSMutableArray* explainRows = [NSMutableArray new];
+    
+    FMResultSet* frs = [db executeQuery:explainSql withArgumentsInArray:arguments];
+    while ([frs next]) {
+        NSMutableDictionary* explainRow = [NSMutableDictionary new];
+        for (int i=0; i<frs.columnCount; i++) {
+            explainRow[[frs columnNameForIndex:i]] = [frs stringForColumnIndex:i];
+        }
+        [explainRows addObject:explainRow];
+    }
+    [frs close];
+    plan[EXPLAIN_ROWS] = explainRows;
+    return plan;
+}
+
+- (void) recordQueryProfile:(SFQueryProfileSample*)sample profiler:(SFSmartStoreQueryProfiler*)profiler smartSql:(NSString*)smartSql sql:(NSString*)sql args:(NSArray*)args rowsReturned:(NSUInteger)rowsReturned withDb:(FMDatabase*)db {
+    double wallTime = (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - sample->wallStart) / 1e6;
+    double cpuTime = (clock_gettime_nsec_np(CLOCK_THREAD_CPUTIME_ID) - sample->cpuStart) / 1e6;
+    NSMutableDictionary* profile = [NSMutableDictionary new];
+    profile[kSFQueryProfileSmartSql] = smartSql;
+    profile[kSFQueryProfileSql] = sql;
+    profile[kSFQueryProfileBindCount] = @(args.count);
+    profile[kSFQueryProfileRowsReturned] = @(rowsReturned);
+    profile[kSFQueryProfileRowsScanned] = @(sample->rowsScanned);
+    profile[kSFQueryProfileVmSteps] = @(sample->vmSteps);
+    profile[kSFQueryProfileWallTime] = @(wallTime);
+    profile[kSFQueryProfileCpuTime] = @(cpuTime);
+    if (wallTime >= profiler.slowQueryThreshold) {
+        [SFSDKSmartStoreLogger i:[self class] format:@"Slow query (%.1f ms): %@", wallTime, sql];
+        profile[kSFQueryProfilePlan] = [self explainQueryPlan:sql withArgumentsInArray:args withDb:db][EXPLAIN_ROWS];
+    }
+    [profiler recordProfile:profile];
+}
+
 - (void) executeUpdateThrows:(NSString*)sql withDb:(FMDatabase*)db {
     BOOL result = [db executeUpdate:sql];
     if (!result) {
@@ -665,6 +971,8 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 {
     __block BOOL success = YES;
     [self.storeQueue inDatabase:^(FMDatabase* db) {
+        // Id counters are only trusted within a block: a rollback or a write made outside of these wrappers would invalidate them
+        [self->_nextEntryIdBySoupTable removeAllObjects];
         @try {
             block(db);
         }
@@ -674,29 +982,106 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
             }
             success = NO;
         }
+        [self pruneCachedStatementsWithDb:db];
     }];
     return success;
 }
 
-- (BOOL)inTransaction:(void (^)(FMDatabase *db, BOOL *rollback))block error:(NSError* __autoreleasing *)error {
+- (BOOL)inReadDatabase:(void (^)(FMDatabase *db))block error:(NSError* __autoreleasing *)error
+{
+    FMDatabasePool *readPool;
+    dispatch_semaphore_t readPoolSemaphore;
+    @synchronized (self) {
+        readPool = self.readPool;
+        readPoolSemaphore = self.readPoolSemaphore;
+    }
+    if (readPool == nil) {
+        return [self inDatabase:block error:error];
+    }
+    
+    // The pool hands out a nil database once all its connections are in use: waiting for one to be returned instead
+    dispatch_semaphore_wait(readPoolSemaphore, DISPATCH_TIME_FOREVER);
     __block BOOL success = YES;
-    [self.storeQueue inTransaction:^(FMDatabase* db, BOOL *rollback) {
+    __block BOOL ranOnPool = NO;
+    [readPool inDatabase:^(FMDatabase* db) {
+        if (db == nil) {
+            return;
+        }
+        ranOnPool = YES;
         @try {
-            block(db, rollback);
+            block(db);
         }
         @catch (NSException *exception) {
-            if (rollback) {
-                *rollback = YES;
+            if (error != nil) {
+                *error = [self errorForException:exception];
+            }
+            success = NO;
+        }
+        [self pruneCachedStatementsWithDb:db];
+    }];
+    dispatch_semaphore_signal(readPoolSemaphore);
+    
+    if (!ranOnPool) {
+        // Read-only connection could not be opened
+        return [self inDatabase:block error:error];
+    }
+    return success;
+}
+
+// Same as FMDatabaseQueue's inTransaction, except that external storage files written by the block
+// are staged before commit and published once the commit succeeded (or discarded on rollback)
+// Returns NO with an error if the transaction committed but some files could not be published
+- (BOOL)inTransaction:(void (^)(FMDatabase *db, BOOL *rollback))block error:(NSError* __autoreleasing *)error {
+    __block BOOL success = YES;
+    [self.storeQueue inDatabase:^(FMDatabase* db) {
+        [self->_nextEntryIdBySoupTable removeAllObjects];
+        BOOL rollback = NO;
+        [db beginTransaction];
+        [self beginExternalWrites:db];
+        @try {
+            block(db, &rollback);
+            if (!rollback) {
+                [self stageExternalWrites];
             }
+        }
+        @catch (NSException *exception) {
+            rollback = YES;
             if (error != nil) {
                 *error = [self errorForException:exception];
             }
             success = NO;
         }
+        if (rollback) {
+            [db rollback];
+            [self endExternalWrites:NO error:nil];
+        } else if ([db commit]) {
+            // The transaction stays committed: reporting files that could not be published
+            if (![self endExternalWrites:YES error:error]) {
+                success = NO;
+            }
+        } else {
+            if (error != nil) {
+                *error = [db lastError];
+            }
+            success = NO;
+            [db rollback];
+            [self endExternalWrites:NO error:nil];
+        }
+        [self pruneCachedStatementsWithDb:db];
     }];
     return success;
 }
 
+// Queries with inlined values (e.g. id lists) produce one-off statements
+// Dropping all the cached statements once there are too many keeps the cache bounded
+- (void)pruneCachedStatementsWithDb:(FMDatabase*)db
+{
+    if (db.cachedStatements.count > kMaxCachedStatements) {
+        [SFSDKSmartStoreLogger d:[self class] format:@"Clearing %lu cached statements", (unsigned long) db.cachedStatements.count];
+        [db clearCachedStatements];
+    }
+}
+
 - (NSError*) errorForException:(NSException*)exception
 {
     return [NSError errorWithDomain:kSFSmartStoreErrorDomain
@@ -812,96 +1197,242 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                     soupEntryId:(NSNumber *)soupEntryId
                   soupTableName:(NSString *)soupTableName {
     
-    // Helper to log messages
-    void (^log)(NSString* step) = ^(NSString* step) {
-        NSString *message = [NSString stringWithFormat:@"%@ (%@): soupEntryId: %@, soupTableName: %@",
-                             NSStringFromSelector(_cmd),
-                             step,
-                             soupEntryId,
-                             soupTableName];
-        [SFSDKSmartStoreLogger i:[self class] format:message];
-    };
-    
     // Computing file path for soup entry
     NSString *filePath = [self externalStorageSoupFilePath:soupEntryId
                                              soupTableName:soupTableName];
     if (filePath == nil) {
         return NO;
     }
+    
+    // Inside a transaction: the file will be written before commit (see stageExternalWrites)
+    @synchronized (_pendingExternalWrites) {
+        if (_stagingExternalWritesDb) {
+            _pendingExternalWrites[filePath] = soupEntry;
+            [_pendingExternalDeletes removeObject:filePath];
+            return YES;
+        }
+    }
 
-    // Computing tmp file path
     // Entry is written to tmp file first, then tmp file is renamed to make write closer to an atomic operation
-    NSString *tmpFilePath = [NSString stringWithFormat:@"%@_tmp", filePath];
+    NSString *tmpFilePath = [self tmpFilePathForExternalFile:filePath];
+    SFSmartStoreEncryptionKeyBlock keyBlock = [SFSmartStore encryptionKeyBlock];
+    NSError *error = nil;
+    BOOL success = [self writeExternalSoupEntry:soupEntry toFile:tmpFilePath encKey:keyBlock ? keyBlock() : nil error:&error]
+        && [self publishExternalFile:tmpFilePath toPath:filePath error:&error];
+    
+    if (!success) {
+        NSString *errorMessage = [NSString stringWithFormat:@"Saving external soup to file failed! encrypted: %@, soupEntryId: %@, soupTableName: %@, tmpFilePath: '%@', filePath: '%@', error: %@.",
+                                  keyBlock ? @"YES" : @"NO",
+                                  soupEntryId,
+                                  soupTableName,
+                                  tmpFilePath,
+                                  filePath,
+                                  error];
+        [SFSDKSmartStoreLogger e:[self class] format:errorMessage];
+    }
     
+    return success;
+}
+
+- (NSString *)tmpFilePathForExternalFile:(NSString *)filePath {
+    return [NSString stringWithFormat:@"%@_tmp", filePath];
+}
+
+- (BOOL)writeExternalSoupEntry:(NSDictionary *)soupEntry
+                        toFile:(NSString *)filePath
+                        encKey:(SFEncryptionKey *)encKey
+                         error:(NSError **)error {
     // Setting up output stream
     NSOutputStream *outputStream = nil;
-    SFSmartStoreEncryptionKeyBlock keyBlock = [SFSmartStore encryptionKeyBlock];
-    if (keyBlock) {
-        SFEncryptStream *encryptStream = [[SFEncryptStream alloc] initToFileAtPath:tmpFilePath append:NO];
-        SFEncryptionKey *encKey = keyBlock();
+    if (encKey) {
+        SFEncryptStream *encryptStream = [[SFEncryptStream alloc] initToFileAtPath:filePath append:NO];
         [encryptStream setupWithEncryptionKey:encKey];
         outputStream = encryptStream;
     } else {
-        outputStream = [[NSOutputStream alloc] initToFileAtPath:tmpFilePath append:NO];
+        outputStream = [[NSOutputStream alloc] initToFileAtPath:filePath append:NO];
     }
     
-    // Writing to tmp file
-    log(@"1/4 Starting to write to tmp file");
     [outputStream open];
-    NSError *error = nil;
+    NSError *writeError = nil;
     
-    // NSJSONSerialization:writeJSONObject returns the number of bytes written
+    // NSJSONSerialization:writeJSONObject returns the number of bytes written
     // So NSJSONSerialization:writeJSONObject can return a value > 0 while there is an error
     [NSJSONSerialization writeJSONObject:soupEntry
                                 toStream:outputStream
                                  options:0
-                                   error:&error];
+                                   error:&writeError];
     [outputStream close];
     
-    if (error) {
-        [SFSmartStore buildEventOnJsonSerializationErrorForUser:self.user fromMethod:NSStringFromSelector(_cmd) error:error];
+    if (writeError) {
+        [SFSmartStore buildEventOnJsonSerializationErrorForUser:self.user fromMethod:NSStringFromSelector(_cmd) error:writeError];
+        if (error) {
+            *error = writeError;
+        }
+        return NO;
     }
+    return YES;
+}
 
-    BOOL success = !error;
-    
-    // Renaming tmp file by using moveItemAtPath (but first check if destination exists and deletes it if it does)
-    if (success) {
-        log(@"2/4 Done writing to tmp file");
-        log(@"3/4 Renaming tmp file");
-        
-        if ([[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
-            success = [[NSFileManager defaultManager] removeItemAtPath:filePath
-                                                                 error:&error];
+// rename(2) atomically replaces the destination if it exists
+- (BOOL)publishExternalFile:(NSString *)tmpFilePath toPath:(NSString *)filePath error:(NSError **)error {
+    if (rename(tmpFilePath.fileSystemRepresentation, filePath.fileSystemRepresentation) != 0) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
         }
+        return NO;
+    }
+    return YES;
+}
 
-        if (success) {
-            success = [[NSFileManager defaultManager] moveItemAtPath:tmpFilePath toPath:filePath error:&error];
-            
-            if (success) {
-                log(@"4/4 Done renaming tmp file");
+#pragma mark - Transactional external storage writes
+
+- (void)beginExternalWrites:(FMDatabase *)db {
+    @synchronized (_pendingExternalWrites) {
+        [_pendingExternalWrites removeAllObjects];
+        [_pendingExternalDeletes removeAllObjects];
+        _stagingExternalWritesDb = db;
+    }
+}
+
+/**
+ Writes the entries saved during the current transaction to their tmp files, concurrently (at most one worker per core).
+ Throws if any of them could not be written: the transaction is then rolled back and the tmp files discarded.
+ */
+- (void)stageExternalWrites {
+    NSArray *filePaths;
+    NSArray *entries;
+    @synchronized (_pendingExternalWrites) {
+        filePaths = [_pendingExternalWrites allKeys];
+        entries = [_pendingExternalWrites objectsForKeys:filePaths notFoundMarker:[NSNull null]];
+    }
+    if (filePaths.count == 0) {
+        return;
+    }
+    
+    SFSmartStoreEncryptionKeyBlock keyBlock = [SFSmartStore encryptionKeyBlock];
+    SFEncryptionKey *encKey = keyBlock ? keyBlock() : nil;
+    __block NSError *failure = nil;
+    NSObject *failureLock = [NSObject new];
+    dispatch_apply(filePaths.count, DISPATCH_APPLY_AUTO, ^(size_t i) {
+        @autoreleasepool {
+            NSError *error = nil;
+            if (![self writeExternalSoupEntry:entries[i] toFile:[self tmpFilePathForExternalFile:filePaths[i]] encKey:encKey error:&error]) {
+                @synchronized (failureLock) {
+                    failure = failure ?: error;
+                }
             }
         }
-    }
+    });
     
-    if (!success) {
-        NSString *errorMessage = [NSString stringWithFormat:@"Saving external soup to file failed! encrypted: %@, soupEntryId: %@, soupTableName: %@, tmpFilePath: '%@', filePath: '%@', error: %@.",
-                                  keyBlock ? @"YES" : @"NO",
-                                  soupEntryId,
-                                  soupTableName,
-                                  tmpFilePath,
-                                  filePath,
-                                  error];
+    if (failure) {
+        NSString *errorMessage = [NSString stringWithFormat:@"Saving %lu external soup files failed! encrypted: %@, error: %@.",
+                                  (unsigned long) filePaths.count,
+                                  encKey ? @"YES" : @"NO",
+                                  failure];
         [SFSDKSmartStoreLogger e:[self class] format:errorMessage];
+        @throw [NSException exceptionWithName:@"Failed to save external soup file."
+                                       reason:errorMessage
+                                     userInfo:nil];
+    }
+}
+
+/**
+ Ends the current transaction. If it was committed, staged files get renamed to their final path and deleted entries get their files removed.
+ Otherwise staged files are deleted and deleted entries keep their files.
+ A failed rename is retried once (after re-creating the soup directory): if it fails again, the tmp file is left behind and an error is returned.
+ */
+- (BOOL)endExternalWrites:(BOOL)committed error:(NSError **)error {
+    NSArray *filePaths;
+    NSArray *deletedFilePaths;
+    @synchronized (_pendingExternalWrites) {
+        filePaths = [_pendingExternalWrites allKeys];
+        deletedFilePaths = committed ? [_pendingExternalDeletes allObjects] : @[];
+        [_pendingExternalDeletes removeAllObjects];
+        _stagingExternalWritesDb = nil;
+        _publishingExternalWrites = committed;
+    }
+    for (NSString *filePath in deletedFilePaths) {
+        int deleteErrno = unlink(filePath.fileSystemRepresentation) == 0 ? 0 : errno;
+        if (deleteErrno != 0 && deleteErrno != ENOENT) {
+            [SFSDKSmartStoreLogger e:[self class] format:@"Failed to delete external entry at path '%@', errno: %d.", filePath, deleteErrno];
+        }
+    }
+    NSMutableArray *failedFilePaths = [NSMutableArray new];
+    NSError *publishError = nil;
+    for (NSString *filePath in filePaths) {
+        NSString *tmpFilePath = [self tmpFilePathForExternalFile:filePath];
+        if (committed) {
+            NSError *renameError = nil;
+            if (![self publishExternalFile:tmpFilePath toPath:filePath error:&renameError]) {
+                [SFDirectoryManager ensureDirectoryExists:[filePath stringByDeletingLastPathComponent] error:nil];
+                if (![self publishExternalFile:tmpFilePath toPath:filePath error:&renameError]) {
+                    [SFSDKSmartStoreLogger e:[self class] format:@"Failed to rename external file '%@', error: %@.", tmpFilePath, renameError];
+                    [failedFilePaths addObject:filePath];
+                    publishError = publishError ?: renameError;
+                }
+            }
+        } else {
+            unlink(tmpFilePath.fileSystemRepresentation);
+        }
+    }
+    // Released only now so that all connections see committed entries until their files are renamed
+    @synchronized (_pendingExternalWrites) {
+        [_pendingExternalWrites removeAllObjects];
+        _publishingExternalWrites = NO;
     }
     
-    return success;
+    if (failedFilePaths.count > 0) {
+        if (error) {
+            NSString *reason = [NSString stringWithFormat:@"Transaction committed but %lu external soup files could not be published: %@",
+                                (unsigned long) failedFilePaths.count, failedFilePaths];
+            *error = [NSError errorWithDomain:kSFSmartStoreErrorDomain
+                                         code:kSFSmartStoreOtherErrorCode
+                                     userInfo:@{NSLocalizedDescriptionKey: reason, NSUnderlyingErrorKey: publishError}];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+/**
+ Entry saved in the current transaction but not written yet - only visible to the connection running the transaction
+ until it commits (read connections keep seeing the previously committed file), then to all connections until it is renamed
+ */
+- (NSDictionary *)pendingExternalWriteForFile:(NSString *)filePath withDb:(FMDatabase *)db {
+    @synchronized (_pendingExternalWrites) {
+        BOOL visible = _publishingExternalWrites || (db != nil && db == _stagingExternalWritesDb);
+        return visible ? _pendingExternalWrites[filePath] : nil;
+    }
 }
 
+- (void)discardPendingExternalWritesInDirectory:(NSString *)dirPath {
+    NSString *pathPrefix = [dirPath stringByAppendingString:@"/"];
+    @synchronized (_pendingExternalWrites) {
+        for (NSString *filePath in [_pendingExternalWrites allKeys]) {
+            if ([filePath hasPrefix:pathPrefix]) {
+                [_pendingExternalWrites removeObjectForKey:filePath];
+            }
+        }
+        for (NSString *filePath in [_pendingExternalDeletes allObjects]) {
+            if ([filePath hasPrefix:pathPrefix]) {
+                [_pendingExternalDeletes removeObject:filePath];
+            }
+        }
+    }
+}
+
+- (id)loadExternalSoupEntry:(NSNumber *)soupEntryId
+              soupTableName:(NSString *)soupTableName
+{
+    return [self loadExternalSoupEntry:soupEntryId soupTableName:soupTableName withDb:nil];
+}
 
 - (id)loadExternalSoupEntry:(NSNumber *)soupEntryId
               soupTableName:(NSString *)soupTableName
+                     withDb:(FMDatabase *)db
 {
-    return [SFJsonUtils objectFromJSONString:[self loadExternalSoupEntryAsString:soupEntryId soupTableName:soupTableName]];
+    NSData *entryAsData = [self loadExternalSoupEntryAsData:soupEntryId soupTableName:soupTableName withDb:db];
+    return entryAsData ? [SFJsonUtils objectFromJSONData:entryAsData] : nil;
 }
 
 + (void)buildEventOnJsonParseErrorForUser:(SFUserAccount *)user fromMethod:(NSString*)fromMethod rawJson:(NSString*)rawJson {
@@ -938,29 +1469,50 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 
 - (NSString*)loadExternalSoupEntryAsString:(NSNumber *)soupEntryId
                              soupTableName:(NSString *)soupTableName
+{
+    NSData *entryAsData = [self loadExternalSoupEntryAsData:soupEntryId soupTableName:soupTableName];
+    return entryAsData ? [[NSString alloc] initWithData:entryAsData encoding:NSUTF8StringEncoding] : nil;
+}
+
+- (NSData*)loadExternalSoupEntryAsData:(NSNumber *)soupEntryId
+                         soupTableName:(NSString *)soupTableName
+{
+    return [self loadExternalSoupEntryAsData:soupEntryId soupTableName:soupTableName withDb:nil];
+}
+
+- (NSData*)loadExternalSoupEntryAsData:(NSNumber *)soupEntryId
+                         soupTableName:(NSString *)soupTableName
+                                withDb:(FMDatabase *)db
 {
     NSString *filePath = [self externalStorageSoupFilePath:soupEntryId
                                              soupTableName:soupTableName];
     
+    // Saved in the current transaction (run on db) but not written yet
+    NSDictionary *pendingEntry = [self pendingExternalWriteForFile:filePath withDb:db];
+    if (pendingEntry) {
+        return [NSJSONSerialization dataWithJSONObject:pendingEntry options:0 error:nil];
+    }
+    
     SFSmartStoreEncryptionKeyBlock keyBlock = [SFSmartStore encryptionKeyBlock];
     SFEncryptionKey* encKey;
     if (keyBlock) {
         encKey = keyBlock();
     }
     
-    NSString* entryAsString = [self readFromEncryptedFile:filePath
+    NSData* entryAsData = [self readDataFromEncryptedFile:filePath
                                                    encKey:encKey];
     
     // Before 6.2, we were using nill IV when encrypting.
     // Starting in 6.2, we are using a non-nil IV when encrypting.
     // If it doesn't look like proper json, it means the entry was encrypted with pre 6.2 SDK.
     // It needs to be stored back with a non-nil IV encryption.
-    if (![entryAsString hasPrefix:@"{"]) {
-        NSDictionary* entry = [SFJsonUtils objectFromJSONString:entryAsString];
+    BOOL looksLikeJson = entryAsData.length > 0 && ((const char *)entryAsData.bytes)[0] == '{';
+    if (!looksLikeJson) {
+        id entry = entryAsData ? [SFJsonUtils objectFromJSONData:entryAsData] : nil;
         
         if(!entry) {
             if (encKey.initializationVector) {
-                entryAsString = [self readFromEncryptedFile:filePath encKey:encKey useNilIV:YES];
+                NSString *entryAsString = [self readFromEncryptedFile:filePath encKey:encKey useNilIV:YES];
                 if ([entryAsString length] > 0) {
                     [self writeToEncryptedFile:filePath
                                        content:entryAsString
@@ -968,6 +1520,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                 } else {
                     [SFSDKSmartStoreLogger e:[self class] format:@"Attempt to migrate an encrypted externally saved soup '%@' with a null IV  failed.", soupTableName];
                 }
+                entryAsData = [entryAsString dataUsingEncoding:NSUTF8StringEncoding];
             } else {
                 NSError* error = [SFJsonUtils lastError];
                 NSString *errorMessage = [NSString stringWithFormat:@"Loading external soup from file failed! encrypted: %@, soupEntryId: %@, soupTableName: %@, filePath: '%@', error: %@.",
@@ -986,11 +1539,48 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     }
 
     // Check for valid JSON.
-    if (![self checkRawJson:entryAsString fromMethod:NSStringFromSelector(_cmd)]) {
-        return nil;
-    } else {
-        return entryAsString;
+    if (_jsonSerializationCheckEnabled) {
+        NSString *entryAsString = entryAsData ? [[NSString alloc] initWithData:entryAsData encoding:NSUTF8StringEncoding] : nil;
+        if (![self checkRawJson:entryAsString fromMethod:NSStringFromSelector(_cmd)]) {
+            return nil;
+        }
+    }
+    return entryAsData;
+}
+
+/**
+ Reads the content of an external entry file without going through an intermediate buffer:
+ unencrypted files are memory mapped, encrypted files are decrypted into a buffer sized from the file length
+ (the decrypted content is never larger than the encrypted content).
+ */
+- (NSData*) readDataFromEncryptedFile:(NSString*)filePath
+                               encKey:(SFEncryptionKey*)encKey
+{
+    if (!encKey) {
+        return [NSData dataWithContentsOfFile:filePath options:NSDataReadingMappedIfSafe error:nil];
+    }
+    
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:nil];
+    NSUInteger capacity = MAX((NSUInteger)[attributes fileSize], kBufferSize);
+    NSMutableData *content = [NSMutableData dataWithLength:capacity];
+    NSUInteger length = 0;
+    SFDecryptStream *decryptStream = [[SFDecryptStream alloc] initWithFileAtPath:filePath];
+    [decryptStream setupWithDecryptionKey:encKey];
+    [decryptStream open];
+    NSInteger len;
+    while (YES) {
+        if (length == content.length) {
+            [content increaseLengthBy:kBufferSize];
+        }
+        len = [decryptStream read:(uint8_t *)content.mutableBytes + length maxLength:content.length - length];
+        if (len <= 0) {
+            break;
+        }
+        length += len;
     }
+    [decryptStream close];
+    content.length = length;
+    return content;
 }
 
 - (NSString*) readFromEncryptedFile:(NSString*)filePath
@@ -1057,6 +1647,14 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                   soupTableName:(NSString *)soupTableName {
     NSString *filePath = [self externalStorageSoupFilePath:soupEntryId
                                              soupTableName:soupTableName];
+    // Inside a transaction: the file is only deleted once the transaction commits (see endExternalWrites)
+    @synchronized (_pendingExternalWrites) {
+        [_pendingExternalWrites removeObjectForKey:filePath];
+        if (_stagingExternalWritesDb) {
+            [_pendingExternalDeletes addObject:filePath];
+            return;
+        }
+    }
     NSError *delError = nil;
     if (![[NSFileManager defaultManager] removeItemAtPath:filePath
                                                     error:&delError]) {
@@ -1067,6 +1665,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 - (void)deleteAllExternalEntries:(NSString *)soupTableName
                        deleteDir:(BOOL)deleteDir {
     NSString *dirPath = [self externalStorageSoupDirectory:soupTableName];
+    [self discardPendingExternalWritesInDirectory:dirPath];
     
     NSError *deleteDirError = nil;
     if (![[NSFileManager defaultManager] removeItemAtPath:dirPath error:&deleteDirError]) {
@@ -1082,28 +1681,12 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 #pragma mark - Data access utility methods
 
 - (void)insertIntoTable:(NSString*)tableName values:(NSDictionary*)map withDb:(FMDatabase *) db {
-    // map all of the columns and values from soupIndexMapInserts
-    __strong NSMutableString *fieldNames = [[NSMutableString alloc] init];
-    __strong NSMutableArray *binds = [[NSMutableArray alloc] init];
-    __strong NSMutableString *fieldValueMarkers = [[NSMutableString alloc] init];
-    __block NSUInteger fieldCount = 0;
-    
-    [map enumerateKeysAndObjectsUsingBlock:
-     ^(id key, id obj, BOOL *stop) {
-         if (fieldCount > 0) {
-             [fieldNames appendFormat:@",%@",key];
-             [fieldValueMarkers appendString:@",?"];
-         } else {
-             [fieldNames appendString:key];
-             [fieldValueMarkers appendString:@"?"];
-         }
-         [binds addObject:obj];
-         fieldCount++;
-     }];
-    
-    
-    NSString *insertSql = [NSString stringWithFormat:@"INSERT INTO %@ (%@) VALUES (%@)",
-                           tableName, fieldNames, fieldValueMarkers];
+    NSArray *columns = [self canonicalColumns:map];
+    NSMutableArray *binds = [NSMutableArray arrayWithCapacity:columns.count];
+    for (NSString *column in columns) {
+        [binds addObject:map[column]];
+    }
+    NSString *insertSql = [self insertSqlForTable:tableName columns:columns];
     [self executeUpdateThrows:insertSql withArgumentsInArray:binds withDb:db];
 }
 
@@ -1111,48 +1694,129 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 {
     NSAssert(entryId != nil, @"Entry ID must have a value.");
     
-    // map all of the columns and values from soupIndexMapInserts
-    __strong NSMutableString *fieldEntries = [[NSMutableString alloc] init];
-    __strong NSMutableArray *binds = [[NSMutableArray alloc] init];
-    __block NSUInteger fieldCount = 0;
-    
-    [map enumerateKeysAndObjectsUsingBlock:
-     ^(id key, id obj, BOOL *stop) {
-         if (fieldCount > 0) {
-             [fieldEntries appendString:@", "];
-         }
-         [fieldEntries appendFormat:@"%@ = ?", key];
-         [binds addObject:obj];
-         fieldCount++;
-     }];
+    NSArray *columns = [self canonicalColumns:map];
+    NSMutableArray *binds = [NSMutableArray arrayWithCapacity:columns.count + 1];
+    for (NSString *column in columns) {
+        [binds addObject:map[column]];
+    }
     [binds addObject:entryId];
-    NSString *updateSql = [NSString stringWithFormat:@"UPDATE %@ SET %@ WHERE %@ = ?",
-                           tableName, fieldEntries, idCol];
+    NSString *updateSql = [self updateSqlForTable:tableName columns:columns idCol:idCol];
     [self executeUpdateThrows:updateSql withArgumentsInArray:binds withDb:db];
 }
 
-- (NSString*)columnNameForPath:(NSString*)path inSoup:(NSString*)soupName withDb:(FMDatabase*) db {
-    //TODO cache these with soupName:path ? if slow...
-    NSString *result = nil;
-    if (nil == path) {
-        return result;
+// Dictionary enumeration order is not stable: sorting the columns gives the same sql (and prepared statement) for the same set of columns
+- (NSArray*)canonicalColumns:(NSDictionary*)map {
+    return [[map allKeys] sortedArrayUsingSelector:@selector(compare:)];
+}
+
+- (void)insertIntoTable:(NSString*)tableName rows:(NSArray<NSDictionary*>*)rows withDb:(FMDatabase *) db {
+    if (rows.count == 0) {
+        return;
     }
-    
-    NSString *querySql = [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE %@ = ? AND %@ = ?",
-                          COLUMN_NAME_COL,SOUP_INDEX_MAP_TABLE,
-                          SOUP_NAME_COL,
-                          PATH_COL
-                          ];
-    FMResultSet *frs = [self executeQueryThrows:querySql withArgumentsInArray:@[soupName, path] withDb:db];
-    if ([frs next]) {
-        result = [frs stringForColumnIndex:0];
+    // All rows are expected to have the same columns
+    NSArray *columns = [self canonicalColumns:rows[0]];
+    NSUInteger rowsPerStatement = MAX(1, kMaxBindVariables / columns.count);
+    for (NSUInteger start = 0; start < rows.count; start += rowsPerStatement) {
+        NSUInteger rowCount = MIN(rowsPerStatement, rows.count - start);
+        NSMutableArray *binds = [NSMutableArray arrayWithCapacity:rowCount * columns.count];
+        for (NSUInteger i = start; i < start + rowCount; i++) {
+            NSDictionary *row = rows[i];
+            for (NSString *column in columns) {
+                id value = row[column];
+                [binds addObject:value != nil ? value : [NSNull null]];
+            }
+        }
+        NSString *insertSql = [self insertSqlForTable:tableName columns:columns rowCount:rowCount];
+        [self executeUpdateThrows:insertSql withArgumentsInArray:binds withDb:db];
     }
-    [frs close];
+}
+
+- (NSString*)insertSqlForTable:(NSString*)tableName columns:(NSArray*)columns {
+    return [self insertSqlForTable:tableName columns:columns rowCount:1];
+}
+
+- (NSString*)insertSqlForTable:(NSString*)tableName columns:(NSArray*)columns rowCount:(NSUInteger)rowCount {
+    NSString *columnsList = [columns componentsJoinedByString:@","];
+    NSString *key = [NSString stringWithFormat:@"INSERT %lu %@", (unsigned long)rowCount, columnsList];
+    return [self statementSqlForTable:tableName key:key build:^NSString *{
+        NSMutableArray *fieldValueMarkers = [NSMutableArray arrayWithCapacity:columns.count];
+        for (NSUInteger i=0; i<columns.count; i++) {
+            [fieldValueMarkers addObject:@"?"];
+        }
+        NSString *rowMarkers = [NSString stringWithFormat:@"(%@)", [fieldValueMarkers componentsJoinedByString:@","]];
+        NSMutableArray *rowsMarkers = [NSMutableArray arrayWithCapacity:rowCount];
+        for (NSUInteger i=0; i<rowCount; i++) {
+            [rowsMarkers addObject:rowMarkers];
+        }
+        return [NSString stringWithFormat:@"INSERT INTO %@ (%@) VALUES %@",
+                tableName, columnsList, [rowsMarkers componentsJoinedByString:@","]];
+    }];
+}
+
+- (NSString*)updateSqlForTable:(NSString*)tableName columns:(NSArray*)columns idCol:(NSString*)idCol {
+    NSString *key = [NSString stringWithFormat:@"UPDATE %@ %@", idCol, [columns componentsJoinedByString:@","]];
+    return [self statementSqlForTable:tableName key:key build:^NSString *{
+        NSMutableArray *fieldEntries = [NSMutableArray arrayWithCapacity:columns.count];
+        for (NSString *column in columns) {
+            [fieldEntries addObject:[NSString stringWithFormat:@"%@ = ?", column]];
+        }
+        return [NSString stringWithFormat:@"UPDATE %@ SET %@ WHERE %@ = ?",
+                tableName, [fieldEntries componentsJoinedByString:@", "], idCol];
+    }];
+}
+
+- (NSString*)statementSqlForTable:(NSString*)tableName key:(NSString*)key build:(NSString* (^)(void))build {
+    NSMutableDictionary *sqlByKey = [_statementSqlByTable objectForKey:tableName];
+    if (nil == sqlByKey) {
+        sqlByKey = [NSMutableDictionary new];
+        [_statementSqlByTable setObject:sqlByKey forKey:tableName];
+    }
+    NSString *sql = sqlByKey[key];
+    if (nil == sql) {
+        sql = build();
+        sqlByKey[key] = sql;
+    }
+    return sql;
+}
+
+- (NSString*)columnNameForPath:(NSString*)path inSoup:(NSString*)soupName withDb:(FMDatabase*) db {
+    if (nil == path) {
+        return nil;
+    }
+    
+    NSString *result = [self indexSpecForPath:path inSoup:soupName withDb:db].columnName;
     if (nil == result) {
         [SFSDKSmartStoreLogger d:[self class] format:@"Unknown index path '%@' in soup '%@' ", path, soupName];
     }
     return result;
-    
+}
+
+- (SFSoupIndex*)indexSpecForPath:(NSString*)path inSoup:(NSString*)soupName withDb:(FMDatabase*) db {
+    //look in the cache first
+    NSDictionary *indexSpecsByPath = [_indexSpecsByPathBySoup objectForKey:soupName];
+    if (nil == indexSpecsByPath) {
+        //build it from the soup index specs
+        NSArray *indexSpecs = [self indicesForSoup:soupName withDb:db];
+        NSMutableDictionary *map = [NSMutableDictionary dictionaryWithCapacity:indexSpecs.count];
+        for (SFSoupIndex *indexSpec in indexSpecs) {
+            // first index spec for a path wins (like the soup_index_map lookup this replaces)
+            if (nil == map[indexSpec.path]) {
+                map[indexSpec.path] = indexSpec;
+            }
+        }
+        indexSpecsByPath = map;
+        
+        // update the cache (not caching unknown soups)
+        if (indexSpecs.count > 0) {
+            [_indexSpecsByPathBySoup setObject:indexSpecsByPath forKey:soupName];
+        }
+    }
+    return indexSpecsByPath[path];
+}
+
+- (SFSmartSqlCache*) smartSqlCache
+{
+    return _smartSqlToSql;
 }
 
 - (NSString*) convertSmartSql:(NSString*)smartSql
@@ -1167,6 +1831,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 - (NSString*) convertSmartSql:(NSString*)smartSql withDb:(FMDatabase*)db
 {
     [SFSDKSmartStoreLogger v:[self class] format:@"convertSmartSQl:%@", smartSql];
+    [self.indexAdvisor recordSmartSql:smartSql];
     NSObject* sql = [_smartSqlToSql sqlForSmartSql:smartSql];
     if (nil == sql) {
         sql = [[SFSmartSqlHelper sharedInstance] convertSmartSql:smartSql withStore:self withDb:db];
@@ -1285,7 +1950,10 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                     [soupFeatures addObject:feature];
                 }
             }
-            attrs = [SFSoupSpec newSoupSpec:soupName withFeatures:soupFeatures];
+            NSString *compositeIndexes = [frs stringForColumn:COMPOSITE_INDEXES_COL];
+            attrs = [SFSoupSpec newSoupSpec:soupName
+                               withFeatures:soupFeatures
+                       withCompositeIndexes:compositeIndexes.length > 0 ? [SFJsonUtils objectFromJSONString:compositeIndexes] : nil];
             
             // update the cache
             [_attrSpecBySoup setObject:attrs forKey:soupName];
@@ -1313,8 +1981,8 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     if (nil == result) {
         result = [NSMutableArray array];
         //no cached indices ...reload from SOUP_INDEX_MAP_TABLE
-        NSString *querySql = [NSString stringWithFormat:@"SELECT %@,%@,%@ FROM %@ WHERE %@ = ?",
-                              PATH_COL, COLUMN_NAME_COL, COLUMN_TYPE_COL,
+        NSString *querySql = [NSString stringWithFormat:@"SELECT %@,%@,%@,%@ FROM %@ WHERE %@ = ?",
+                              PATH_COL, COLUMN_NAME_COL, COLUMN_TYPE_COL, OPTIONS_COL,
                               SOUP_INDEX_MAP_TABLE,
                               SOUP_NAME_COL];
         [SFSDKSmartStoreLogger d:[self class] format:@"indices sql: %@", querySql];
@@ -1323,7 +1991,11 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
             NSString *path = [frs stringForColumn:PATH_COL];
             NSString *columnName = [frs stringForColumn:COLUMN_NAME_COL];
             NSString *type = [frs stringForColumn:COLUMN_TYPE_COL];
+            NSString *options = [frs stringForColumn:OPTIONS_COL];
             SFSoupIndex *spec = [[SFSoupIndex alloc] initWithPath:path indexType:type columnName:columnName];
+            if (options.length > 0) {
+                spec.ftsOptions = [SFJsonUtils objectFromJSONString:options];
+            }
             [result addObject:spec];
         }
         [frs close];
@@ -1372,6 +2044,9 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
             soupMapValues[feature] = @(kSoupFeatureEnabled);
         }
     }
+    if (soupSpec.compositeIndexes.count > 0) {
+        soupMapValues[COMPOSITE_INDEXES_COL] = [SFJsonUtils JSONRepresentation:[SFSoupCompositeIndex asArrayOfDictionaries:soupSpec.compositeIndexes]];
+    }
     [self insertIntoTable:SOUP_ATTRS_TABLE values:soupMapValues withDb:db];
     // Get a safe table name for the soupName
     NSString *soupTableName = [self tableNameBySoupId:[db lastInsertRowId]];
@@ -1392,6 +2067,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
             featuresMapValues[feature] = @(kSoupFeatureDisabled);
         }
     }
+    featuresMapValues[COMPOSITE_INDEXES_COL] = [SFJsonUtils JSONRepresentation:[SFSoupCompositeIndex asArrayOfDictionaries:soupSpec.compositeIndexes]];
     
     NSNumber *soupId = [self soupIdFromTableName:soupTableName];
     [self updateTable:SOUP_ATTRS_TABLE values:featuresMapValues entryId:soupId idCol:ID_COL withDb:db];
@@ -1441,6 +2117,15 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     if (soupUsesExternalStorage && soupUsesJSON1) {
         @throw [NSException exceptionWithName:@"Can't have JSON1 index specs in externally stored soup" reason:nil userInfo:nil];
     }
+    
+    // Generated columns are computed from the soup column
+    BOOL soupUsesGeneratedColumns = [soupSpec.features containsObject:kSoupFeatureGeneratedColumns];
+    if (soupUsesExternalStorage && soupUsesGeneratedColumns) {
+        @throw [NSException exceptionWithName:@"Can't have generated columns in externally stored soup" reason:nil userInfo:nil];
+    }
+    
+    // Validates fts options before anything gets created
+    NSString *ftsOptionsClause = [self ftsOptionsClauseForIndexSpecs:indexSpecs];
    
     if (nil == soupTableName) {
         soupTableName = [self registerNewSoupWithSpec:soupSpec withDb:db];
@@ -1468,6 +2153,8 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     
     NSMutableString *createFtsStmt = [NSMutableString new];
     NSMutableArray *columnsForFts = [NSMutableArray new];
+    NSMutableDictionary *columnNamesByPath = [NSMutableDictionary new];
+    NSMutableArray *countedColumns = [NSMutableArray new];
     
     // Indexes on created and lastModified
     NSString* createIndexFormat = @"CREATE INDEX IF NOT EXISTS %@_%@_idx ON %@ ( %@ )";
@@ -1487,6 +2174,9 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
         if (kValueExtractedToColumn(indexSpec)) {
             NSString * columnType = [indexSpec columnType];
             [createTableStmt appendFormat:@", %@ %@ ",columnName,columnType];
+            if (soupUsesGeneratedColumns) {
+                [createTableStmt appendFormat:@"GENERATED ALWAYS AS (json_extract(%@, '$.%@')) STORED ", SOUP_COL, indexSpec.path];
+            }
         }
         
         // for fts
@@ -1494,12 +2184,25 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
             [columnsForFts addObject:columnName];
         }
         
+        // for composite indexes (first index spec for a path wins, like in indexSpecForPath)
+        if (nil == columnNamesByPath[indexSpec.path]) {
+            columnNamesByPath[indexSpec.path] = columnName;
+        }
+        
+        // for materialized counts
+        if ([SFSmartStore isCountedIndexSpec:indexSpec]) {
+            [countedColumns addObject:columnName];
+        }
+        
         // for inserting into meta mapping table
         NSMutableDictionary *values = [[NSMutableDictionary alloc] init];
         values[SOUP_NAME_COL] = soupSpec.soupName;
         values[PATH_COL] = indexSpec.path;
         values[COLUMN_NAME_COL] = columnName;
         values[COLUMN_TYPE_COL] = indexSpec.indexType;
+        if (indexSpec.ftsOptions.count > 0) {
+            values[OPTIONS_COL] = [SFJsonUtils JSONRepresentation:indexSpec.ftsOptions];
+        }
         [soupIndexMapInserts addObject:values];
         
         // for creating an index on the soup table
@@ -1509,9 +2212,12 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     [createTableStmt appendString:@")"];
     [SFSDKSmartStoreLogger d:[self class] format:@"createTableStmt: %@", createTableStmt];
     
+    // Composite, covering and partial indexes
+    [createIndexStmts addObjectsFromArray:[self createCompositeIndexStmts:soupSpec soupTableName:soupTableName columnNamesByPath:columnNamesByPath]];
+    
     // fts
     if (columnsForFts.count > 0) {
-        [createFtsStmt appendFormat:@"CREATE VIRTUAL TABLE %@_fts USING fts%u(%@)", soupTableName, (unsigned)self.ftsExtension, [columnsForFts componentsJoinedByString:@","]];
+        [createFtsStmt appendFormat:@"CREATE VIRTUAL TABLE %@_fts USING fts%u(%@%@)", soupTableName, (unsigned)self.ftsExtension, [columnsForFts componentsJoinedByString:@","], ftsOptionsClause];
         [SFSDKSmartStoreLogger d:[self class] format:@"createFtsStmt: %@", createFtsStmt];
     }
     
@@ -1530,6 +2236,15 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     }
     [self insertIntoSoupIndexMap:soupIndexMapInserts withDb:db];
 
+    // counts (dropped first in case of re-registration, they get rebuilt as rows are copied back)
+    [self executeUpdateThrows:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@_counts", soupTableName] withDb:db];
+    if ([soupSpec.features containsObject:kSoupFeatureMaterializedCounts]) {
+        for (NSString *countsStmt in [self createMaterializedCountsStmts:soupTableName countedColumns:countedColumns]) {
+            [SFSDKSmartStoreLogger d:[self class] format:@"countsStmt: %@", countsStmt];
+            [self executeUpdateThrows:countsStmt withDb:db];
+        }
+    }
+
     // Logs analytics event.
     NSMutableArray<NSString *> *features = [[NSMutableArray alloc] init];
     if (soupUsesJSON1) {
@@ -1538,9 +2253,18 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     if (soupUsesExternalStorage) {
         [features addObject:@"ExternalStorage"];
     }
+    if (soupUsesGeneratedColumns) {
+        [features addObject:@"GeneratedColumns"];
+    }
     if ([SFSoupIndex hasFts:indexSpecs]) {
         [features addObject:@"FTS"];
     }
+    if (soupSpec.compositeIndexes.count > 0) {
+        [features addObject:@"CompositeIndexes"];
+    }
+    if ([soupSpec.features containsObject:kSoupFeatureMaterializedCounts]) {
+        [features addObject:@"MaterializedCounts"];
+    }
     NSMutableDictionary *attributes = [[NSMutableDictionary alloc] init];
     attributes[@"features"] = features;
     [SFSDKEventBuilderHelper createAndStoreEvent:@"registerSoup" userAccount:self.user className:NSStringFromClass([self class]) attributes:attributes];
@@ -1555,6 +2279,206 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     }
 }
 
++ (BOOL)isCountedIndexSpec:(SFSoupIndex*)indexSpec
+{
+    return [@[kSoupIndexTypeString, kSoupIndexTypeInteger, kSoupIndexTypeFloating] containsObject:indexSpec.indexType];
+}
+
+/**
+ Value a match key compares as against an integer or floating column (sqlite converts well-formed numeric text), nil if it is not a number
+ */
++ (NSNumber*)numericMatchKey:(id)matchKey
+{
+    if ([matchKey isKindOfClass:[NSNumber class]]) {
+        return matchKey;
+    }
+    if (![matchKey isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    NSString* trimmedKey = [matchKey stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    long long longValue;
+    NSScanner* scanner = [NSScanner scannerWithString:trimmedKey];
+    if ([scanner scanLongLong:&longValue] && scanner.isAtEnd) {
+        return @(longValue);
+    }
+    double doubleValue;
+    scanner = [NSScanner scannerWithString:trimmedKey];
+    if ([scanner scanDouble:&doubleValue] && scanner.isAtEnd) {
+        return @(doubleValue);
+    }
+    return nil;
+}
+
+- (NSArray*)createMaterializedCountsStmts:(NSString*)soupTableName countedColumns:(NSArray*)countedColumns
+{
+    NSString *countsTableName = [NSString stringWithFormat:@"%@_counts", soupTableName];
+    
+    NSString *increment = [NSString stringWithFormat:@"ON CONFLICT (%@, %@) DO UPDATE SET %@ = %@ + 1", COLUMN_NAME_COL, COUNTS_VALUE_COL, COUNTS_COUNT_COL, COUNTS_COUNT_COL];
+    NSString *insertFormat = [NSString stringWithFormat:@"INSERT INTO %@ (%@, %@, %@) ", countsTableName, COLUMN_NAME_COL, COUNTS_VALUE_COL, COUNTS_COUNT_COL];
+    NSString *decrementFormat = [NSString stringWithFormat:@"UPDATE %@ SET %@ = %@ - 1 WHERE %@ = ", countsTableName, COUNTS_COUNT_COL, COUNTS_COUNT_COL, COLUMN_NAME_COL];
+    
+    NSMutableString *onInsert = [NSMutableString new];
+    NSMutableString *onDelete = [NSMutableString new];
+    NSMutableString *onUpdate = [NSMutableString new];
+    [onInsert appendFormat:@"%@VALUES ('%@', '', 1) %@; ", insertFormat, COUNTS_TOTAL_KEY, increment];
+    [onDelete appendFormat:@"%@'%@'; ", decrementFormat, COUNTS_TOTAL_KEY];
+    for (NSString *col in countedColumns) {
+        // null values are not counted (exact queries never match them)
+        [onInsert appendFormat:@"%@SELECT '%@', NEW.%@, 1 WHERE NEW.%@ IS NOT NULL %@; ", insertFormat, col, col, col, increment];
+        [onDelete appendFormat:@"%@'%@' AND %@ = OLD.%@; ", decrementFormat, col, COUNTS_VALUE_COL, col];
+        [onUpdate appendFormat:@"%@'%@' AND %@ = OLD.%@ AND OLD.%@ IS NOT NEW.%@; ", decrementFormat, col, COUNTS_VALUE_COL, col, col, col];
+        [onUpdate appendFormat:@"%@SELECT '%@', NEW.%@, 1 WHERE NEW.%@ IS NOT NULL AND OLD.%@ IS NOT NEW.%@ %@; ", insertFormat, col, col, col, col, col, increment];
+    }
+    
+    NSMutableArray *stmts = [NSMutableArray new];
+    [stmts addObject:[NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (%@ TEXT, %@, %@ INTEGER, PRIMARY KEY (%@, %@)) WITHOUT ROWID",
+                      countsTableName, COLUMN_NAME_COL, COUNTS_VALUE_COL, COUNTS_COUNT_COL, COLUMN_NAME_COL, COUNTS_VALUE_COL]];
+    // Not updated by the triggers when the table is empty
+    [stmts addObject:[NSString stringWithFormat:@"%@VALUES ('%@', '', 0)", insertFormat, COUNTS_TOTAL_KEY]];
+    [stmts addObject:[NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS %@_insert AFTER INSERT ON %@ BEGIN %@END", countsTableName, soupTableName, onInsert]];
+    [stmts addObject:[NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS %@_delete AFTER DELETE ON %@ BEGIN %@END", countsTableName, soupTableName, onDelete]];
+    if (countedColumns.count > 0) {
+        [stmts addObject:[NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS %@_update AFTER UPDATE ON %@ BEGIN %@END", countsTableName, soupTableName, onUpdate]];
+    }
+    return stmts;
+}
+
+/**
+ Matches the {soupName:path} references of the where clause of a partial index - the path is the first capture group
+ */
++ (NSRegularExpression*)compositeIndexWhereReferenceRegex:(NSString*)soupName
+{
+    NSString *pattern = [NSString stringWithFormat:@"\\{%@:([^}]+)\\}", [NSRegularExpression escapedPatternForString:soupName]];
+    return [NSRegularExpression regularExpressionWithPattern:pattern options:0 error:nil];
+}
+
+/**
+ Checks that all the paths of the composite indexes of soupSpec (including the ones referenced by their where clause)
+ are indexed by indexSpecs (createCompositeIndexStmts throws otherwise)
+ */
+- (BOOL)compositeIndexPathsAreIndexed:(SFSoupSpec*)soupSpec indexSpecs:(NSArray*)indexSpecs
+{
+    NSMutableSet *indexedPaths = [NSMutableSet setWithArray:@[SOUP_ENTRY_ID, @"_soupCreatedDate", SOUP_LAST_MODIFIED_DATE]];
+    for (SFSoupIndex *indexSpec in [SFSoupIndex asArraySoupIndexes:indexSpecs]) {
+        [indexedPaths addObject:indexSpec.path];
+    }
+    NSRegularExpression *whereReferenceRegex = [SFSmartStore compositeIndexWhereReferenceRegex:soupSpec.soupName];
+    for (SFSoupCompositeIndex *compositeIndex in soupSpec.compositeIndexes) {
+        NSMutableArray *paths = [[compositeIndex.paths arrayByAddingObjectsFromArray:compositeIndex.includedPaths] mutableCopy];
+        if (compositeIndex.whereClause.length > 0) {
+            for (NSTextCheckingResult *match in [whereReferenceRegex matchesInString:compositeIndex.whereClause options:0 range:NSMakeRange(0, compositeIndex.whereClause.length)]) {
+                [paths addObject:[compositeIndex.whereClause substringWithRange:[match rangeAtIndex:1]]];
+            }
+        }
+        for (NSString *path in paths) {
+            if (![indexedPaths containsObject:path]) {
+                [SFSDKSmartStoreLogger e:[self class] format:@"Composite index path '%@' of soup '%@' is not indexed", path, soupSpec.soupName];
+                return NO;
+            }
+        }
+    }
+    return YES;
+}
+
+- (NSArray*)createCompositeIndexStmts:(SFSoupSpec*)soupSpec soupTableName:(NSString*)soupTableName columnNamesByPath:(NSDictionary*)columnNamesByPath
+{
+    NSMutableDictionary *columns = [columnNamesByPath mutableCopy];
+    columns[SOUP_ENTRY_ID] = ID_COL;
+    columns[@"_soupCreatedDate"] = CREATED_COL;
+    columns[SOUP_LAST_MODIFIED_DATE] = LAST_MODIFIED_COL;
+    NSString *(^columnForPath)(NSString*) = ^NSString *(NSString *path) {
+        NSString *column = columns[path];
+        if (nil == column) {
+            @throw [NSException exceptionWithName:@"Composite index path is not indexed" reason:path userInfo:nil];
+        }
+        return column;
+    };
+    
+    NSMutableArray *createIndexStmts = [NSMutableArray new];
+    for (NSUInteger i = 0; i < soupSpec.compositeIndexes.count; i++) {
+        SFSoupCompositeIndex *compositeIndex = soupSpec.compositeIndexes[i];
+        NSMutableArray *indexColumns = [NSMutableArray new];
+        for (NSString *path in [compositeIndex.paths arrayByAddingObjectsFromArray:compositeIndex.includedPaths]) {
+            NSString *column = columnForPath(path);
+            if (![indexColumns containsObject:column]) {
+                [indexColumns addObject:column];
+            }
+        }
+        if (indexColumns.count == 0) {
+            @throw [NSException exceptionWithName:@"Bogus composite index" reason:nil userInfo:nil];
+        }
+        NSMutableString *createIndexStmt = [NSMutableString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@_c%lu_idx ON %@ ( %@ )",
+                                            soupTableName, (unsigned long)i, soupTableName, [indexColumns componentsJoinedByString:@", "]];
+        if (compositeIndex.whereClause.length > 0) {
+            // References are converted to bare column names, the way smart sql converts them in where clauses
+            NSRegularExpression *regex = [SFSmartStore compositeIndexWhereReferenceRegex:soupSpec.soupName];
+            NSMutableString *whereClause = [compositeIndex.whereClause mutableCopy];
+            NSArray *matches = [regex matchesInString:whereClause options:0 range:NSMakeRange(0, whereClause.length)];
+            for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
+                NSString *path = [whereClause substringWithRange:[match rangeAtIndex:1]];
+                [whereClause replaceCharactersInRange:match.range withString:columnForPath(path)];
+            }
+            [createIndexStmt appendFormat:@" WHERE %@", whereClause];
+        }
+        [createIndexStmts addObject:createIndexStmt];
+    }
+    return createIndexStmts;
+}
+
+- (NSString*)ftsOptionsClauseForIndexSpecs:(NSArray*)indexSpecs
+{
+    for (SFSoupIndex *indexSpec in indexSpecs) {
+        if (indexSpec.ftsOptions.count > 0 && ![indexSpec.indexType isEqualToString:kSoupIndexTypeFullText]) {
+            @throw [NSException exceptionWithName:@"Fts options are only supported on full_text index specs" reason:indexSpec.path userInfo:nil];
+        }
+    }
+    BOOL conflict = NO;
+    NSDictionary *ftsOptions = [SFSoupIndex ftsOptions:indexSpecs conflict:&conflict];
+    if (conflict) {
+        @throw [NSException exceptionWithName:@"Full_text index specs have conflicting fts options" reason:nil userInfo:nil];
+    }
+    if (ftsOptions.count == 0) {
+        return @"";
+    }
+    if (self.ftsExtension != SFSmartStoreFTS5) {
+        @throw [NSException exceptionWithName:@"Fts options require fts5" reason:nil userInfo:nil];
+    }
+    
+    NSMutableString *clause = [NSMutableString new];
+    for (NSString *key in ftsOptions) {
+        id value = ftsOptions[key];
+        if ([key isEqualToString:kSoupIndexFtsPrefix]) {
+            NSArray *prefixes = [value isKindOfClass:[NSArray class]] ? value : @[value];
+            NSMutableArray *lengths = [NSMutableArray new];
+            for (id prefix in prefixes) {
+                NSInteger length = [prefix respondsToSelector:@selector(integerValue)] ? [prefix integerValue] : 0;
+                if (length < 1 || length > 999) {
+                    @throw [NSException exceptionWithName:@"Invalid fts prefix option" reason:[NSString stringWithFormat:@"%@", prefix] userInfo:nil];
+                }
+                [lengths addObject:[NSString stringWithFormat:@"%ld", (long)length]];
+            }
+            [clause appendFormat:@", prefix='%@'", [lengths componentsJoinedByString:@" "]];
+        } else if ([key isEqualToString:kSoupIndexFtsTokenize]) {
+            if (![value isKindOfClass:[NSString class]] || [value length] == 0) {
+                @throw [NSException exceptionWithName:@"Invalid fts tokenize option" reason:[NSString stringWithFormat:@"%@", value] userInfo:nil];
+            }
+            // The trigram tokenizer was added in sqlite 3.34
+            if ([[value componentsSeparatedByString:@" "].firstObject isEqualToString:kSoupIndexFtsTokenizerTrigram] && sqlite3_libversion_number() < 3034000) {
+                @throw [NSException exceptionWithName:@"Trigram tokenizer not supported" reason:[NSString stringWithFormat:@"sqlite %s", sqlite3_libversion()] userInfo:nil];
+            }
+            [clause appendFormat:@", tokenize='%@'", [value stringByReplacingOccurrencesOfString:@"'" withString:@"''"]];
+        } else if ([key isEqualToString:kSoupIndexFtsDetail]) {
+            if (![@[kSoupIndexFtsDetailFull, kSoupIndexFtsDetailColumn, kSoupIndexFtsDetailNone] containsObject:value]) {
+                @throw [NSException exceptionWithName:@"Invalid fts detail option" reason:[NSString stringWithFormat:@"%@", value] userInfo:nil];
+            }
+            [clause appendFormat:@", detail=%@", value];
+        } else {
+            @throw [NSException exceptionWithName:@"Unknown fts option" reason:key userInfo:nil];
+        }
+    }
+    return clause;
+}
+
 - (void)removeSoup:(NSString*)soupName {
     [self inTransaction:^(FMDatabase* db, BOOL* rollback) {
         [self removeSoup:soupName withDb:db];
@@ -1573,6 +2497,12 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     NSString *dropSql = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@",soupTableName];
     [self executeUpdateThrows:dropSql withDb:db];
 
+    // counts
+    if ([soupSpec.features containsObject:kSoupFeatureMaterializedCounts]) {
+        NSString *dropCountsSql = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@_counts",soupTableName];
+        [self executeUpdateThrows:dropCountsSql withDb:db];
+    }
+
     // fts
     if ([self hasFts:soupName withDb:db]) {
         NSString *dropFtsSql = [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@_fts",soupTableName];
@@ -1588,6 +2518,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     
     // Cleanup caches
     [self removeFromCache:soupName];
+    [db clearCachedStatements];
     
     // Cleanup external storage directory
     if (soupUsesExternalStorage) {
@@ -1604,8 +2535,15 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 }
 
 - (void)removeFromCache:(NSString*) soupName {
+    NSString *soupTableName = [_soupNameToTableName objectForKey:soupName];
+    if (soupTableName) {
+        [_statementSqlByTable removeObjectForKey:soupTableName];
+    }
+    // Soup tables get dropped / renamed (e.g. alter soup): not relying on the table name cache to find the counter
+    [_nextEntryIdBySoupTable removeAllObjects];
     [_attrSpecBySoup removeObjectForKey:soupName ];
     [_indexSpecsBySoup removeObjectForKey:soupName ];
+    [_indexSpecsByPathBySoup removeObjectForKey:soupName ];
     [_soupNameToTableName removeObjectForKey:soupName ];
     [_smartSqlToSql removeEntriesForSoup:soupName ];
 }
@@ -1695,10 +2633,69 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     return returnId;
 }
 
+- (NSString *)lookupKeyForFieldValue:(id)fieldValue
+{
+    // Values read back from the database might not have the same type as the values in the entries (e.g. numbers stored in string columns)
+    return [NSString stringWithFormat:@"%@", fieldValue];
+}
+
+- (NSDictionary *)lookupSoupEntryIdsForSoupName:(NSString *)soupName
+                                  soupTableName:(NSString *)soupTableName
+                                   forFieldPath:(NSString *)fieldPath
+                                    fieldValues:(NSArray *)fieldValues
+                                          error:(NSError **)error
+                                         withDb:(FMDatabase*)db
+{
+    NSAssert(soupName != nil && [soupName length] > 0, @"Soup name must have a value.");
+    NSAssert(soupTableName != nil && [soupTableName length] > 0, @"Soup table name must have a value.");
+    NSAssert(fieldPath != nil && [fieldPath length] > 0, @"Field path must have a value.");
+    
+    NSString *fieldPathColumnName = [self columnNameForPath:fieldPath inSoup:soupName withDb:db];
+    if (fieldPathColumnName == nil) {
+        if (error != nil) {
+            NSString *errorDesc = [NSString stringWithFormat:kSFSmartStoreIndexNotDefinedDescription, fieldPath];
+            *error = [NSError errorWithDomain:kSFSmartStoreErrorDomain
+                                         code:kSFSmartStoreIndexNotDefinedCode
+                                     userInfo:@{NSLocalizedDescriptionKey: errorDesc}];
+        }
+        return nil;
+    }
+    
+    NSMutableDictionary *idsByKey = [NSMutableDictionary dictionaryWithCapacity:fieldValues.count];
+    NSArray *distinctValues = [[NSOrderedSet orderedSetWithArray:fieldValues] array];
+    for (NSUInteger start = 0; start < distinctValues.count; start += kMaxBindVariables) {
+        NSArray *binds = [distinctValues subarrayWithRange:NSMakeRange(start, MIN(kMaxBindVariables, distinctValues.count - start))];
+        NSMutableArray *markers = [NSMutableArray arrayWithCapacity:binds.count];
+        for (NSUInteger i=0; i<binds.count; i++) {
+            [markers addObject:@"?"];
+        }
+        NSString *lookupSql = [NSString stringWithFormat:@"SELECT %@, %@ FROM %@ WHERE %@ IN (%@)",
+                               ID_COL, fieldPathColumnName, soupTableName, fieldPathColumnName, [markers componentsJoinedByString:@","]];
+        FMResultSet *rs = [self executeQueryThrows:lookupSql withArgumentsInArray:binds withDb:db];
+        while ([rs next]) {
+            NSString *key = [self lookupKeyForFieldValue:[rs objectForColumnIndex:1]];
+            if (idsByKey[key] != nil) {
+                // Shouldn't be more than one value; that's an error.
+                if (error != nil) {
+                    NSString *errorDesc = [NSString stringWithFormat:kSFSmartStoreTooManyEntriesDescription, key, fieldPath];
+                    *error = [NSError errorWithDomain:kSFSmartStoreErrorDomain
+                                                 code:kSFSmartStoreTooManyEntriesCode
+                                             userInfo:@{NSLocalizedDescriptionKey: errorDesc}];
+                }
+                [rs close];
+                return nil;
+            }
+            idsByKey[key] = @([rs longLongIntForColumnIndex:0]);
+        }
+        [rs close];
+    }
+    return idsByKey;
+}
+
 - (NSNumber*)countWithQuerySpec:(SFQuerySpec*)querySpec error:(NSError **)error;
 {
     __block NSInteger result;
-    [self inDatabase:^(FMDatabase* db) {
+    [self inReadDatabase:^(FMDatabase* db) {
         result = [self countWithQuerySpec:querySpec withDb:db];
     } error:error];
     return [NSNumber numberWithUnsignedInteger:result];
@@ -1709,6 +2706,12 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     [SFSDKSmartStoreLogger d:[self class] format:@"countWithQuerySpec: \nquerySpec:%@ \n", querySpec];
     NSUInteger result = 0;
     
+    // Materialized counts
+    NSNumber* materializedCount = [self materializedCountWithQuerySpec:querySpec withDb:db];
+    if (materializedCount) {
+        return [materializedCount unsignedIntegerValue];
+    }
+    
     // SQL
     NSString* countSql = [self convertSmartSql:querySpec.countSmartSql withDb:db];
     [SFSDKSmartStoreLogger d:[self class] format:@"countWithQuerySpec: countSql:%@ \n", countSql];
@@ -1717,19 +2720,63 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     NSArray* args = [querySpec bindsForQuerySpec];
     
     // Executing query
+    SFSmartStoreQueryProfiler *profiler = self.queryProfiler;
+    SFQueryProfileSample sample;
+    if (profiler) SFQueryProfileStart(&sample);
     FMResultSet *frs = [self executeQueryThrows:countSql withArgumentsInArray:args withDb:db];
+    if (profiler) SFQueryProfileResetCounters((sqlite3_stmt *)frs.statement.statement);
     if([frs next]) {
         result = [frs intForColumnIndex:0];
     }
+    if (profiler) SFQueryProfileReadCounters(&sample, (sqlite3_stmt *)frs.statement.statement);
     [frs close];
+    if (profiler) [self recordQueryProfile:&sample profiler:profiler smartSql:querySpec.countSmartSql sql:countSql args:args rowsReturned:1 withDb:db];
     
     return result;
 }
 
+// Returns nil if the count can't be read from the soup counts table
+- (NSNumber*)materializedCountWithQuerySpec:(SFQuerySpec*)querySpec withDb:(FMDatabase*)db
+{
+    if (querySpec.queryType != kSFSoupQueryTypeRange && querySpec.queryType != kSFSoupQueryTypeExact && querySpec.queryType != kSFSoupQueryTypeLike) {
+        return nil;
+    }
+    if (![[self attributesForSoup:querySpec.soupName withDb:db].features containsObject:kSoupFeatureMaterializedCounts]) {
+        return nil;
+    }
+    
+    NSString* columnName = COUNTS_TOTAL_KEY;
+    id value = @"";
+    if (querySpec.path != nil) {
+        // Only exact queries on counted indexes, with the key converted to the column type
+        // (the counts table has no column affinity to do it for the comparison)
+        SFSoupIndex* indexSpec = [self indexSpecForPath:querySpec.path inSoup:querySpec.soupName withDb:db];
+        if (querySpec.queryType != kSFSoupQueryTypeExact || indexSpec == nil || ![SFSmartStore isCountedIndexSpec:indexSpec]) {
+            return nil;
+        }
+        if ([indexSpec.indexType isEqualToString:kSoupIndexTypeString]) {
+            value = [querySpec.matchKey isKindOfClass:[NSString class]] ? querySpec.matchKey : nil;
+        } else {
+            value = [SFSmartStore numericMatchKey:querySpec.matchKey];
+        }
+        if (value == nil) {
+            return nil;
+        }
+        columnName = indexSpec.columnName;
+    }
+    
+    NSString* soupTableName = [self tableNameForSoup:querySpec.soupName withDb:db];
+    NSString* countSql = [NSString stringWithFormat:@"SELECT %@ FROM %@_counts WHERE %@ = ? AND %@ = ?", COUNTS_COUNT_COL, soupTableName, COLUMN_NAME_COL, COUNTS_VALUE_COL];
+    FMResultSet *frs = [self executeQueryThrows:countSql withArgumentsInArray:@[columnName, value] withDb:db];
+    NSUInteger result = [frs next] ? [frs intForColumnIndex:0] : 0;
+    [frs close];
+    return @(result);
+}
+
 - (NSArray *)queryWithQuerySpec:(SFQuerySpec *)querySpec pageIndex:(NSUInteger)pageIndex error:(NSError **)error;
 {
     __block NSMutableArray* resultArray = [NSMutableArray new];
-    BOOL succ = [self inDatabase:^(FMDatabase* db) {
+    BOOL succ = [self inReadDatabase:^(FMDatabase* db) {
         [self runQuery:resultArray resultString:nil querySpec:querySpec pageIndex:pageIndex withDb:db];
     } error:error];
     if (succ) {
@@ -1741,202 +2788,331 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 
 - (BOOL) queryAsString:(NSMutableString*)resultString querySpec:(SFQuerySpec *)querySpec pageIndex:(NSUInteger)pageIndex error:(NSError **)error NS_SWIFT_NAME(query(result:querySpec:pageIndex:))
 {
-    return [self inDatabase:^(FMDatabase* db) {
+    return [self inReadDatabase:^(FMDatabase* db) {
         [self runQuery:nil resultString:resultString querySpec:querySpec pageIndex:pageIndex withDb:db];
     } error:error];
 }
 
+- (NSArray *)queryWithQuerySpec:(SFQuerySpec *)querySpec continuationToken:(NSDictionary *)continuationToken nextContinuationToken:(NSDictionary **)nextContinuationToken error:(NSError **)error
+{
+    NSMutableArray* resultArray = [NSMutableArray new];
+    BOOL succ = [self runKeysetQuery:resultArray resultString:nil querySpec:querySpec pageIndex:0 continuationToken:continuationToken nextContinuationToken:nextContinuationToken error:error];
+    return succ ? resultArray : nil;
+}
+
+- (BOOL) queryAsString:(NSMutableString*)resultString querySpec:(SFQuerySpec *)querySpec continuationToken:(NSDictionary *)continuationToken nextContinuationToken:(NSDictionary **)nextContinuationToken error:(NSError **)error
+{
+    return [self runKeysetQuery:nil resultString:resultString querySpec:querySpec pageIndex:0 continuationToken:continuationToken nextContinuationToken:nextContinuationToken error:error];
+}
+
+- (BOOL) enumerateQuerySpec:(SFQuerySpec *)querySpec usingBlock:(SFSmartStoreQueryEnumerationBlock)block error:(NSError **)error
+{
+    return [self inReadDatabase:^(FMDatabase* db) {
+        // SQL - no limit, the statement is stepped through until the end or until the block asks to stop
+        NSString* sql = [self convertSmartSql:querySpec.smartSql withDb:db];
+        FMResultSet *frs = [self executeQueryThrows:sql withArgumentsInArray:[querySpec bindsForQuerySpec] ?: @[] withDb:db];
+        @try {
+            int columnCount = [frs columnCount];
+            NSData *rowLayout = SFRowLayout((sqlite3_stmt *)frs.statement.statement, columnCount);
+            BOOL returnsRows = querySpec.returnsRows;
+            BOOL stop = NO;
+            while (!stop && [frs next]) {
+                @autoreleasepool {
+                    NSMutableArray *rowData = [NSMutableArray arrayWithCapacity:columnCount];
+                    [self getDataFromRow:rowData resultSet:frs rowLayout:rowLayout columnCount:columnCount withDb:db];
+                    if (returnsRows) {
+                        block(rowData, &stop);
+                    }
+                    // Exact/like/range queries select the soup entry only, skipping the ones that could not be read
+                    else if (rowData.count > 0 && rowData[0] != [NSNull null]) {
+                        block(rowData[0], &stop);
+                    }
+                }
+            }
+        }
+        @finally {
+            [frs close];
+        }
+    } error:error];
+}
+
+- (BOOL) runKeysetQuery:(NSMutableArray*)resultArray resultString:(NSMutableString*)resultString querySpec:(SFQuerySpec*)querySpec pageIndex:(NSUInteger)pageIndex continuationToken:(NSDictionary*)continuationToken nextContinuationToken:(NSDictionary**)nextContinuationToken error:(NSError**)error
+{
+    __block NSDictionary* lastRowToken = nil;
+    __block NSUInteger rowCount = 0;
+    BOOL succ = [self inReadDatabase:^(FMDatabase* db) {
+        // Page - the offset is only used when jumping to a page without a continuation token
+        NSUInteger offsetRows = continuationToken ? 0 : querySpec.pageSize * pageIndex;
+
+        // SQL
+        NSString* sql = [self convertSmartSql:[querySpec keysetSmartSqlAfterContinuationToken:continuationToken] withDb:db];
+        NSString* limitSql = [sql stringByAppendingString:@"LIMIT ?,?"];
+
+        // Args
+        NSMutableArray* args = [NSMutableArray arrayWithArray:[querySpec keysetBindsAfterContinuationToken:continuationToken]];
+        [args addObject:@(offsetRows)];
+        [args addObject:@(querySpec.pageSize)];
+
+        rowCount = [self runQuery:resultArray resultString:resultString querySpec:querySpec sql:limitSql args:args keysetColumns:YES lastRowToken:&lastRowToken withDb:db];
+    } error:error];
+
+    if (nextContinuationToken) {
+        // A partial page means we reached the end of the results
+        *nextContinuationToken = (succ && rowCount == querySpec.pageSize) ? lastRowToken : nil;
+    }
+    return succ;
+}
+
 - (void)runQuery:(NSMutableArray*)resultArray resultString:(NSMutableString*)resultString querySpec:(SFQuerySpec *)querySpec pageIndex:(NSUInteger)pageIndex withDb:(FMDatabase*)db
 {
-    NSAssert(resultArray != nil ^ resultString != nil, @"resultArray or resultString must be non-nil, but not both at the same times.");
-    BOOL computeResultAsString = resultString != nil;
-    
     // Page
     NSUInteger offsetRows = querySpec.pageSize * pageIndex;
     NSUInteger numberRows = querySpec.pageSize;
-    NSString* limit = [NSString stringWithFormat:@"%lu,%lu",(unsigned long)offsetRows,(unsigned long)numberRows];
     
     // SQL
     NSString* sql = [self convertSmartSql: querySpec.smartSql withDb:db];
-    NSString* limitSql = [@[@"SELECT * FROM (", sql, @") LIMIT ", limit] componentsJoinedByString:@""];
+    NSString* limitSql = [@[@"SELECT * FROM (", sql, @") LIMIT ?,?"] componentsJoinedByString:@""];
     
-    // Args
-    NSArray* args = [querySpec bindsForQuerySpec];
+    // Args - limit is bound so that the statement can be reused from one page to the next
+    NSMutableArray* args = [NSMutableArray arrayWithArray:[querySpec bindsForQuerySpec] ?: @[]];
+    [args addObject:@(offsetRows)];
+    [args addObject:@(numberRows)];
+    
+    [self runQuery:resultArray resultString:resultString querySpec:querySpec sql:limitSql args:args keysetColumns:NO lastRowToken:nil withDb:db];
+}
+
+/**
+ Run the given sql and add the rows to resultArray or resultString
+ When keysetColumns is YES, the last two columns are the order value and soup entry id of the row: they are not returned
+ but used to build the continuation token of the last row
+ @return the number of rows read
+ */
+- (NSUInteger)runQuery:(NSMutableArray*)resultArray resultString:(NSMutableString*)resultString querySpec:(SFQuerySpec *)querySpec sql:(NSString*)sql args:(NSArray*)args keysetColumns:(BOOL)keysetColumns lastRowToken:(NSDictionary**)lastRowToken withDb:(FMDatabase*)db
+{
+    NSAssert(resultArray != nil ^ resultString != nil, @"resultArray or resultString must be non-nil, but not both at the same times.");
+    BOOL computeResultAsString = resultString != nil;
     
     // Executing query
-    FMResultSet *frs = [self executeQueryThrows:limitSql withArgumentsInArray:args withDb:db];
-    NSMutableArray *resultStrings = [NSMutableArray array];
+    SFSmartStoreQueryProfiler *profiler = self.queryProfiler;
+    SFQueryProfileSample sample;
+    if (profiler) SFQueryProfileStart(&sample);
+    FMResultSet *frs = [self executeQueryThrows:sql withArgumentsInArray:args withDb:db];
+    if (profiler) SFQueryProfileResetCounters((sqlite3_stmt *)frs.statement.statement);
+    int dataColumnCount = [frs columnCount] - (keysetColumns ? 2 : 0);
+    NSMutableData *resultData = computeResultAsString ? [NSMutableData dataWithCapacity:kBufferSize] : nil;
+    SFAppendJsonLiteral(resultData, "[");
     NSUInteger currentRow = 0;
+    id lastOrderValue = nil;
+    id lastSoupEntryId = nil;
+    // External entries to load once all rows are read (when loadsExternalEntriesConcurrently is set)
+    NSMutableArray *pendingSoupEntryIds = self.loadsExternalEntriesConcurrently ? [NSMutableArray new] : nil;
+    NSMutableArray *pendingSoupTableNames = self.loadsExternalEntriesConcurrently ? [NSMutableArray new] : nil;
+    // Smart queries (or queries with select paths, or ranked match queries with a snippet) return rows
+    BOOL returnsRows = querySpec.returnsRows;
+    NSData *rowLayout = returnsRows ? SFRowLayout((sqlite3_stmt *)frs.statement.statement, dataColumnCount) : nil;
     while ([frs next]) {
         currentRow++;
         
         // Smart queries
-        if (querySpec.queryType == kSFSoupQueryTypeSmart || querySpec.selectPaths != nil) {
+        if (returnsRows) {
             if (computeResultAsString) {
-                NSMutableString *rowData = [NSMutableString new];
-                [self getDataFromRow:nil resultString:rowData resultSet:frs];
-                if (rowData) {
-                    [resultStrings addObject:rowData];
-                }
+                SFAppendJsonSeparator(resultData);
+                [self writeRow:resultData resultSet:frs rowLayout:rowLayout columnCount:dataColumnCount withDb:db];
             } else {
-                NSMutableArray *rowData = [NSMutableArray new];
-                [self getDataFromRow:rowData resultString:nil resultSet:frs];
-                if (rowData) {
-                    [resultArray addObject:rowData];
-                }
+                NSMutableArray *rowData = [NSMutableArray arrayWithCapacity:dataColumnCount];
+                [self getDataFromRow:rowData resultSet:frs rowLayout:rowLayout columnCount:dataColumnCount withDb:db];
+                [resultArray addObject:rowData];
             }
         }
         // Exact/like/range queries
         else {
             NSString* rawJson;
             NSString *columnName = [frs columnNameForIndex:0];
-            if ([columnName isEqualToString:SOUP_COL]) {
+            BOOL isSoupCol = [columnName isEqualToString:SOUP_COL];
+            if (isSoupCol && computeResultAsString) {
+                // Copying the serialized json straight from sqlite
+                sqlite3_stmt *statement = (sqlite3_stmt *)frs.statement.statement;
+                if (sqlite3_column_type(statement, 0) != SQLITE_NULL) {
+                    SFAppendJsonSeparator(resultData);
+                    [resultData appendBytes:sqlite3_column_text(statement, 0) length:sqlite3_column_bytes(statement, 0)];
+                }
+            }
+            else if (isSoupCol) {
                 rawJson = [frs stringForColumnIndex:0];
             }
             else if ([columnName isEqualToString:kSoupFeatureExternalStorage]) {
                 NSString *tableName = [frs stringForColumnIndex:0];
                 NSNumber *soupEntryId = @([frs longForColumnIndex:1]);
-                rawJson = [self loadExternalSoupEntryAsString:soupEntryId soupTableName:tableName];
+                if (pendingSoupEntryIds) {
+                    [pendingSoupEntryIds addObject:soupEntryId];
+                    [pendingSoupTableNames addObject:tableName];
+                } else if (computeResultAsString) {
+                    NSData *entryAsData = [self loadExternalSoupEntryAsData:soupEntryId soupTableName:tableName withDb:db];
+                    if (entryAsData) {
+                        SFAppendJsonSeparator(resultData);
+                        [resultData appendData:entryAsData];
+                    }
+                } else {
+                    id entry = [self loadExternalSoupEntry:soupEntryId soupTableName:tableName withDb:db];
+                    if (entry) {
+                        [resultArray addObject:entry];
+                    }
+                }
             }
             
-            if (computeResultAsString) {
-                if (rawJson) {
-                    [resultStrings addObject:rawJson];
-                }
-            } else {
+            if (rawJson) {
                 id entry = [SFJsonUtils objectFromJSONString:rawJson];
                 if (entry) {
                     [resultArray addObject:entry];
                 }
             }
         }
+
+        if (keysetColumns) {
+            lastOrderValue = [frs objectForColumnIndex:dataColumnCount];
+            lastSoupEntryId = [frs objectForColumnIndex:dataColumnCount + 1];
+        }
     }
+    if (profiler) SFQueryProfileReadCounters(&sample, (sqlite3_stmt *)frs.statement.statement);
     [frs close];
     
+    // Only exact/like/range queries on external soups get here: every row is a pending entry, so row order is preserved
+    if (pendingSoupEntryIds.count > 0) {
+        for (id entry in [self loadExternalSoupEntries:pendingSoupEntryIds soupTableNames:pendingSoupTableNames asData:computeResultAsString withDb:db]) {
+            if (entry == [NSNull null]) {
+                continue;
+            }
+            if (computeResultAsString) {
+                SFAppendJsonSeparator(resultData);
+                [resultData appendData:entry];
+            } else {
+                [resultArray addObject:entry];
+            }
+        }
+    }
+    
     if (computeResultAsString) {
-        [resultString appendString:@"["];
-        [resultString appendString:[resultStrings componentsJoinedByString:@","]];
-        [resultString appendString:@"]"];
+        SFAppendJsonLiteral(resultData, "]");
+        NSString *json = [[NSString alloc] initWithBytesNoCopy:resultData.mutableBytes length:resultData.length encoding:NSUTF8StringEncoding freeWhenDone:NO];
+        [resultString appendString:json];
+    }
+
+    if (lastRowToken) {
+        *lastRowToken = lastSoupEntryId ? @{kQuerySpecContinuationOrderValue: lastOrderValue ?: [NSNull null],
+                                            kQuerySpecContinuationSoupEntryId: lastSoupEntryId} : nil;
     }
+    if (profiler) [self recordQueryProfile:&sample profiler:profiler smartSql:querySpec.smartSql sql:sql args:args rowsReturned:currentRow withDb:db];
+    return currentRow;
 }
 
-- (void) getDataFromRow:(NSMutableArray*)resultArray resultString:(NSMutableString*)resultString resultSet:(FMResultSet*)frs
+/**
+ Add the values of the given row to resultArray, reading them straight from the sqlite statement
+ */
+- (void) getDataFromRow:(NSMutableArray*)resultArray resultSet:(FMResultSet*)frs rowLayout:(NSData*)rowLayout columnCount:(int)columnCount withDb:(FMDatabase*)db
 {
-    NSAssert(resultArray != nil ^ resultString != nil, @"resultArray or resultString must be non-nil, but not both at the same times.");
-    BOOL computeResultAsString = resultString != nil;
-    NSDictionary* valuesMap = [frs resultDictionary];
-    NSMutableArray *resultStrings = [NSMutableArray array];
+    sqlite3_stmt *statement = (sqlite3_stmt *)frs.statement.statement;
+    const SFResultColumnKind *kinds = rowLayout.bytes;
     
-    for (int i = 0; i < frs.columnCount; i++) {
+    for (int i = 0; i < columnCount; i++) {
         @autoreleasepool {
-            NSString* columnName = [frs columnNameForIndex:i];
-            id value = valuesMap[columnName];
-            
-            BOOL isSoupCol = [value isKindOfClass:[NSString class]] &&
-            ([columnName isEqualToString:SOUP_COL] || [columnName hasPrefix:[NSString stringWithFormat:@"%@:", SOUP_COL]]);
-            BOOL isExternalSoupCol = [columnName isEqualToString:kSoupFeatureExternalStorage];
-            
-            // If this is a soup column then the value is a serialized json
-            if (isSoupCol || isExternalSoupCol) {
-                if (isExternalSoupCol) {
+            id value;
+            switch (kinds[i]) {
+                case SFResultColumnKindSoup:
+                    // If this is a soup column then the value is a serialized json
+                    if (sqlite3_column_type(statement, i) == SQLITE_TEXT) {
+                        NSData *rawJson = [NSData dataWithBytesNoCopy:(void *)sqlite3_column_text(statement, i)
+                                                               length:sqlite3_column_bytes(statement, i)
+                                                         freeWhenDone:NO];
+                        value = [SFJsonUtils objectFromJSONData:rawJson];
+                    }
+                    break;
+                case SFResultColumnKindExternalSoup: {
                     // Reading the actual value from external storage
+                    NSString *soupTableName = [frs stringForColumnIndex:i];
                     NSNumber *soupEntryId = @([frs longForColumnIndex:++i]);
-                    value = [self loadExternalSoupEntryAsString:soupEntryId soupTableName:value];
-                }
-
-                if (computeResultAsString) {
-                    if (value) {
-                        [resultStrings addObject:value];
-                    } else {
-                        // This is a smart query, we can't skip
-                        // If you do select x,y,z, then you expect 3 values per row in the result set
-                        [resultStrings addObject:@"null"];
-                    }
-                } else {
-                    id entry = [SFJsonUtils objectFromJSONString:value];
-                    if (entry) {
-                        [resultArray addObject:entry];
-                    } else {
-                        // This is a smart query, we can't skip
-                        // If you do select x,y,z, then you expect 3 values per row in the result set
-                        [resultStrings addObject:[NSNull null]];
-                    }
+                    value = [self loadExternalSoupEntry:soupEntryId soupTableName:soupTableName withDb:db];
+                    break;
                 }
+                case SFResultColumnKindValue:
+                    value = SFColumnValue(statement, i);
+                    break;
             }
-            // Otherwise the value is an atomic type
-            else {
-                if (computeResultAsString) {
-                    if ([value isKindOfClass:[NSNull class]]) {
-                        [resultStrings addObject:@"null"];
-                    } else if ([value isKindOfClass:[NSNumber class]]) {
-                        [resultStrings addObject:[((NSNumber*)value) stringValue]];
-                    }
-                    else if ([value isKindOfClass:[NSString class]]) {
-                        NSString *escapedAndQuotedValue = [self escapeStringValueAndQuote:(NSString*) value];
-                        if (escapedAndQuotedValue) {
-                            [resultStrings addObject:escapedAndQuotedValue];
-                        } else {
-                            // This is a smart query, we can't skip
-                            // If you do select x,y,z, then you expect 3 values per row in the result set
-                            [resultStrings addObject:@"null"];
-                        }
-                    }
+            // This is a smart query, we can't skip
+            // If you do select x,y,z, then you expect 3 values per row in the result set
+            [resultArray addObject:value ?: [NSNull null]];
+        }
+    }
+}
 
+/**
+ Write the given row as a json array into resultData, reading the values straight from the sqlite statement
+ */
+- (void) writeRow:(NSMutableData*)resultData resultSet:(FMResultSet*)frs rowLayout:(NSData*)rowLayout columnCount:(int)columnCount withDb:(FMDatabase*)db
+{
+    sqlite3_stmt *statement = (sqlite3_stmt *)frs.statement.statement;
+    const SFResultColumnKind *kinds = rowLayout.bytes;
+    
+    SFAppendJsonLiteral(resultData, "[");
+    for (int i = 0; i < columnCount; i++) {
+        if (i > 0) {
+            SFAppendJsonLiteral(resultData, ",");
+        }
+        int columnType = sqlite3_column_type(statement, i);
+        
+        // If this is a soup column then the value is a serialized json
+        if (kinds[i] == SFResultColumnKindSoup && columnType == SQLITE_TEXT) {
+            [resultData appendBytes:sqlite3_column_text(statement, i) length:sqlite3_column_bytes(statement, i)];
+        }
+        else if (kinds[i] == SFResultColumnKindExternalSoup) {
+            // Reading the actual value from external storage
+            @autoreleasepool {
+                NSString *soupTableName = [frs stringForColumnIndex:i];
+                NSNumber *soupEntryId = @([frs longForColumnIndex:++i]);
+                NSData *value = [self loadExternalSoupEntryAsData:soupEntryId soupTableName:soupTableName withDb:db];
+                if (value) {
+                    [resultData appendData:value];
                 } else {
-                    [resultArray addObject:value];
+                    // This is a smart query, we can't skip
+                    // If you do select x,y,z, then you expect 3 values per row in the result set
+                    SFAppendJsonLiteral(resultData, "null");
                 }
             }
         }
-    }
-    
-    if (computeResultAsString) {
-        [resultString appendString:@"["];
-        [resultString appendString:[resultStrings componentsJoinedByString:@","]];
-        [resultString appendString:@"]"];
-    }
-}
-
--(NSString*) escapeStringValueAndQuote:(NSString*) raw {
-    NSMutableString* escaped = [NSMutableString new];
-    [escaped appendString:@"\""];
-    for (NSUInteger i = 0; i < raw.length; i += 1) {
-        unichar c = [raw characterAtIndex:i];
-        switch (c) {
-            case '\\':
-            case '/':
-            case '"':
-                [escaped appendFormat:@"\\%C", c];
-                break;
-            case '\b':
-                [escaped appendString:@"\\b"];
-                break;
-            case '\f':
-                [escaped appendString:@"\\f"];
-                break;
-            case '\n':
-                [escaped appendString:@"\\n"];
-                break;
-            case '\r':
-                [escaped appendString:@"\\r"];
-                break;
-            case '\t':
-                [escaped appendString:@"\\t"];
-                break;
-            default:
-                if (c < ' ') {
-                    [escaped appendFormat:@"\\u%04x", c];
-                } else {
-                    [escaped appendFormat:@"%C", c];
+        // Otherwise the value is an atomic type
+        else {
+            switch (columnType) {
+                case SQLITE_INTEGER: {
+                    char number[24];
+                    int length = snprintf(number, sizeof(number), "%lld", sqlite3_column_int64(statement, i));
+                    [resultData appendBytes:number length:length];
+                    break;
                 }
+                case SQLITE_FLOAT:
+                    SFAppendJsonString(resultData, [@(sqlite3_column_double(statement, i)) stringValue]);
+                    break;
+                case SQLITE_TEXT: {
+                    NSUInteger valueStart = resultData.length;
+                    SFAppendJsonEscapedValue(resultData, sqlite3_column_text(statement, i), sqlite3_column_bytes(statement, i));
+                    if (_jsonSerializationCheckEnabled && ![self checkEscapedValue:resultData fromOffset:valueStart]) {
+                        // This is a smart query, we can't skip
+                        // If you do select x,y,z, then you expect 3 values per row in the result set
+                        resultData.length = valueStart;
+                        SFAppendJsonLiteral(resultData, "null");
+                    }
+                    break;
+                }
+                default:
+                    SFAppendJsonLiteral(resultData, "null");
+                    break;
+            }
         }
     }
-    [escaped appendString:@"\""];
-    
-    if (![self checkRawJson:[NSString stringWithFormat:@"[%@]", escaped] fromMethod:NSStringFromSelector(_cmd)]) {
-        return nil;
-    } else {
-        return [NSString stringWithString:escaped];
-    }
+    SFAppendJsonLiteral(resultData, "]");
+}
+
+- (BOOL) checkEscapedValue:(NSData*)resultData fromOffset:(NSUInteger)offset {
+    NSString *escaped = [[NSString alloc] initWithBytes:(const char *)resultData.bytes + offset length:resultData.length - offset encoding:NSUTF8StringEncoding];
+    return escaped != nil && [self checkRawJson:[NSString stringWithFormat:@"[%@]", escaped] fromMethod:NSStringFromSelector(_cmd)];
 }
 
 - (NSString *)idsInPredicate:(NSArray *)ids idCol:(NSString*)idCol
@@ -1965,7 +3141,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 - (NSArray *)retrieveEntries:(NSArray*)soupEntryIds fromSoup:(NSString*)soupName
 {
     __block NSArray* result;
-    [self inDatabase:^(FMDatabase* db) {
+    [self inReadDatabase:^(FMDatabase* db) {
         result = [self retrieveEntries:soupEntryIds fromSoup:soupName withDb:db];
     } error:nil];
     return result;
@@ -1983,11 +3159,23 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     
     SFSoupSpec *soupSpec = [self attributesForSoup:soupName withDb:db];
     BOOL soupUsesExternalStorage = [soupSpec.features containsObject:kSoupFeatureExternalStorage];
-    if (soupUsesExternalStorage) {
+    if (soupUsesExternalStorage && self.loadsExternalEntriesConcurrently && soupEntryIds.count > 1) {
+        NSMutableArray *soupTableNames = [NSMutableArray arrayWithCapacity:soupEntryIds.count];
+        for (NSUInteger i = 0; i < soupEntryIds.count; i++) {
+            [soupTableNames addObject:soupTableName];
+        }
+        for (id entry in [self loadExternalSoupEntries:soupEntryIds soupTableNames:soupTableNames asData:NO withDb:db]) {
+            if (entry != [NSNull null]) {
+                [result addObject:entry];
+            }
+        }
+    }
+    else if (soupUsesExternalStorage) {
         for (NSNumber *soupEntryId in soupEntryIds) {
             @autoreleasepool {
                 NSDictionary *entry = [self loadExternalSoupEntry:soupEntryId
-                                                    soupTableName:soupTableName];
+                                                    soupTableName:soupTableName
+                                                           withDb:db];
                 if (entry) {
                     [result addObject:entry];
                 }
@@ -2013,22 +3201,81 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     return result;
 }
 
-- (NSDictionary *)insertOneEntry:(NSDictionary*)entry inSoupTable:(NSString*)soupTableName soupAttributes:(SFSoupSpec*)soupSpec indices:(NSArray*)indices withDb:(FMDatabase*) db
+/**
+ Loads external soup entries on a concurrent queue - dispatch_apply runs at most one worker per core
+ @param soupEntryIds the soup entry ids
+ @param soupTableNames the soup table name of each entry
+ @param asData YES to get the serialized entries, NO to get the parsed entries
+ @param db the connection the rows were read with
+ @return one element per soup entry id, in the same order: the entry or NSNull if it could not be loaded
+ */
+- (NSArray *)loadExternalSoupEntries:(NSArray<NSNumber *> *)soupEntryIds soupTableNames:(NSArray<NSString *> *)soupTableNames asData:(BOOL)asData withDb:(FMDatabase*)db
+{
+    NSUInteger count = soupEntryIds.count;
+    __strong id *loaded = (__strong id *)calloc(count, sizeof(id));
+    dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t i) {
+        @autoreleasepool {
+            @try {
+                loaded[i] = asData
+                    ? [self loadExternalSoupEntryAsData:soupEntryIds[i] soupTableName:soupTableNames[i] withDb:db]
+                    : [self loadExternalSoupEntry:soupEntryIds[i] soupTableName:soupTableNames[i] withDb:db];
+            } @catch (NSException *exception) {
+                // Rethrown on the calling thread below
+                loaded[i] = exception;
+            }
+        }
+    });
+    
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:count];
+    NSException *failure = nil;
+    for (NSUInteger i = 0; i < count; i++) {
+        if ([loaded[i] isKindOfClass:[NSException class]]) {
+            failure = failure ?: loaded[i];
+        }
+        [result addObject:loaded[i] ?: [NSNull null]];
+        loaded[i] = nil;
+    }
+    free(loaded);
+    if (failure) {
+        @throw failure;
+    }
+    return result;
+}
+
+/**
+ Hands out the id of the next entry inserted in the given soup table.
+ The counter is seeded from SQLITE_SEQUENCE the first time a soup table is used in an inDatabase/inTransaction block,
+ then kept in memory: entries are inserted with the id they were given so that sqlite's own sequence follows along.
+ */
+- (NSNumber *)nextEntryIdForSoupTable:(NSString *)soupTableName withDb:(FMDatabase *)db
+{
+    NSNumber *nextEntryId = _nextEntryIdBySoupTable[soupTableName];
+    if (nil == nextEntryId) {
+        FMResultSet *frs = [self executeQueryThrows:@"SELECT seq FROM SQLITE_SEQUENCE WHERE name = ?" withArgumentsInArray:@[soupTableName] withDb:db];
+        if ([frs next]) {
+            nextEntryId = [NSNumber numberWithLongLong:1LL + [frs longLongIntForColumnIndex:0]];
+        }
+        else {
+            // First time, we won't find any rows;
+            nextEntryId = [NSNumber numberWithLongLong:1LL];
+        }
+        [frs close];
+    }
+    _nextEntryIdBySoupTable[soupTableName] = [NSNumber numberWithLongLong:nextEntryId.longLongValue + 1LL];
+    return nextEntryId;
+}
+
+/**
+ @param ftsBuffer Buffer for the fts row, or nil to write it right away
+ */
+- (NSDictionary *)insertOneEntry:(NSDictionary*)entry inSoupTable:(NSString*)soupTableName soupAttributes:(SFSoupSpec*)soupSpec indices:(NSArray*)indices ftsBuffer:(SFSoupFtsBuffer*)ftsBuffer withDb:(FMDatabase*) db
 {
     NSNumber *nowVal = [self currentTimeInMilliseconds];
     NSNumber *newEntryId;
     BOOL soupUsesExternalStorage = [soupSpec.features containsObject:kSoupFeatureExternalStorage];
     
     // Get next id
-    FMResultSet *frs = [self executeQueryThrows:@"SELECT seq FROM SQLITE_SEQUENCE WHERE name = ?" withArgumentsInArray:@[soupTableName] withDb:db];
-    if ([frs next]) {
-        newEntryId = [NSNumber numberWithLongLong:1LL + [frs longLongIntForColumnIndex:0]];
-    }
-    else {
-        // First time, we won't find any rows;
-        newEntryId = [NSNumber numberWithLongLong:1LL];
-    }
-    [frs close];
+    newEntryId = [self nextEntryIdForSoupTable:soupTableName withDb:db];
 
     //clone the entry so that we can insert the new SOUP_ENTRY_ID into the json
     NSMutableDictionary *mutableEntry = [entry mutableCopy];
@@ -2036,6 +3283,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     [mutableEntry setValue:nowVal forKey:SOUP_LAST_MODIFIED_DATE];
     
     NSMutableDictionary *values = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                   newEntryId, ID_COL,
                                    nowVal, CREATED_COL,
                                    nowVal, LAST_MODIFIED_COL,
                                    nil];
@@ -2046,7 +3294,9 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     }
     
     //build up the set of index column values for this new row
-    [self projectIndexedPaths:entry values:values indices:indices typeFilter:kValueExtractedToColumn];
+    if (![soupSpec.features containsObject:kSoupFeatureGeneratedColumns]) {
+        [self projectIndexedPaths:entry values:values indices:indices typeFilter:kValueExtractedToColumn];
+    }
     [self insertIntoTable:soupTableName values:values withDb:db];
     
     // external storage
@@ -2067,18 +3317,26 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                                           newEntryId, ROWID_COL,
                                           nil];
         [self projectIndexedPaths:entry values:ftsValues indices:indices typeFilter:kValueExtractedToFtsColumn];
-        [self insertIntoTable:[NSString stringWithFormat:@"%@_fts", soupTableName] values:ftsValues withDb:db];
+        if (ftsBuffer) {
+            [ftsBuffer addRow:ftsValues forEntryId:newEntryId isNew:YES];
+        } else {
+            [self insertIntoTable:[NSString stringWithFormat:@"%@_fts", soupTableName] values:ftsValues withDb:db];
+        }
     }
     
     return mutableEntry;
 }
 
 
+/**
+ @param ftsBuffer Buffer for the fts row, or nil to write it right away
+ */
 - (NSDictionary *)updateOneEntry:(NSDictionary *)entry
                      withEntryId:(NSNumber *)entryId
                      inSoupTable:(NSString *)soupTableName
                   soupAttributes:(SFSoupSpec *)soupSpec
                          indices:(NSArray *)indices
+                       ftsBuffer:(SFSoupFtsBuffer *)ftsBuffer
                           withDb:(FMDatabase *) db
 {
     NSNumber *nowVal = [self currentTimeInMilliseconds];
@@ -2088,7 +3346,9 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                                     nil];
     
     //build up the set of index column values for this row
-    [self projectIndexedPaths:entry values:values indices:indices typeFilter:kValueExtractedToColumn];
+    if (![soupSpec.features containsObject:kSoupFeatureGeneratedColumns]) {
+        [self projectIndexedPaths:entry values:values indices:indices typeFilter:kValueExtractedToColumn];
+    }
     
     //clone the entry so that we can modify SOUP_LAST_MODIFIED_DATE
     NSMutableDictionary *mutableEntry = [entry mutableCopy];
@@ -2101,13 +3361,13 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     }
 	
     [self updateTable:soupTableName values:values entryId:entryId idCol:ID_COL withDb:db];
+    // A buffered fts row is deleted then re-inserted: it must not be added for an entry that does not exist
+    BOOL entryExists = [db changes] > 0;
     
     // external storage:
     // Update db first
     // (If file save fails, db will be rolledback)
     if (soupUsesExternalStorage) {
-        [self updateTable:soupTableName values:values entryId:entryId idCol:ID_COL withDb:db];
-        
         BOOL didSave = [self saveSoupEntryExternally:mutableEntry
                                          soupEntryId:entryId
                                        soupTableName:soupTableName];
@@ -2122,7 +3382,13 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     if ([SFSoupIndex hasFts:indices]) {
         NSMutableDictionary *ftsValues = [NSMutableDictionary new];
         [self projectIndexedPaths:entry values:ftsValues indices:indices typeFilter:kValueExtractedToFtsColumn];
-        [self updateTable:[NSString stringWithFormat:@"%@_fts", soupTableName] values:ftsValues entryId:entryId idCol:ROWID_COL withDb:db];
+        if (ftsBuffer) {
+            if (entryExists) {
+                [ftsBuffer addRow:ftsValues forEntryId:entryId isNew:NO];
+            }
+        } else {
+            [self updateTable:[NSString stringWithFormat:@"%@_fts", soupTableName] values:ftsValues entryId:entryId idCol:ROWID_COL withDb:db];
+        }
     }
     
     return mutableEntry;
@@ -2182,6 +3448,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                           inSoupTable:soupTableName
                        soupAttributes:soupSpec
                               indices:indices
+                            ftsBuffer:nil
                                withDb:db];
     } else {
         //no entry id: insert
@@ -2189,6 +3456,7 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
                           inSoupTable:soupTableName
                        soupAttributes:soupSpec
                               indices:indices
+                            ftsBuffer:nil
                                withDb:db];
     }
     
@@ -2224,6 +3492,16 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     if ([self soupExists:soupName withDb:db]) {
         NSArray *indices = [self indicesForSoup:soupName withDb:db];
         
+        if (entries.count > 1) {
+            NSError *localError = nil;
+            NSArray *upsertedEntries = [self bulkUpsertEntries:entries inSoup:soupName indices:indices externalIdPath:localExternalIdPath error:&localError withDb:db];
+            if (nil != upsertedEntries && localError == nil) {
+                return upsertedEntries;
+            }
+            if (error != nil) *error = localError;
+            return [NSMutableArray array];
+        }
+        
         result = [NSMutableArray array]; //empty result array by default
         BOOL upsertSuccess = YES;
         for (NSDictionary *entry in entries) {
@@ -2246,6 +3524,162 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     return result;
 }
 
+- (NSArray *)bulkUpsertEntries:(NSArray *)entries
+                        inSoup:(NSString *)soupName
+                       indices:(NSArray *)indices
+                externalIdPath:(NSString *)externalIdPath
+                         error:(NSError **)error
+                        withDb:(FMDatabase *)db
+{
+    NSString *soupTableName = [self tableNameForSoup:soupName withDb:db];
+    SFSoupSpec *soupSpec = [self attributesForSoup:soupName withDb:db];
+    BOOL soupUsesExternalStorage = [soupSpec.features containsObject:kSoupFeatureExternalStorage];
+    BOOL soupUsesGeneratedColumns = [soupSpec.features containsObject:kSoupFeatureGeneratedColumns];
+    BOOL hasFts = [SFSoupIndex hasFts:indices];
+    
+    // Resolve ids of existing entries up front (one IN query for the whole batch instead of one lookup per entry)
+    NSMutableDictionary *existingIdsByPosition = [NSMutableDictionary dictionaryWithCapacity:entries.count];
+    NSMutableArray *lookupKeys = nil;
+    if ([externalIdPath isEqualToString:SOUP_ENTRY_ID]) {
+        [entries enumerateObjectsUsingBlock:^(NSDictionary *entry, NSUInteger position, BOOL *stop) {
+            id soupEntryId = entry[SOUP_ENTRY_ID];
+            if (soupEntryId != nil) {
+                existingIdsByPosition[@(position)] = soupEntryId;
+            }
+        }];
+    } else {
+        NSMutableArray *fieldValues = [NSMutableArray arrayWithCapacity:entries.count];
+        for (NSDictionary *entry in entries) {
+            id fieldValue = [SFJsonUtils projectIntoJson:entry path:externalIdPath];
+            if (fieldValue == nil) {
+                // Cannot have empty values for user-defined external ID upsert.
+                if (error != nil) {
+                    NSString *errorDescription = [NSString stringWithFormat:kSFSmartStoreExternalIdNilDescription, externalIdPath];
+                    *error = [NSError errorWithDomain:kSFSmartStoreErrorDomain
+                                                 code:kSFSmartStoreExternalIdNilCode
+                                             userInfo:@{NSLocalizedDescriptionKey: errorDescription}];
+                }
+                return nil;
+            }
+            [fieldValues addObject:fieldValue];
+        }
+        NSDictionary *idsByKey = [self lookupSoupEntryIdsForSoupName:soupName
+                                                       soupTableName:soupTableName
+                                                        forFieldPath:externalIdPath
+                                                         fieldValues:fieldValues
+                                                               error:error
+                                                              withDb:db];
+        if (idsByKey == nil) {
+            NSString *errorMsg = [NSString stringWithFormat:kSFSmartStoreExtIdLookupError,
+                                  externalIdPath, fieldValues, (error != nil ? [*error localizedDescription] : @"")];
+            [SFSDKSmartStoreLogger d:[self class] format:@"%@", errorMsg];
+            return nil;
+        }
+        lookupKeys = [NSMutableArray arrayWithCapacity:entries.count];
+        for (NSUInteger position = 0; position < fieldValues.count; position++) {
+            NSString *key = [self lookupKeyForFieldValue:fieldValues[position]];
+            [lookupKeys addObject:key];
+            if (idsByKey[key] != nil) {
+                existingIdsByPosition[@(position)] = idsByKey[key];
+            }
+        }
+    }
+    
+    // New entries are inserted with multi-row INSERTs, fts rows (of new and updated entries) are buffered
+    NSMutableArray *pendingRows = [NSMutableArray new];
+    NSMutableArray *pendingExternalEntries = [NSMutableArray new];
+    NSMutableSet *pendingIds = [NSMutableSet new];
+    NSString *soupFtsTableName = [NSString stringWithFormat:@"%@_fts", soupTableName];
+    SFSoupFtsBuffer *ftsBuffer = hasFts ? [[SFSoupFtsBuffer alloc] initWithStore:self ftsTableName:soupFtsTableName db:db] : nil;
+    NSDictionary *ftsMergeSettings = nil;
+    if (hasFts && entries.count >= kFtsBulkLoadMinEntries) {
+        ftsMergeSettings = [self deferFtsMerges:soupFtsTableName withDb:db];
+    }
+    void (^flushPendingInserts)(void) = ^{
+        [self insertIntoTable:soupTableName rows:pendingRows withDb:db];
+        for (NSDictionary *mutableEntry in pendingExternalEntries) {
+            BOOL didSave = [self saveSoupEntryExternally:mutableEntry
+                                             soupEntryId:mutableEntry[SOUP_ENTRY_ID]
+                                           soupTableName:soupTableName];
+            if (!didSave) {
+                @throw [NSException exceptionWithName:@"Failed to save external soup file."
+                                               reason:nil
+                                             userInfo:nil];
+            }
+        }
+        [pendingRows removeAllObjects];
+        [pendingExternalEntries removeAllObjects];
+        [pendingIds removeAllObjects];
+    };
+    
+    NSMutableDictionary *insertedIdsByKey = [NSMutableDictionary new];
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:entries.count];
+    for (NSUInteger position = 0; position < entries.count; position++) {
+        NSDictionary *entry = entries[position];
+        NSString *lookupKey = lookupKeys[position];
+        id soupEntryId = existingIdsByPosition[@(position)];
+        if (soupEntryId == nil && lookupKey != nil) {
+            // Inserted earlier in the same batch
+            soupEntryId = insertedIdsByKey[lookupKey];
+        }
+        
+        if (nil != soupEntryId) {
+            // Updates are per row: the update statement is prepared once and reused
+            if ([pendingIds containsObject:soupEntryId]) {
+                flushPendingInserts();
+            }
+            [result addObject:[self updateOneEntry:entry
+                                       withEntryId:soupEntryId
+                                       inSoupTable:soupTableName
+                                    soupAttributes:soupSpec
+                                           indices:indices
+                                         ftsBuffer:ftsBuffer
+                                            withDb:db]];
+            continue;
+        }
+        
+        NSNumber *nowVal = [self currentTimeInMilliseconds];
+        NSNumber *newEntryId = [self nextEntryIdForSoupTable:soupTableName withDb:db];
+        NSMutableDictionary *mutableEntry = [entry mutableCopy];
+        [mutableEntry setValue:newEntryId forKey:SOUP_ENTRY_ID];
+        [mutableEntry setValue:nowVal forKey:SOUP_LAST_MODIFIED_DATE];
+        
+        NSMutableDictionary *values = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                       newEntryId, ID_COL,
+                                       nowVal, CREATED_COL,
+                                       nowVal, LAST_MODIFIED_COL,
+                                       nil];
+        if (!soupUsesExternalStorage) {
+            values[SOUP_COL] = [SFJsonUtils JSONRepresentation:mutableEntry];
+        } else {
+            [pendingExternalEntries addObject:mutableEntry];
+        }
+        if (!soupUsesGeneratedColumns) {
+            [self projectIndexedPaths:entry values:values indices:indices typeFilter:kValueExtractedToColumn];
+        }
+        [pendingRows addObject:values];
+        
+        if (hasFts) {
+            NSMutableDictionary *ftsValues = [NSMutableDictionary dictionary];
+            [self projectIndexedPaths:entry values:ftsValues indices:indices typeFilter:kValueExtractedToFtsColumn];
+            [ftsBuffer addRow:ftsValues forEntryId:newEntryId isNew:YES];
+        }
+        
+        [pendingIds addObject:newEntryId];
+        if (lookupKey != nil) {
+            insertedIdsByKey[lookupKey] = newEntryId;
+        }
+        [result addObject:mutableEntry];
+    }
+    flushPendingInserts();
+    [ftsBuffer flush];
+    if (ftsMergeSettings) {
+        [self setFtsMerges:soupFtsTableName settings:ftsMergeSettings withDb:db];
+    }
+    
+    return result;
+}
+
 - (void)removeEntries:(NSArray*)soupEntryIds fromSoup:(NSString*)soupName
 {
     [self removeEntries:soupEntryIds fromSoup:soupName error:nil];
@@ -2301,22 +3735,24 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     NSString* limitSql = [NSString stringWithFormat:@"SELECT * FROM (%@) LIMIT %lu", querySql, (unsigned long)querySpec.pageSize];
     NSArray* args = [querySpec bindsForQuerySpec];
     
-    // For soup using external storage, run query to get ids
+    // Run the query once: the ids are used for the soup table, the fts table and the external storage
     NSMutableArray* ids = [NSMutableArray new];
     SFSoupSpec *soupSpec = [self attributesForSoup:soupName withDb:db];
     BOOL soupUsesExternalStorage = [soupSpec.features containsObject:kSoupFeatureExternalStorage];
-    if (soupUsesExternalStorage) {
-        FMResultSet* frs = [self executeQueryThrows:limitSql withArgumentsInArray:args withDb:db];
-        while ([frs next]) {
-            [ids addObject:@([frs longForColumnIndex:0])];
-        }
+    FMResultSet* frs = [self executeQueryThrows:limitSql withArgumentsInArray:args withDb:db];
+    while ([frs next]) {
+        [ids addObject:@([frs longLongIntForColumnIndex:0])];
+    }
+    [frs close];
+    if (ids.count == 0) {
+        return;
     }
     
-    NSString *deleteSql = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ in (%@)", soupTableName, ID_COL, limitSql];
-    [self executeUpdateThrows:deleteSql withArgumentsInArray:args withDb:db];
+    NSString *deleteSql = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@", soupTableName, [self idsInPredicate:ids idCol:ID_COL]];
+    [self executeUpdateThrows:deleteSql withDb:db];
     // fts
     if ([self hasFts:soupName withDb:db]) {
-        NSString *deleteFtsSql = [NSString stringWithFormat:@"DELETE FROM %@_fts WHERE %@ in (%@)", soupTableName, ROWID_COL, querySql];
+        NSString *deleteFtsSql = [NSString stringWithFormat:@"DELETE FROM %@_fts WHERE %@", soupTableName, [self idsInPredicate:ids idCol:ROWID_COL]];
         [self executeUpdateThrows:deleteFtsSql withDb:db];
     }
 
@@ -2417,6 +3853,10 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 - (BOOL) alterSoup:(NSString*)soupName withIndexSpecs:(NSArray*)indexSpecs reIndexData:(BOOL)reIndexData
 {
     if ([self soupExists:soupName]) {
+        // Checked before starting: the operation would only fail once the old soup table has been renamed
+        if (![self compositeIndexPathsAreIndexed:[self attributesForSoup:soupName] indexSpecs:indexSpecs]) {
+            return NO;
+        }
         SFAlterSoupLongOperation* operation = [[SFAlterSoupLongOperation alloc] initWithStore:self
                                                                                      soupName:soupName
                                                                                 newIndexSpecs:indexSpecs
@@ -2431,6 +3871,10 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 - (BOOL) alterSoup:(NSString*)soupName withSoupSpec:(SFSoupSpec*)soupSpec withIndexSpecs:(NSArray*)indexSpecs reIndexData:(BOOL)reIndexData
 {
     if ([self soupExists:soupName]) {
+        // Checked before starting: the operation would only fail once the old soup table has been renamed
+        if (![self compositeIndexPathsAreIndexed:(soupSpec ?: [self attributesForSoup:soupName]) indexSpecs:indexSpecs]) {
+            return NO;
+        }
         SFAlterSoupLongOperation* operation = [[SFAlterSoupLongOperation alloc] initWithStore:self
                                                                                      soupName:soupName
                                                                                   newSoupSpec:soupSpec
@@ -2445,69 +3889,219 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 
 - (BOOL) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray*)indexPaths
 {
-    __block BOOL result;
-    [self inTransaction:^(FMDatabase* db, BOOL* rollback) {
-        result = [self reIndexSoup:soupName withIndexPaths:indexPaths withDb:db];
-    } error:nil];
-    return result;
+    return [self reIndexSoup:soupName withIndexPaths:indexPaths chunkSize:kSFReIndexSoupDefaultChunkSize progress:nil];
+}
+
+- (BOOL) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray*)indexPaths chunkSize:(NSUInteger)chunkSize progress:(SFReIndexSoupProgressBlock)progressBlock
+{
+    if ([self soupExists:soupName]) {
+        SFReIndexSoupLongOperation* operation = [[SFReIndexSoupLongOperation alloc] initWithStore:self
+                                                                                         soupName:soupName
+                                                                                       indexPaths:indexPaths
+                                                                                        chunkSize:chunkSize];
+        operation.progressBlock = progressBlock;
+        return [operation run];
+    } else {
+        return NO;
+    }
 }
 
 - (BOOL) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray*)indexPaths withDb:(FMDatabase*)db
 {
     if ([self soupExists:soupName withDb:db]) {
-        NSString *soupTableName = [self tableNameForSoup:soupName withDb:db];
-        NSDictionary *mapIndexSpecs = [SFSoupIndex mapForSoupIndexes:[self indicesForSoup:soupName withDb:db]];
-        NSMutableArray* indices = [NSMutableArray new];
+        [self reIndexSoup:soupName withIndexPaths:indexPaths afterEntryId:0 limit:0 lastEntryId:NULL withDb:db];
+        return YES;
+    }
+    else {
+        return NO;
+    }
+}
 
-        SFSoupSpec *soupSpec = [self attributesForSoup:soupName withDb:db];
-        BOOL soupUsesExternalStorage = [soupSpec.features containsObject:kSoupFeatureExternalStorage];
-        NSArray *queryCols = soupUsesExternalStorage ? @[ID_COL] : @[ID_COL, SOUP_COL];
-
-        BOOL hasFts = NO;
-        for (NSString* indexPath in  indexPaths) {
-            SFSoupIndex *idx = mapIndexSpecs[indexPath];
-            if (idx) {
-                [indices addObject:idx];
-                if ([idx.indexType isEqualToString:kSoupIndexTypeFullText]) {
-                    hasFts = YES;
+- (NSUInteger) reIndexSoup:(NSString*)soupName withIndexPaths:(NSArray*)indexPaths afterEntryId:(long long)afterEntryId limit:(NSUInteger)limit lastEntryId:(long long*)lastEntryId withDb:(FMDatabase*)db
+{
+    if (![self soupExists:soupName withDb:db]) {
+        return 0;
+    }
+
+    NSString *soupTableName = [self tableNameForSoup:soupName withDb:db];
+    NSDictionary *mapIndexSpecs = [SFSoupIndex mapForSoupIndexes:[self indicesForSoup:soupName withDb:db]];
+    NSMutableArray* indices = [NSMutableArray new];
+
+    SFSoupSpec *soupSpec = [self attributesForSoup:soupName withDb:db];
+    BOOL soupUsesExternalStorage = [soupSpec.features containsObject:kSoupFeatureExternalStorage];
+    BOOL soupUsesGeneratedColumns = [soupSpec.features containsObject:kSoupFeatureGeneratedColumns];
+    NSArray *queryCols = soupUsesExternalStorage ? @[ID_COL] : @[ID_COL, SOUP_COL];
+
+    BOOL hasFts = NO;
+    for (NSString* indexPath in  indexPaths) {
+        SFSoupIndex *idx = mapIndexSpecs[indexPath];
+        if (idx) {
+            [indices addObject:idx];
+            if ([idx.indexType isEqualToString:kSoupIndexTypeFullText]) {
+                hasFts = YES;
+            }
+        }
+    }
+
+    // Walking the soup in id order lets callers pick up right after the last entry of the previous chunk
+    NSString *whereClause = [NSString stringWithFormat:@"%@ > ?", ID_COL];
+    NSString *limitStr = limit > 0 ? [NSString stringWithFormat:@"%lu", (unsigned long)limit] : nil;
+    FMResultSet* frs = [self queryTable:soupTableName forColumns:queryCols orderBy:[NSString stringWithFormat:@"%@ ASC", ID_COL] limit:limitStr whereClause:whereClause whereArgs:@[@(afterEntryId)] withDb:db];
+
+    // Rows are parsed and projected a batch at a time on a worker pool, then written back in order
+    NSMutableArray *batchEntryIds = [NSMutableArray arrayWithCapacity:kReIndexBatchSize];
+    NSMutableArray *batchRawEntries = [NSMutableArray arrayWithCapacity:kReIndexBatchSize];
+    NSUInteger count = 0;
+    long long maxEntryId = afterEntryId;
+    BOOL hasRow = YES;
+    while (hasRow) {
+        @autoreleasepool {
+            hasRow = [frs next];
+            if (hasRow) {
+                maxEntryId = [frs longLongIntForColumn:ID_COL];
+                [batchEntryIds addObject:@(maxEntryId)];
+                if (!soupUsesExternalStorage) {
+                    [batchRawEntries addObject:[frs stringForColumn:SOUP_COL] ?: [NSNull null]];
                 }
+                count++;
+            }
+            if (batchEntryIds.count == kReIndexBatchSize || (!hasRow && batchEntryIds.count > 0)) {
+                [self reIndexEntries:batchEntryIds
+                          rawEntries:soupUsesExternalStorage ? nil : batchRawEntries
+                       soupTableName:soupTableName
+                             indices:indices
+                      projectColumns:!soupUsesGeneratedColumns // Generated columns are always up to date
+                          projectFts:hasFts
+                              withDb:db];
+                [batchEntryIds removeAllObjects];
+                [batchRawEntries removeAllObjects];
             }
         }
-        FMResultSet* frs = [self queryTable:soupTableName forColumns:queryCols orderBy:nil limit:nil whereClause:nil whereArgs:nil withDb:db];
-    
-        while([frs next]) {
-            @autoreleasepool {
-                NSNumber *entryId = @([frs longForColumn:ID_COL]);
+    }
+    [frs close];
+
+    if (lastEntryId) {
+        *lastEntryId = maxEntryId;
+    }
+    return count;
+}
+
+/**
+ Parses and projects entries concurrently, then updates their rows (and fts rows) in the order given
+ @param entryIds Ids of the entries
+ @param rawEntries Serialized entries, nil if the soup uses external storage
+ */
+- (void) reIndexEntries:(NSArray<NSNumber*>*)entryIds
+             rawEntries:(NSArray*)rawEntries
+          soupTableName:(NSString*)soupTableName
+                indices:(NSArray*)indices
+         projectColumns:(BOOL)projectColumns
+             projectFts:(BOOL)projectFts
+                 withDb:(FMDatabase*)db
+{
+    NSUInteger count = entryIds.count;
+    __strong id *projectedValues = (__strong id *)calloc(count, sizeof(id));
+    __strong id *projectedFtsValues = (__strong id *)calloc(count, sizeof(id));
+    dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t i) {
+        @autoreleasepool {
+            @try {
                 NSDictionary *entry;
-                if (soupUsesExternalStorage) {
-                    entry = [self loadExternalSoupEntry:entryId
-                                          soupTableName:soupTableName];
-                }
-                else {
-                    NSString *soupElt = [frs stringForColumn:SOUP_COL];
-                    entry = [SFJsonUtils objectFromJSONString:soupElt];
+                if (rawEntries == nil) {
+                    entry = [self loadExternalSoupEntry:entryIds[i] soupTableName:soupTableName withDb:db];
+                } else if (rawEntries[i] != [NSNull null]) {
+                    entry = [SFJsonUtils objectFromJSONString:rawEntries[i]];
                 }
-                
-                NSMutableDictionary *values = [NSMutableDictionary dictionary];
-                [self projectIndexedPaths:entry values:values indices:indices typeFilter:kValueExtractedToColumn];
-                if ([values count] > 0) {
-                    [self updateTable:soupTableName values:values entryId:entryId idCol:ID_COL withDb:db];
+                if (projectColumns) {
+                    NSMutableDictionary *values = [NSMutableDictionary dictionary];
+                    [self projectIndexedPaths:entry values:values indices:indices typeFilter:kValueExtractedToColumn];
+                    projectedValues[i] = values;
                 }
-                // fts
-                if (hasFts) {
+                if (projectFts) {
                     NSMutableDictionary *ftsValues = [NSMutableDictionary dictionary];
                     [self projectIndexedPaths:entry values:ftsValues indices:indices typeFilter:kValueExtractedToFtsColumn];
-                    if ([ftsValues count] > 0) {
-                        [self updateTable:[NSString stringWithFormat:@"%@_fts", soupTableName] values:ftsValues entryId:entryId idCol:ROWID_COL withDb:db];
+                    projectedFtsValues[i] = ftsValues;
+                }
+            } @catch (NSException *exception) {
+                // Rethrown on the calling thread below
+                projectedValues[i] = exception;
+            }
+        }
+    });
+
+    NSException *failure = nil;
+    NSString *ftsTableName = [NSString stringWithFormat:@"%@_fts", soupTableName];
+    for (NSUInteger i = 0; i < count; i++) {
+        if (failure == nil) {
+            if ([projectedValues[i] isKindOfClass:[NSException class]]) {
+                failure = projectedValues[i];
+            } else {
+                @try {
+                    if ([projectedValues[i] count] > 0) {
+                        [self updateTable:soupTableName values:projectedValues[i] entryId:entryIds[i] idCol:ID_COL withDb:db];
+                    }
+                    // NB: not going through a SFSoupFtsBuffer - indices can be a subset of the full_text indexes
+                    // and replacing the fts row would clear the columns of the other ones
+                    if ([projectedFtsValues[i] count] > 0) {
+                        [self updateTable:ftsTableName values:projectedFtsValues[i] entryId:entryIds[i] idCol:ROWID_COL withDb:db];
                     }
+                } @catch (NSException *exception) {
+                    failure = exception;
                 }
             }
         }
-        return YES;
+        projectedValues[i] = nil;
+        projectedFtsValues[i] = nil;
     }
-    else {
-        return NO;
+    free(projectedValues);
+    free(projectedFtsValues);
+    if (failure) {
+        @throw failure;
+    }
+}
+
+#pragma mark - Fts maintenance
+
+- (NSDictionary*) deferFtsMerges:(NSString*)ftsTableName withDb:(FMDatabase*)db
+{
+    if (self.ftsExtension != SFSmartStoreFTS5) {
+        return nil;
+    }
+    // Current settings live in the config shadow table (only when they were changed from the defaults)
+    NSMutableDictionary *settings = [NSMutableDictionary dictionaryWithDictionary:@{@"automerge": @4, @"crisismerge": @16}];
+    NSString *configSql = [NSString stringWithFormat:@"SELECT k, v FROM %@_config WHERE k IN ('automerge', 'crisismerge')", ftsTableName];
+    FMResultSet *frs = [self executeQueryThrows:configSql withDb:db];
+    while ([frs next]) {
+        settings[[frs stringForColumnIndex:0]] = @([frs intForColumnIndex:1]);
+    }
+    [frs close];
+    [self setFtsMerges:ftsTableName settings:@{@"automerge": @(kFtsBulkLoadAutomerge), @"crisismerge": @(kFtsBulkLoadCrisismerge)} withDb:db];
+    return settings;
+}
+
+- (void) setFtsMerges:(NSString*)ftsTableName settings:(NSDictionary*)settings withDb:(FMDatabase*)db
+{
+    for (NSString *key in @[@"automerge", @"crisismerge"]) {
+        NSString *sql = [NSString stringWithFormat:@"INSERT INTO %@(%@, rank) VALUES('%@', %d)", ftsTableName, ftsTableName, key, [settings[key] intValue]];
+        [self executeUpdateThrows:sql withDb:db];
+    }
+}
+
+- (BOOL) optimizeFts:(NSString*)soupName error:(NSError**)error
+{
+    return [self inTransaction:^(FMDatabase* db, BOOL* rollback) {
+        [self optimizeFts:soupName withDb:db];
+    } error:error];
+}
+
+- (void) optimizeFts:(NSString*)soupName withDb:(FMDatabase*)db
+{
+    if (![self soupExists:soupName withDb:db] || ![self hasFts:soupName withDb:db]) {
+        return;
     }
+    NSString *ftsTableName = [NSString stringWithFormat:@"%@_fts", [self tableNameForSoup:soupName withDb:db]];
+    // Same command for fts4 and fts5: merges all the index segments into one
+    NSString *optimizeSql = [NSString stringWithFormat:@"INSERT INTO %@(%@) VALUES('optimize')", ftsTableName, ftsTableName];
+    [self executeUpdateThrows:optimizeSql withDb:db];
 }
 
 - (BOOL) hasFts:(NSString*)soupName withDb:(FMDatabase *)db
@@ -2533,18 +4127,33 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
 - (void) projectIndexedPaths:(NSDictionary*)entry values:(NSMutableDictionary*)values indices:(NSArray*)indices typeFilter:(SFIndexSpecTypeFilterBlock)typeFilter
 {
     // build up the set of index column values for this row
-    for (SFSoupIndex *idx in indices) {
-        if (!typeFilter(idx))
-            continue;
-        
-        id indexColVal = [SFJsonUtils projectIntoJson:entry path:[idx path]];
-        // values for non-leaf nodes are json-ized
-        if ([indexColVal isKindOfClass:[NSDictionary class]] || [indexColVal isKindOfClass:[NSArray class]]) {
-            indexColVal = [SFJsonUtils JSONRepresentation:indexColVal options:0];
+    [[self projectorForIndices:indices typeFilter:typeFilter] projectEntry:entry intoValues:values];
+}
+
+/**
+ Projectors are built once per array of indices (as cached in _indexSpecsBySoup) and type filter
+ They go away with the array of indices they were built for
+ */
+- (SFSoupIndexProjector*) projectorForIndices:(NSArray*)indices typeFilter:(SFIndexSpecTypeFilterBlock)typeFilter
+{
+    @synchronized (_indexProjectors) {
+        NSMapTable *projectorsByFilter = [_indexProjectors objectForKey:indices];
+        if (projectorsByFilter == nil) {
+            projectorsByFilter = [NSMapTable strongToStrongObjectsMapTable];
+            [_indexProjectors setObject:projectorsByFilter forKey:indices];
         }
-        
-        NSString *colName = [idx columnName];
-        values[colName] = indexColVal != nil ? indexColVal : [NSNull null];
+        SFSoupIndexProjector *projector = [projectorsByFilter objectForKey:typeFilter];
+        if (projector == nil) {
+            NSMutableArray *filteredIndices = [NSMutableArray arrayWithCapacity:indices.count];
+            for (SFSoupIndex *idx in indices) {
+                if (typeFilter(idx)) {
+                    [filteredIndices addObject:idx];
+                }
+            }
+            projector = [[SFSoupIndexProjector alloc] initWithIndices:filteredIndices];
+            [projectorsByFilter setObject:projector forKey:typeFilter];
+        }
+        return projector;
     }
 }
 
@@ -2582,6 +4191,44 @@ NSUInteger CACHES_COUNT_LIMIT = 1024;
     return [[self queryPragma:@"cipher_version"] componentsJoinedByString:@""];
 }
 
+- (void) reportSlowQueries
+{
+    NSDictionary* attributes = [self slowQueriesEventAttributes];
+    if (attributes == nil) {
+        return;
+    }
+    [SFSDKEventBuilderHelper createAndStoreEvent:@"SmartStoreSlowQueries" userAccount:self.user className:NSStringFromClass([self class]) attributes:attributes];
+}
+
+- (NSDictionary*) slowQueriesEventAttributes
+{
+    NSArray<NSDictionary*>* slowestQueries = [self.queryProfiler slowestQueries];
+    if (slowestQueries.count == 0) {
+        return nil;
+    }
+    // No sql or smart sql: they can contain search terms and record values inlined as literals
+    NSArray* reportedKeys = @[kSFQueryProfileBindCount, kSFQueryProfileRowsReturned, kSFQueryProfileRowsScanned,
+                              kSFQueryProfileVmSteps, kSFQueryProfileWallTime, kSFQueryProfileCpuTime];
+    NSMutableArray* queries = [NSMutableArray arrayWithCapacity:slowestQueries.count];
+    for (NSDictionary* profile in slowestQueries) {
+        NSMutableDictionary* query = [NSMutableDictionary new];
+        for (NSString* key in reportedKeys) {
+            query[key] = profile[key];
+        }
+        NSMutableArray* planDetails = [NSMutableArray new];
+        for (NSDictionary* planRow in profile[kSFQueryProfilePlan]) {
+            if (planRow[@"detail"]) [planDetails addObject:planRow[@"detail"]];
+        }
+        query[kSFQueryProfilePlan] = planDetails.count > 0 ? planDetails : nil;
+        [queries addObject:query];
+    }
+    NSMutableDictionary *attributes = [[NSMutableDictionary alloc] init];
+    attributes[@"storeName"] = self.storeName;
+    attributes[@"recordedCount"] = @(self.queryProfiler.recordedCount);
+    attributes[@"slowQueries"] = queries;
+    return attributes;
+}
+
 - (NSArray*) queryPragma:(NSString*) pragma
 {
     __block NSMutableArray* result = [NSMutableArray new];
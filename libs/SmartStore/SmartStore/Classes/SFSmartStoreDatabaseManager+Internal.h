@@ -51,6 +51,7 @@ static NSString * const kStoresDirectory          = @"stores";
                                error:(NSError **)error;
 
 + (FMDatabase *)openDatabaseWithPath:(NSString *)dbPath key:(NSString *)key salt:(NSString *)salt error:(NSError **)error;
++ (FMDatabase *)unlockReadOnlyDatabase:(FMDatabase *)db key:(NSString *)key salt:(NSString *)salt;
 + (FMDatabase *)encryptOrUnencryptDb:(FMDatabase *)db
                                 name:(NSString *)storeName
                                 path:(NSString *)storePath
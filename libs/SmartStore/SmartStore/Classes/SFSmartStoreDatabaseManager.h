@@ -28,6 +28,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 @class FMDatabase;
 @class FMDatabaseQueue;
+@class FMDatabasePool;
 @class SFUserAccount;
 
 /**
@@ -87,6 +88,18 @@ NS_SWIFT_NAME(DatabaseManager)
  */
 - (nullable FMDatabaseQueue *)openStoreQueueWithName:(NSString *)storeName key:(NSString *)key salt:(nullable NSString *)salt error:(NSError **)error;
 
+/**
+ Creates a pool of read-only connections to an existing store DB.
+ Connections are opened (and keyed) on demand. The DB should be in WAL journal mode so that
+ reads from the pool don't wait for the writer.
+ @param storeName The name of the store.
+ @param key The encryption key associated with the store.
+ @param salt String used when the database header is stored in plain text for Shared mode.
+ @param maximumNumberOfConnections The maximum number of connections in the pool.
+ @return The FMDatabasePool instance to read from the DB.
+ */
+- (FMDatabasePool *)openStoreReadPoolWithName:(NSString *)storeName key:(NSString *)key salt:(nullable NSString *)salt maximumNumberOfConnections:(NSUInteger)maximumNumberOfConnections;
+
 /**
  Encrypts an existing unencrypted database.
  @param db The DB to encrypt.
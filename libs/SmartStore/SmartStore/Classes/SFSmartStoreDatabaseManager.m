@@ -33,9 +33,11 @@
 #import <SalesforceSDKCore/SFDirectoryManager.h>
 #import <SalesforceSDKCore/SFKeychainItemWrapper.h>
 #import <sqlite3.h>
+#import <objc/runtime.h>
 #import "SFSmartStoreUtils.h"
 #import "FMDatabase.h"
 #import "FMDatabaseQueue.h"
+#import "FMDatabasePool.h"
 #import "FMResultSet.h"
 
 static NSMutableDictionary *sDatabaseManagers;
@@ -57,6 +59,25 @@ static NSString * const kSFSmartStoreVerifyDbErrorDesc     = @"Could not open da
 static NSInteger  const kSFSmartStoreVerifyReadDbErrorCode = 7;
 static NSString * const kSFSmartStoreVerifyReadDbErrorDesc = @"Could not read from database at path '%@', for verification: %@";
 
+// Keys the connections created by a read pool
+@interface SFSmartStoreReadPoolDelegate : NSObject
+
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, copy) NSString *salt;
+
+@end
+
+@implementation SFSmartStoreReadPoolDelegate
+
+- (BOOL)databasePool:(FMDatabasePool *)pool shouldAddDatabaseToPool:(FMDatabase *)database {
+    return [SFSmartStoreDatabaseManager unlockReadOnlyDatabase:database key:self.key salt:self.salt] != nil;
+}
+
+@end
+
+// FMDatabasePool does not retain its delegate
+static char kReadPoolDelegateKey;
+
 @implementation SFSmartStoreDatabaseManager
 
 @synthesize user = _user;
@@ -177,6 +198,18 @@ static NSString * const kSFSmartStoreVerifyReadDbErrorDesc = @"Could not read fr
     return (result ? queue : nil);
 }
 
+- (FMDatabasePool *)openStoreReadPoolWithName:(NSString *)storeName key:(NSString *)key salt:(NSString *)salt maximumNumberOfConnections:(NSUInteger)maximumNumberOfConnections {
+    NSString *fullDbFilePath = [self fullDbFilePathForStoreName:storeName];
+    FMDatabasePool *pool = [FMDatabasePool databasePoolWithPath:fullDbFilePath flags:SQLITE_OPEN_READONLY];
+    pool.maximumNumberOfDatabasesToCreate = maximumNumberOfConnections;
+    SFSmartStoreReadPoolDelegate *delegate = [SFSmartStoreReadPoolDelegate new];
+    delegate.key = key;
+    delegate.salt = salt;
+    pool.delegate = delegate;
+    objc_setAssociatedObject(pool, &kReadPoolDelegateKey, delegate, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    return pool;
+}
+
 + (FMDatabase *)openDatabaseWithPath:(NSString *)dbPath key:(NSString *)key salt:(NSString *)salt error:(NSError **)error {
     FMDatabase *db = [FMDatabase databaseWithPath:dbPath];
     return [self setKeyForDb:db key:key salt:salt error:error];
@@ -228,6 +261,29 @@ static NSString * const kSFSmartStoreVerifyReadDbErrorDesc = @"Could not read fr
     }
 }
 
+// Same as unlockDatabase but without any write (no cipher migration, journal mode already set by the writer)
++ (FMDatabase*) unlockReadOnlyDatabase:(FMDatabase*)db key:(NSString*)key salt:(NSString *)salt {
+    [db setLogsErrors:YES];
+    [db setCrashOnErrors:NO];
+    [db setShouldCacheStatements:YES];
+    [[db executeQuery:@"PRAGMA cipher_default_kdf_iter = 4000"] close];
+    if (key)
+        [db setKey:key];
+    if (salt && [key length] > 0) {
+        [[db executeQuery:@"PRAGMA cipher_plaintext_header_size = 32"] close];
+        NSString *pragma = [NSString stringWithFormat:@"PRAGMA cipher_salt = \"x'%@'\"",salt];
+        [[db executeQuery:pragma] close];
+    }
+
+    NSError* verifyError = nil;
+    if ([self verifyDatabaseAccess:db error:&verifyError]) {
+        return db;
+    } else {
+        [SFSDKSmartStoreLogger e:[self class] format:@"Error reading the content of store '%@' from read-only connection: %@", [db databasePath], [verifyError localizedDescription]];
+        return nil;
+    }
+}
+
 - (FMDatabase *)encryptDb:(FMDatabase *)db name:(NSString *)storeName key:(NSString *)key salt:(NSString *)salt error:(NSError **)error
 {
     return [self encryptOrUnencryptDb:db name:storeName oldKey:@"" newKey:key salt:salt error:error];
@@ -0,0 +1,87 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+@class SFSmartStore;
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Fields of the recommendations returned by SFSmartStoreIndexAdvisor
+extern NSString * const kSFIndexRecommendationSoupName;         // soup to alter
+extern NSString * const kSFIndexRecommendationPath;             // path to index
+extern NSString * const kSFIndexRecommendationCurrentIndexType; // type of the current index on the path - absent if the path is not indexed
+extern NSString * const kSFIndexRecommendationIndexType;        // type of the index to create (string, integer or floating depending on the values stored)
+extern NSString * const kSFIndexRecommendationQueryCount;       // number of queries recorded that filter or sort on the path
+extern NSString * const kSFIndexRecommendationWallTime;         // total time in ms of those queries (only known for queries recorded from profiles)
+
+/**
+ Records the smart sql run against a store and recommends the indexes that would speed it up.
+ 
+ A path referenced in a WHERE or ORDER BY clause gets a recommendation when:
+ - it is not indexed and is read with json_extract({soup:_soup}, '$.path')
+ - it has a json1 index: a column index avoids parsing the soup for every row read.
+ Once such a path is indexed, queries should reference it as {soup:path} rather than with json_extract to use the index.
+ 
+ Smart sql is recorded from the queries converted by a store when the advisor is assigned to its indexAdvisor property,
+ or from the profiles kept by a query profiler.
+ */
+@interface SFSmartStoreIndexAdvisor : NSObject
+
+/**
+ Record a smart sql query.
+ @param smartSql The smart sql.
+ */
+- (void) recordSmartSql:(NSString *)smartSql;
+
+/**
+ Record the smart sql of query profiles.
+ @param profiles Profiles as returned by -[SFSmartStoreQueryProfiler slowestQueries].
+ */
+- (void) recordProfiles:(NSArray<NSDictionary *> *)profiles;
+
+/**
+ @param store The store the recorded queries were run against.
+ @return Recommendations (using the kSFIndexRecommendation keys), most costly queries first then most frequent ones.
+ */
+- (NSArray<NSDictionary *> *) recommendationsForStore:(SFSmartStore *)store;
+
+/**
+ Alter the soups to add (or change the type of) the recommended indexes, re-indexing their data.
+ Can take a while on large soups, should not be called on the main thread.
+ @param recommendations Recommendations as returned by recommendationsForStore:.
+ @param store The store to alter.
+ @return YES if all the soups were altered successfully.
+ */
+- (BOOL) applyRecommendations:(NSArray<NSDictionary *> *)recommendations toStore:(SFSmartStore *)store;
+
+/**
+ Forget all the queries recorded.
+ */
+- (void) reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,269 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "SFSmartStoreIndexAdvisor.h"
+#import "SFSmartStore+Internal.h"
+#import "SFSmartStoreQueryProfiler.h"
+#import "SFSDKSmartStoreLogger.h"
+#import "SFSoupIndex.h"
+#import "SFSoupSpec.h"
+#import "FMDatabase.h"
+
+NSString * const kSFIndexRecommendationSoupName = @"soupName";
+NSString * const kSFIndexRecommendationPath = @"path";
+NSString * const kSFIndexRecommendationCurrentIndexType = @"currentIndexType";
+NSString * const kSFIndexRecommendationIndexType = @"indexType";
+NSString * const kSFIndexRecommendationQueryCount = @"queryCount";
+NSString * const kSFIndexRecommendationWallTime = @"wallTime";
+
+// Maximum number of distinct smart sql queries recorded
+static NSUInteger const kMaxRecordedQueries = 1000;
+
+// Number of rows sampled to pick the type of a recommended index
+static NSUInteger const kTypeSampleSize = 1000;
+
+// Number of times a query (or a path) was recorded and total time spent running it
+@interface SFIndexAdvisorStats : NSObject
+
+@property (nonatomic, assign) NSUInteger count;
+@property (nonatomic, assign) double wallTime;
+
+@end
+
+@implementation SFIndexAdvisorStats
+
+@end
+
+@interface SFSmartStoreIndexAdvisor ()
+
+@property (nonatomic, strong) NSMutableDictionary<NSString *, SFIndexAdvisorStats *> *statsBySmartSql;
+
+@end
+
+@implementation SFSmartStoreIndexAdvisor
+
+- (instancetype) init {
+    self = [super init];
+    if (self) {
+        self.statsBySmartSql = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void) recordSmartSql:(NSString *)smartSql {
+    [self recordSmartSql:smartSql wallTime:0];
+}
+
+- (void) recordProfiles:(NSArray<NSDictionary *> *)profiles {
+    for (NSDictionary *profile in profiles) {
+        [self recordSmartSql:profile[kSFQueryProfileSmartSql] wallTime:[profile[kSFQueryProfileWallTime] doubleValue]];
+    }
+}
+
+- (void) recordSmartSql:(NSString *)smartSql wallTime:(double)wallTime {
+    if (smartSql == nil) {
+        return;
+    }
+    // Queries can be converted concurrently on the read connections
+    @synchronized (self) {
+        SFIndexAdvisorStats *stats = self.statsBySmartSql[smartSql];
+        if (stats == nil) {
+            if (self.statsBySmartSql.count >= kMaxRecordedQueries) {
+                return;
+            }
+            stats = [SFIndexAdvisorStats new];
+            self.statsBySmartSql[smartSql] = stats;
+        }
+        stats.count++;
+        stats.wallTime += wallTime;
+    }
+}
+
+- (void) reset {
+    @synchronized (self) {
+        [self.statsBySmartSql removeAllObjects];
+    }
+}
+
+#pragma mark - Recommendations
+
+- (NSArray<NSDictionary *> *) recommendationsForStore:(SFSmartStore *)store {
+    NSDictionary<NSString *, SFIndexAdvisorStats *> *statsBySmartSql;
+    @synchronized (self) {
+        statsBySmartSql = [self.statsBySmartSql copy];
+    }
+    
+    // Stats of the queries referencing each [soupName, path]
+    NSMutableDictionary<NSArray<NSString *> *, SFIndexAdvisorStats *> *statsByReference = [NSMutableDictionary new];
+    [statsBySmartSql enumerateKeysAndObjectsUsingBlock:^(NSString *smartSql, SFIndexAdvisorStats *queryStats, BOOL *stop) {
+        for (NSArray<NSString *> *reference in [NSSet setWithArray:[SFSmartStoreIndexAdvisor pathReferencesInSmartSql:smartSql]]) {
+            SFIndexAdvisorStats *stats = statsByReference[reference];
+            if (stats == nil) {
+                stats = [SFIndexAdvisorStats new];
+                statsByReference[reference] = stats;
+            }
+            stats.count += queryStats.count;
+            stats.wallTime += queryStats.wallTime;
+        }
+    }];
+    
+    NSMutableArray<NSDictionary *> *recommendations = [NSMutableArray new];
+    [store inReadDatabase:^(FMDatabase *db) {
+        [statsByReference enumerateKeysAndObjectsUsingBlock:^(NSArray<NSString *> *reference, SFIndexAdvisorStats *stats, BOOL *stop) {
+            NSString *soupName = reference[0];
+            NSString *path = reference[1];
+            NSString *soupTableName = [store tableNameForSoup:soupName withDb:db];
+            if (soupTableName == nil) {
+                return;
+            }
+            SFSoupIndex *indexSpec = [store indexSpecForPath:path inSoup:soupName withDb:db];
+            if (indexSpec != nil && ![indexSpec.indexType isEqualToString:kSoupIndexTypeJSON1]) {
+                return;
+            }
+            BOOL soupUsesExternalStorage = [[store attributesForSoup:soupName withDb:db].features containsObject:kSoupFeatureExternalStorage];
+            NSMutableDictionary *recommendation = [NSMutableDictionary new];
+            recommendation[kSFIndexRecommendationSoupName] = soupName;
+            recommendation[kSFIndexRecommendationPath] = path;
+            recommendation[kSFIndexRecommendationCurrentIndexType] = indexSpec.indexType;
+            recommendation[kSFIndexRecommendationIndexType] = soupUsesExternalStorage ? kSoupIndexTypeString : [self indexTypeForPath:path soupTableName:soupTableName store:store withDb:db];
+            recommendation[kSFIndexRecommendationQueryCount] = @(stats.count);
+            recommendation[kSFIndexRecommendationWallTime] = @(stats.wallTime);
+            [recommendations addObject:recommendation];
+        }];
+    } error:nil];
+    
+    [recommendations sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:kSFIndexRecommendationWallTime ascending:NO],
+                                            [NSSortDescriptor sortDescriptorWithKey:kSFIndexRecommendationQueryCount ascending:NO],
+                                            [NSSortDescriptor sortDescriptorWithKey:kSFIndexRecommendationSoupName ascending:YES],
+                                            [NSSortDescriptor sortDescriptorWithKey:kSFIndexRecommendationPath ascending:YES]]];
+    return recommendations;
+}
+
+/**
+ Paths referenced in the WHERE and ORDER BY clauses of a smart sql query as [soupName, path] pairs:
+ {soupName:path} and json_extract({soupName:_soup}, '$.path') (or json_extract({soupName}.soup, '$.path'))
+ */
++ (NSArray<NSArray<NSString *> *> *) pathReferencesInSmartSql:(NSString *)smartSql {
+    static NSRegularExpression *keywordRegex;
+    static NSRegularExpression *pathRegex;
+    static NSRegularExpression *jsonExtractRegex;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        keywordRegex = [NSRegularExpression regularExpressionWithPattern:@"\\b(select|from|join|where|group\\s+by|having|order\\s+by|limit|union|intersect|except)\\b" options:NSRegularExpressionCaseInsensitive error:nil];
+        pathRegex = [NSRegularExpression regularExpressionWithPattern:@"\\{([^}:]+):([^}]+)\\}" options:0 error:nil];
+        jsonExtractRegex = [NSRegularExpression regularExpressionWithPattern:@"json_extract\\(\\s*\\{([^}:]+)(?::_soup)?\\}(?:\\.soup)?\\s*,\\s*'\\$\\.([^']+)'\\s*\\)" options:NSRegularExpressionCaseInsensitive error:nil];
+    });
+    
+    NSMutableArray<NSArray<NSString *> *> *references = [NSMutableArray new];
+    NSArray<NSTextCheckingResult *> *keywords = [keywordRegex matchesInString:smartSql options:0 range:NSMakeRange(0, smartSql.length)];
+    for (NSUInteger i = 0; i < keywords.count; i++) {
+        NSString *keyword = [[smartSql substringWithRange:keywords[i].range] lowercaseString];
+        if (![keyword isEqualToString:@"where"] && ![keyword hasPrefix:@"order"]) {
+            continue;
+        }
+        // The clause goes up to the next keyword
+        NSUInteger start = NSMaxRange(keywords[i].range);
+        NSUInteger end = i + 1 < keywords.count ? keywords[i + 1].range.location : smartSql.length;
+        NSRange clauseRange = NSMakeRange(start, end - start);
+        for (NSTextCheckingResult *match in [pathRegex matchesInString:smartSql options:0 range:clauseRange]) {
+            NSString *path = [smartSql substringWithRange:[match rangeAtIndex:2]];
+            // _soup, _soupEntryId, _soupCreatedDate and _soupLastModifiedDate are not index paths
+            if (![path hasPrefix:@"_soup"]) {
+                [references addObject:@[[smartSql substringWithRange:[match rangeAtIndex:1]], path]];
+            }
+        }
+        for (NSTextCheckingResult *match in [jsonExtractRegex matchesInString:smartSql options:0 range:clauseRange]) {
+            [references addObject:@[[smartSql substringWithRange:[match rangeAtIndex:1]], [smartSql substringWithRange:[match rangeAtIndex:2]]]];
+        }
+    }
+    return references;
+}
+
+/**
+ Type of the values found at the given path in a sample of the soup entries:
+ integer if all are integers, floating if all are numbers, string otherwise
+ */
+- (NSString *) indexTypeForPath:(NSString *)path soupTableName:(NSString *)soupTableName store:(SFSmartStore *)store withDb:(FMDatabase *)db {
+    NSString *sql = [NSString stringWithFormat:@"SELECT DISTINCT typeof(value) FROM (SELECT json_extract(%@, ?) AS value FROM %@ LIMIT %lu) WHERE value IS NOT NULL",
+                     SOUP_COL, soupTableName, (unsigned long)kTypeSampleSize];
+    NSMutableSet<NSString *> *valueTypes = [NSMutableSet new];
+    FMResultSet *frs = [store executeQueryThrows:sql withArgumentsInArray:@[[@"$." stringByAppendingString:path]] withDb:db];
+    while ([frs next]) {
+        [valueTypes addObject:[frs stringForColumnIndex:0]];
+    }
+    [frs close];
+    
+    if (valueTypes.count > 0 && [valueTypes isSubsetOfSet:[NSSet setWithObject:@"integer"]]) {
+        return kSoupIndexTypeInteger;
+    }
+    if (valueTypes.count > 0 && [valueTypes isSubsetOfSet:[NSSet setWithObjects:@"integer", @"real", nil]]) {
+        return kSoupIndexTypeFloating;
+    }
+    return kSoupIndexTypeString;
+}
+
+#pragma mark - Auto-apply
+
+- (BOOL) applyRecommendations:(NSArray<NSDictionary *> *)recommendations toStore:(SFSmartStore *)store {
+    // Recommended index type by path by soup
+    NSMutableDictionary<NSString *, NSMutableDictionary<NSString *, NSString *> *> *indexTypesBySoup = [NSMutableDictionary new];
+    for (NSDictionary *recommendation in recommendations) {
+        NSString *soupName = recommendation[kSFIndexRecommendationSoupName];
+        if (indexTypesBySoup[soupName] == nil) {
+            indexTypesBySoup[soupName] = [NSMutableDictionary new];
+        }
+        indexTypesBySoup[soupName][recommendation[kSFIndexRecommendationPath]] = recommendation[kSFIndexRecommendationIndexType];
+    }
+    
+    BOOL success = YES;
+    for (NSString *soupName in indexTypesBySoup) {
+        NSMutableDictionary<NSString *, NSString *> *indexTypesByPath = indexTypesBySoup[soupName];
+        NSMutableArray<SFSoupIndex *> *indexSpecs = [NSMutableArray new];
+        // Json1 indexes get replaced, other indexes are kept
+        for (SFSoupIndex *indexSpec in [store indicesForSoup:soupName]) {
+            NSString *indexType = indexSpec.indexType;
+            if (indexTypesByPath[indexSpec.path] != nil) {
+                if ([indexType isEqualToString:kSoupIndexTypeJSON1]) {
+                    indexType = indexTypesByPath[indexSpec.path];
+                }
+                [indexTypesByPath removeObjectForKey:indexSpec.path];
+            }
+            SFSoupIndex *keptIndexSpec = [[SFSoupIndex alloc] initWithPath:indexSpec.path indexType:indexType columnName:nil];
+            keptIndexSpec.ftsOptions = indexSpec.ftsOptions;
+            [indexSpecs addObject:keptIndexSpec];
+        }
+        // Paths not indexed get a new index
+        for (NSString *path in indexTypesByPath) {
+            [indexSpecs addObject:[[SFSoupIndex alloc] initWithPath:path indexType:indexTypesByPath[path] columnName:nil]];
+        }
+        [SFSDKSmartStoreLogger i:[self class] format:@"Altering soup %@ with recommended indexes: %@", soupName, [SFSoupIndex asArrayOfDictionaries:indexSpecs withColumnName:NO]];
+        if (![store alterSoup:soupName withIndexSpecs:indexSpecs reIndexData:YES]) {
+            success = NO;
+        }
+    }
+    return success;
+}
+
+@end
@@ -29,10 +29,12 @@
 #import "SFSmartStoreInspectorViewController.h"
 #import <SalesforceSDKCore/SFSDKResourceUtils.h>
 #import "SFQuerySpec.h"
+#import "SFSoupSpec.h"
 #import <SalesforceSDKCommon/SFJsonUtils.h>
 #import <SalesforceSDKCore/SFUserAccountManager.h>
 #import <SalesforceSDKCore/UIColor+SFColors.h>
 #import "SFSmartStore+Internal.h"
+#import "SFSmartStoreQueryProfiler.h"
 
 // Nav bar
 static CGFloat      const kNavBarHeight          = 44.0;
@@ -68,6 +70,7 @@ static NSString * const kInspectorPageIndexHintKey = @"inspectorPageIndexHint";
 static NSString * const kInspectorClearButtonTitleKey = @"inspectorClearButtonTitle";
 static NSString * const kInspectorSoupsButtonTitleKey = @"inspectorSoupsButtonTitle";
 static NSString * const kInspectorIndicesButtonTitleKey = @"inspectorIndicesButtonTitle";
+static NSString * const kInspectorSlowQueriesButtonTitleKey = @"inspectorSlowQueriesButtonTitle";
 static NSString * const kInspectorTitleKey = @"inspectorTitle";
 static NSString * const kInspectorBackButtonTitleKey = @"inspectorBackButtonTitle";
 static NSString * const kInspectorRunButtonTitleKey = @"inspectorRunButtonTitle";
@@ -90,6 +93,7 @@ static NSString * const kInspectorPickerDefault = @"default";
 @property (nonatomic, strong) UIButton *clearButton;
 @property (nonatomic, strong) UIButton *soupsButton;
 @property (nonatomic, strong) UIButton *indicesButton;
+@property (nonatomic, strong) UIButton *slowQueriesButton;
 @property (nonatomic, strong) UICollectionView *resultGrid;
 @property (nonatomic, strong) NSArray *results;
 @property (readonly, atomic, assign) NSUInteger countColumns;
@@ -275,10 +279,31 @@ static NSString * const kInspectorPickerDefault = @"default";
 
 - (void) indicesButtonClicked
 {
-    self.queryField.text = [NSString stringWithFormat:@"select %@,%@,%@ from %@", SOUP_NAME_COL, PATH_COL, COLUMN_TYPE_COL, SOUP_INDEX_MAP_TABLE];
+    self.queryField.text = [NSString stringWithFormat:@"select %@,%@,%@,%@ from %@ join %@ using (%@)", SOUP_NAME_COL, PATH_COL, COLUMN_TYPE_COL, kSoupFeatureGeneratedColumns, SOUP_INDEX_MAP_TABLE, SOUP_ATTRS_TABLE, SOUP_NAME_COL];
     [self runQuery];
 }
 
+- (void) slowQueriesButtonClicked
+{
+    [self stopEditing];
+    NSMutableArray* results = [NSMutableArray new];
+    for (NSDictionary* profile in [self.store.queryProfiler slowestQueries]) {
+        NSMutableArray* planDetails = [NSMutableArray new];
+        for (NSDictionary* planRow in profile[kSFQueryProfilePlan]) {
+            if (planRow[@"detail"]) [planDetails addObject:planRow[@"detail"]];
+        }
+        [results addObject:@[[NSString stringWithFormat:@"%.1f ms", [profile[kSFQueryProfileWallTime] doubleValue]],
+                             [NSString stringWithFormat:@"%.1f ms cpu", [profile[kSFQueryProfileCpuTime] doubleValue]],
+                             [NSString stringWithFormat:@"%@ rows / %@ scanned", profile[kSFQueryProfileRowsReturned], profile[kSFQueryProfileRowsScanned]],
+                             profile[kSFQueryProfileSql],
+                             [planDetails componentsJoinedByString:@"; "]]];
+    }
+    if ([results count] == 0) {
+        [self showAlert:[SFSDKResourceUtils localizedString:kInspectorNoRowsReturnedKey] title:nil];
+    }
+    self.results = results;
+}
+
 - (void) clearButtonClicked
 {
     [self stopEditing];
@@ -328,6 +353,7 @@ static NSString * const kInspectorPickerDefault = @"default";
     self.clearButton = [self createButtonWithLabel:[SFSDKResourceUtils localizedString:kInspectorClearButtonTitleKey] action:@selector(clearButtonClicked)];
     self.soupsButton = [self createButtonWithLabel:[SFSDKResourceUtils localizedString:kInspectorSoupsButtonTitleKey] action:@selector(soupsButtonClicked)];
     self.indicesButton = [self createButtonWithLabel:[SFSDKResourceUtils localizedString:kInspectorIndicesButtonTitleKey] action:@selector(indicesButtonClicked)];
+    self.slowQueriesButton = [self createButtonWithLabel:[SFSDKResourceUtils localizedString:kInspectorSlowQueriesButtonTitleKey] action:@selector(slowQueriesButtonClicked)];
     
     // Results grid
     self.resultGrid = [self createGridView];
@@ -501,12 +527,13 @@ static NSString * const kInspectorPickerDefault = @"default";
 
 - (void)layoutButtons
 {
-    CGFloat w = self.view.bounds.size.width / 3.0;
+    CGFloat w = self.view.bounds.size.width / 4.0;
     CGFloat y = [self belowFrame:self.pageSizeField.frame];
     CGFloat h = kButtonHeight;
     self.clearButton.frame = CGRectMake(0, y, w, h);
     self.soupsButton.frame = CGRectMake(w, y, w, h);
     self.indicesButton.frame = CGRectMake(w * 2.0, y, w, h);
+    self.slowQueriesButton.frame = CGRectMake(w * 3.0, y, w, h);
 }
 
 - (void) layoutResultGrid
@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Fields of the query profiles recorded by SFSmartStoreQueryProfiler
+extern NSString * const kSFQueryProfileSmartSql;     // smart sql of the query spec
+extern NSString * const kSFQueryProfileSql;          // sql run (smart sql already converted)
+extern NSString * const kSFQueryProfileBindCount;    // number of arguments bound
+extern NSString * const kSFQueryProfileRowsReturned; // number of rows read by the store
+extern NSString * const kSFQueryProfileRowsScanned;  // number of rows visited by full table scans
+extern NSString * const kSFQueryProfileVmSteps;      // number of virtual machine steps - a measure of the total work done by sqlite
+extern NSString * const kSFQueryProfileWallTime;     // elapsed time in ms
+extern NSString * const kSFQueryProfileCpuTime;      // cpu time of the calling thread in ms
+extern NSString * const kSFQueryProfilePlan;         // rows of EXPLAIN QUERY PLAN - only for queries slower than slowQueryThreshold
+
+/**
+ Keeps the profiles of the slowest queries run by a store.
+ Profiling is opt-in: assign a profiler to the queryProfiler property of a store to record its queryWithQuerySpec and countWithQuerySpec calls.
+ */
+@interface SFSmartStoreQueryProfiler : NSObject
+
+/**
+ Maximum number of profiles kept.
+ */
+@property (nonatomic, readonly, assign) NSUInteger capacity;
+
+/**
+ Queries running longer than this (in ms) get their query plan captured. Defaults to 100.
+ */
+@property (nonatomic, assign) double slowQueryThreshold;
+
+/**
+ Number of queries recorded since the profiler was created or last reset.
+ */
+@property (nonatomic, readonly, assign) NSUInteger recordedCount;
+
+/**
+ Profiler keeping the 20 slowest queries.
+ */
+- (instancetype) init;
+
+/**
+ @param capacity Maximum number of profiles kept.
+ */
+- (instancetype) initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/**
+ Record a query profile. It is only kept if it is one of the capacity slowest seen so far.
+ @param profile Dictionary using the kSFQueryProfile keys.
+ */
+- (void) recordProfile:(NSDictionary *)profile;
+
+/**
+ @return The profiles kept, slowest first.
+ */
+- (NSArray<NSDictionary *> *) slowestQueries;
+
+/**
+ Drop all the profiles kept.
+ */
+- (void) reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
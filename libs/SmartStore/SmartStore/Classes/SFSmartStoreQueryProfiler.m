@@ -0,0 +1,101 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "SFSmartStoreQueryProfiler.h"
+
+NSString * const kSFQueryProfileSmartSql = @"smartSql";
+NSString * const kSFQueryProfileSql = @"sql";
+NSString * const kSFQueryProfileBindCount = @"bindCount";
+NSString * const kSFQueryProfileRowsReturned = @"rowsReturned";
+NSString * const kSFQueryProfileRowsScanned = @"rowsScanned";
+NSString * const kSFQueryProfileVmSteps = @"vmSteps";
+NSString * const kSFQueryProfileWallTime = @"wallTime";
+NSString * const kSFQueryProfileCpuTime = @"cpuTime";
+NSString * const kSFQueryProfilePlan = @"plan";
+
+static NSUInteger const kDefaultCapacity = 20;
+static double const kDefaultSlowQueryThreshold = 100;
+
+@interface SFSmartStoreQueryProfiler ()
+
+@property (nonatomic, readwrite, assign) NSUInteger capacity;
+@property (nonatomic, readwrite, assign) NSUInteger recordedCount;
+
+// Profiles kept - sorted by descending wall time
+@property (nonatomic, strong) NSMutableArray<NSDictionary *> *profiles;
+
+@end
+
+@implementation SFSmartStoreQueryProfiler
+
+- (instancetype) init {
+    return [self initWithCapacity:kDefaultCapacity];
+}
+
+- (instancetype) initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (self) {
+        self.capacity = MAX(capacity, 1);
+        self.slowQueryThreshold = kDefaultSlowQueryThreshold;
+        self.profiles = [NSMutableArray arrayWithCapacity:self.capacity + 1];
+    }
+    return self;
+}
+
+- (void) recordProfile:(NSDictionary *)profile {
+    double wallTime = [profile[kSFQueryProfileWallTime] doubleValue];
+    // Queries can be run concurrently on the read connections
+    @synchronized (self) {
+        self.recordedCount++;
+        if (self.profiles.count == self.capacity && wallTime <= [self.profiles.lastObject[kSFQueryProfileWallTime] doubleValue]) {
+            return;
+        }
+        NSUInteger index = [self.profiles indexOfObject:profile
+                                          inSortedRange:NSMakeRange(0, self.profiles.count)
+                                                options:NSBinarySearchingInsertionIndex
+                                        usingComparator:^NSComparisonResult(NSDictionary *p1, NSDictionary *p2) {
+            return [p2[kSFQueryProfileWallTime] compare:p1[kSFQueryProfileWallTime]];
+        }];
+        [self.profiles insertObject:profile atIndex:index];
+        if (self.profiles.count > self.capacity) {
+            [self.profiles removeLastObject];
+        }
+    }
+}
+
+- (NSArray<NSDictionary *> *) slowestQueries {
+    @synchronized (self) {
+        return [self.profiles copy];
+    }
+}
+
+- (void) reset {
+    @synchronized (self) {
+        [self.profiles removeAllObjects];
+        self.recordedCount = 0;
+    }
+}
+
+@end
@@ -0,0 +1,98 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+extern NSString * const kSoupCompositeIndexPaths;
+extern NSString * const kSoupCompositeIndexIncludedPaths;
+extern NSString * const kSoupCompositeIndexWhere;
+
+/**
+ * Definition of a multi-column index on a given soup, registered through its SFSoupSpec.
+ * All paths must be indexed paths of the soup (or _soupEntryId, _soupCreatedDate, _soupLastModifiedDate).
+ *
+ * - Composite index: several paths, e.g. @[@"__local__", @"Id"]
+ * - Covering index: included paths are appended to the index columns so that queries selecting them are answered from the index alone
+ *   (sqlite has no INCLUDE clause, so they are trailing index columns)
+ * - Partial index: only rows matching the where clause are indexed, e.g. @"{contacts:__local__} = '1'".
+ *   The where clause uses smart sql references to the soup; sqlite only uses the index for queries whose where clause contains that same term.
+ */
+NS_SWIFT_NAME(SoupCompositeIndex)
+@interface SFSoupCompositeIndex : NSObject
+
+/**
+ * The paths making up the index, in order.
+ */
+@property (nonatomic, copy, readonly) NSArray<NSString*> *paths;
+
+/**
+ * The paths appended to the index to make it covering.
+ */
+@property (nonatomic, copy, readonly) NSArray<NSString*> *includedPaths;
+
+/**
+ * The where clause of a partial index (smart sql), or nil.
+ */
+@property (nonatomic, copy, readonly, nullable) NSString *whereClause;
+
+/**
+ * Designated initializer.
+ *
+ * @param paths The paths making up the index.
+ * @param includedPaths The paths appended to the index, or nil.
+ * @param whereClause The where clause of a partial index, or nil.
+ */
+- (instancetype)initWithPaths:(NSArray<NSString*>*)paths includedPaths:(nullable NSArray<NSString*>*)includedPaths whereClause:(nullable NSString*)whereClause;
+
+/**
+ * Creates an SFSoupCompositeIndex based on the given NSDictionary.
+ * @param dict the dictionary to use
+ * @return Initialized SFSoupCompositeIndex object, nil if the dictionary has no paths.
+ */
+- (nullable instancetype)initWithDictionary:(NSDictionary*)dict;
+
+/**
+ * Return dictionary for this SFSoupCompositeIndex object
+ */
+- (NSDictionary*)asDictionary;
+
+/**
+ * Returns an array of NSDictionary objects for a given array of composite indexes.
+ * @param compositeIndexes Array of composite indexes
+ * @return Array of NSDictionary objects
+ */
++ (NSArray<NSDictionary*>*) asArrayOfDictionaries:(NSArray<SFSoupCompositeIndex*>*)compositeIndexes;
+
+/**
+ * Returns an array of SFSoupCompositeIndex objects for a given array of dictionaries.
+ * @param arrayOfDictionaries Array of dictionaries (or SFSoupCompositeIndex objects)
+ * @return Array of SFSoupCompositeIndex objects
+ */
++ (NSArray<SFSoupCompositeIndex*>*) asArrayOfCompositeIndexes:(NSArray*)arrayOfDictionaries;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,112 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SFSoupCompositeIndex.h"
+
+NSString * const kSoupCompositeIndexPaths         = @"paths";
+NSString * const kSoupCompositeIndexIncludedPaths = @"includedPaths";
+NSString * const kSoupCompositeIndexWhere         = @"where";
+
+@implementation SFSoupCompositeIndex
+
+- (instancetype)initWithPaths:(NSArray<NSString*>*)paths includedPaths:(NSArray<NSString*>*)includedPaths whereClause:(NSString*)whereClause
+{
+    self = [super init];
+    if (self) {
+        _paths = [paths copy];
+        _includedPaths = [includedPaths copy] ?: @[];
+        _whereClause = [whereClause copy];
+    }
+    return self;
+}
+
+- (instancetype)initWithDictionary:(NSDictionary*)dict
+{
+    NSArray *paths = dict[kSoupCompositeIndexPaths];
+    if (![paths isKindOfClass:[NSArray class]] || paths.count == 0) {
+        return nil;
+    }
+    return [self initWithPaths:paths
+                 includedPaths:dict[kSoupCompositeIndexIncludedPaths]
+                   whereClause:dict[kSoupCompositeIndexWhere]];
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"<SFSoupCompositeIndex paths=%@ includedPaths=%@ where=%@>", self.paths, self.includedPaths, self.whereClause];
+}
+
+- (BOOL)isEqual:(id)object
+{
+    if (![object isKindOfClass:[SFSoupCompositeIndex class]]) {
+        return NO;
+    }
+    SFSoupCompositeIndex *other = (SFSoupCompositeIndex*)object;
+    return [self.paths isEqualToArray:other.paths]
+        && [self.includedPaths isEqualToArray:other.includedPaths]
+        && (self.whereClause == other.whereClause || [self.whereClause isEqualToString:other.whereClause]);
+}
+
+- (NSUInteger)hash
+{
+    return self.paths.hash ^ self.includedPaths.hash ^ self.whereClause.hash;
+}
+
+#pragma mark - Converting to JSON
+
+- (NSDictionary*)asDictionary
+{
+    NSMutableDictionary *result = [NSMutableDictionary dictionary];
+    result[kSoupCompositeIndexPaths] = self.paths;
+    if (self.includedPaths.count > 0)
+        result[kSoupCompositeIndexIncludedPaths] = self.includedPaths;
+    if (self.whereClause)
+        result[kSoupCompositeIndexWhere] = self.whereClause;
+    return result;
+}
+
++ (NSArray*) asArrayOfDictionaries:(NSArray*)compositeIndexes
+{
+    NSMutableArray* result = [NSMutableArray array];
+    for (SFSoupCompositeIndex* compositeIndex in compositeIndexes) {
+        [result addObject:[compositeIndex asDictionary]];
+    }
+    return result;
+}
+
++ (NSArray*) asArrayOfCompositeIndexes:(NSArray*)arrayOfDictionaries
+{
+    NSMutableArray* result = [NSMutableArray array];
+    for (id dict in arrayOfDictionaries) {
+        SFSoupCompositeIndex* compositeIndex = [dict isKindOfClass:[SFSoupCompositeIndex class]]
+                                                ? (SFSoupCompositeIndex*) dict
+                                                : [[SFSoupCompositeIndex alloc] initWithDictionary:dict];
+        if (compositeIndex) {
+            [result addObject:compositeIndex];
+        }
+    }
+    return result;
+}
+
+@end
@@ -0,0 +1,65 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+@class SFSmartStore;
+@class FMDatabase;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Accumulates the changes to the rows of a soup fts table and writes them with a few multi-row statements.
+ Rows of existing entries are replaced (one DELETE for all of them followed by the INSERTs): fts tables have no multi-row UPDATE.
+ A buffer is meant to live within a single transaction and must be flushed before the transaction commits.
+ */
+@interface SFSoupFtsBuffer : NSObject
+
+@property (nonatomic, readonly, strong) NSString *ftsTableName;
+
+/**
+ Number of rows waiting to be written.
+ */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+- (instancetype)initWithStore:(SFSmartStore*)store ftsTableName:(NSString*)ftsTableName db:(FMDatabase*)db;
+
+/**
+ Buffers the fts row of an entry. The latest values for a given entry win.
+ The buffer flushes itself once it holds a large number of rows.
+ @param ftsValues The fts column values of the entry.
+ @param entryId The soup entry id (rowid of the fts row).
+ @param isNew YES if the entry was just inserted (it has no fts row yet), NO if its fts row must be replaced - ftsValues must then hold all the fts columns.
+ */
+- (void)addRow:(NSDictionary*)ftsValues forEntryId:(NSNumber*)entryId isNew:(BOOL)isNew;
+
+/**
+ Writes the buffered rows. Throws an NSException if a statement fails.
+ */
+- (void)flush;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,99 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "SFSoupFtsBuffer.h"
+#import "SFSmartStore+Internal.h"
+
+// Bounds the memory held by a buffer during very large upserts
+static NSUInteger const kMaxBufferedFtsRows = 1000;
+
+@interface SFSoupFtsBuffer ()
+
+@property (nonatomic, weak) SFSmartStore *store;
+@property (nonatomic, strong) FMDatabase *db;
+@property (nonatomic, strong) NSMutableArray<NSNumber*> *entryIds;
+@property (nonatomic, strong) NSMutableDictionary<NSNumber*, NSDictionary*> *rowsByEntryId;
+@property (nonatomic, strong) NSMutableArray<NSNumber*> *replacedEntryIds;
+
+@end
+
+@implementation SFSoupFtsBuffer
+
+- (instancetype)initWithStore:(SFSmartStore*)store ftsTableName:(NSString*)ftsTableName db:(FMDatabase*)db
+{
+    self = [super init];
+    if (self) {
+        _store = store;
+        _ftsTableName = ftsTableName;
+        _db = db;
+        _entryIds = [NSMutableArray new];
+        _rowsByEntryId = [NSMutableDictionary new];
+        _replacedEntryIds = [NSMutableArray new];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return self.entryIds.count;
+}
+
+- (void)addRow:(NSDictionary*)ftsValues forEntryId:(NSNumber*)entryId isNew:(BOOL)isNew
+{
+    NSMutableDictionary *row = [ftsValues mutableCopy];
+    row[ROWID_COL] = entryId;
+    if (self.rowsByEntryId[entryId] == nil) {
+        [self.entryIds addObject:entryId];
+        if (!isNew) {
+            [self.replacedEntryIds addObject:entryId];
+        }
+    }
+    self.rowsByEntryId[entryId] = row;
+    if (self.entryIds.count >= kMaxBufferedFtsRows) {
+        [self flush];
+    }
+}
+
+- (void)flush
+{
+    if (self.entryIds.count == 0) {
+        return;
+    }
+    if (self.replacedEntryIds.count > 0) {
+        NSString *deleteSql = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ IN (%@)",
+                               self.ftsTableName, ROWID_COL, [self.replacedEntryIds componentsJoinedByString:@","]];
+        [self.store executeUpdateThrows:deleteSql withDb:self.db];
+    }
+    NSMutableArray *rows = [NSMutableArray arrayWithCapacity:self.entryIds.count];
+    for (NSNumber *entryId in self.entryIds) {
+        [rows addObject:self.rowsByEntryId[entryId]];
+    }
+    [self.store insertIntoTable:self.ftsTableName rows:rows withDb:self.db];
+    [self.entryIds removeAllObjects];
+    [self.rowsByEntryId removeAllObjects];
+    [self.replacedEntryIds removeAllObjects];
+}
+
+@end
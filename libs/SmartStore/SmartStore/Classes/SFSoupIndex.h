@@ -33,6 +33,21 @@ extern NSString * const kSoupIndexTypeInteger;
 extern NSString * const kSoupIndexTypeFloating;
 extern NSString * const kSoupIndexTypeFullText;
 extern NSString * const kSoupIndexTypeJSON1;
+extern NSString * const kSoupIndexFtsOptions;
+
+/**
+ * Keys of the fts options of full_text indexes (fts5 only)
+ * kSoupIndexFtsPrefix: array of prefix lengths to index, e.g. @[@2, @3] to speed up "term*" queries on 2 and 3 characters
+ * kSoupIndexFtsTokenize: tokenizer, e.g. @"porter unicode61" or kSoupIndexFtsTokenizerTrigram for substring search
+ * kSoupIndexFtsDetail: kSoupIndexFtsDetailFull (default), kSoupIndexFtsDetailColumn or kSoupIndexFtsDetailNone to shrink the index
+ */
+extern NSString * const kSoupIndexFtsPrefix;
+extern NSString * const kSoupIndexFtsTokenize;
+extern NSString * const kSoupIndexFtsDetail;
+extern NSString * const kSoupIndexFtsTokenizerTrigram;
+extern NSString * const kSoupIndexFtsDetailFull;
+extern NSString * const kSoupIndexFtsDetailColumn;
+extern NSString * const kSoupIndexFtsDetailNone;
 
 
 /**
@@ -52,6 +67,7 @@ NS_SWIFT_NAME(SoupIndex)
     NSString *_path;
     NSString *_indexType;
     NSString *_columnName;
+    NSArray<NSString*> *_pathComponents;
 }
 
 /**
@@ -59,11 +75,23 @@ NS_SWIFT_NAME(SoupIndex)
  */
 @property (nonatomic, strong) NSString *path;
 
+/**
+ * The components of the path, e.g. ["Account", "Id"] for "Account.Id" - computed once per path.
+ */
+@property (nonatomic, strong, readonly) NSArray<NSString*> *pathComponents;
+
 /**
  * The type of index this is (string or date).
  */
 @property (nonatomic, strong) NSString *indexType;
 
+/**
+ * Options of the fts table for full_text indexes (see kSoupIndexFtsPrefix, kSoupIndexFtsTokenize and kSoupIndexFtsDetail).
+ * The options apply to the fts table of the soup: all the full_text indexes of a soup that have options must have the same ones.
+ * Note: detail=column does not support phrase and NEAR queries, detail=none does not support column filters either.
+ */
+@property (nonatomic, copy, nullable) NSDictionary<NSString*, id> *ftsOptions;
+
 /**
  * The type of data that will be indexed (string or integer).
  */
@@ -128,6 +156,13 @@ NS_SWIFT_NAME(SoupIndex)
  */
 + (BOOL) hasFts:(NSArray<SFSoupIndex*>*)soupIndexes;
 
+/** Returns the fts options of the full_text indexes
+ * @param soupIndexes array of SFSoupIndex objects
+ * @param conflict Set to YES if full_text indexes have different options
+ * @return The fts options of the soup, nil if none of the indexes have options
+ */
++ (nullable NSDictionary<NSString*, id>*) ftsOptions:(NSArray<SFSoupIndex*>*)soupIndexes conflict:(BOOL*)conflict;
+
 /** Returns YES if any of the indexes are JSON1
  * @param soupIndexes array of SFSoupIndex objects
  * @return YES if any of the indexes are JSON1
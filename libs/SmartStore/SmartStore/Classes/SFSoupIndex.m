@@ -32,6 +32,15 @@ NSString * const kSoupIndexTypeJSON1    = @"json1";
 NSString * const kSoupIndexPath         = @"path";
 NSString * const kSoupIndexType         = @"type";
 NSString * const kSoupIndexColumnName   = @"columnName";
+NSString * const kSoupIndexFtsOptions   = @"ftsOptions";
+
+NSString * const kSoupIndexFtsPrefix           = @"prefix";
+NSString * const kSoupIndexFtsTokenize         = @"tokenize";
+NSString * const kSoupIndexFtsDetail           = @"detail";
+NSString * const kSoupIndexFtsTokenizerTrigram = @"trigram";
+NSString * const kSoupIndexFtsDetailFull       = @"full";
+NSString * const kSoupIndexFtsDetailColumn     = @"column";
+NSString * const kSoupIndexFtsDetailNone       = @"none";
 
 SFIndexSpecTypeFilterBlock const kValueExtractedToColumn = ^BOOL (SFSoupIndex* idx) { return ![idx.indexType isEqualToString:kSoupIndexTypeJSON1]; };
 SFIndexSpecTypeFilterBlock const kValueExtractedToFtsColumn = ^BOOL (SFSoupIndex* idx) { return [idx.indexType isEqualToString:kSoupIndexTypeFullText]; };
@@ -59,6 +68,9 @@ SFIndexSpecTypeFilterBlock const kValueIndexedWithJSONExtract = ^BOOL (SFSoupInd
                     indexType:dict[kSoupIndexType]
                    columnName:dict[kSoupIndexColumnName]
             ];
+    if (nil != self && [dict[kSoupIndexFtsOptions] isKindOfClass:[NSDictionary class]]) {
+        self.ftsOptions = dict[kSoupIndexFtsOptions];
+    }
     return self;
 }
 
@@ -66,6 +78,18 @@ SFIndexSpecTypeFilterBlock const kValueIndexedWithJSONExtract = ^BOOL (SFSoupInd
     SFRelease(_columnName);
     SFRelease(_indexType);
     SFRelease(_path);
+    SFRelease(_pathComponents);
+    SFRelease(_ftsOptions);
+}
+
+- (void)setPath:(NSString *)path {
+    _path = path;
+    // Same as [SFJsonUtils projectIntoJson:path:]: an empty path designates the whole entry
+    _pathComponents = path.length > 0 ? [path componentsSeparatedByString:@"."] : @[];
+}
+
+- (NSArray<NSString*> *)pathComponents {
+    return _pathComponents;
 }
 
 /**
@@ -101,6 +125,8 @@ SFIndexSpecTypeFilterBlock const kValueIndexedWithJSONExtract = ^BOOL (SFSoupInd
     result[kSoupIndexType] = self.indexType;
     if (withColumnName && self.columnName)
         result[kSoupIndexColumnName] = self.columnName;
+    if (self.ftsOptions.count > 0)
+        result[kSoupIndexFtsOptions] = self.ftsOptions;
     return result;
 }
 
@@ -150,6 +176,26 @@ SFIndexSpecTypeFilterBlock const kValueIndexedWithJSONExtract = ^BOOL (SFSoupInd
     return NO;
 }
 
++ (NSDictionary*) ftsOptions:(NSArray*)soupIndexes conflict:(BOOL*)conflict
+{
+    NSDictionary* result = nil;
+    BOOL hasConflict = NO;
+    for (SFSoupIndex* soupIndex in soupIndexes) {
+        if (![soupIndex.indexType isEqualToString:kSoupIndexTypeFullText] || soupIndex.ftsOptions.count == 0) {
+            continue;
+        }
+        if (result == nil) {
+            result = soupIndex.ftsOptions;
+        } else if (![result isEqualToDictionary:soupIndex.ftsOptions]) {
+            hasConflict = YES;
+        }
+    }
+    if (conflict) {
+        *conflict = hasConflict;
+    }
+    return result;
+}
+
 + (BOOL) hasJSON1:(NSArray*)soupIndexes
 {
     for (SFSoupIndex* soupIndex in soupIndexes) {
@@ -0,0 +1,50 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class SFSoupIndex;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Extracts the values of a set of indexes from soup entries.
+ Index paths are compiled once into a tree of path components, so that an entry is traversed only once for all the indexes
+ and that paths sharing a prefix (e.g. "Account.Id" and "Account.Name") share the lookups of that prefix.
+ Results are the same as calling [SFJsonUtils projectIntoJson:path:] for each index, including the fan-out over arrays.
+ */
+@interface SFSoupIndexProjector : NSObject
+
+- (instancetype)initWithIndices:(NSArray<SFSoupIndex*>*)indices;
+
+/**
+ Sets values[columnName] for every index: non-leaf values are json-ized, missing values are set to NSNull.
+ @param entry The soup entry.
+ @param values The dictionary to populate.
+ */
+- (void)projectEntry:(NSDictionary*)entry intoValues:(NSMutableDictionary*)values;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,157 @@
+/*
+ Copyright (c) 2020-present, salesforce.com, inc. All rights reserved.
+ 
+ Redistribution and use of this software in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of
+ conditions and the following disclaimer in the documentation and/or other materials provided
+ with the distribution.
+ * Neither the name of salesforce.com, inc. nor the names of its contributors may be used to
+ endorse or promote products derived from this software without specific prior written
+ permission of salesforce.com, inc.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <SalesforceSDKCommon/SFJsonUtils.h>
+#import "SFSoupIndexProjector.h"
+#import "SFSoupIndex.h"
+
+/**
+ Node of the path components tree: the root is the entry, every other node is one path component.
+ */
+@interface SFSoupIndexProjectorNode : NSObject
+
+@property (nonatomic, strong) NSString *key;
+@property (nonatomic, strong) NSMutableArray<SFSoupIndexProjectorNode*> *children;
+@property (nonatomic, strong) NSMutableDictionary<NSString*, SFSoupIndexProjectorNode*> *childrenByKey;
+// Indexes whose path ends at this node
+@property (nonatomic, strong) NSMutableArray<NSNumber*> *terminalSlots;
+// Indexes whose path goes through (but does not end at) this node
+@property (nonatomic, strong) NSMutableArray<NSNumber*> *descendantSlots;
+
+@end
+
+@implementation SFSoupIndexProjectorNode
+
+- (instancetype)initWithKey:(NSString *)key {
+    self = [super init];
+    if (self) {
+        _key = key;
+        _children = [NSMutableArray new];
+        _childrenByKey = [NSMutableDictionary new];
+        _terminalSlots = [NSMutableArray new];
+        _descendantSlots = [NSMutableArray new];
+    }
+    return self;
+}
+
+@end
+
+@interface SFSoupIndexProjector ()
+
+@property (nonatomic, strong) NSArray<NSString*> *columnNames;
+@property (nonatomic, strong) SFSoupIndexProjectorNode *root;
+
+@end
+
+static void SFProjectChildren(SFSoupIndexProjectorNode *node, id value, __strong id *out, NSUInteger slotCount);
+
+// Sets the value of the indexes ending at node and of the ones below it
+static void SFProjectNode(SFSoupIndexProjectorNode *node, id value, __strong id *out, NSUInteger slotCount) {
+    for (NSNumber *slot in node.terminalSlots) {
+        out[slot.unsignedIntegerValue] = value;
+    }
+    if (value != nil && node.children.count > 0) {
+        SFProjectChildren(node, value, out, slotCount);
+    }
+}
+
+// Applies the next path components (i.e. the children of node) to value
+// Like [SFJsonUtils projectIntoJson:path:], arrays are traversed element by element with the same path components
+static void SFProjectChildren(SFSoupIndexProjectorNode *node, id value, __strong id *out, NSUInteger slotCount) {
+    if ([value isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dict = (NSDictionary *)value;
+        for (SFSoupIndexProjectorNode *child in node.children) {
+            SFProjectNode(child, dict[child.key], out, slotCount);
+        }
+    }
+    else if ([value isKindOfClass:[NSArray class]]) {
+        NSArray<NSNumber*> *slots = node.descendantSlots;
+        NSMutableArray *results = [NSMutableArray arrayWithCapacity:slots.count];
+        for (NSUInteger i = 0; i < slots.count; i++) {
+            [results addObject:[NSMutableArray new]];
+        }
+        __strong id *elementOut = (__strong id *)calloc(slotCount, sizeof(id));
+        for (id element in (NSArray *)value) {
+            SFProjectChildren(node, element, elementOut, slotCount);
+            for (NSUInteger i = 0; i < slots.count; i++) {
+                NSUInteger slot = slots[i].unsignedIntegerValue;
+                if (elementOut[slot] != nil) {
+                    [results[i] addObject:elementOut[slot]];
+                    elementOut[slot] = nil;
+                }
+            }
+        }
+        free(elementOut);
+        for (NSUInteger i = 0; i < slots.count; i++) {
+            NSArray *result = results[i];
+            out[slots[i].unsignedIntegerValue] = result.count > 0 ? result : nil;
+        }
+    }
+}
+
+@implementation SFSoupIndexProjector
+
+- (instancetype)initWithIndices:(NSArray<SFSoupIndex*>*)indices {
+    self = [super init];
+    if (self) {
+        NSMutableArray *columnNames = [NSMutableArray arrayWithCapacity:indices.count];
+        _root = [[SFSoupIndexProjectorNode alloc] initWithKey:@""];
+        for (SFSoupIndex *idx in indices) {
+            NSNumber *slot = @(columnNames.count);
+            [columnNames addObject:idx.columnName];
+            SFSoupIndexProjectorNode *node = _root;
+            for (NSString *pathComponent in idx.pathComponents) {
+                [node.descendantSlots addObject:slot];
+                SFSoupIndexProjectorNode *child = node.childrenByKey[pathComponent];
+                if (child == nil) {
+                    child = [[SFSoupIndexProjectorNode alloc] initWithKey:pathComponent];
+                    node.childrenByKey[pathComponent] = child;
+                    [node.children addObject:child];
+                }
+                node = child;
+            }
+            [node.terminalSlots addObject:slot];
+        }
+        _columnNames = columnNames;
+    }
+    return self;
+}
+
+- (void)projectEntry:(NSDictionary*)entry intoValues:(NSMutableDictionary*)values {
+    NSUInteger slotCount = self.columnNames.count;
+    __strong id *out = (__strong id *)calloc(slotCount, sizeof(id));
+    SFProjectNode(self.root, entry, out, slotCount);
+    for (NSUInteger slot = 0; slot < slotCount; slot++) {
+        id value = out[slot];
+        // values for non-leaf nodes are json-ized
+        if ([value isKindOfClass:[NSDictionary class]] || [value isKindOfClass:[NSArray class]]) {
+            value = [SFJsonUtils JSONRepresentation:value options:0];
+        }
+        values[self.columnNames[slot]] = value != nil ? value : [NSNull null];
+        out[slot] = nil;
+    }
+    free(out);
+}
+
+@end
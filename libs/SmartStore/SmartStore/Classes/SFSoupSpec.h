@@ -24,10 +24,13 @@
 
 #import <Foundation/Foundation.h>
 
+@class SFSoupCompositeIndex;
+
 NS_ASSUME_NONNULL_BEGIN
 
 extern NSString * const kSoupSpecSoupName;
 extern NSString * const kSoupSpecFeatures;
+extern NSString * const kSoupSpecCompositeIndexes;
 
 // Soup Features
 /**
@@ -37,6 +40,22 @@ extern NSString * const kSoupSpecFeatures;
  */
 extern NSString * const kSoupFeatureExternalStorage;
 
+/**
+ *  Feature to have SQLite compute the index columns from the soup json (STORED generated columns).
+ *  Upserts only bind the serialized entry: there is no extraction of index values in Objective-C.
+ *  Unlike other soups, index paths going through arrays are not fanned out (the column is null), since json_extract does not traverse arrays.
+ *  Can't be combined with kSoupFeatureExternalStorage.
+ */
+extern NSString * const kSoupFeatureGeneratedColumns;
+
+/**
+ *  Feature to keep the row count of the soup, and the row count for each value of its string / integer / floating indexes,
+ *  in a side table maintained by triggers.
+ *  countWithQuerySpec then answers "all" queries and exact queries on those indexes without scanning the soup.
+ *  Every insert / update / delete also updates the counts, so only enable it for soups that get counted often.
+ */
+extern NSString * const kSoupFeatureMaterializedCounts;
+
 /**
  * Object containing soup specifications, such as soup name and features.
  */
@@ -53,6 +72,11 @@ NS_SWIFT_NAME(SoupSpec)
  */
 @property (nonatomic, copy, readonly) NSArray *features;
 
+/**
+ *  The composite, covering and partial indexes of the soup (see SFSoupCompositeIndex).
+ */
+@property (nonatomic, copy, readonly) NSArray<SFSoupCompositeIndex*> *compositeIndexes;
+
 /**
  * Factory method to build a soup spec.
  * @param soupName The soup name.
@@ -61,6 +85,15 @@ NS_SWIFT_NAME(SoupSpec)
  */
 + (SFSoupSpec *)newSoupSpec:(NSString *)soupName withFeatures:(nullable NSArray *)features;
 
+/**
+ * Factory method to build a soup spec with composite indexes.
+ * @param soupName The soup name.
+ * @param features The soup features.
+ * @param compositeIndexes The composite indexes (SFSoupCompositeIndex objects or dictionaries).
+ * @return A soup spec object.
+ */
++ (SFSoupSpec *)newSoupSpec:(NSString *)soupName withFeatures:(nullable NSArray *)features withCompositeIndexes:(nullable NSArray *)compositeIndexes;
+
 /**
  * Factory method to build a soup spec from a dictionary.
  * @discussion At least "soupName" is required. Otherwise, this method returns nil.
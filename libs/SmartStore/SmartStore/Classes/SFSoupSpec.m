@@ -23,31 +23,42 @@
  */
 
 #import "SFSoupSpec.h"
+#import "SFSoupCompositeIndex.h"
 
 NSString * const kSoupSpecSoupName = @"name";
 NSString * const kSoupSpecFeatures = @"features";
+NSString * const kSoupSpecCompositeIndexes = @"compositeIndexes";
 NSString * const kSoupFeatureExternalStorage = @"externalStorage";
+NSString * const kSoupFeatureGeneratedColumns = @"generatedColumns";
+NSString * const kSoupFeatureMaterializedCounts = @"materializedCounts";
 
 @interface SFSoupSpec()
 
 @property (nonatomic, copy, readwrite) NSString *soupName;
 @property (nonatomic, copy, readwrite) NSArray *features;
+@property (nonatomic, copy, readwrite) NSArray<SFSoupCompositeIndex*> *compositeIndexes;
 
 @end
 
 @implementation SFSoupSpec
 
 + (SFSoupSpec *)newSoupSpec:(NSString *)soupName withFeatures:(NSArray *)features {
+    return [SFSoupSpec newSoupSpec:soupName withFeatures:features withCompositeIndexes:nil];
+}
+
++ (SFSoupSpec *)newSoupSpec:(NSString *)soupName withFeatures:(NSArray *)features withCompositeIndexes:(NSArray *)compositeIndexes {
     SFSoupSpec *soupSpec = [[SFSoupSpec alloc] init];
     soupSpec.soupName = soupName;
     soupSpec.features = features;
+    soupSpec.compositeIndexes = [SFSoupCompositeIndex asArrayOfCompositeIndexes:compositeIndexes];
     return soupSpec;
 }
 
 + (SFSoupSpec *)newSoupSpecWithDictionary:(NSDictionary *)dictionary {
     if (dictionary[kSoupSpecSoupName]) {
         return [SFSoupSpec newSoupSpec:dictionary[kSoupSpecSoupName]
-                          withFeatures:dictionary[kSoupSpecFeatures]];
+                          withFeatures:dictionary[kSoupSpecFeatures]
+                  withCompositeIndexes:dictionary[kSoupSpecCompositeIndexes]];
     }
     return nil;
 }
@@ -58,6 +69,9 @@ NSString * const kSoupFeatureExternalStorage = @"externalStorage";
     if (self.features) {
         dictionary[kSoupSpecFeatures] = self.features;
     }
+    if (self.compositeIndexes.count > 0) {
+        dictionary[kSoupSpecCompositeIndexes] = [SFSoupCompositeIndex asArrayOfDictionaries:self.compositeIndexes];
+    }
     return dictionary;
 }
 
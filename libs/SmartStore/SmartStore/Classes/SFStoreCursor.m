@@ -37,6 +37,12 @@
 @property (nonatomic, readwrite, strong) NSNumber *totalPages;
 @property (nonatomic, readwrite, strong) NSNumber *totalEntries;
 
+// Keyset pagination state: continuation token returned with the last page fetched
+@property (nonatomic, strong) NSNumber *lastFetchedPageIndex;
+@property (nonatomic, strong) NSDictionary *nextContinuationToken;
+
+- (BOOL)runQuery:(SFSmartStore*)store resultArray:(NSMutableArray*)resultArray resultString:(NSMutableString*)resultString error:(NSError**)error;
+
 @end
 
 @implementation SFStoreCursor
@@ -77,6 +83,8 @@
     self.currentPageIndex = nil;
     self.pageSize = nil;
     self.totalPages = nil;
+    self.lastFetchedPageIndex = nil;
+    self.nextContinuationToken = nil;
 }
 
 - (NSString*)getDataSerialized:(SFSmartStore*)store error:(NSError**)error {
@@ -88,7 +96,7 @@
     [resultBuilder appendFormat:@"\"%@\":%@, ", @"totalPages", self.totalPages ?: @0];
     [resultBuilder appendFormat:@"\"%@\":%@, ", @"totalEntries", self.totalEntries ?: @0];
     [resultBuilder appendFormat:@"\"%@\":", @"currentPageOrderedEntries"];
-    BOOL succ = [store queryAsString:resultBuilder querySpec:self.querySpec pageIndex:[self.currentPageIndex integerValue] error:error];
+    BOOL succ = [self runQuery:store resultArray:nil resultString:resultBuilder error:error];
     [resultBuilder appendString:@"}"];
 
     if (succ && [store checkRawJson:resultBuilder fromMethod:NSStringFromSelector(_cmd)]) {
@@ -108,8 +116,8 @@
     result[@"totalPages"] = self.totalPages ?: @0;
     result[@"totalEntries"] = self.totalEntries ?: @0;
     
-    NSArray* entries = [store queryWithQuerySpec:self.querySpec pageIndex:[self.currentPageIndex integerValue] error:error];
-    if (entries) {
+    NSMutableArray* entries = [NSMutableArray new];
+    if ([self runQuery:store resultArray:entries resultString:nil error:error]) {
         result[@"currentPageOrderedEntries"] = entries;
         return result;
     } else {
@@ -117,5 +125,38 @@
     }
 }
 
+/**
+ * Moving to the page following the last one fetched seeks past its last row (keyset pagination)
+ * Any other page is fetched with an offset
+ */
+- (BOOL)runQuery:(SFSmartStore*)store resultArray:(NSMutableArray*)resultArray resultString:(NSMutableString*)resultString error:(NSError**)error
+{
+    NSUInteger pageIndex = [self.currentPageIndex unsignedIntegerValue];
+    if (!self.querySpec.supportsKeysetPagination) {
+        return resultArray
+        ? [self addEntries:[store queryWithQuerySpec:self.querySpec pageIndex:pageIndex error:error] toArray:resultArray]
+        : [store queryAsString:resultString querySpec:self.querySpec pageIndex:pageIndex error:error];
+    }
+
+    BOOL isNextPage = self.lastFetchedPageIndex != nil && pageIndex == [self.lastFetchedPageIndex unsignedIntegerValue] + 1;
+    NSDictionary* continuationToken = isNextPage ? self.nextContinuationToken : nil;
+    NSDictionary* nextContinuationToken = nil;
+    BOOL succ = [store runKeysetQuery:resultArray resultString:resultString querySpec:self.querySpec pageIndex:pageIndex continuationToken:continuationToken nextContinuationToken:&nextContinuationToken error:error];
+    // Keep the token of the last page fetched unless we are refetching the same page
+    if (succ && (self.lastFetchedPageIndex == nil || pageIndex != [self.lastFetchedPageIndex unsignedIntegerValue])) {
+        self.lastFetchedPageIndex = @(pageIndex);
+        self.nextContinuationToken = nextContinuationToken;
+    }
+    return succ;
+}
+
+- (BOOL)addEntries:(NSArray*)entries toArray:(NSMutableArray*)resultArray
+{
+    if (entries) {
+        [resultArray addObjectsFromArray:entries];
+    }
+    return entries != nil;
+}
+
 @end
 
@@ -34,10 +34,14 @@
 #import <SmartStore/SFSmartStoreUtils.h>
 #import <SmartStore/SFSmartStoreUpgrade.h>
 #import <SmartStore/SFSmartStoreInspectorViewController.h>
+#import <SmartStore/SFSmartStoreQueryProfiler.h>
+#import <SmartStore/SFSmartStoreIndexAdvisor.h>
 #import <SmartStore/SFStoreCursor.h>
 #import <SmartStore/SFSmartStoreDatabaseManager.h>
 #import <SmartStore/SFAlterSoupLongOperation.h>
+#import <SmartStore/SFReIndexSoupLongOperation.h>
 #import <SmartStore/SFSmartSqlHelper.h>
 #import <SmartStore/SFSoupSpec.h>
+#import <SmartStore/SFSoupCompositeIndex.h>
 #import <SmartStore/SFSDKSmartStoreLogger.h>
 #import <SmartStore/SFSoupIndex.h>
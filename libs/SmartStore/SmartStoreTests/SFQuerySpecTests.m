@@ -141,6 +141,29 @@
     XCTAssertEqualObjects(@"SELECT id FROM {employees} WHERE {employees:_soupEntryId} IN (SELECT rowid FROM {employees}_fts WHERE {employees}_fts MATCH '{employees:lastName}:Bond') ORDER BY {employees:firstName} ASC ", querySpec.idsSmartSql, @"Wrong ids smart sql for match query spec");
 }
 
+- (void) testRankedMatchQuerySmartSql
+{
+    SFQuerySpec* querySpec = [SFQuerySpec newRankedMatchQuerySpec:@"employees" withSelectPaths:nil withPath:nil withMatchKey:@"Bond" includesSnippet:NO withPageSize:1];
+    XCTAssertEqualObjects(@"SELECT {employees:_soup} FROM {employees}_fts JOIN {employees} ON {employees:_soupEntryId} = {employees}_fts.rowid WHERE {employees}_fts MATCH ? ORDER BY bm25({employees}_fts), {employees:_soupEntryId} ", querySpec.smartSql, @"Wrong smart sql for ranked match query spec");
+    XCTAssertEqualObjects(@[@"Bond"], [querySpec bindsForQuerySpec], @"Match key should be bound");
+    XCTAssertFalse(querySpec.returnsRows, @"Ranked match query without snippet should return soup entries");
+    XCTAssertFalse(querySpec.supportsKeysetPagination, @"Ranked match query should not support keyset pagination");
+}
+
+- (void) testRankedMatchQuerySmartSqlWithPathAndSnippet
+{
+    SFQuerySpec* querySpec = [SFQuerySpec newRankedMatchQuerySpec:@"employees" withSelectPaths:@[@"_soupEntryId", @"lastName"] withPath:@"lastName" withMatchKey:@"Bond" includesSnippet:YES withPageSize:1];
+    XCTAssertEqualObjects(@"SELECT {employees:_soupEntryId}, {employees}.{employees:lastName}, snippet({employees}_fts, -1, '<b>', '</b>', '...', 16) FROM {employees}_fts JOIN {employees} ON {employees:_soupEntryId} = {employees}_fts.rowid WHERE {employees}_fts MATCH '{employees:lastName} : (' || ? || ')' ORDER BY bm25({employees}_fts), {employees:_soupEntryId} ", querySpec.smartSql, @"Wrong smart sql for ranked match query spec with snippet");
+    XCTAssertEqualObjects(@"SELECT count(*) FROM {employees}_fts JOIN {employees} ON {employees:_soupEntryId} = {employees}_fts.rowid WHERE {employees}_fts MATCH '{employees:lastName} : (' || ? || ')' ", querySpec.countSmartSql, @"Wrong count smart sql for ranked match query spec");
+    XCTAssertEqualObjects(@"SELECT {employees:_soupEntryId} FROM {employees}_fts JOIN {employees} ON {employees:_soupEntryId} = {employees}_fts.rowid WHERE {employees}_fts MATCH '{employees:lastName} : (' || ? || ')' ORDER BY bm25({employees}_fts), {employees:_soupEntryId} ", querySpec.idsSmartSql, @"Wrong ids smart sql for ranked match query spec");
+    XCTAssertTrue(querySpec.returnsRows, @"Ranked match query with snippet should return rows");
+
+    // Round trip through dictionary
+    SFQuerySpec* querySpecFromDict = [[SFQuerySpec alloc] initWithDictionary:[querySpec asDictionary] withSoupName:@"employees"];
+    XCTAssertEqual(kSFSoupQueryTypeRankedMatch, querySpecFromDict.queryType, @"Wrong query type");
+    XCTAssertTrue(querySpecFromDict.includesSnippet, @"Snippet flag should have been kept");
+}
+
 - (void) testLikeQuerySmartSql
 {
     SFQuerySpec* querySpec = [SFQuerySpec newLikeQuerySpec:@"employees" withPath:@"lastName" withLikeKey:@"Bon%" withOrderPath:@"lastName" withOrder:kSFSoupQuerySortOrderAscending withPageSize:1];
@@ -78,4 +78,50 @@
     XCTAssertEqual(@"select * from table_3", [cache sqlForSmartSql:@"select * from {regions}"]);
 }
 
+- (void) testLeastRecentlyUsedEvictedFirst {
+    SFSmartSqlCache* cache = [[SFSmartSqlCache alloc] initWithCountLimit:2];
+    [cache setSql:@"select * from table_1" forSmartSql:@"select * from {employees}"];
+    [cache setSql:@"select * from table_2" forSmartSql:@"select * from {departments}"];
+    // Using employees makes departments the least recently used
+    XCTAssertEqual(@"select * from table_1", [cache sqlForSmartSql:@"select * from {employees}"]);
+    [cache setSql:@"select * from table_3" forSmartSql:@"select * from {regions}"];
+    XCTAssertEqual(@"select * from table_1", [cache sqlForSmartSql:@"select * from {employees}"]);
+    XCTAssertNil([cache sqlForSmartSql:@"select * from {departments}"]);
+    XCTAssertEqual(@"select * from table_3", [cache sqlForSmartSql:@"select * from {regions}"]);
+    XCTAssertEqual(cache.count, 2);
+    XCTAssertEqual(cache.evictionCount, 1);
+    XCTAssertEqual(cache.hitCount, 3);
+    XCTAssertEqual(cache.missCount, 1);
+}
+
+- (void) testWriteToCachePastTotalCostLimit {
+    // Entries cost 2 bytes per character of their smart sql and sql: 92, 94 and 94 bytes below
+    SFSmartSqlCache* cache = [[SFSmartSqlCache alloc] initWithCountLimit:10 totalCostLimit:200];
+    [cache setSql:@"select * from table_1" forSmartSql:@"select * from {employees}"];
+    [cache setSql:@"select * from table_2" forSmartSql:@"select * from {employees1}"];
+    XCTAssertEqual(cache.totalCost, 92 + 94);
+    [cache setSql:@"select * from table_3" forSmartSql:@"select * from {employees2}"];
+    XCTAssertEqual(cache.count, 2);
+    XCTAssertLessThanOrEqual(cache.totalCost, 200);
+    XCTAssertNil([cache sqlForSmartSql:@"select * from {employees}"]);
+    XCTAssertEqual(@"select * from table_3", [cache sqlForSmartSql:@"select * from {employees2}"]);
+}
+
+- (void) testRemoveEntriesForSoupReferencedByPath {
+    SFSmartSqlCache* cache = [[SFSmartSqlCache alloc] initWithCountLimit:5];
+    [cache setSql:@"select table_1.name from table_2, table_1" forSmartSql:@"select {employees:name} from {departments}, {employees}"];
+    [cache setSql:@"select table_1_0 from table_1" forSmartSql:@"select {employees:name} from {employees} e"];
+    [cache setSql:@"select table_3_0 from table_3" forSmartSql:@"select {regions:name} from {regions}"];
+    [cache removeEntriesForSoup:@"employees"];
+    XCTAssertNil([cache sqlForSmartSql:@"select {employees:name} from {departments}, {employees}"]);
+    XCTAssertNil([cache sqlForSmartSql:@"select {employees:name} from {employees} e"]);
+    XCTAssertEqual(@"select table_3_0 from table_3", [cache sqlForSmartSql:@"select {regions:name} from {regions}"]);
+    // Other soups entries are only dropped with their soup
+    [cache removeEntriesForSoup:@"departments"];
+    XCTAssertEqual(cache.count, 1);
+    [cache removeEntriesForSoup:@"regions"];
+    XCTAssertEqual(cache.count, 0);
+    XCTAssertEqual(cache.totalCost, 0);
+}
+
 @end
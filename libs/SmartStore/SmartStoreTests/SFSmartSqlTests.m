@@ -209,6 +209,21 @@
 }
 
 
+- (void) testConvertSmartSqlEdgeCases
+{
+    // Leading whitespace and mixed case write statements
+    XCTAssertNil([self.store convertSmartSql:@"  \n DeLeTe from {employees}"], @"Should have returned nil for a delete query");
+    // Reference at the very start of the query
+    XCTAssertEqualObjects(@"TABLE_1_1", [self.store convertSmartSql:@"{employees:lastName}"], @"Bad conversion");
+    // Non ascii characters around references
+    XCTAssertEqualObjects(@"select TABLE_1_1 from TABLE_1 where TABLE_1_0 = 'Zoë ☃'",
+                          [self.store convertSmartSql:@"select {employees:lastName} from {employees} where {employees:firstName} = 'Zoë ☃'"], @"Bad conversion");
+    // Invalid references
+    XCTAssertNil([self.store convertSmartSql:@"select {employees:lastName:x} from {employees}"], @"Should have returned nil for an invalid reference");
+    XCTAssertNil([self.store convertSmartSql:@"select {unknownSoup:lastName} from {unknownSoup}"], @"Should have returned nil for an unknown soup");
+    XCTAssertNil([self.store convertSmartSql:@"select {employees:unknownPath} from {employees}"], @"Should have returned nil for an unknown path");
+}
+
 - (void) testSmartQueryDoingCount 
 {
     [self loadData];
@@ -23,15 +23,24 @@
  */
 
 #import "SFAlterSoupLongOperation.h"
+#import "SFReIndexSoupLongOperation.h"
 #import "SFSmartStore+Internal.h"
 #import "SFSoupIndex.h"
 #import "SFQuerySpec.h"
 #import "SFSoupSpec.h"
+#import "SFSoupCompositeIndex.h"
 #import <SalesforceSDKCommon/SFJsonUtils.h>
 #import "FMDatabaseQueue.h"
 #import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
 #import "SFSmartStoreTestCase.h"
 
+@interface SFAlterSoupLongOperation ()
+
+- (BOOL) copyNextBatch;
+
+@end
+
 @interface SFSmartStoreAlterTests : SFSmartStoreTestCase
 
 @property (nonatomic, strong) SFUserAccount *smartStoreUser;
@@ -107,6 +116,35 @@
     [self checkIndexSpecs:actualIndexSpecs withExpectedIndexSpecs:indexSpecs checkColumnName:NO];
 }
 
+/**
+ * Test that cached column names for paths are refreshed by alterSoup and removeSoup
+ */
+- (void) testColumnNameForPathAfterAlterAndRemove {
+    [self.store registerSoup:kTestSoupName withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}]] error:nil];
+    __block NSString* lastNameColumn;
+    __block NSString* cityColumn;
+    [self.store.storeQueue inDatabase:^(FMDatabase* db) {
+        lastNameColumn = [self.store columnNameForPath:kLastName inSoup:kTestSoupName withDb:db];
+        cityColumn = [self.store columnNameForPath:kAddressCity inSoup:kTestSoupName withDb:db];
+    }];
+    XCTAssertEqualObjects(lastNameColumn, kLastNameCol, @"Wrong column name");
+    XCTAssertNil(cityColumn, @"Path should not be indexed");
+    
+    [self.store alterSoup:kTestSoupName withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[@{@"path": kAddressCity, @"type": @"string"}]] reIndexData:NO];
+    [self.store.storeQueue inDatabase:^(FMDatabase* db) {
+        lastNameColumn = [self.store columnNameForPath:kLastName inSoup:kTestSoupName withDb:db];
+        cityColumn = [self.store columnNameForPath:kAddressCity inSoup:kTestSoupName withDb:db];
+    }];
+    XCTAssertNil(lastNameColumn, @"Path should no longer be indexed");
+    XCTAssertEqualObjects(cityColumn, @"TABLE_1_0", @"Wrong column name");
+    
+    [self.store removeSoup:kTestSoupName];
+    [self.store.storeQueue inDatabase:^(FMDatabase* db) {
+        cityColumn = [self.store columnNameForPath:kAddressCity inSoup:kTestSoupName withDb:db];
+    }];
+    XCTAssertNil(cityColumn, @"Soup no longer exists");
+}
+
 /**
  * Test for alterSoup with reIndexData = false
  */
@@ -124,6 +162,93 @@
 }
 
 
+/**
+ * Test for alterSoup to and from generated columns
+ */
+- (void) testAlterSoupToAndFromGeneratedColumns
+{
+    [self.store registerSoup:kTestSoupName withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}, @{@"path": kAddressCity, @"type": @"string"}]] error:nil];
+    NSArray* savedEntries = [self.store upsertEntries:@[@{kLastName:@"Doe", kAddress: @{kCity: @"San Francisco", kStreet: @"1 market"}},
+                                                        @{kLastName:@"Jackson", kAddress: @{kCity: @"Los Angeles", kStreet: @"100 mission"}}]
+                                               toSoup:kTestSoupName];
+    NSArray* indexSpecsNew = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}, @{@"path": kAddressStreet, @"type": @"string"}]];
+    
+    // To generated columns: no re-indexing needed for the new street index
+    // Then back to regular columns: values are copied from the generated columns
+    for (NSArray* features in @[ @[kSoupFeatureGeneratedColumns], @[] ]) {
+        XCTAssertTrue([self.store alterSoup:kTestSoupName withSoupSpec:[SFSoupSpec newSoupSpec:kTestSoupName withFeatures:features] withIndexSpecs:indexSpecsNew reIndexData:NO], @"Alter soup failed");
+        XCTAssertEqualObjects([self.store attributesForSoup:kTestSoupName].features, features, @"Wrong features");
+        [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+            FMResultSet* frs = [self.store queryTable:kTestSoupTableName forColumns:nil orderBy:@"id ASC" limit:nil whereClause:nil whereArgs:nil withDb:db];
+            for (NSDictionary* savedEntry in savedEntries) {
+                XCTAssertTrue([frs next], @"Row missing");
+                XCTAssertEqualObjects([frs stringForColumn:kLastNameCol], savedEntry[kLastName], "Wrong name");
+                XCTAssertEqualObjects([frs stringForColumn:kAddressStreetCol], savedEntry[kAddress][kStreet], "Wrong street");
+            }
+            XCTAssertFalse([frs next], @"Only two rows should have been returned");
+            [frs close];
+        }];
+    }
+}
+
+/**
+ * Test composite (covering and partial) index registration, and that it survives alterSoup
+ */
+- (void) testAlterSoupWithCompositeIndex
+{
+    NSString* localField = @"__local__";
+    NSString* where = [NSString stringWithFormat:@"{%@:%@} = '1'", kTestSoupName, localField];
+    SFSoupCompositeIndex* compositeIndex = [[SFSoupCompositeIndex alloc] initWithPaths:@[kLastName] includedPaths:@[localField] whereClause:where];
+    SFSoupSpec* soupSpec = [SFSoupSpec newSoupSpec:kTestSoupName withFeatures:nil withCompositeIndexes:@[compositeIndex]];
+    NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}, @{@"path": localField, @"type": @"string"}]];
+    NSError* error = nil;
+    XCTAssertTrue([self.store registerSoupWithSpec:soupSpec withIndexSpecs:indexSpecs error:&error], @"Register soup failed: %@", error);
+    XCTAssertEqualObjects([self.store attributesForSoup:kTestSoupName].compositeIndexes, @[compositeIndex], @"Composite index should have been persisted");
+    XCTAssertEqualObjects([self.store attributesForSoup:kTestSoupName].features, @[], @"Composite indexes are not features");
+    NSArray* savedEntries = [self.store upsertEntries:@[@{kLastName:@"Doe", localField: @YES},
+                                                        @{kLastName:@"Jackson", localField: @NO},
+                                                        @{kLastName:@"Adams", localField: @YES}]
+                                               toSoup:kTestSoupName];
+
+    NSString* dirtySmartSql = [NSString stringWithFormat:@"SELECT {%@:%@} FROM {%@} WHERE %@ ORDER BY {%@:%@} ASC", kTestSoupName, kLastName, kTestSoupName, where, kTestSoupName, kLastName];
+    NSArray* indexSpecsNew = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kAddressCity, @"type": @"string"}, @{@"path": localField, @"type": @"string"}, @{@"path": kLastName, @"type": @"string"}]];
+    for (NSArray* specs in @[ indexSpecs, indexSpecsNew ]) {
+        if (specs == indexSpecsNew) {
+            XCTAssertTrue([self.store alterSoup:kTestSoupName withIndexSpecs:indexSpecsNew reIndexData:YES], @"Alter soup failed");
+            XCTAssertEqualObjects([self.store attributesForSoup:kTestSoupName].compositeIndexes, @[compositeIndex], @"Composite index should have survived alter soup");
+        }
+        [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+            NSString* createSql = [db stringForQuery:@"SELECT sql FROM sqlite_master WHERE name = 'TABLE_1_c0_idx'"];
+            XCTAssertTrue([createSql hasSuffix:@"= '1'"], @"Partial index expected: %@", createSql);
+            XCTAssertEqual(1, [db intForQuery:@"SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' AND name GLOB 'TABLE_1_c[0-9]*_idx'"], @"Only one composite index expected");
+        }];
+        self.store.captureExplainQueryPlan = YES;
+        NSArray* results = [self.store queryWithQuerySpec:[SFQuerySpec newSmartQuerySpec:dirtySmartSql withPageSize:10] pageIndex:0 error:nil];
+        self.store.captureExplainQueryPlan = NO;
+        XCTAssertEqualObjects(results, (@[@[savedEntries[2][kLastName]], @[savedEntries[0][kLastName]]]), @"Wrong results");
+        NSString* detail = ((NSArray*)self.store.lastExplainQueryPlan[EXPLAIN_ROWS])[0][@"detail"];
+        XCTAssertTrue([detail containsString:@"COVERING INDEX TABLE_1_c0_idx"], @"Wrong explain plan: %@", detail);
+    }
+
+    // Composite index paths must be indexed
+    SFSoupSpec* badSoupSpec = [SFSoupSpec newSoupSpec:@"otherSoup" withFeatures:nil withCompositeIndexes:@[@{kSoupCompositeIndexPaths: @[kCity]}]];
+    XCTAssertFalse([self.store registerSoupWithSpec:badSoupSpec withIndexSpecs:indexSpecs error:nil], @"Register soup should have failed");
+    XCTAssertFalse([self.store soupExists:@"otherSoup"], @"Soup should not exist");
+
+    // Alter soup dropping an indexed path used by the composite index (kept soup spec or new one) should fail before starting
+    NSArray* indexSpecsWithoutLocal = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}]];
+    XCTAssertFalse([self.store alterSoup:kTestSoupName withIndexSpecs:indexSpecsWithoutLocal reIndexData:YES], @"Alter soup should have failed");
+    XCTAssertFalse([self.store alterSoup:kTestSoupName withSoupSpec:soupSpec withIndexSpecs:indexSpecsWithoutLocal reIndexData:YES], @"Alter soup should have failed");
+    // Same with a partial index whose where clause references a path that is not indexed
+    NSString* unindexedWhere = [NSString stringWithFormat:@"{%@:%@} = 'London'", kTestSoupName, kAddressCity];
+    SFSoupCompositeIndex* partialIndex = [[SFSoupCompositeIndex alloc] initWithPaths:@[kLastName] includedPaths:nil whereClause:unindexedWhere];
+    SFSoupSpec* partialSoupSpec = [SFSoupSpec newSoupSpec:kTestSoupName withFeatures:nil withCompositeIndexes:@[partialIndex]];
+    XCTAssertFalse([self.store alterSoup:kTestSoupName withSoupSpec:partialSoupSpec withIndexSpecs:indexSpecs reIndexData:YES], @"Alter soup should have failed");
+    XCTAssertTrue([[self.store getLongOperations] count] == 0, @"There should be no long operations left");
+    XCTAssertEqualObjects([[self.store indicesForSoup:kTestSoupName] valueForKey:@"path"], [indexSpecsNew valueForKey:@"path"], @"Soup should be unchanged");
+    XCTAssertEqual([[self.store queryWithQuerySpec:[SFQuerySpec newSmartQuerySpec:dirtySmartSql withPageSize:10] pageIndex:0 error:nil] count], 2, @"Soup should still be queryable");
+}
+
 /**
  * Test for alterSoup with column type change from string to integer
  */
@@ -331,6 +456,146 @@
     [self tryAlterSoupInterruptResume:SFAlterSoupStepDropOldTable];
 }
 
+/**
+ * Test alter soup copying rows in several batches, and recording step timings
+ */
+- (void) testAlterSoupCopyInBatchesWithStepTimings
+{
+    NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}, @{@"path": kAddressCity, @"type": @"string"}]];
+    [self.store registerSoup:kTestSoupName withIndexSpecs:indexSpecs error:nil];
+    NSArray* savedEntries = [self.store upsertEntries:@[@{kLastName:@"Doe", kAddress: @{kCity: @"San Francisco", kStreet: @"1 market"}},
+                                                        @{kLastName:@"Jackson", kAddress: @{kCity: @"Los Angeles", kStreet: @"100 mission"}},
+                                                        @{kLastName:@"Watson", kAddress: @{kCity: @"London", kStreet: @"50 market"}}]
+                                               toSoup:kTestSoupName];
+
+    NSArray* indexSpecsNew = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}, @{@"path": kAddressStreet, @"type": @"string"}]];
+    SFAlterSoupLongOperation* operation = [[SFAlterSoupLongOperation alloc] initWithStore:self.store soupName:kTestSoupName newIndexSpecs:indexSpecsNew reIndexData:YES];
+    operation.batchSize = 2;
+    [operation runToStep:SFAlterSoupStepCopyTable];
+
+    // Timings of completed steps should be in the details
+    NSArray* operations = [self.store getLongOperations];
+    XCTAssertTrue([operations count] == 1, @"Wrong number of long operations found");
+    NSArray* expectedSteps = @[@"renameOldSoupTable", @"dropOldIndexes", @"registerSoupUsingTableName", @"copyTable"];
+    XCTAssertEqualObjects([NSSet setWithArray:[((SFAlterSoupLongOperation*)operations[0]).stepTimings allKeys]], [NSSet setWithArray:expectedSteps], @"Wrong step timings");
+    // Batch size should be in the details too
+    XCTAssertEqual(((SFAlterSoupLongOperation*)operations[0]).batchSize, 2, @"Batch size should be kept when resuming");
+
+    [operation run];
+    XCTAssertTrue([[self.store getLongOperations] count] == 0, @"There should be no long operations left");
+    expectedSteps = [expectedSteps arrayByAddingObjectsFromArray:@[@"reIndexSoup", @"dropOldTable", @"cleanup"]];
+    XCTAssertEqualObjects([NSSet setWithArray:[operation.stepTimings allKeys]], [NSSet setWithArray:expectedSteps], @"Wrong step timings");
+
+    // All rows should have been copied and re-indexed
+    [self checkStreets:savedEntries reIndexedCount:3];
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        FMResultSet* frs = [self.store queryTable:kTestSoupTableName forColumns:nil orderBy:@"id ASC" limit:nil whereClause:nil whereArgs:nil withDb:db];
+        for (NSDictionary* savedEntry in savedEntries) {
+            [frs next];
+            XCTAssertEqualObjects([frs stringForColumn:kLastNameCol], savedEntry[kLastName], "Wrong name");
+        }
+        [frs close];
+    }];
+}
+
+/**
+ * Test alter soup with entries upserted before and in between copy batches
+ */
+- (void) testAlterSoupUpsertBetweenCopyBatches
+{
+    NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"full_text"}, @{@"path": kAddressCity, @"type": @"string"}]];
+    [self.store registerSoup:kTestSoupName withIndexSpecs:indexSpecs error:nil];
+    NSArray* savedEntries = [self.store upsertEntries:@[@{kLastName:@"Doe", kAddress: @{kCity: @"San Francisco", kStreet: @"1 market"}},
+                                                        @{kLastName:@"Jackson", kAddress: @{kCity: @"Los Angeles", kStreet: @"100 mission"}},
+                                                        @{kLastName:@"Watson", kAddress: @{kCity: @"London", kStreet: @"50 market"}}]
+                                               toSoup:kTestSoupName];
+
+    NSArray* indexSpecsNew = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"full_text"}, @{@"path": kAddressStreet, @"type": @"string"}]];
+    SFAlterSoupLongOperation* operation = [[SFAlterSoupLongOperation alloc] initWithStore:self.store soupName:kTestSoupName newIndexSpecs:indexSpecsNew reIndexData:YES];
+    operation.batchSize = 2;
+    [operation runToStep:SFAlterSoupStepRegisterSoupUsingTableName];
+
+    // Upsert before the first batch: should not take the id of an entry not copied yet
+    NSDictionary* entryBeforeCopy = [self.store upsertEntries:@[@{kLastName:@"Holmes", kAddress: @{kCity: @"London", kStreet: @"221b baker"}}] toSoup:kTestSoupName][0];
+    XCTAssertGreaterThan([entryBeforeCopy[SOUP_ENTRY_ID] longLongValue], [savedEntries[2][SOUP_ENTRY_ID] longLongValue], @"Id of an old entry was reused");
+
+    // Copy first batch
+    XCTAssertTrue([operation copyNextBatch], @"First batch should have been copied");
+    XCTAssertEqual(operation.lastCopiedId, [savedEntries[1][SOUP_ENTRY_ID] longLongValue], @"Wrong last copied id");
+    SFAlterSoupLongOperation* savedOperation = [self.store getLongOperations][0];
+    XCTAssertEqual(savedOperation.lastCopiedId, operation.lastCopiedId, @"Last copied id should be in the details");
+
+    // Upsert between batches
+    NSDictionary* entryDuringCopy = [self.store upsertEntries:@[@{kLastName:@"Moriarty", kAddress: @{kCity: @"London", kStreet: @"1 reichenbach"}}] toSoup:kTestSoupName][0];
+
+    // Resume from the saved operation
+    [savedOperation run];
+    XCTAssertTrue([[self.store getLongOperations] count] == 0, @"There should be no long operations left");
+
+    // Every entry should have survived
+    NSArray* allEntries = [savedEntries arrayByAddingObjectsFromArray:@[entryBeforeCopy, entryDuringCopy]];
+    NSArray* allIds = [allEntries valueForKey:SOUP_ENTRY_ID];
+    NSArray* retrievedEntries = [self.store retrieveEntries:allIds fromSoup:kTestSoupName];
+    XCTAssertEqual([retrievedEntries count], [allEntries count], @"Entries were lost during alter");
+    for (NSDictionary* entry in allEntries) {
+        NSUInteger index = [[retrievedEntries valueForKey:SOUP_ENTRY_ID] indexOfObject:entry[SOUP_ENTRY_ID]];
+        XCTAssertNotEqual(index, NSNotFound, @"Entry %@ was lost during alter", entry[SOUP_ENTRY_ID]);
+        if (index != NSNotFound) {
+            XCTAssertEqualObjects(retrievedEntries[index][kLastName], entry[kLastName], @"Wrong name");
+        }
+    }
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual((int)[allEntries count], [db intForQuery:@"SELECT COUNT(*) FROM " kTestSoupTableName], @"Wrong number of rows");
+        XCTAssertEqual((int)[allEntries count], [db intForQuery:@"SELECT COUNT(*) FROM " kTestSoupFtsTableName], @"Wrong number of fts rows");
+    }];
+}
+
+/**
+ * Test reIndexSoup in chunks with progress reporting
+ */
+- (void) testReIndexSoupInChunksWithProgress
+{
+    NSArray* savedEntries = [self setupSoupWithUnindexedStreets];
+
+    NSMutableArray* progressReports = [NSMutableArray new];
+    BOOL success = [self.store reIndexSoup:kTestSoupName withIndexPaths:@[kAddressStreet] chunkSize:2 progress:^(NSUInteger reIndexedCount, NSUInteger totalCount) {
+        [progressReports addObject:@[@(reIndexedCount), @(totalCount)]];
+    }];
+    XCTAssertTrue(success, @"Re-index failed");
+    XCTAssertEqualObjects(progressReports, (@[@[@2, @3], @[@3, @3]]), @"Wrong progress reports");
+    XCTAssertTrue([[self.store getLongOperations] count] == 0, @"There should be no long operations left");
+    [self checkStreets:savedEntries reIndexedCount:3];
+}
+
+/**
+ * Test reIndexSoup interrupted after one chunk then resumed
+ */
+- (void) testReIndexSoupInterruptResume
+{
+    NSArray* savedEntries = [self setupSoupWithUnindexedStreets];
+
+    // Only doing the first chunk
+    SFReIndexSoupLongOperation* operation = [[SFReIndexSoupLongOperation alloc] initWithStore:self.store soupName:kTestSoupName indexPaths:@[kAddressStreet] chunkSize:2];
+    XCTAssertEqual([operation runNextChunk], 2, @"Wrong number of entries re-indexed");
+    [self checkStreets:savedEntries reIndexedCount:2];
+
+    // Validate long_operations_status table
+    NSArray* operations = [self.store getLongOperations];
+    XCTAssertTrue([operations count] == 1, @"Wrong number of long operations found");
+    SFReIndexSoupLongOperation* actualOperation = (SFReIndexSoupLongOperation*)operations[0];
+    XCTAssertTrue([actualOperation isKindOfClass:[SFReIndexSoupLongOperation class]], @"Wrong type of long operation");
+    XCTAssertEqualObjects(actualOperation.soupName, kTestSoupName, @"Wrong soup name");
+    XCTAssertEqualObjects(actualOperation.indexPaths, @[kAddressStreet], @"Wrong index paths");
+    XCTAssertEqual(actualOperation.chunkSize, 2, @"Wrong chunk size");
+    XCTAssertEqual(actualOperation.reIndexedCount, 2, @"Wrong re-indexed count");
+    XCTAssertEqual(actualOperation.lastEntryId, [savedEntries[1][SOUP_ENTRY_ID] longLongValue], @"Wrong last entry id");
+
+    // Simulate restart
+    [self.store resumeLongOperations];
+    XCTAssertTrue([[self.store getLongOperations] count] == 0, @"There should be no long operations left");
+    [self checkStreets:savedEntries reIndexedCount:3];
+}
+
 #pragma mark - helper methods
 
 /**
@@ -626,6 +891,46 @@
     }];
 }
 
+/**
+ * Register soup indexing lastName and address.city, populate it,
+ * then alter it to index address.street without re-indexing
+ */
+- (NSArray*) setupSoupWithUnindexedStreets
+{
+    NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}, @{@"path": kAddressCity, @"type": @"string"}]];
+    [self.store registerSoup:kTestSoupName withIndexSpecs:indexSpecs error:nil];
+    NSArray* savedEntries = [self.store upsertEntries:@[@{kLastName:@"Doe", kAddress: @{kCity: @"San Francisco", kStreet: @"1 market"}},
+                                                        @{kLastName:@"Jackson", kAddress: @{kCity: @"Los Angeles", kStreet: @"100 mission"}},
+                                                        @{kLastName:@"Watson", kAddress: @{kCity: @"London", kStreet: @"50 market"}}]
+                                               toSoup:kTestSoupName];
+    NSArray* indexSpecsNew = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kLastName, @"type": @"string"}, @{@"path": kAddressStreet, @"type": @"string"}]];
+    [self.store alterSoup:kTestSoupName withIndexSpecs:indexSpecsNew reIndexData:NO];
+    [self checkStreets:savedEntries reIndexedCount:0];
+    return savedEntries;
+}
+
+/**
+ * Check that the first reIndexedCount rows have their street column populated and the others do not
+ */
+- (void) checkStreets:(NSArray*)savedEntries reIndexedCount:(NSUInteger)reIndexedCount
+{
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        FMResultSet* frs = [self.store queryTable:kTestSoupTableName forColumns:nil orderBy:@"id ASC" limit:nil whereClause:nil whereArgs:nil withDb:db];
+        for (NSUInteger i=0; i<[savedEntries count]; i++) {
+            [frs next];
+            XCTAssertEqualObjects(@([frs longForColumn:ID_COL]), savedEntries[i][SOUP_ENTRY_ID], "Wrong id");
+            if (i < reIndexedCount) {
+                XCTAssertEqualObjects([frs stringForColumn:kAddressStreetCol], savedEntries[i][kAddress][kStreet], "Wrong street");
+            }
+            else {
+                XCTAssertNil([frs stringForColumn:kAddressStreetCol], "Wrong street - nil expected");
+            }
+        }
+        XCTAssertFalse([frs next], @"Only %lu rows should have been returned", (unsigned long)[savedEntries count]);
+        [frs close];
+    }];
+}
+
 - (void) tryAlterSoupInterruptResume:(SFAlterSoupStep)toStep
 {
     for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
@@ -29,6 +29,8 @@
 #import <SalesforceSDKCommon/SFJsonUtils.h>
 #import "FMDatabaseQueue.h"
 #import "FMDatabase.h"
+#import "FMDatabaseAdditions.h"
+#import "sqlite3.h"
 
 @interface SFSmartStoreFullTextSearchTests ()
 
@@ -562,9 +564,276 @@
     [self trySearch:@[self.eileenEvaId, self.christineHaasId] path:nil matchKey:@"{employees:lastName}:Eva OR Haas NOT Ali" orderPath:kLastName];
 }
 
+/**
+ * Test ranked search (bm25 ordering, snippet, bound match key) with fts5
+ */
+- (void) testRankedSearchWithFts5
+{
+    [self loadData:SFSmartStoreFTS5];
+    NSNumber* haasHaasId = [self createEmployeeWithFirstName:@"Haas" lastName:@"Haas" employeeId:@"00080"][SOUP_ENTRY_ID];
+
+    // Best match first, ties ordered by id
+    [self tryRankedSearch:@[haasHaasId, self.christineHaasId, self.aliHaasId] path:nil matchKey:@"Haas"];
+    // Only the last name counts
+    [self tryRankedSearch:@[self.christineHaasId, self.aliHaasId, haasHaasId] path:kLastName matchKey:@"Haas"];
+    [self tryRankedSearch:@[self.evaPulaskiId] path:kFirstName matchKey:@"Eva"];
+    [self tryRankedSearch:@[self.michaelThompsonId, self.aliHaasId] path:nil matchKey:@"Thompson OR Ali"];
+    // Match key is bound: quotes need no escaping
+    [self tryRankedSearch:@[] path:nil matchKey:@"\"O'Brien\""];
+
+    // Snippet
+    SFQuerySpec* querySpec = [SFQuerySpec newRankedMatchQuerySpec:kEmployeesSoup withSelectPaths:@[SOUP_ENTRY_ID] withPath:nil withMatchKey:@"Thompson" includesSnippet:YES withPageSize:25];
+    NSArray* results = [self.store queryWithQuerySpec:querySpec pageIndex:0 error:nil];
+    XCTAssertEqual(1, results.count, @"Wrong number of results");
+    XCTAssertEqualObjects(self.michaelThompsonId, results[0][0], @"Wrong id");
+    XCTAssertEqualObjects(@"<b>Thompson</b>", results[0][1], @"Wrong snippet");
+
+    // Count
+    querySpec = [SFQuerySpec newRankedMatchQuerySpec:kEmployeesSoup withSelectPaths:nil withPath:nil withMatchKey:@"Haas" includesSnippet:NO withPageSize:25];
+    XCTAssertEqual(3, [[self.store countWithQuerySpec:querySpec error:nil] unsignedIntegerValue], @"Wrong count");
+}
+
+/**
+ * Test upserting several rows at once (fts rows are buffered) with fts4
+ */
+- (void) testBulkUpsertWithFts4
+{
+    [self tryBulkUpsert:SFSmartStoreFTS4];
+}
+
+/**
+ * Test upserting several rows at once (fts rows are buffered) with fts5
+ */
+- (void) testBulkUpsertWithFts5
+{
+    [self tryBulkUpsert:SFSmartStoreFTS5];
+}
+
+- (void) tryBulkUpsert:(SFSmartStoreFtsExtension)ftsExtension
+{
+    [self setupSoup:ftsExtension];
+    NSDictionary* firstEmployee = [self createEmployeeWithFirstName:@"Christine" lastName:@"Haas" employeeId:@"00010"];
+    NSDictionary* secondEmployee = [self createEmployeeWithFirstName:@"Michael" lastName:@"Thompson" employeeId:@"00020"];
+    NSArray* actualIndexSpecs = [self.store indicesForSoup:kEmployeesSoup];
+
+    // Update second employee twice, insert a third one and update it in the same batch
+    NSArray* upserted = [self.store upsertEntries:@[@{SOUP_ENTRY_ID: secondEmployee[SOUP_ENTRY_ID], kFirstName: @"Michael-updated", kLastName: @"Thompson", kEmployeeId: @"00020"},
+                                                    @{kFirstName: @"Ali", kLastName: @"Haas", kEmployeeId: @"00030"},
+                                                    @{SOUP_ENTRY_ID: secondEmployee[SOUP_ENTRY_ID], kFirstName: @"Michael-updated-again", kLastName: @"Thompson", kEmployeeId: @"00020"}]
+                                           toSoup:kEmployeesSoup];
+    XCTAssertEqual(3, upserted.count, @"Wrong number of upserted entries");
+    NSDictionary* thirdEmployee = upserted[1];
+    NSDictionary* thirdEmployeeUpdated = [self.store upsertEntries:@[@{SOUP_ENTRY_ID: thirdEmployee[SOUP_ENTRY_ID], kFirstName: @"Ali-updated", kLastName: @"Haas", kEmployeeId: @"00030"},
+                                                                     @{kFirstName: @"John", kLastName: @"Geyer", kEmployeeId: @"00040"}]
+                                                            toSoup:kEmployeesSoup][0];
+
+    // Check fts table
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        FMResultSet* frs = [self.store queryTable:@"TABLE_1_fts" forColumns:@[ROWID_COL, @"TABLE_1_0", @"TABLE_1_1"] orderBy:@"rowid ASC" limit:@"3" whereClause:nil whereArgs:nil withDb:db];
+        [self checkFtsRow:frs withExpectedEntry:firstEmployee withSoupIndexes:actualIndexSpecs];
+        [self checkFtsRow:frs withExpectedEntry:upserted[2] withSoupIndexes:actualIndexSpecs];
+        [self checkFtsRow:frs withExpectedEntry:thirdEmployeeUpdated withSoupIndexes:actualIndexSpecs];
+        [frs close];
+        XCTAssertEqual(4, [db intForQuery:@"SELECT COUNT(*) FROM TABLE_1_fts"], @"Wrong number of fts rows");
+    }];
+    [self trySearch:@[secondEmployee[SOUP_ENTRY_ID]] path:kFirstName matchKey:@"again" orderPath:kEmployeeId];
+    [self trySearch:@[firstEmployee[SOUP_ENTRY_ID], thirdEmployee[SOUP_ENTRY_ID]] path:kLastName matchKey:@"Haas" orderPath:kEmployeeId];
+}
+
+/**
+ * Test re-indexing one full_text path with fts4: the other full_text column should be kept
+ */
+- (void) testReIndexOneFtsPathWithFts4
+{
+    [self tryReIndexOneFtsPath:SFSmartStoreFTS4];
+}
+
+/**
+ * Test re-indexing one full_text path with fts5: the other full_text column should be kept
+ */
+- (void) testReIndexOneFtsPathWithFts5
+{
+    [self tryReIndexOneFtsPath:SFSmartStoreFTS5];
+}
+
+- (void) tryReIndexOneFtsPath:(SFSmartStoreFtsExtension)ftsExtension
+{
+    [self loadData:ftsExtension];
+    XCTAssertTrue([self.store reIndexSoup:kEmployeesSoup withIndexPaths:@[kFirstName]], @"Re-index soup failed");
+
+    // Both full_text columns should still match
+    [self trySearch:@[self.christineHaasId, self.aliHaasId] path:kLastName matchKey:@"Haas" orderPath:kEmployeeId];
+    [self trySearch:@[self.michaelThompsonId] path:kFirstName matchKey:@"Michael" orderPath:kEmployeeId];
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual(7, [db intForQuery:@"SELECT COUNT(*) FROM TABLE_1_fts"], @"Wrong number of fts rows");
+    }];
+}
+
+/**
+ * Test large upsert (merges deferred) followed by optimizeFts with fts5
+ */
+- (void) testBulkLoadAndOptimizeWithFts5
+{
+    [self setupSoup:SFSmartStoreFTS5];
+    NSMutableArray* employees = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [employees addObject:@{kFirstName: [NSString stringWithFormat:@"First%lu", (unsigned long)i], kLastName: (i % 2 == 0 ? @"Even" : @"Odd"), kEmployeeId: [NSString stringWithFormat:@"%05lu", (unsigned long)i]}];
+    }
+    NSArray* upserted = [self.store upsertEntries:employees toSoup:kEmployeesSoup];
+    XCTAssertEqual(2000, upserted.count, @"Wrong number of upserted entries");
+
+    // Merge settings should have been restored
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual(2000, [db intForQuery:@"SELECT COUNT(*) FROM TABLE_1_fts"], @"Wrong number of fts rows");
+        FMResultSet* frs = [db executeQuery:@"SELECT k, v FROM TABLE_1_fts_config WHERE k IN ('automerge', 'crisismerge')"];
+        while ([frs next]) {
+            NSString* key = [frs stringForColumnIndex:0];
+            XCTAssertEqual([key isEqualToString:@"automerge"] ? 4 : 16, [frs intForColumnIndex:1], @"Wrong value for %@", key);
+        }
+        [frs close];
+    }];
+
+    NSError* error = nil;
+    XCTAssertTrue([self.store optimizeFts:kEmployeesSoup error:&error], @"optimizeFts should have succeeded");
+    XCTAssertNil(error, @"Unexpected error %@", error);
+    [self trySearch:@[upserted[1234][SOUP_ENTRY_ID]] path:kFirstName matchKey:@"First1234" orderPath:kEmployeeId];
+    SFQuerySpec* querySpec = [SFQuerySpec newMatchQuerySpec:kEmployeesSoup withSelectPaths:@[SOUP_ENTRY_ID] withPath:kLastName withMatchKey:@"Odd" withOrderPath:kEmployeeId withOrder:kSFSoupQuerySortOrderAscending withPageSize:25];
+    XCTAssertEqual(1000, [[self.store countWithQuerySpec:querySpec error:nil] unsignedIntegerValue], @"Wrong count");
+}
+
+/**
+ * Test deleting rows by query with fts4
+ */
+- (void) testDeleteByQueryWithFts4
+{
+    [self tryDeleteByQuery:SFSmartStoreFTS4];
+}
+
+/**
+ * Test deleting rows by query with fts5
+ */
+- (void) testDeleteByQueryWithFts5
+{
+    [self tryDeleteByQuery:SFSmartStoreFTS5];
+}
+
+- (void) tryDeleteByQuery:(SFSmartStoreFtsExtension)ftsExtension
+{
+    [self loadData:ftsExtension];
+    NSArray* actualIndexSpecs = [self.store indicesForSoup:kEmployeesSoup];
+
+    // Delete the first of the two Haas (the page size limits the deletion to one entry)
+    SFQuerySpec* querySpec = [SFQuerySpec newMatchQuerySpec:kEmployeesSoup withPath:kLastName withMatchKey:@"Haas" withOrderPath:kEmployeeId withOrder:kSFSoupQuerySortOrderAscending withPageSize:1];
+    XCTAssertTrue([self.store removeEntriesByQuery:querySpec fromSoup:kEmployeesSoup error:nil], @"removeEntriesByQuery should have succeeded");
+
+    // The fts row of the other one should still be there
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        XCTAssertEqual(6, [db intForQuery:@"SELECT COUNT(*) FROM TABLE_1"], @"Wrong number of rows");
+        XCTAssertEqual(6, [db intForQuery:@"SELECT COUNT(*) FROM TABLE_1_fts"], @"Wrong number of fts rows");
+        FMResultSet* frs = [self.store queryTable:@"TABLE_1_fts" forColumns:@[ROWID_COL, @"TABLE_1_0", @"TABLE_1_1"] orderBy:@"rowid ASC" limit:nil whereClause:@"rowid = ?" whereArgs:@[self.aliHaasId] withDb:db];
+        [self checkFtsRow:frs withExpectedEntry:@{SOUP_ENTRY_ID: self.aliHaasId, kFirstName: @"Ali", kLastName: @"Haas"} withSoupIndexes:actualIndexSpecs];
+        [frs close];
+    }];
+    [self trySearch:@[self.aliHaasId] path:kLastName matchKey:@"Haas" orderPath:kEmployeeId];
+}
+
+/**
+ * Test register soup with prefix and detail fts options, they should survive an alter soup
+ */
+- (void) testRegisterSoupWithFtsOptions
+{
+    self.store.ftsExtension = SFSmartStoreFTS5;
+    NSDictionary* ftsOptions = @{kSoupIndexFtsPrefix: @[@2, @3], kSoupIndexFtsDetail: kSoupIndexFtsDetailColumn};
+    NSArray* soupIndices = [SFSoupIndex asArraySoupIndexes:
+                            @[@{@"path": kFirstName, @"type": kSoupIndexTypeFullText, kSoupIndexFtsOptions: ftsOptions},
+                              @{@"path": kLastName, @"type": kSoupIndexTypeFullText, kSoupIndexFtsOptions: ftsOptions},
+                              [self createStringIndexSpec:kEmployeeId]]];
+    NSError* error = nil;
+    XCTAssertTrue([self.store registerSoup:kEmployeesSoup withIndexSpecs:soupIndices error:&error], @"Register soup failed: %@", error);
+    [self checkFtsCreateSql:@[@"prefix='2 3'", @"detail=column"]];
+    XCTAssertEqualObjects(ftsOptions, ((SFSoupIndex*)[self.store indicesForSoup:kEmployeesSoup][0]).ftsOptions, @"Fts options should have been persisted");
+
+    // Prefix queries
+    self.christineHaasId = [self createEmployeeWithFirstName:@"Christine" lastName:@"Haas" employeeId:@"00010"][SOUP_ENTRY_ID];
+    self.michaelThompsonId = [self createEmployeeWithFirstName:@"Michael" lastName:@"Thompson" employeeId:@"00020"][SOUP_ENTRY_ID];
+    [self trySearch:@[self.christineHaasId] path:kFirstName matchKey:@"Ch*" orderPath:kEmployeeId];
+    [self trySearch:@[self.michaelThompsonId] path:nil matchKey:@"Tho*" orderPath:kEmployeeId];
+
+    // Alter soup
+    NSArray* alteredIndices = [[self.store indicesForSoup:kEmployeesSoup] arrayByAddingObject:[[SFSoupIndex alloc] initWithDictionary:@{@"path": @"salary", @"type": kSoupIndexTypeInteger}]];
+    XCTAssertTrue([self.store alterSoup:kEmployeesSoup withIndexSpecs:alteredIndices reIndexData:YES], @"Alter soup failed");
+    [self checkFtsCreateSql:@[@"prefix='2 3'", @"detail=column"]];
+    XCTAssertEqualObjects(ftsOptions, ((SFSoupIndex*)[self.store indicesForSoup:kEmployeesSoup][1]).ftsOptions, @"Fts options should have survived alter soup");
+    [self trySearch:@[self.christineHaasId] path:kFirstName matchKey:@"Ch*" orderPath:kEmployeeId];
+}
+
+/**
+ * Test register soup with invalid fts options
+ */
+- (void) testRegisterSoupWithInvalidFtsOptions
+{
+    NSArray* invalidOptions = @[
+        // conflicting options
+        @[@{kSoupIndexFtsPrefix: @[@2]}, @{kSoupIndexFtsPrefix: @[@3]}],
+        // bad values
+        @[@{kSoupIndexFtsPrefix: @[@0]}, @{}],
+        @[@{kSoupIndexFtsDetail: @"partial"}, @{}],
+        @[@{@"columnsize": @0}, @{}],
+    ];
+    for (NSArray* options in invalidOptions) {
+        self.store.ftsExtension = SFSmartStoreFTS5;
+        NSArray* soupIndices = [SFSoupIndex asArraySoupIndexes:
+                                @[@{@"path": kFirstName, @"type": kSoupIndexTypeFullText, kSoupIndexFtsOptions: options[0]},
+                                  @{@"path": kLastName, @"type": kSoupIndexTypeFullText, kSoupIndexFtsOptions: options[1]}]];
+        NSError* error = nil;
+        XCTAssertFalse([self.store registerSoup:kEmployeesSoup withIndexSpecs:soupIndices error:&error], @"Register soup should have failed for %@", options);
+        XCTAssertNotNil(error, @"Expected error for %@", options);
+        XCTAssertFalse([self.store soupExists:kEmployeesSoup], @"Soup should not exist");
+    }
+
+    // Options require fts5
+    self.store.ftsExtension = SFSmartStoreFTS4;
+    NSArray* soupIndices = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kFirstName, @"type": kSoupIndexTypeFullText, kSoupIndexFtsOptions: @{kSoupIndexFtsPrefix: @[@2]}}]];
+    XCTAssertFalse([self.store registerSoup:kEmployeesSoup withIndexSpecs:soupIndices error:nil], @"Register soup should have failed with fts4");
+
+    // Options only apply to full_text indexes
+    self.store.ftsExtension = SFSmartStoreFTS5;
+    soupIndices = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kFirstName, @"type": kSoupIndexTypeString, kSoupIndexFtsOptions: @{kSoupIndexFtsPrefix: @[@2]}}]];
+    XCTAssertFalse([self.store registerSoup:kEmployeesSoup withIndexSpecs:soupIndices error:nil], @"Register soup should have failed with string index");
+}
+
+/**
+ * Test register soup with trigram tokenizer - only available with sqlite 3.34 and above
+ */
+- (void) testRegisterSoupWithTrigramTokenizer
+{
+    self.store.ftsExtension = SFSmartStoreFTS5;
+    NSArray* soupIndices = [SFSoupIndex asArraySoupIndexes:@[@{@"path": kFirstName, @"type": kSoupIndexTypeFullText, kSoupIndexFtsOptions: @{kSoupIndexFtsTokenize: kSoupIndexFtsTokenizerTrigram}}]];
+    NSError* error = nil;
+    BOOL registered = [self.store registerSoup:kEmployeesSoup withIndexSpecs:soupIndices error:&error];
+    if (sqlite3_libversion_number() < 3034000) {
+        XCTAssertFalse(registered, @"Register soup should have failed");
+        XCTAssertNotNil(error, @"Expected error");
+    } else {
+        XCTAssertTrue(registered, @"Register soup failed: %@", error);
+        [self checkFtsCreateSql:@[@"tokenize='trigram'"]];
+        self.christineHaasId = [self createEmployeeWithFirstName:@"Christine" lastName:@"Haas" employeeId:@"00010"][SOUP_ENTRY_ID];
+        [self trySearch:@[self.christineHaasId] path:kFirstName matchKey:@"stin" orderPath:kFirstName];
+    }
+}
 
 #pragma mark - helper methods
 
+- (void) checkFtsCreateSql:(NSArray*)expectedFragments
+{
+    [self.store.storeQueue inDatabase:^(FMDatabase *db) {
+        NSString* createSql = [db stringForQuery:@"SELECT sql FROM sqlite_master WHERE name = 'TABLE_1_fts'"];
+        for (NSString* fragment in expectedFragments) {
+            XCTAssertTrue([createSql containsString:fragment], @"%@ should contain %@", createSql, fragment);
+        }
+    }];
+}
+
 - (void) trySearch:(NSArray*)expectedIds path:(NSString*)path matchKey:(NSString*)matchKey orderPath:(NSString*)orderPath
 {
     // Returning soup elements
@@ -585,6 +854,18 @@
     
 }
 
+- (void) tryRankedSearch:(NSArray*)expectedIds path:(NSString*)path matchKey:(NSString*)matchKey
+{
+    SFQuerySpec* querySpec = [SFQuerySpec newRankedMatchQuerySpec:kEmployeesSoup withSelectPaths:nil withPath:path withMatchKey:matchKey includesSnippet:NO withPageSize:25];
+    NSError* error = nil;
+    NSArray* results = [self.store queryWithQuerySpec:querySpec pageIndex:0 error:&error];
+    XCTAssertNil(error, @"Unexpected error %@", error);
+    XCTAssertEqual(expectedIds.count, results.count, @"Wrong number of results");
+    for (int i=0; i<results.count; i++) {
+        XCTAssertEqual(((NSNumber*)expectedIds[i]).longValue, ((NSNumber*)results[i][SOUP_ENTRY_ID]).longValue, @"Wrong results for ranked match query");
+    }
+}
+
 
 - (void) loadData:(SFSmartStoreFtsExtension) ftsExtension
 {
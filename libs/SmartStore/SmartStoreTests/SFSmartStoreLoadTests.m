@@ -24,7 +24,9 @@
 
 #import "SFSmartStore+Internal.h"
 #import "SFSoupIndex.h"
+#import "SFSoupSpec.h"
 #import "SFQuerySpec.h"
+#import "SFSmartStoreQueryProfiler.h"
 #import <SalesforceSDKCommon/SFJsonUtils.h>
 #import "FMDatabaseQueue.h"
 #import "FMDatabase.h"
@@ -42,6 +44,7 @@
 #define NUMBER_ENTRIES           1000//0
 #define NUMBER_ENTRIES_PER_BATCH 100
 #define MS_IN_S                  1000
+#define KEYSET_MAX_VM_STEPS_RATIO 3
 #define TEST_SMARTSTORE          @"testSmartStore"
 #define TEST_SOUP                @"testSoup"
 
@@ -87,6 +90,14 @@
     [self tryUpsertQuery:kSoupIndexTypeString numberEntries:NUMBER_ENTRIES numberFieldsPerEntry:10 numberCharactersPerField:20 numberIndexes:10];
 }
 
+// To compare with testUpsertQuery10StringIndexes10fields20characters
+-(void) testUpsertQuery10GeneratedColumns10fields20characters
+{
+    [self setupSoup:TEST_SOUP numberIndexes:10 indexType:kSoupIndexTypeString features:@[kSoupFeatureGeneratedColumns]];
+    [self upsertEntries:NUMBER_ENTRIES / NUMBER_ENTRIES_PER_BATCH numberEntriesPerBatch:NUMBER_ENTRIES_PER_BATCH numberFieldsPerEntry:10 numberCharactersPerField:20];
+    [self queryEntries];
+}
+
 -(void) testUpsertQuery1JSON1Index1field20characters
 {
     [self tryUpsertQuery:kSoupIndexTypeJSON1 numberEntries:NUMBER_ENTRIES numberFieldsPerEntry:1 numberCharactersPerField:20 numberIndexes:1];
@@ -107,6 +118,31 @@
     [self tryUpsertQuery:kSoupIndexTypeJSON1 numberEntries:NUMBER_ENTRIES numberFieldsPerEntry:10 numberCharactersPerField:20 numberIndexes:10];
 }
 
+-(void) testUpsertWithExternalIdOneByOneVersusBulk
+{
+    [self tryUpsertWithExternalId:NUMBER_ENTRIES indexType:kSoupIndexTypeString];
+}
+
+-(void) testQueryWhileUpsertingWithoutReadConnections
+{
+    [self tryQueryWhileUpserting:0 numberReaders:4];
+}
+
+-(void) testQueryWhileUpsertingWithReadConnections
+{
+    [self tryQueryWhileUpserting:4 numberReaders:4];
+}
+
+-(void) testRetrieveExternalEntriesSeriallyVersusConcurrently
+{
+    [self tryRetrieveExternalEntries:500 numberCharactersPerField:1000];
+}
+
+-(void) testQueryPage100WithOffsetVersusKeyset
+{
+    [self tryQueryPage:100 pageSize:10 indexType:kSoupIndexTypeString];
+}
+
 -(void) testAlterSoupClassicIndexing
 {
     [self tryAlterSoup:kSoupIndexTypeString];
@@ -133,15 +169,20 @@ numberCharactersPerField:(NSUInteger)numberCharactersPerField
 }
     
 -(void) setupSoup:(NSString*)soupName numberIndexes:(NSUInteger)numberIndexes indexType:(NSString*)indexType
+{
+    [self setupSoup:soupName numberIndexes:numberIndexes indexType:indexType features:nil];
+}
+
+-(void) setupSoup:(NSString*)soupName numberIndexes:(NSUInteger)numberIndexes indexType:(NSString*)indexType features:(NSArray*)features
 {
     NSMutableArray* indexSpecs = [NSMutableArray new];
     for (NSUInteger indexNumber=0; indexNumber<numberIndexes; indexNumber++) {
         indexSpecs[indexNumber] = @{kSoupIndexPath:[NSString stringWithFormat:@"k_%tu", indexNumber], kSoupIndexType:indexType};
     }
     NSError* error = nil;
-    [self.store registerSoup:TEST_SOUP withIndexSpecs:[SFSoupIndex asArraySoupIndexes:indexSpecs] error:&error];
+    [self.store registerSoupWithSpec:[SFSoupSpec newSoupSpec:TEST_SOUP withFeatures:features] withIndexSpecs:[SFSoupIndex asArraySoupIndexes:indexSpecs] error:&error];
     XCTAssertNil(error, @"There should be no errors.");
-    [SFSDKSmartStoreLogger d:[self class] format:@"Creating table with %u %@ indexes", numberIndexes, indexType];
+    [SFSDKSmartStoreLogger d:[self class] format:@"Creating table with %u %@ indexes, features: %@", numberIndexes, indexType, features ?: @[]];
 }
     
 -(void) upsertEntries:(NSUInteger)numberBatches numberEntriesPerBatch:(NSUInteger)numberEntriesPerBatch numberFieldsPerEntry:(NSUInteger)numberFieldsPerEntry numberCharactersPerField:(NSUInteger)numberCharactersPerField
@@ -214,6 +255,164 @@ numberCharactersPerField:(NSUInteger)numberCharactersPerField
         [querySpec asDictionary][kQuerySpecParamQueryType], countMatches, querySpec.pageSize, avgMilliseconds];
 }
     
+-(void) tryQueryPage:(NSUInteger)pageIndex pageSize:(NSUInteger)pageSize indexType:(NSString*)indexType
+{
+    NSUInteger numberBatches = ((pageIndex + 1) * pageSize + NUMBER_ENTRIES_PER_BATCH - 1) / NUMBER_ENTRIES_PER_BATCH;
+    NSUInteger numberEntries = numberBatches * NUMBER_ENTRIES_PER_BATCH;
+    [self setupSoup:TEST_SOUP numberIndexes:1 indexType:indexType];
+    [self upsertEntries:numberBatches numberEntriesPerBatch:NUMBER_ENTRIES_PER_BATCH numberFieldsPerEntry:1 numberCharactersPerField:20];
+    SFQuerySpec* querySpec = [SFQuerySpec newAllQuerySpec:TEST_SOUP withOrderPath:@"k_0" withOrder:kSFSoupQuerySortOrderAscending withPageSize:pageSize];
+    NSError* error = nil;
+
+    // Work done by sqlite is compared through the vm steps recorded by the profiler (timings are only logged)
+    SFSmartStoreQueryProfiler* profiler = [[SFSmartStoreQueryProfiler alloc] initWithCapacity:1];
+
+    // Offset pagination
+    self.store.queryProfiler = profiler;
+    NSDate* start = [NSDate date];
+    NSArray* offsetResults = [self.store queryWithQuerySpec:querySpec pageIndex:pageIndex error:&error];
+    double offsetMilliseconds = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+    XCTAssertNil(error, @"There should be no errors.");
+    NSUInteger offsetVmSteps = [[profiler slowestQueries][0][kSFQueryProfileVmSteps] unsignedIntegerValue];
+    [profiler reset];
+
+    // Keyset pagination - first page, as a reference
+    start = [NSDate date];
+    [self.store queryWithQuerySpec:querySpec continuationToken:nil nextContinuationToken:nil error:&error];
+    double firstPageMilliseconds = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+    XCTAssertNil(error, @"There should be no errors.");
+    NSUInteger firstPageVmSteps = [[profiler slowestQueries][0][kSFQueryProfileVmSteps] unsignedIntegerValue];
+    [profiler reset];
+    self.store.queryProfiler = nil;
+
+    // Keyset pagination - walking to the previous page first
+    NSDictionary* continuationToken = nil;
+    for (NSUInteger i=0; i<pageIndex; i++) {
+        NSDictionary* nextContinuationToken = nil;
+        [self.store queryWithQuerySpec:querySpec continuationToken:continuationToken nextContinuationToken:&nextContinuationToken error:&error];
+        continuationToken = nextContinuationToken;
+    }
+    self.store.queryProfiler = profiler;
+    start = [NSDate date];
+    NSArray* keysetResults = [self.store queryWithQuerySpec:querySpec continuationToken:continuationToken nextContinuationToken:nil error:&error];
+    double keysetMilliseconds = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+    XCTAssertNil(error, @"There should be no errors.");
+    NSUInteger keysetVmSteps = [[profiler slowestQueries][0][kSFQueryProfileVmSteps] unsignedIntegerValue];
+    self.store.queryProfiler = nil;
+    XCTAssertEqualObjects([keysetResults valueForKey:@"k_0"], [offsetResults valueForKey:@"k_0"], @"Both pagination should return the same page");
+
+    [SFSDKSmartStoreLogger d:[self class] format:@"Querying page %u of %u entries with %u page size: offset --> %.3f ms (%u vm steps), keyset --> %.3f ms (%u vm steps), first page --> %.3f ms (%u vm steps)",
+        pageIndex, numberEntries, pageSize, offsetMilliseconds, offsetVmSteps, keysetMilliseconds, keysetVmSteps, firstPageMilliseconds, firstPageVmSteps];
+
+    // Seeking past the previous page should do about the same work as fetching the first page, skipping rows should not
+    XCTAssertLessThanOrEqual(keysetVmSteps, firstPageVmSteps * KEYSET_MAX_VM_STEPS_RATIO, @"Deep keyset page should not do more work than the first page");
+    XCTAssertGreaterThan(offsetVmSteps, keysetVmSteps, @"Offset page should do more work than keyset page");
+}
+
+-(void) tryUpsertWithExternalId:(NSUInteger)numberEntries indexType:(NSString*)indexType
+{
+    [self setupSoup:TEST_SOUP numberIndexes:2 indexType:indexType];
+    NSMutableArray* entries = [NSMutableArray arrayWithCapacity:numberEntries];
+    for (NSUInteger entryNumber=0; entryNumber<numberEntries; entryNumber++) {
+        [entries addObject:@{@"k_0": [NSString stringWithFormat:@"id_%lu", (unsigned long)entryNumber], @"k_1": [self pad:@"v_" numberCharacters:20]}];
+    }
+    NSError* error = nil;
+
+    // One entry per call
+    NSDate* start = [NSDate date];
+    for (NSDictionary* entry in entries) {
+        [self.store upsertEntries:@[entry] toSoup:TEST_SOUP withExternalIdPath:@"k_0" error:&error];
+    }
+    double oneByOneMilliseconds = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+    XCTAssertNil(error, @"There should be no errors.");
+    [self.store clearSoup:TEST_SOUP];
+
+    // All entries in one call (inserts, then updates)
+    start = [NSDate date];
+    [self.store upsertEntries:entries toSoup:TEST_SOUP withExternalIdPath:@"k_0" error:&error];
+    double bulkInsertMilliseconds = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+    start = [NSDate date];
+    [self.store upsertEntries:entries toSoup:TEST_SOUP withExternalIdPath:@"k_0" error:&error];
+    double bulkUpdateMilliseconds = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+    XCTAssertNil(error, @"There should be no errors.");
+    XCTAssertEqual([[self.store countWithQuerySpec:[SFQuerySpec newAllQuerySpec:TEST_SOUP withOrderPath:nil withOrder:kSFSoupQuerySortOrderAscending withPageSize:1] error:nil] unsignedIntegerValue], numberEntries);
+
+    [SFSDKSmartStoreLogger d:[self class] format:@"Upserting %u entries with external id: one by one --> %.3f ms, bulk insert --> %.3f ms, bulk update --> %.3f ms",
+        numberEntries, oneByOneMilliseconds, bulkInsertMilliseconds, bulkUpdateMilliseconds];
+}
+
+-(void) tryQueryWhileUpserting:(NSUInteger)readConnectionsCount numberReaders:(NSUInteger)numberReaders
+{
+    self.store.readConnectionsCount = readConnectionsCount;
+    [self setupSoup:TEST_SOUP numberIndexes:1 indexType:kSoupIndexTypeString];
+    [self upsertEntries:NUMBER_ENTRIES / NUMBER_ENTRIES_PER_BATCH numberEntriesPerBatch:NUMBER_ENTRIES_PER_BATCH numberFieldsPerEntry:1 numberCharactersPerField:20];
+    SFQuerySpec* querySpec = [SFQuerySpec newLikeQuerySpec:TEST_SOUP withPath:@"k_0" withLikeKey:@"v_1_%" withOrderPath:@"k_0" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+
+    // One writer - writing is read and written under the times lock
+    NSMutableArray* times = [NSMutableArray new];
+    __block BOOL writing = YES;
+    BOOL (^isWriting)(void) = ^BOOL{
+        @synchronized (times) {
+            return writing;
+        }
+    };
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [self upsertEntries:NUMBER_ENTRIES / NUMBER_ENTRIES_PER_BATCH numberEntriesPerBatch:NUMBER_ENTRIES_PER_BATCH numberFieldsPerEntry:10 numberCharactersPerField:1000];
+        @synchronized (times) {
+            writing = NO;
+        }
+    });
+
+    // N readers
+    for (NSUInteger readerNumber=0; readerNumber<numberReaders; readerNumber++) {
+        dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            while (isWriting()) {
+                NSDate* start = [NSDate date];
+                NSError* error = nil;
+                [self.store queryWithQuerySpec:querySpec pageIndex:0 error:&error];
+                XCTAssertNil(error, @"There should be no errors.");
+                double milliseconds = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+                @synchronized (times) {
+                    [times addObject:@(milliseconds)];
+                }
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    double maxMilliseconds = [[times valueForKeyPath:@"@max.doubleValue"] doubleValue];
+    [SFSDKSmartStoreLogger d:[self class] format:@"Querying with %u readers while upserting with %u read connections: %u queries, average time per query --> %.3f ms, max --> %.3f ms",
+        numberReaders, readConnectionsCount, times.count, [self average:times], maxMilliseconds];
+}
+
+-(void) tryRetrieveExternalEntries:(NSUInteger)numberEntries numberCharactersPerField:(NSUInteger)numberCharactersPerField
+{
+    SFSoupSpec* soupSpec = [SFSoupSpec newSoupSpec:TEST_SOUP withFeatures:@[kSoupFeatureExternalStorage]];
+    [self.store registerSoupWithSpec:soupSpec withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[@{@"path": @"k_0", @"type": kSoupIndexTypeString}]] error:nil];
+    NSMutableArray* entries = [NSMutableArray arrayWithCapacity:numberEntries];
+    for (NSUInteger entryNumber=0; entryNumber<numberEntries; entryNumber++) {
+        [entries addObject:@{@"k_0": [NSString stringWithFormat:@"v_%lu", (unsigned long)entryNumber], @"k_1": [self pad:@"v_" numberCharacters:numberCharactersPerField]}];
+    }
+    NSArray* soupEntryIds = [[self.store upsertEntries:entries toSoup:TEST_SOUP] valueForKey:SOUP_ENTRY_ID];
+    SFQuerySpec* querySpec = [SFQuerySpec newAllQuerySpec:TEST_SOUP withOrderPath:@"k_0" withOrder:kSFSoupQuerySortOrderAscending withPageSize:numberEntries];
+
+    double milliseconds[2][2];
+    for (NSUInteger concurrently=0; concurrently<2; concurrently++) {
+        self.store.loadsExternalEntriesConcurrently = concurrently == 1;
+        NSDate* start = [NSDate date];
+        XCTAssertEqual([self.store retrieveEntries:soupEntryIds fromSoup:TEST_SOUP].count, numberEntries);
+        milliseconds[concurrently][0] = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+        start = [NSDate date];
+        XCTAssertEqual([self.store queryWithQuerySpec:querySpec pageIndex:0 error:nil].count, numberEntries);
+        milliseconds[concurrently][1] = [[NSDate date] timeIntervalSinceDate:start] * MS_IN_S;
+    }
+    self.store.loadsExternalEntriesConcurrently = NO;
+
+    [SFSDKSmartStoreLogger d:[self class] format:@"Loading %u external entries: retrieve serially --> %.3f ms, concurrently --> %.3f ms, query serially --> %.3f ms, concurrently --> %.3f ms",
+        numberEntries, milliseconds[0][0], milliseconds[1][0], milliseconds[0][1], milliseconds[1][1]];
+}
+
 -(NSString*) pad:(NSString*)s numberCharacters:(NSUInteger)numberCharacters
 {
     NSMutableString* result = [NSMutableString stringWithCapacity:numberCharacters];
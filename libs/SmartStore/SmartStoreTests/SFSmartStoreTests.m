@@ -32,6 +32,9 @@
 #import "SFSmartStoreDatabaseManager.h"
 #import "SFSmartStore+Internal.h"
 #import "SFSoupIndex.h"
+#import "SFSoupIndexProjector.h"
+#import "SFSmartStoreQueryProfiler.h"
+#import "SFSmartStoreIndexAdvisor.h"
 #import "SFSmartStoreUpgrade.h"
 #import "SFSmartStoreUpgrade+Internal.h"
 #import <SalesforceSDKCore/SFPasscodeManager.h>
@@ -199,6 +202,30 @@
     
 }
 
+/**
+  * Testing that the projector extracts the same values as projectIntoJson for many indexes at once
+  */
+- (void) testProjectorMatchesProjectIntoJson
+{
+    NSString* rawJson = @"{\"a\":\"a1\", \"b\":2, \"c\":[{\"cc\":\"cc1\"}, {\"cc\":2}, {\"cc\":[1,2,3]}, {}, {\"cc\":{\"cc5\":5}}], \"d\":[{\"dd\":[{\"ddd\":\"ddd11\"},{\"ddd\":\"ddd12\"}]}, {\"dd\":[{\"ddd\":\"ddd21\"}]}, {\"dd\":[{\"ddd\":\"ddd31\"},{\"ddd3\":\"ddd32\"}]}], \"e\":{\"e1\":[[{\"x\":1}],[{\"x\":2},{\"y\":3}]]}}";
+    NSDictionary* json = [SFJsonUtils objectFromJSONString:rawJson];
+    NSArray* paths = @[@"", @"a", @"b", @"c", @"c.cc", @"c.cc.cc5", @"d", @"d.dd", @"d.dd.ddd", @"d.dd.ddd3", @"e", @"e.e1", @"e.e1.x", @"e.e1.y", @"a.missing", @"missing.a"];
+    NSMutableArray* indices = [NSMutableArray array];
+    for (NSUInteger i = 0; i < paths.count; i++) {
+        [indices addObject:[[SFSoupIndex alloc] initWithPath:paths[i] indexType:kSoupIndexTypeString columnName:[NSString stringWithFormat:@"TABLE_1_%lu", (unsigned long) i]]];
+    }
+    NSMutableDictionary* values = [NSMutableDictionary dictionary];
+    [[[SFSoupIndexProjector alloc] initWithIndices:indices] projectEntry:json intoValues:values];
+    
+    for (SFSoupIndex* idx in indices) {
+        id expected = [SFJsonUtils projectIntoJson:json path:idx.path];
+        if ([expected isKindOfClass:[NSDictionary class]] || [expected isKindOfClass:[NSArray class]]) {
+            expected = [SFJsonUtils JSONRepresentation:expected options:0];
+        }
+        XCTAssertEqualObjects(values[idx.columnName], expected ?: [NSNull null], @"Wrong value for path %@", idx.path);
+    }
+}
+
 /**
  * Check that the meta data tables (soup index map and soup names) have been created
  */
@@ -921,6 +948,266 @@
     }
 }
 
+/**
+ * Test that upserts reuse prepared statements whatever the order of the fields in the entries
+ */
+- (void) testUpsertReusesCachedStatements
+{
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [self registerTestSoup:store indexType:kSoupIndexTypeString];
+        [store upsertEntries:@[@{@"key": @"ka1", @"value": @"va1"}, @{@"key": @"ka2", @"value": @"va2"}] toSoup:kTestSoupName];
+        __block NSUInteger cachedStatementsCount;
+        [store.storeQueue inDatabase:^(FMDatabase* db) {
+            XCTAssertTrue(db.shouldCacheStatements, @"Statements should be cached");
+            cachedStatementsCount = db.cachedStatements.count;
+        }];
+
+        // Same fields in a different order
+        NSMutableDictionary* entry = [NSMutableDictionary new];
+        entry[@"value"] = @"va3";
+        entry[@"key"] = @"ka3";
+        NSArray* savedEntries = [store upsertEntries:@[entry] toSoup:kTestSoupName];
+        NSMutableDictionary* updatedEntry = [savedEntries[0] mutableCopy];
+        updatedEntry[@"value"] = @"va3u";
+        [store upsertEntries:@[updatedEntry] toSoup:kTestSoupName];
+        [store.storeQueue inDatabase:^(FMDatabase* db) {
+            // Only the update statement should have been added
+            XCTAssertEqual(db.cachedStatements.count, cachedStatementsCount + 1, @"Insert statement should have been reused");
+        }];
+
+        // Removing the soup clears cached statements
+        __block NSString* soupTableName;
+        [store.storeQueue inDatabase:^(FMDatabase* db) {
+            soupTableName = [store tableNameForSoup:kTestSoupName withDb:db];
+        }];
+        [store removeSoup:kTestSoupName];
+        [store.storeQueue inDatabase:^(FMDatabase* db) {
+            for (NSString* sql in db.cachedStatements) {
+                XCTAssertFalse([sql containsString:soupTableName], @"Cached statements should have been cleared");
+            }
+        }];
+    }
+}
+
+/**
+ * Test upserting several entries at once with an external id path: existing entries are updated, new entries inserted
+ */
+- (void) testBulkUpsertWithExternalIdPath
+{
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [self registerTestSoup:store indexType:kSoupIndexTypeString];
+        NSArray* existingEntries = [store upsertEntries:@[@{@"key": @"ka1", @"value": @"va1"}, @{@"key": @"ka2", @"value": @"va2"}] toSoup:kTestSoupName];
+        
+        // Updates ka2, inserts ka3 then updates it from the same batch, inserts ka4
+        NSError* error = nil;
+        NSArray* upsertedEntries = [store upsertEntries:@[@{@"key": @"ka2", @"value": @"va2u"}, @{@"key": @"ka3", @"value": @"va3"}, @{@"key": @"ka4", @"value": @"va4"}, @{@"key": @"ka3", @"value": @"va3u"}]
+                                                 toSoup:kTestSoupName
+                                     withExternalIdPath:@"key"
+                                                  error:&error];
+        XCTAssertNil(error, @"There should be no errors");
+        XCTAssertEqual(upsertedEntries.count, 4, @"All entries should have been upserted");
+        XCTAssertEqualObjects(upsertedEntries[0][SOUP_ENTRY_ID], existingEntries[1][SOUP_ENTRY_ID], @"Existing entry should have been updated");
+        XCTAssertEqualObjects(upsertedEntries[3][SOUP_ENTRY_ID], upsertedEntries[1][SOUP_ENTRY_ID], @"Entry inserted earlier in the batch should have been updated");
+        XCTAssertEqual([upsertedEntries[2][SOUP_ENTRY_ID] longLongValue], [upsertedEntries[1][SOUP_ENTRY_ID] longLongValue] + 1, @"Wrong id for new entry");
+        
+        NSArray* results = [store queryWithQuerySpec:[SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] pageIndex:0 error:&error];
+        XCTAssertEqualObjects([results valueForKey:@"value"], (@[@"va1", @"va2u", @"va3u", @"va4"]), @"Wrong soup content");
+        
+        // Entries without external id are rejected and nothing gets written
+        upsertedEntries = [store upsertEntries:@[@{@"key": @"ka5", @"value": @"va5"}, @{@"value": @"va6"}]
+                                        toSoup:kTestSoupName
+                            withExternalIdPath:@"key"
+                                         error:&error];
+        XCTAssertNotNil(error, @"Upsert should have failed");
+        XCTAssertEqual(upsertedEntries.count, 0, @"No entries should have been returned");
+        XCTAssertEqual([[store countWithQuerySpec:[SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:nil withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] error:nil] unsignedIntegerValue], 4, @"No entries should have been inserted");
+        [store removeSoup:kTestSoupName];
+    }
+}
+
+/**
+ * Test that queries don't wait for the writer when using read connections
+ */
+- (void) testQueriesWithReadConnections
+{
+    self.store.readConnectionsCount = 2;
+    [self registerTestSoup:self.store indexType:kSoupIndexTypeString];
+    NSArray* savedEntries = [self.store upsertEntries:@[@{@"key": @"ka1", @"value": @"va1"}, @{@"key": @"ka2", @"value": @"va2"}] toSoup:kTestSoupName];
+    SFQuerySpec* querySpec = [SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+    
+    __block NSString* journalMode;
+    [self.store.storeQueue inDatabase:^(FMDatabase* db) {
+        journalMode = [db stringForQuery:@"PRAGMA journal_mode"];
+    }];
+    XCTAssertEqualObjects([journalMode lowercaseString], @"wal", @"Database should be in WAL mode");
+    
+    // Reads while a write transaction is in progress
+    XCTestExpectation* readsDone = [self expectationWithDescription:@"readsDone"];
+    [self.store.storeQueue inTransaction:^(FMDatabase* db, BOOL* rollback) {
+        [db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@", [self.store tableNameForSoup:kTestSoupName withDb:db]]];
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            NSError* error = nil;
+            NSArray* results = [self.store queryWithQuerySpec:querySpec pageIndex:0 error:&error];
+            XCTAssertNil(error);
+            XCTAssertEqualObjects([results valueForKey:@"key"], (@[@"ka1", @"ka2"]), @"Uncommitted changes should not be visible");
+            XCTAssertEqual([[self.store countWithQuerySpec:querySpec error:&error] unsignedIntegerValue], 2);
+            XCTAssertEqual([self.store retrieveEntries:@[savedEntries[0][SOUP_ENTRY_ID]] fromSoup:kTestSoupName].count, 1);
+            [readsDone fulfill];
+        });
+        [self waitForExpectations:@[readsDone] timeout:5];
+        *rollback = YES;
+    }];
+    
+    self.store.readConnectionsCount = 0;
+    XCTAssertNil(self.store.readPool, @"Read pool should have been closed");
+    XCTAssertEqual([[self.store countWithQuerySpec:querySpec error:nil] unsignedIntegerValue], 2);
+    [self.store removeSoup:kTestSoupName];
+}
+
+/**
+ * Test ids handed out to new entries: increasing, never reused, consistent with sqlite's sequence
+ */
+- (void) testEntryIdsAllocation
+{
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [self registerTestSoup:store indexType:kSoupIndexTypeString];
+        NSArray* entries = [store upsertEntries:@[@{@"key": @"ka1"}, @{@"key": @"ka2"}, @{@"key": @"ka3"}] toSoup:kTestSoupName];
+        long long firstId = [entries[0][SOUP_ENTRY_ID] longLongValue];
+        XCTAssertEqual([entries[2][SOUP_ENTRY_ID] longLongValue], firstId + 2, @"Ids should be consecutive");
+        
+        // Removed ids are not reused
+        [store removeEntries:@[entries[2][SOUP_ENTRY_ID]] fromSoup:kTestSoupName error:nil];
+        NSDictionary* entry = [store upsertEntries:@[@{@"key": @"ka4"}] toSoup:kTestSoupName][0];
+        XCTAssertEqual([entry[SOUP_ENTRY_ID] longLongValue], firstId + 3, @"Wrong id for new entry");
+        
+        // Rolled back inserts
+        NSError* error = nil;
+        [store upsertEntries:@[@{@"key": @"ka5"}, @{@"key": @"ka6"}] toSoup:kTestSoupName withExternalIdPath:@"key" error:&error];
+        [store.storeQueue inTransaction:^(FMDatabase* db, BOOL* rollback) {
+            [store upsertEntries:@[@{@"key": @"ka7"}] toSoup:kTestSoupName withExternalIdPath:SOUP_ENTRY_ID error:nil withDb:db];
+            *rollback = YES;
+        }];
+        entry = [store upsertEntries:@[@{@"key": @"ka8"}] toSoup:kTestSoupName][0];
+        XCTAssertEqual([entry[SOUP_ENTRY_ID] longLongValue], firstId + 6, @"Wrong id for new entry");
+        
+        // Stored ids match the json
+        NSArray* results = [store queryWithQuerySpec:[SFQuerySpec newExactQuerySpec:kTestSoupName withPath:@"key" withMatchKey:@"ka8" withOrderPath:nil withOrder:kSFSoupQuerySortOrderAscending withPageSize:1] pageIndex:0 error:&error];
+        XCTAssertEqualObjects(results[0][SOUP_ENTRY_ID], entry[SOUP_ENTRY_ID]);
+        __block long long seq;
+        [store.storeQueue inDatabase:^(FMDatabase* db) {
+            seq = [db longForQuery:@"SELECT seq FROM SQLITE_SEQUENCE WHERE name = ?", [store tableNameForSoup:kTestSoupName withDb:db]];
+        }];
+        XCTAssertEqual(seq, firstId + 6, @"Sequence should follow the ids handed out");
+        [store removeSoup:kTestSoupName];
+    }
+}
+
+/**
+ * Test soup with generated columns: index columns are computed by sqlite from the soup column
+ */
+- (void) testGeneratedColumns
+{
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        NSError* error = nil;
+        SFSoupSpec* soupSpec = [SFSoupSpec newSoupSpec:kTestSoupName withFeatures:@[kSoupFeatureGeneratedColumns]];
+        NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": @"key", @"type": kSoupIndexTypeString},
+                                                               @{@"path": @"nested.count", @"type": kSoupIndexTypeInteger},
+                                                               @{@"path": @"text", @"type": kSoupIndexTypeFullText}]];
+        [store registerSoupWithSpec:soupSpec withIndexSpecs:indexSpecs error:&error];
+        XCTAssertNil(error, @"Soup should have registered without error");
+        XCTAssertTrue([[store attributesForSoup:kTestSoupName].features containsObject:kSoupFeatureGeneratedColumns], @"Feature should have been registered");
+        
+        NSArray* entries = [store upsertEntries:@[@{@"key": @"ka1", @"nested": @{@"count": @1}, @"text": @"hello world"},
+                                                  @{@"key": @"ka2", @"nested": @{@"count": @2}, @"text": @"goodbye world"}]
+                                         toSoup:kTestSoupName];
+        NSMutableDictionary* updatedEntry = [entries[1] mutableCopy];
+        updatedEntry[@"nested"] = @{@"count": @3};
+        [store upsertEntries:@[updatedEntry] toSoup:kTestSoupName];
+        
+        // Index columns were computed
+        __block NSArray* rows;
+        [store.storeQueue inDatabase:^(FMDatabase* db) {
+            NSString* soupTableName = [store tableNameForSoup:kTestSoupName withDb:db];
+            FMResultSet* frs = [db executeQuery:[NSString stringWithFormat:@"SELECT %@_0, %@_1 FROM %@ ORDER BY id", soupTableName, soupTableName, soupTableName]];
+            NSMutableArray* result = [NSMutableArray array];
+            while ([frs next]) {
+                [result addObject:@[[frs objectForColumnIndex:0], [frs objectForColumnIndex:1]]];
+            }
+            [frs close];
+            rows = result;
+        }];
+        XCTAssertEqualObjects(rows, (@[@[@"ka1", @1], @[@"ka2", @3]]), @"Wrong index column values");
+        
+        // Queries use them
+        NSArray* results = [store queryWithQuerySpec:[SFQuerySpec newRangeQuerySpec:kTestSoupName withPath:@"nested.count" withBeginKey:@"2" withEndKey:@"3" withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] pageIndex:0 error:&error];
+        XCTAssertEqualObjects([results valueForKey:@"key"], @[@"ka2"], @"Wrong range query results");
+        results = [store queryWithQuerySpec:[SFQuerySpec newMatchQuerySpec:kTestSoupName withPath:@"text" withMatchKey:@"hello" withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] pageIndex:0 error:&error];
+        XCTAssertEqualObjects([results valueForKey:@"key"], @[@"ka1"], @"Wrong match query results");
+        [store removeSoup:kTestSoupName];
+        
+        // Not supported with external storage
+        soupSpec = [SFSoupSpec newSoupSpec:kTestSoupName withFeatures:@[kSoupFeatureGeneratedColumns, kSoupFeatureExternalStorage]];
+        XCTAssertFalse([store registerSoupWithSpec:soupSpec withIndexSpecs:indexSpecs error:&error], @"Registration should have failed");
+        XCTAssertFalse([store soupExists:kTestSoupName], @"Soup should not exist");
+    }
+}
+
+/**
+ * Test soup with materialized counts: counts of "all" and exact queries are read from the counts table kept up to date by triggers
+ */
+- (void) testMaterializedCounts
+{
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        NSError* error = nil;
+        NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": @"key", @"type": kSoupIndexTypeString},
+                                                               @{@"path": @"nested.count", @"type": kSoupIndexTypeInteger},
+                                                               @{@"path": @"text", @"type": kSoupIndexTypeFullText}]];
+        SFQuerySpec* allQuerySpec = [SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+        SFQuerySpec* exactKeyQuerySpec = [SFQuerySpec newExactQuerySpec:kTestSoupName withPath:@"key" withMatchKey:@"ka1" withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+        SFQuerySpec* exactCountQuerySpec = [SFQuerySpec newExactQuerySpec:kTestSoupName withPath:@"nested.count" withMatchKey:@"2" withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+        SFQuerySpec* rangeQuerySpec = [SFQuerySpec newRangeQuerySpec:kTestSoupName withPath:@"nested.count" withBeginKey:@"2" withEndKey:@"3" withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+        void (^checkCounts)(NSArray*) = ^(NSArray* expectedCounts) {
+            NSArray* querySpecs = @[allQuerySpec, exactKeyQuerySpec, exactCountQuerySpec, rangeQuerySpec];
+            for (NSUInteger i = 0; i < querySpecs.count; i++) {
+                XCTAssertEqualObjects([store countWithQuerySpec:querySpecs[i] error:nil], expectedCounts[i], @"Wrong count for %@", querySpecs[i]);
+                BOOL materialized = ((SFQuerySpec*)querySpecs[i]).queryType != kSFSoupQueryTypeRange || ((SFQuerySpec*)querySpecs[i]).path == nil;
+                XCTAssertEqual(materialized, [store.lastExplainQueryPlan[EXPLAIN_SQL] containsString:@"_counts"], @"Wrong count query %@", store.lastExplainQueryPlan[EXPLAIN_SQL]);
+            }
+        };
+
+        SFSoupSpec* soupSpec = [SFSoupSpec newSoupSpec:kTestSoupName withFeatures:@[kSoupFeatureMaterializedCounts]];
+        XCTAssertTrue([store registerSoupWithSpec:soupSpec withIndexSpecs:indexSpecs error:&error], @"Register soup failed: %@", error);
+        checkCounts(@[@0, @0, @0, @0]);
+
+        // Inserts / updates / deletes
+        NSArray* entries = [store upsertEntries:@[@{@"key": @"ka1", @"nested": @{@"count": @1}, @"text": @"hello"},
+                                                  @{@"key": @"ka2", @"nested": @{@"count": @2}, @"text": @"hello"},
+                                                  @{@"key": @"ka1", @"nested": @{@"count": @2}}]
+                                         toSoup:kTestSoupName];
+        checkCounts(@[@3, @2, @2, @2]);
+        NSMutableDictionary* updatedEntry = [entries[1] mutableCopy];
+        updatedEntry[@"key"] = @"ka1";
+        updatedEntry[@"nested"] = @{@"count": @3};
+        [store upsertEntries:@[updatedEntry] toSoup:kTestSoupName];
+        checkCounts(@[@3, @3, @1, @2]);
+        [store removeEntries:@[entries[0][SOUP_ENTRY_ID]] fromSoup:kTestSoupName];
+        checkCounts(@[@2, @2, @1, @2]);
+        [store clearSoup:kTestSoupName];
+        checkCounts(@[@0, @0, @0, @0]);
+        NSString* countsTableName = [NSString stringWithFormat:@"%@_counts", [self getSoupTableName:kTestSoupName store:store]];
+        XCTAssertTrue([self hasTable:countsTableName store:store], @"Counts table should exist");
+        [store removeSoup:kTestSoupName];
+        XCTAssertFalse([self hasTable:countsTableName store:store], @"Counts table should have been dropped");
+
+        // Enabling the feature through alter soup counts the existing rows
+        [store registerSoup:kTestSoupName withIndexSpecs:indexSpecs error:nil];
+        [store upsertEntries:@[@{@"key": @"ka1", @"nested": @{@"count": @2}}, @{@"key": @"ka2", @"nested": @{@"count": @2}}] toSoup:kTestSoupName];
+        XCTAssertTrue([store alterSoup:kTestSoupName withSoupSpec:soupSpec withIndexSpecs:indexSpecs reIndexData:NO], @"Alter soup failed");
+        checkCounts(@[@2, @1, @2, @2]);
+        [store removeSoup:kTestSoupName];
+    }
+}
+
 - (void)testQuerySpecPageSize
 {
     NSDictionary *allQueryNoPageSize = @{kQuerySpecParamQueryType: kQuerySpecTypeRange,
@@ -1447,6 +1734,283 @@
     }
 }
 
+/**
+ * Test paging through results with continuation tokens (keyset pagination) in both orders, with duplicate and missing order values
+ */
+- (void)testQueryAsStringEscapesValues {
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [self registerTestSoup:store indexType:kSoupIndexTypeString];
+        NSString* value = @"quote\" backslash\\ slash/ newline\n tab\t control\x01 accent\u00e9 emoji\U0001F600";
+        [store upsertEntries:@[@{@"key": @"k1", @"value": value, @"number": @12}] toSoup:kTestSoupName];
+
+        // Exact query
+        NSMutableString* resultString = [NSMutableString new];
+        NSError* error = nil;
+        [store queryAsString:resultString querySpec:[SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:nil withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] pageIndex:0 error:&error];
+        XCTAssertNil(error);
+        NSArray* result = [SFJsonUtils objectFromJSONString:resultString];
+        XCTAssertEqual(result.count, 1);
+        XCTAssertEqualObjects(result[0][@"value"], value);
+
+        // Smart query mixing soup, string, integer, float and null values
+        NSString* smartSql = [NSString stringWithFormat:@"SELECT {%1$@:_soup}, {%1$@:value}, {%1$@:_soupEntryId}, 1.5, null FROM {%1$@}", kTestSoupName];
+        resultString = [NSMutableString new];
+        [store queryAsString:resultString querySpec:[SFQuerySpec newSmartQuerySpec:smartSql withPageSize:10] pageIndex:0 error:&error];
+        XCTAssertNil(error);
+        XCTAssertTrue([resultString containsString:@"slash\\/"], @"Slashes should be escaped");
+        XCTAssertTrue([resultString containsString:@"control\\u0001"], @"Control characters should be escaped");
+        result = [SFJsonUtils objectFromJSONString:resultString];
+        XCTAssertEqual(result.count, 1);
+        XCTAssertEqualObjects(result[0][0][@"value"], value);
+        XCTAssertEqualObjects(result[0][1], value);
+        XCTAssertEqualObjects(result[0][2], result[0][0][SOUP_ENTRY_ID]);
+        XCTAssertEqualObjects(result[0][3], @1.5);
+        XCTAssertEqualObjects(result[0][4], [NSNull null]);
+        [store removeSoup:kTestSoupName];
+    }
+}
+
+- (void)testSelectPathsReturnTypedColumnValues {
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": @"key", @"type": kSoupIndexTypeString},
+                                                                @{@"path": @"count", @"type": kSoupIndexTypeInteger},
+                                                                @{@"path": @"amount", @"type": kSoupIndexTypeFloating}]];
+        [store registerSoup:kTestSoupName withIndexSpecs:indexSpecs error:nil];
+        [store upsertEntries:@[@{@"key": @"k1", @"count": @12, @"amount": @1.5, @"other": @"o1"},
+                               @{@"key": @"k2"}] toSoup:kTestSoupName];
+        SFQuerySpec* querySpec = [SFQuerySpec newAllQuerySpec:kTestSoupName withSelectPaths:@[@"key", @"count", @"amount", @"other"] withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+        NSArray* expectedResults = @[@[@"k1", @12, @1.5, @"o1"], @[@"k2", [NSNull null], [NSNull null], [NSNull null]]];
+
+        // As array
+        NSError* error = nil;
+        NSArray* result = [store queryWithQuerySpec:querySpec pageIndex:0 error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(result, expectedResults);
+        XCTAssertTrue([result[0][1] isKindOfClass:[NSNumber class]], @"Integer column should be read as a number");
+
+        // As string
+        NSMutableString* resultString = [NSMutableString new];
+        [store queryAsString:resultString querySpec:querySpec pageIndex:0 error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqualObjects([SFJsonUtils objectFromJSONString:resultString], expectedResults);
+        [store removeSoup:kTestSoupName];
+    }
+}
+
+- (void)testEnumerateQuerySpec {
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [self registerTestSoup:store indexType:kSoupIndexTypeString];
+        NSMutableArray* entries = [NSMutableArray new];
+        for (int i = 0; i < 25; i++) {
+            [entries addObject:@{@"key": [NSString stringWithFormat:@"k%02d", i], @"value": [NSString stringWithFormat:@"v%02d", i]}];
+        }
+        NSArray* savedEntries = [store upsertEntries:entries toSoup:kTestSoupName];
+
+        // All query: whole entries, in order, regardless of page size
+        NSMutableArray* enumerated = [NSMutableArray new];
+        NSError* error = nil;
+        BOOL success = [store enumerateQuerySpec:[SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] usingBlock:^(id entry, BOOL *stop) {
+            [enumerated addObject:entry];
+        } error:&error];
+        XCTAssertTrue(success);
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(enumerated, savedEntries);
+
+        // Smart query: rows, stopping early
+        [enumerated removeAllObjects];
+        NSString* smartSql = [NSString stringWithFormat:@"SELECT {%1$@:key}, {%1$@:value} FROM {%1$@} ORDER BY {%1$@:key} DESC", kTestSoupName];
+        success = [store enumerateQuerySpec:[SFQuerySpec newSmartQuerySpec:smartSql withPageSize:10] usingBlock:^(id row, BOOL *stop) {
+            [enumerated addObject:row];
+            *stop = enumerated.count == 3;
+        } error:&error];
+        XCTAssertTrue(success);
+        XCTAssertEqualObjects(enumerated, (@[@[@"k24", @"v24"], @[@"k23", @"v23"], @[@"k22", @"v22"]]));
+
+        // Invalid query
+        success = [store enumerateQuerySpec:[SFQuerySpec newSmartQuerySpec:@"SELECT {unknownSoup:key} FROM {unknownSoup}" withPageSize:10] usingBlock:^(id row, BOOL *stop) {
+            XCTFail(@"Block should not be called");
+        } error:&error];
+        XCTAssertFalse(success);
+        XCTAssertNotNil(error);
+        [store removeSoup:kTestSoupName];
+    }
+}
+
+- (void)testQueryProfiler {
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [self registerTestSoup:store indexType:kSoupIndexTypeString];
+        NSMutableArray* entries = [NSMutableArray new];
+        for (int i = 0; i < 25; i++) {
+            [entries addObject:@{@"key": [NSString stringWithFormat:@"k%02d", i], @"value": [NSString stringWithFormat:@"v%02d", i]}];
+        }
+        [store upsertEntries:entries toSoup:kTestSoupName];
+        NSError* error = nil;
+
+        // Not profiled by default
+        XCTAssertNil(store.queryProfiler);
+        [store queryWithQuerySpec:[SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] pageIndex:0 error:&error];
+        XCTAssertNil(error);
+
+        // Profiles recorded, plan captured for slow queries
+        store.queryProfiler = [[SFSmartStoreQueryProfiler alloc] init];
+        store.queryProfiler.slowQueryThreshold = 1e6;
+        [store queryWithQuerySpec:[SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] pageIndex:0 error:&error];
+        XCTAssertNil(error);
+        NSDictionary* profile = [store.queryProfiler slowestQueries].firstObject;
+        XCTAssertEqual(store.queryProfiler.recordedCount, 1);
+        XCTAssertTrue([profile[kSFQueryProfileSql] hasPrefix:@"SELECT"]);
+        XCTAssertEqualObjects(profile[kSFQueryProfileBindCount], @0);
+        XCTAssertEqualObjects(profile[kSFQueryProfileRowsReturned], @10);
+        XCTAssertGreaterThan([profile[kSFQueryProfileVmSteps] intValue], 0);
+        XCTAssertGreaterThanOrEqual([profile[kSFQueryProfileWallTime] doubleValue], 0);
+        XCTAssertGreaterThanOrEqual([profile[kSFQueryProfileCpuTime] doubleValue], 0);
+        XCTAssertNil(profile[kSFQueryProfilePlan]);
+
+        store.queryProfiler.slowQueryThreshold = 0;
+        NSNumber* count = [store countWithQuerySpec:[SFQuerySpec newExactQuerySpec:kTestSoupName withPath:@"key" withMatchKey:@"k03" withOrderPath:@"key" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10] error:&error];
+        XCTAssertEqualObjects(count, @1);
+        XCTAssertEqual(store.queryProfiler.recordedCount, 2);
+        profile = [[store.queryProfiler slowestQueries] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"%K CONTAINS 'count(*)'", kSFQueryProfileSql]].firstObject;
+        XCTAssertNotNil(profile);
+        XCTAssertEqualObjects(profile[kSFQueryProfileBindCount], @1);
+        XCTAssertEqualObjects(profile[kSFQueryProfileRowsReturned], @1);
+        XCTAssertGreaterThan([profile[kSFQueryProfilePlan] count], 0);
+
+        // Only the slowest queries are kept, slowest first
+        store.queryProfiler = [[SFSmartStoreQueryProfiler alloc] initWithCapacity:2];
+        for (int i = 0; i < 5; i++) {
+            [store queryWithQuerySpec:[SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"value" withOrder:kSFSoupQuerySortOrderAscending withPageSize:(i+1) * 5] pageIndex:0 error:&error];
+        }
+        NSArray* slowestQueries = [store.queryProfiler slowestQueries];
+        XCTAssertEqual(store.queryProfiler.recordedCount, 5);
+        XCTAssertEqual(slowestQueries.count, 2);
+        XCTAssertGreaterThanOrEqual([slowestQueries[0][kSFQueryProfileWallTime] doubleValue], [slowestQueries[1][kSFQueryProfileWallTime] doubleValue]);
+        // The event posted carries no query text
+        NSArray* reportedQueries = [store slowQueriesEventAttributes][@"slowQueries"];
+        XCTAssertEqual(reportedQueries.count, 2);
+        for (NSDictionary* reportedQuery in reportedQueries) {
+            XCTAssertNil(reportedQuery[kSFQueryProfileSql]);
+            XCTAssertNil(reportedQuery[kSFQueryProfileSmartSql]);
+            XCTAssertNotNil(reportedQuery[kSFQueryProfileVmSteps]);
+        }
+        [store reportSlowQueries];
+        [store.queryProfiler reset];
+        XCTAssertNil([store slowQueriesEventAttributes]);
+        XCTAssertEqual([store.queryProfiler slowestQueries].count, 0);
+        XCTAssertEqual(store.queryProfiler.recordedCount, 0);
+
+        store.queryProfiler = nil;
+        [store removeSoup:kTestSoupName];
+    }
+}
+
+- (void)testIndexAdvisor {
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        NSArray* indexSpecs = [SFSoupIndex asArraySoupIndexes:@[@{@"path": @"key", @"type": kSoupIndexTypeString},
+                                                                @{@"path": @"amount", @"type": kSoupIndexTypeJSON1}]];
+        [store registerSoup:kTestSoupName withIndexSpecs:indexSpecs error:nil];
+        NSMutableArray* entries = [NSMutableArray new];
+        for (int i = 0; i < 10; i++) {
+            [entries addObject:@{@"key": [NSString stringWithFormat:@"k%d", i], @"amount": @(i), @"name": [NSString stringWithFormat:@"n%d", i]}];
+        }
+        [store upsertEntries:entries toSoup:kTestSoupName];
+        store.indexAdvisor = [SFSmartStoreIndexAdvisor new];
+
+        // Unindexed path read with json_extract, path with a json1 index, path with a column index
+        NSString* unindexedSql = [NSString stringWithFormat:@"SELECT {%1$@:key} FROM {%1$@} WHERE json_extract({%1$@:_soup}, '$.name') = 'n3'", kTestSoupName];
+        NSString* json1Sql = [NSString stringWithFormat:@"SELECT {%1$@:key} FROM {%1$@} ORDER BY {%1$@:amount}", kTestSoupName];
+        NSString* indexedSql = [NSString stringWithFormat:@"SELECT {%1$@:amount} FROM {%1$@} WHERE {%1$@:key} = 'k3'", kTestSoupName];
+        for (NSString* smartSql in @[unindexedSql, unindexedSql, json1Sql, indexedSql]) {
+            NSError* error = nil;
+            [store queryWithQuerySpec:[SFQuerySpec newSmartQuerySpec:smartSql withPageSize:10] pageIndex:0 error:&error];
+            XCTAssertNil(error);
+        }
+        NSArray* recommendations = [store.indexAdvisor recommendationsForStore:store];
+        XCTAssertEqual(recommendations.count, 2);
+        XCTAssertEqualObjects(recommendations[0], (@{kSFIndexRecommendationSoupName: kTestSoupName, kSFIndexRecommendationPath: @"name",
+                                                     kSFIndexRecommendationIndexType: kSoupIndexTypeString,
+                                                     kSFIndexRecommendationQueryCount: @2, kSFIndexRecommendationWallTime: @0}));
+        XCTAssertEqualObjects(recommendations[1], (@{kSFIndexRecommendationSoupName: kTestSoupName, kSFIndexRecommendationPath: @"amount",
+                                                     kSFIndexRecommendationCurrentIndexType: kSoupIndexTypeJSON1, kSFIndexRecommendationIndexType: kSoupIndexTypeInteger,
+                                                     kSFIndexRecommendationQueryCount: @1, kSFIndexRecommendationWallTime: @0}));
+
+        // Auto-apply
+        XCTAssertTrue([store.indexAdvisor applyRecommendations:recommendations toStore:store]);
+        NSDictionary<NSString*, SFSoupIndex*>* indexSpecsByPath = [SFSoupIndex mapForSoupIndexes:[store indicesForSoup:kTestSoupName]];
+        XCTAssertEqual(indexSpecsByPath.count, 3);
+        XCTAssertEqualObjects(indexSpecsByPath[@"key"].indexType, kSoupIndexTypeString);
+        XCTAssertEqualObjects(indexSpecsByPath[@"amount"].indexType, kSoupIndexTypeInteger);
+        XCTAssertEqualObjects(indexSpecsByPath[@"name"].indexType, kSoupIndexTypeString);
+        XCTAssertEqual([store.indexAdvisor recommendationsForStore:store].count, 0);
+
+        // From profiles
+        SFSmartStoreIndexAdvisor* advisor = [SFSmartStoreIndexAdvisor new];
+        [advisor recordProfiles:@[@{kSFQueryProfileSmartSql: [NSString stringWithFormat:@"SELECT {%1$@:key} FROM {%1$@} WHERE json_extract({%1$@:_soup}, '$.other') > 1", kTestSoupName],
+                                    kSFQueryProfileWallTime: @12.5}]];
+        recommendations = [advisor recommendationsForStore:store];
+        XCTAssertEqual(recommendations.count, 1);
+        XCTAssertEqualObjects(recommendations[0][kSFIndexRecommendationPath], @"other");
+        XCTAssertEqualObjects(recommendations[0][kSFIndexRecommendationWallTime], @12.5);
+
+        store.indexAdvisor = nil;
+        [store removeSoup:kTestSoupName];
+    }
+}
+
+- (void)testKeysetPagination {
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        NSDictionary* soupIndex = @{@"path": @"key",@"type": @"string"};
+        [store registerSoup:kTestSoupName withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[soupIndex]] error:nil];
+
+        // 25 entries: every fifth entry has no key, the others share 4 keys
+        NSMutableArray* entries = [NSMutableArray new];
+        for (NSUInteger i=0; i<25; i++) {
+            [entries addObject:(i % 5 == 4 ? @{@"value": @(i)} : @{@"key": [NSString stringWithFormat:@"k%lu", (unsigned long)(i % 4)], @"value": @(i)})];
+        }
+        NSArray* savedEntries = [store upsertEntries:entries toSoup:kTestSoupName];
+
+        for (NSNumber* order in @[@(kSFSoupQuerySortOrderAscending), @(kSFSoupQuerySortOrderDescending)]) {
+            SFSoupQuerySortOrder sortOrder = (SFSoupQuerySortOrder) order.unsignedIntegerValue;
+
+            // Expected order: by key (missing keys first when ascending) then by soup entry id
+            NSArray* expectedEntries = [savedEntries sortedArrayUsingComparator:^NSComparisonResult(NSDictionary* e1, NSDictionary* e2) {
+                NSString* k1 = e1[@"key"] ?: @"";
+                NSString* k2 = e2[@"key"] ?: @"";
+                NSComparisonResult result = [k1 compare:k2];
+                if (result == NSOrderedSame) {
+                    result = [e1[SOUP_ENTRY_ID] compare:e2[SOUP_ENTRY_ID]];
+                }
+                return sortOrder == kSFSoupQuerySortOrderAscending ? result : -result;
+            }];
+
+            SFQuerySpec* querySpec = [SFQuerySpec newAllQuerySpec:kTestSoupName withOrderPath:@"key" withOrder:sortOrder withPageSize:7];
+            XCTAssertTrue(querySpec.supportsKeysetPagination);
+            NSMutableArray* actualEntries = [NSMutableArray new];
+            NSDictionary* continuationToken = nil;
+            NSUInteger pageCount = 0;
+            do {
+                NSError* error = nil;
+                NSDictionary* nextContinuationToken = nil;
+                NSArray* page = [store queryWithQuerySpec:querySpec continuationToken:continuationToken nextContinuationToken:&nextContinuationToken error:&error];
+                XCTAssertNil(error, @"No error expected");
+                [actualEntries addObjectsFromArray:page];
+                continuationToken = nextContinuationToken;
+                pageCount++;
+            } while (continuationToken != nil);
+
+            XCTAssertEqual(pageCount, 4, @"Wrong number of pages");
+            XCTAssertEqualObjects([actualEntries valueForKey:SOUP_ENTRY_ID], [expectedEntries valueForKey:SOUP_ENTRY_ID], @"Wrong entries");
+        }
+
+        // Smart queries can't be paged with continuation tokens
+        NSError* error = nil;
+        SFQuerySpec* smartQuerySpec = [SFQuerySpec newSmartQuerySpec:[NSString stringWithFormat:@"SELECT {%@:key} FROM {%@}", kTestSoupName, kTestSoupName] withPageSize:7];
+        XCTAssertFalse(smartQuerySpec.supportsKeysetPagination);
+        XCTAssertNil([store queryWithQuerySpec:smartQuerySpec continuationToken:nil nextContinuationToken:nil error:&error]);
+        XCTAssertNotNil(error, @"Error expected");
+    }
+}
+
 /**
 Test running an invalid query with SFStoreCursor
 NB: there are many more tests in SalesforceMobileSDK-iOS-Hybrid exercising StoreCursor
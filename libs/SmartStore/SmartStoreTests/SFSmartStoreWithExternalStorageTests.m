@@ -305,6 +305,93 @@ static NSInteger const kSSMegaBytePayloadSize = 1024 * 1024;
     }
 }
 
+- (void)testRetrieveAndQueryEntriesConcurrentlyWithExternalStorage {
+    NSUInteger const numberOfEntries = 50;
+    SFSoupSpec *soupSpec = [SFSoupSpec newSoupSpec:kSSExternalStorage_TestSoupName withFeatures:@[kSoupFeatureExternalStorage]];
+    NSDictionary* soupIndex = @{@"path": @"name", @"type": @"string"};
+    
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [store registerSoupWithSpec:soupSpec withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[soupIndex]] error:nil];
+        NSMutableArray *entriesToInsert = [[NSMutableArray alloc] initWithCapacity:numberOfEntries];
+        for (NSUInteger i = 0; i < numberOfEntries; i++) {
+            [entriesToInsert addObject:@{@"name": [NSString stringWithFormat:@"somebody_%03lu", (unsigned long) i]}];
+        }
+        NSArray *savedEntries = [store upsertEntries:entriesToInsert toSoup:kSSExternalStorage_TestSoupName];
+        NSArray *reversedIds = [[[self entriesIdFromEntries:savedEntries] reverseObjectEnumerator] allObjects];
+        SFQuerySpec *querySpec = [SFQuerySpec newAllQuerySpec:kSSExternalStorage_TestSoupName withOrderPath:@"name" withOrder:kSFSoupQuerySortOrderDescending withPageSize:numberOfEntries];
+        NSArray *expectedEntries = [[savedEntries reverseObjectEnumerator] allObjects];
+        
+        store.loadsExternalEntriesConcurrently = YES;
+        @try {
+            // Entries come back in the order of the ids / rows
+            XCTAssertEqualObjects([store retrieveEntries:reversedIds fromSoup:kSSExternalStorage_TestSoupName], expectedEntries, @"Retrieve entries failed.");
+            XCTAssertEqualObjects([store queryWithQuerySpec:querySpec pageIndex:0 error:nil], expectedEntries, @"Query failed.");
+            NSMutableString *resultString = [NSMutableString new];
+            [store queryAsString:resultString querySpec:querySpec pageIndex:0 error:nil];
+            XCTAssertEqualObjects([SFJsonUtils objectFromJSONString:resultString], expectedEntries, @"Query as string failed.");
+        }
+        @finally {
+            store.loadsExternalEntriesConcurrently = NO;
+        }
+    }
+}
+
+- (void)testExternalFilesWrittenAtCommit {
+    SFSoupSpec *soupSpec = [SFSoupSpec newSoupSpec:kSSExternalStorage_TestSoupName withFeatures:@[kSoupFeatureExternalStorage]];
+    NSDictionary* soupIndex = @{@"path": @"name", @"type": @"string"};
+    
+    for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+        [store registerSoupWithSpec:soupSpec withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[soupIndex]] error:nil];
+        __block NSString *soupTableName;
+        [store.storeQueue inDatabase:^(FMDatabase *db) {
+            soupTableName = [store tableNameForSoup:kSSExternalStorage_TestSoupName withDb:db];
+        }];
+        NSString *externalSoupDir = [store externalStorageSoupDirectory:soupTableName];
+        NSArray *entries = @[@{@"name": @"a"}, @{@"name": @"b"}, @{@"name": @"c"}];
+        
+        // Rolled back: no files
+        [store inTransaction:^(FMDatabase *db, BOOL *rollback) {
+            NSArray *savedEntries = [store upsertEntries:entries toSoup:kSSExternalStorage_TestSoupName withExternalIdPath:SOUP_ENTRY_ID error:nil withDb:db];
+            XCTAssertEqual([[NSFileManager defaultManager] contentsOfDirectoryAtPath:externalSoupDir error:nil].count, 0, @"No file should be written before commit.");
+            // Entries saved in the transaction can be read back
+            NSArray *retrievedEntries = [store retrieveEntries:[self entriesIdFromEntries:savedEntries] fromSoup:kSSExternalStorage_TestSoupName withDb:db];
+            XCTAssertEqualObjects(retrievedEntries, savedEntries, @"Retrieve entries failed.");
+            *rollback = YES;
+        } error:nil];
+        XCTAssertEqual([[NSFileManager defaultManager] contentsOfDirectoryAtPath:externalSoupDir error:nil].count, 0, @"No file should be left after rollback.");
+        
+        // Committed: one file per entry, no tmp file
+        NSArray *savedEntries = [store upsertEntries:entries toSoup:kSSExternalStorage_TestSoupName];
+        NSArray *contentsOfDir = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:externalSoupDir error:nil];
+        XCTAssertEqual(contentsOfDir.count, entries.count, @"Wrong number of external files after commit.");
+        for (NSString *fileName in contentsOfDir) {
+            XCTAssertFalse([fileName hasSuffix:@"_tmp"], @"Tmp file left behind.");
+        }
+        XCTAssertEqualObjects([store retrieveEntries:[self entriesIdFromEntries:savedEntries] fromSoup:kSSExternalStorage_TestSoupName], savedEntries, @"Retrieve entries failed.");
+        
+        // Rolled back update and delete: staged content only visible to the transaction, committed files untouched
+        NSNumber *updatedEntryId = savedEntries[0][SOUP_ENTRY_ID];
+        NSNumber *removedEntryId = savedEntries[1][SOUP_ENTRY_ID];
+        NSString *removedFilePath = [store externalStorageSoupFilePath:removedEntryId soupTableName:soupTableName];
+        [store inTransaction:^(FMDatabase *db, BOOL *rollback) {
+            NSMutableDictionary *updatedEntry = [savedEntries[0] mutableCopy];
+            updatedEntry[@"name"] = @"z";
+            [store upsertEntries:@[updatedEntry] toSoup:kSSExternalStorage_TestSoupName withExternalIdPath:SOUP_ENTRY_ID error:nil withDb:db];
+            [store removeEntries:@[removedEntryId] fromSoup:kSSExternalStorage_TestSoupName withDb:db];
+            XCTAssertEqualObjects([store loadExternalSoupEntry:updatedEntryId soupTableName:soupTableName withDb:db][@"name"], @"z", @"Transaction should see its own update.");
+            XCTAssertEqualObjects([store loadExternalSoupEntry:updatedEntryId soupTableName:soupTableName withDb:nil][@"name"], @"a", @"Other connections should see the committed entry.");
+            XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:removedFilePath], @"File should only be deleted at commit.");
+            *rollback = YES;
+        } error:nil];
+        XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:removedFilePath], @"File should be kept after rollback.");
+        XCTAssertEqualObjects([store retrieveEntries:[self entriesIdFromEntries:savedEntries] fromSoup:kSSExternalStorage_TestSoupName], savedEntries, @"Retrieve entries failed.");
+        
+        // Committed delete: file removed
+        [store removeEntries:@[removedEntryId] fromSoup:kSSExternalStorage_TestSoupName];
+        XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:removedFilePath], @"File should be deleted after commit.");
+    }
+}
+
 - (void)testRemoveEntryWithExternalStorage {
     NSUInteger const iterations = 10;
     SFSoupSpec *soupSpec = [SFSoupSpec newSoupSpec:kSSExternalStorage_TestSoupName withFeatures:@[kSoupFeatureExternalStorage]];
@@ -443,6 +530,50 @@ static NSInteger const kSSMegaBytePayloadSize = 1024 * 1024;
     }
 }
 
+- (void)testLoadExternalEntryLargerThanBuffer {
+    SFSmartStoreEncryptionKeyBlock originalEncryptionBlock = [SFSmartStore encryptionKeyBlock];
+    SFEncryptionKey *key = [[SFEncryptionKey alloc] initWithData:[@"secretKey" dataUsingEncoding:NSUTF8StringEncoding]
+                                            initializationVector:[@"1234567890123456" dataUsingEncoding:NSUTF8StringEncoding]];
+    SFSoupSpec *soupSpec = [SFSoupSpec newSoupSpec:kSSExternalStorage_TestSoupName withFeatures:@[kSoupFeatureExternalStorage]];
+    NSDictionary* soupIndex = @{@"path": @"name", @"type": @"string"};
+    NSString *payloadString = [self createRandomPayloadStringOfSize:kBufferSize * 10 + 7];
+    
+    @try {
+        // Mapped (not encrypted) then decrypted into a preallocated buffer (encrypted)
+        for (NSNumber *encrypted in @[ @NO, @YES ]) {
+            [SFSmartStore setEncryptionKeyBlock:encrypted.boolValue ? ^SFEncryptionKey *{
+                return key;
+            } : nil];
+            for (SFSmartStore *store in @[ self.store, self.globalStore ]) {
+                [store registerSoupWithSpec:soupSpec withIndexSpecs:[SFSoupIndex asArraySoupIndexes:@[soupIndex]] error:nil];
+                __block NSString *soupTableName;
+                [store.storeQueue inDatabase:^(FMDatabase *db) {
+                    soupTableName = [store tableNameForSoup:kSSExternalStorage_TestSoupName withDb:db];
+                }];
+                
+                NSDictionary *savedEntry = [store upsertEntries:@[@{@"name": payloadString}] toSoup:kSSExternalStorage_TestSoupName][0];
+                
+                // Raw data
+                NSData *entryAsData = [store loadExternalSoupEntryAsData:savedEntry[SOUP_ENTRY_ID] soupTableName:soupTableName];
+                XCTAssertEqualObjects([SFJsonUtils objectFromJSONData:entryAsData], savedEntry, @"Wrong entry loaded");
+                
+                // Query as objects and as string
+                SFQuerySpec *querySpec = [SFQuerySpec newAllQuerySpec:kSSExternalStorage_TestSoupName withOrderPath:@"name" withOrder:kSFSoupQuerySortOrderAscending withPageSize:10];
+                NSArray *results = [store queryWithQuerySpec:querySpec pageIndex:0 error:nil];
+                XCTAssertEqualObjects(results, @[savedEntry], @"Wrong query results");
+                NSMutableString *resultString = [NSMutableString new];
+                [store queryAsString:resultString querySpec:querySpec pageIndex:0 error:nil];
+                XCTAssertEqualObjects([SFJsonUtils objectFromJSONString:resultString], @[savedEntry], @"Wrong query results as string");
+                
+                [store removeSoup:kSSExternalStorage_TestSoupName];
+            }
+        }
+    }
+    @finally {
+        [SFSmartStore setEncryptionKeyBlock:originalEncryptionBlock];
+    }
+}
+
 - (void)testExternalStorageIsEncryptedWhenDbIsEncrypted {
     SFSmartStoreEncryptionKeyBlock originalEncryptionBlock = [SFSmartStore encryptionKeyBlock];
     